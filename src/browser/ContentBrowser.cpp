@@ -5,6 +5,7 @@
 #include "ContentBrowser.h"
 #include <unordered_set>
 #include <iostream>
+#include <fstream>
 #include <algorithm>
 #include <sst/plugininfra/strnatcmp.h>
 
@@ -12,86 +13,428 @@ namespace scxt
 {
 namespace content
 {
+static constexpr const char *indexHeader = "scxt-content-index 1";
+
+/*
+ * One directory on the path the scan is currently descending. entries holds the
+ * sorted listing with final nodes for files and placeholders for directories, and
+ * children the finished nodes for entries[0 .. children.size()).
+ */
+struct ContentBrowser::ScanLevel
+{
+    std::shared_ptr<Content> node;
+    std::vector<ContentPtr> entries;
+    std::vector<ContentPtr> children;
+};
+
+ContentBrowser::~ContentBrowser()
+{
+    {
+        auto lg = std::lock_guard(scanMutex);
+        stopping = true;
+        abortScan = true;
+    }
+    scanCV.notify_all();
+    if (scanThread.joinable())
+        scanThread.join();
+}
+
 void ContentBrowser::initialize(const fs::path &userDocumentPath)
 {
     {
         auto lg = std::lock_guard(contentMutex);
         contentRoots.push_back(userDocumentPath / "Library");
+
+        auto r = std::make_shared<Content>();
+        r->type = Content::ROOT;
+        r->scanned = false;
+        root = r;
     }
+    indexPath = userDocumentPath / "Cache" / "ContentIndex.txt";
     rescanContentRoots();
 }
 
 void ContentBrowser::addContentRoot(const fs::path &here)
 {
-    auto lg = std::lock_guard(contentMutex);
+    {
+        auto lg = std::lock_guard(contentMutex);
+        if (std::find(contentRoots.begin(), contentRoots.end(), here) != contentRoots.end())
+            return;
+        contentRoots.push_back(here);
+    }
+    rescanContentRoots();
 }
 
 void ContentBrowser::rescanContentRoots()
+{
+    {
+        auto lg = std::lock_guard(scanMutex);
+        scanRequested = true;
+        scanning = true;
+        abortScan = true;
+        if (!scanThread.joinable())
+            scanThread = std::thread([this]() { scanLoop(); });
+    }
+    scanCV.notify_all();
+}
+
+bool ContentBrowser::isScanning()
+{
+    auto lg = std::lock_guard(scanMutex);
+    return scanning;
+}
+
+void ContentBrowser::waitForScan()
+{
+    auto lk = std::unique_lock(scanMutex);
+    scanCV.wait(lk, [this]() { return !scanning; });
+}
+
+ContentBrowser::ContentPtr ContentBrowser::getRoot()
 {
     auto lg = std::lock_guard(contentMutex);
+    return root;
+}
 
-    root = std::make_unique<Content>();
-    root->type = Content::ROOT;
-    for (const auto &r : contentRoots)
+void ContentBrowser::scanLoop()
+{
+    auto lk = std::unique_lock(scanMutex);
+    while (true)
     {
-        if (fs::is_directory(r))
+        scanCV.wait(lk, [this]() { return scanRequested || stopping; });
+        if (stopping)
+            break;
+        scanRequested = false;
+        abortScan = false;
+        lk.unlock();
+
+        std::vector<fs::path> roots;
         {
-            auto child = std::make_unique<Content>();
-            child->type = Content::DIR;
-            child->fullPath = r;
-            child->displayPath = r.filename();
-            child->recursivelyPopulate();
-            root->children.push_back(std::move(child));
+            auto lg = std::lock_guard(contentMutex);
+            roots = contentRoots;
+        }
+        scan(roots);
+
+        lk.lock();
+        if (!scanRequested)
+        {
+            scanning = false;
+            scanCV.notify_all();
         }
     }
 }
 
-void ContentBrowser::Content::recursivelyPopulate()
+void ContentBrowser::scan(const std::vector<fs::path> &roots)
 {
-    if (type != DIR)
+    if (!indexLoaded)
+    {
+        loadIndex();
+        indexLoaded = true;
+    }
+    scanCount++;
+
+    auto prev = getRoot();
+    std::vector<ScanLevel> spine(1);
+    auto &top = spine[0];
+    top.node = std::make_shared<Content>();
+    top.node->type = Content::ROOT;
+    for (const auto &r : roots)
+    {
+        std::error_code ec;
+        if (!fs::is_directory(r, ec))
+            continue;
+
+        ContentPtr placeholder;
+        if (prev)
+            for (const auto &c : prev->children)
+                if (c->fullPath == r)
+                    placeholder = c;
+        if (!placeholder)
+        {
+            auto c = std::make_shared<Content>();
+            c->type = Content::DIR;
+            c->fullPath = r;
+            c->displayPath = r.filename();
+            c->scanned = false;
+            placeholder = c;
+        }
+        top.entries.push_back(placeholder);
+    }
+
+    for (size_t i = 0; i < spine[0].entries.size() && !abortScan; ++i)
+    {
+        auto e = spine[0].entries[i];
+        auto c = scanDirectory(e->fullPath, e, spine); // this grows spine, so not inline
+        spine[0].children.push_back(c);
+        maybePublish(spine);
+    }
+
+    // an aborted scan is replaced by a newer one, but keep what it learned
+    saveIndex(!abortScan);
+    if (abortScan)
         return;
 
+    if (prev && prev->scanned && spine[0].children == prev->children)
+    {
+        lastPublish = std::chrono::steady_clock::now();
+        return;
+    }
+    spine[0].node->children = std::move(spine[0].children);
+    publish(spine[0].node);
+}
+
+ContentBrowser::ContentPtr ContentBrowser::scanDirectory(const fs::path &dir,
+                                                         const ContentPtr &prev,
+                                                         std::vector<ScanLevel> &spine)
+{
+    ScanLevel level;
+    level.node = std::make_shared<Content>();
+    level.node->type = Content::DIR;
+    level.node->fullPath = dir;
+    level.node->displayPath = dir.filename();
+
+    auto listing = listDirectory(dir);
+    bool same = listing && prev && prev->scanned &&
+                prev->children.size() == listing->entries.size();
+    for (size_t i = 0; same && i < prev->children.size(); ++i)
+        same = prev->children[i]->type == listing->entries[i].type &&
+               path_to_string(prev->children[i]->displayPath) == listing->entries[i].name;
+
+    if (same)
+    {
+        level.entries = prev->children;
+    }
+    else if (listing)
+    {
+        // directories we haven't reached yet show what they held last time
+        std::unordered_map<std::string, ContentPtr> prevDirs;
+        if (prev)
+            for (const auto &c : prev->children)
+                if (c->type == Content::DIR)
+                    prevDirs[path_to_string(c->displayPath)] = c;
+
+        for (const auto &e : listing->entries)
+        {
+            auto p = prevDirs.find(e.name);
+            if (e.type == Content::DIR && p != prevDirs.end())
+            {
+                level.entries.push_back(p->second);
+                continue;
+            }
+            auto c = std::make_shared<Content>();
+            c->type = e.type;
+            c->displayPath = string_to_path(e.name);
+            c->fullPath = dir / c->displayPath;
+            c->scanned = e.type != Content::DIR;
+            level.entries.push_back(c);
+        }
+    }
+
+    spine.push_back(std::move(level));
+    auto li = spine.size() - 1;
+    for (size_t i = 0; i < spine[li].entries.size() && !abortScan; ++i)
+    {
+        auto e = spine[li].entries[i];
+        if (e->type == Content::DIR)
+            e = scanDirectory(e->fullPath, e, spine);
+        spine[li].children.push_back(e);
+        maybePublish(spine);
+    }
+
+    // nothing changed below here, so keep sharing the previous subtree
+    if (same && !abortScan && spine[li].children == prev->children)
+    {
+        spine.pop_back();
+        return prev;
+    }
+
+    auto node = spine[li].node;
+    node->children = std::move(spine[li].children);
+    spine.pop_back();
+    return node;
+}
+
+const ContentBrowser::DirectoryListing *ContentBrowser::listDirectory(const fs::path &dir)
+{
+    std::error_code ec;
+    auto mtime = fs::last_write_time(dir, ec);
+    if (ec)
+        return nullptr;
+
+    auto &l = index[path_to_string(dir)];
+    l.lastScan = scanCount;
+    auto mt = (int64_t)mtime.time_since_epoch().count();
+    if (l.mtime == mt)
+        return &l;
+
     const static auto samplesuffixes =
-        std::unordered_set<std::string>({".wav", ".riff", ".sf2", ".sfz"});
+        std::unordered_set<std::string>({".wav", ".w64", ".rf64", ".riff", ".sf2", ".sfz"});
     const static auto patchsuffixes = std::unordered_set<std::string>({".sc2p", ".sc2m"});
-    for (const auto &d : fs::directory_iterator(fullPath))
+
+    indexDirty = true;
+    l.mtime = mt;
+    l.entries.clear();
+    // use the file type from the directory read rather than a stat per entry
+    for (auto it = fs::directory_iterator(dir, fs::directory_options::skip_permission_denied, ec);
+         !ec && it != fs::directory_iterator(); it.increment(ec))
     {
+        if (abortScan)
+        {
+            l.mtime = unlistedDirectory;
+            return nullptr;
+        }
+
+        const auto &d = *it;
         auto dp = d.path();
-        if (fs::is_directory(dp))
+        std::error_code tec;
+        if (d.is_directory(tec))
+        {
+            l.entries.push_back({Content::DIR, path_to_string(dp.filename())});
+            continue;
+        }
+
+        auto l8 = path_to_string(dp.extension());
+        std::for_each(l8.begin(), l8.end(), [](char &c) { c = ::tolower(c); });
+        if (samplesuffixes.find(l8) != samplesuffixes.end())
+            l.entries.push_back({Content::SAMPLE, path_to_string(dp.filename())});
+        else if (patchsuffixes.find(l8) != patchsuffixes.end())
+            l.entries.push_back({Content::PATCH, path_to_string(dp.filename())});
+    }
+    if (ec)
+        l.mtime = unlistedDirectory; // use what we got, but don't trust it next time
+
+    std::sort(l.entries.begin(), l.entries.end(), [](const auto &a, const auto &b) {
+        return strnatcasecmp(a.name.c_str(), b.name.c_str()) < 0;
+    });
+    return &l;
+}
+
+void ContentBrowser::maybePublish(const std::vector<ScanLevel> &spine)
+{
+    if (abortScan ||
+        std::chrono::steady_clock::now() - lastPublish < std::chrono::milliseconds(250))
+        return;
+
+    // rebuild just the path being scanned; everything else is shared with the last snapshot
+    ContentPtr below;
+    for (auto l = spine.rbegin(); l != spine.rend(); ++l)
+    {
+        auto n = std::make_shared<Content>(*l->node);
+        n->scanned = false;
+        n->children = l->children;
+        if (below)
+            n->children.push_back(below);
+        n->children.insert(n->children.end(), l->entries.begin() + n->children.size(),
+                           l->entries.end());
+        below = n;
+    }
+    publish(below);
+}
+
+void ContentBrowser::publish(ContentPtr newRoot)
+{
+    {
+        auto lg = std::lock_guard(contentMutex);
+        root = std::move(newRoot);
+    }
+    lastPublish = std::chrono::steady_clock::now();
+}
+
+/*
+ * The index is a text file with a header line, then for each directory a line
+ * "D <tab> mtime <tab> path" followed by "d|s|p <tab> name" for its entries.
+ */
+void ContentBrowser::loadIndex()
+{
+    std::ifstream ifs(indexPath, std::ios::binary);
+    std::string line;
+    if (!std::getline(ifs, line) || line != indexHeader)
+        return;
+
+    DirectoryListing *l = nullptr;
+    while (std::getline(ifs, line))
+    {
+        if (line.size() < 2 || line[1] != '\t')
+            break;
+
+        auto rest = line.substr(2);
+        if (line[0] == 'D')
         {
-            auto child = std::make_unique<Content>();
-            child->type = DIR;
-            child->fullPath = dp;
-            child->displayPath = dp.filename();
-            child->recursivelyPopulate();
-            children.push_back(std::move(child));
+            auto tab = rest.find('\t');
+            if (tab == std::string::npos)
+                break;
+            l = &index[rest.substr(tab + 1)];
+            l->mtime = std::strtoll(rest.c_str(), nullptr, 10);
+            l->entries.clear();
+            continue;
         }
-        else
+        if (!l)
+            break;
+        switch (line[0])
         {
-            auto l8 = dp.extension().u8string();
-            std::for_each(l8.begin(), l8.end(), [](char &c) { c = ::tolower(c); });
-            if (samplesuffixes.find(l8) != samplesuffixes.end())
-            {
-                auto child = std::make_unique<Content>();
-                child->type = SAMPLE;
-                child->fullPath = dp;
-                child->displayPath = dp.filename();
-                children.push_back(std::move(child));
-            }
-            else if (patchsuffixes.find(l8) != patchsuffixes.end())
+        case 'd':
+            l->entries.push_back({Content::DIR, rest});
+            break;
+        case 's':
+            l->entries.push_back({Content::SAMPLE, rest});
+            break;
+        case 'p':
+            l->entries.push_back({Content::PATCH, rest});
+            break;
+        default:
+            l->mtime = unlistedDirectory;
+            break;
+        }
+    }
+}
+
+void ContentBrowser::saveIndex(bool prune)
+{
+    if (prune)
+    {
+        // drop directories this (complete) scan didn't visit; they are gone
+        for (auto it = index.begin(); it != index.end();)
+        {
+            if (it->second.lastScan != scanCount)
             {
-                auto child = std::make_unique<Content>();
-                child->type = PATCH;
-                child->fullPath = dp;
-                child->displayPath = dp.filename();
-                children.push_back(std::move(child));
+                it = index.erase(it);
+                indexDirty = true;
             }
+            else
+                ++it;
+        }
+    }
+    if (!indexDirty || indexPath.empty())
+        return;
+
+    std::error_code ec;
+    fs::create_directories(indexPath.parent_path(), ec);
+    auto tmp = indexPath;
+    tmp += ".tmp";
+    {
+        std::ofstream ofs(tmp, std::ios::binary);
+        if (!ofs)
+            return;
+        ofs << indexHeader << "\n";
+        for (const auto &[path, l] : index)
+        {
+            auto isLine = [](const std::string &s) { return s.find('\n') == std::string::npos; };
+            if (l.mtime == unlistedDirectory || !isLine(path) ||
+                !std::all_of(l.entries.begin(), l.entries.end(),
+                             [&](const auto &e) { return isLine(e.name); }))
+                continue;
+
+            ofs << "D\t" << l.mtime << "\t" << path << "\n";
+            for (const auto &e : l.entries)
+                ofs << (e.type == Content::DIR ? 'd' : e.type == Content::SAMPLE ? 's' : 'p')
+                    << "\t" << e.name << "\n";
         }
-        std::sort(children.begin(), children.end(), [](const auto &a, const auto &b) {
-            return strnatcasecmp(a->displayPath.u8string().c_str(),
-                                 b->displayPath.u8string().c_str()) < 0;
-        });
+        if (!ofs)
+            return;
     }
+    fs::rename(tmp, indexPath, ec);
+    if (!ec)
+        indexDirty = false;
 }
 } // namespace content
-} // namespace scxt
\ No newline at end of file
+} // namespace scxt
@@ -6,6 +6,13 @@
 #define SHORTCIRCUIT_CONTENTBROWSER_H
 
 #include "filesystem/import.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 #include <thread>
 #include <mutex>
@@ -17,17 +24,28 @@ namespace content
 /*
  * The ContentBrowser is a replacement for the browser database vt_gui object
  * reworked with more, well, filesystemy goodness and stuff in mind.
- * It is thread safe, but at a cost which is it takes internal locks on rescans
- * and the like, so be careful with the thread conventions. But we only have two
- * threads so it's not *that* hard.
+ *
+ * Scanning happens on a background thread. The tree is published as immutable
+ * snapshots, so getRoot() can be called from any thread at any time and the result
+ * used without locks; while a scan is running the snapshot fills in progressively,
+ * with directories it hasn't reached yet showing their previous contents (or nothing,
+ * marked !scanned). Unchanged subtrees are shared between snapshots.
+ *
+ * The directory listings are kept in an index keyed by directory modification time,
+ * which is saved in the user documents so later scans (and later sessions) only list
+ * directories which changed and otherwise just stat each directory.
  */
 struct ContentBrowser
 {
     ContentBrowser() {}
+    ~ContentBrowser();
 
     void initialize(const fs::path &userDocumentPath);
     void addContentRoot(const fs::path &here);
+    // start a scan in the background, restarting any which is in progress
     void rescanContentRoots();
+    bool isScanning();
+    void waitForScan();
 
     std::vector<fs::path> contentRoots;
 
@@ -42,17 +60,55 @@ struct ContentBrowser
         } type;
         fs::path fullPath;
         fs::path displayPath;
-        std::vector<std::unique_ptr<Content>> children;
+        std::vector<std::shared_ptr<const Content>> children;
+        bool scanned{true};
+    };
+    typedef std::shared_ptr<const Content> ContentPtr;
+
+    // the latest snapshot of the tree; never null after initialize
+    ContentPtr getRoot();
+
+    std::mutex contentMutex; // guards contentRoots and root
+
+  private:
+    ContentPtr root;
 
-        void recursivelyPopulate();
+    struct IndexEntry
+    {
+        Content::Type type;
+        std::string name; // utf8 filename
+    };
+    static constexpr int64_t unlistedDirectory = INT64_MIN;
+    struct DirectoryListing
+    {
+        int64_t mtime{unlistedDirectory};
+        uint64_t lastScan{0};
+        std::vector<IndexEntry> entries; // in display order
     };
+    struct ScanLevel;
+
+    void scanLoop();
+    void scan(const std::vector<fs::path> &roots);
+    ContentPtr scanDirectory(const fs::path &dir, const ContentPtr &prev,
+                             std::vector<ScanLevel> &spine);
+    const DirectoryListing *listDirectory(const fs::path &dir);
+    void maybePublish(const std::vector<ScanLevel> &spine);
+    void publish(ContentPtr newRoot);
+    void loadIndex();
+    void saveIndex(bool prune);
 
-    /*
-     * This is only updated on init or by a user action from the wrapper
-     */
-    std::unique_ptr<Content> root;
+    // owned by the scan thread
+    std::unordered_map<std::string, DirectoryListing> index;
+    bool indexLoaded{false}, indexDirty{false};
+    uint64_t scanCount{0};
+    std::chrono::steady_clock::time_point lastPublish;
 
-    std::mutex contentMutex;
+    fs::path indexPath;
+    std::thread scanThread;
+    std::mutex scanMutex; // guards the flags below
+    std::condition_variable scanCV;
+    bool scanRequested{false}, scanning{false}, stopping{false};
+    std::atomic<bool> abortScan{false};
 };
 } // namespace content
 } // namespace scxt
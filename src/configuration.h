@@ -16,7 +16,13 @@
 class configuration
 {
     fs::path mRelative;
+    fs::path mSampleCache;
     fs::path mConfFilename;
+    bool mCompressSamples{false};
+    int mSampleStorage{0};
+    int mSampleAnalysis{0};
+    bool mLoadOnDemand{false};
+    uint32_t mSampleRateTarget{0};
 
   public:
     // TODO probably this doesn't belong here in the object hierarchy
@@ -25,6 +31,25 @@ class configuration
     // replace <relative> in filename
     fs::path resolve_path(const fs::path &in);
     void set_relative_path(const fs::path &in);
+    const fs::path &get_relative_path() const { return mRelative; }
+    // directory for decoded samples (see loaders/sample_cache.h), empty disables the cache
+    void set_sample_cache_path(const fs::path &in) { mSampleCache = in; }
+    const fs::path &get_sample_cache_path() const { return mSampleCache; }
+    // hold loaded 16 bit samples losslessly compressed (see sample_codec.h)
+    void set_compress_samples(bool b) { mCompressSamples = b; }
+    bool get_compress_samples() const { return mCompressSamples; }
+    // sample_storage for newly loaded samples wider than 16 bits (see sample.h)
+    void set_sample_storage(int s) { mSampleStorage = s; }
+    int get_sample_storage() const { return mSampleStorage; }
+    // sample_analysis flags for newly loaded samples (see sample.h)
+    void set_sample_analysis(int a) { mSampleAnalysis = a; }
+    int get_sample_analysis() const { return mSampleAnalysis; }
+    // keep just the head of uncompressed samples in memory until played, see sample.h
+    void set_load_on_demand(bool b) { mLoadOnDemand = b; }
+    bool get_load_on_demand() const { return mLoadOnDemand; }
+    // resample newly loaded samples to this rate, 0 leaves them be (see sample.h, pending_rate)
+    void set_sample_rate_target(uint32_t r) { mSampleRateTarget = r; }
+    uint32_t get_sample_rate_target() const { return mSampleRateTarget; }
 };
 
 // parse a path into components. All outputs are optional. Example:
@@ -4,6 +4,8 @@
 #include "sampler_voice.h"
 #include "util/tools.h"
 #include <vt_dsp/basic_dsp.h>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 
 extern float SincTableF32[(FIRipol_M + 1) * FIRipol_N];
@@ -14,87 +16,121 @@ extern short SincOffsetI16[(FIRipol_M)*FIRipol_N];
 const float I16InvScale = (1.f / (16384.f * 32768.f));
 const __m128 I16InvScale_m128 = _mm_set1_ps(I16InvScale);
 
-template <bool, bool, int, int>
+template <bool, int, int, int, bool>
 void GeneratorSample(GeneratorState *__restrict GD, GeneratorIO *__restrict IO);
 
-GeneratorFPtr GetFPtrGeneratorSample(bool Stereo, bool Float, int LoopMode)
+template <bool stereo, int format, int SSE, bool linear>
+GeneratorFPtr GetFPtrGeneratorSampleMode(int LoopMode)
 {
-    if (Stereo)
+    switch (LoopMode)
     {
-        if (Float)
-        {
-            switch (LoopMode)
-            {
-            case 0:
-                return GeneratorSample<1, 1, 0, 1>;
-            case 1:
-                return GeneratorSample<1, 1, 1, 1>;
-            case 2:
-                return GeneratorSample<1, 1, 2, 1>;
-            case 3:
-                return GeneratorSample<1, 1, 3, 1>;
-            case 4:
-                return GeneratorSample<1, 1, 4, 1>;
-            }
-        }
-        else
-        {
-            switch (LoopMode)
-            {
-            case 0:
-                return GeneratorSample<1, 0, 0, 2>;
-            case 1:
-                return GeneratorSample<1, 0, 1, 2>;
-            case 2:
-                return GeneratorSample<1, 0, 2, 2>;
-            case 3:
-                return GeneratorSample<1, 0, 3, 2>;
-            case 4:
-                return GeneratorSample<1, 0, 4, 2>;
-            }
-        }
+    case 0:
+        return GeneratorSample<stereo, format, 0, SSE, linear>;
+    case 1:
+        return GeneratorSample<stereo, format, 1, SSE, linear>;
+    case 2:
+        return GeneratorSample<stereo, format, 2, SSE, linear>;
+    case 3:
+        return GeneratorSample<stereo, format, 3, SSE, linear>;
+    case 4:
+        return GeneratorSample<stereo, format, 4, SSE, linear>;
     }
-    else
+    return 0;
+}
+
+template <bool stereo, bool linear>
+GeneratorFPtr GetFPtrGeneratorSampleQ(int Format, int LoopMode)
+{
+    switch (Format)
     {
-        if (Float)
-        {
-            switch (LoopMode)
-            {
-            case 0:
-                return GeneratorSample<0, 1, 0, 1>;
-            case 1:
-                return GeneratorSample<0, 1, 1, 1>;
-            case 2:
-                return GeneratorSample<0, 1, 2, 1>;
-            case 3:
-                return GeneratorSample<0, 1, 3, 1>;
-            case 4:
-                return GeneratorSample<0, 1, 4, 1>;
-            }
-        }
-        else
-        {
-            switch (LoopMode)
-            {
-            case 0:
-                return GeneratorSample<0, 0, 0, 2>;
-            case 1:
-                return GeneratorSample<0, 0, 1, 2>;
-            case 2:
-                return GeneratorSample<0, 0, 2, 2>;
-            case 3:
-                return GeneratorSample<0, 0, 3, 2>;
-            case 4:
-                return GeneratorSample<0, 0, 4, 2>;
-            }
-        }
+    case GSF_Float:
+        return GetFPtrGeneratorSampleMode<stereo, GSF_Float, 1, linear>(LoopMode);
+    case GSF_Int24:
+        return GetFPtrGeneratorSampleMode<stereo, GSF_Int24, 1, linear>(LoopMode);
     }
-    return 0;
+    return GetFPtrGeneratorSampleMode<stereo, GSF_Int16, 2, linear>(LoopMode);
+}
+
+GeneratorFPtr GetFPtrGeneratorSample(bool Stereo, int Format, int LoopMode, bool Linear)
+{
+    if (Stereo)
+        return Linear ? GetFPtrGeneratorSampleQ<true, true>(Format, LoopMode)
+                      : GetFPtrGeneratorSampleQ<true, false>(Format, LoopMode);
+    return Linear ? GetFPtrGeneratorSampleQ<false, true>(Format, LoopMode)
+                  : GetFPtrGeneratorSampleQ<false, false>(Format, LoopMode);
+}
+
+// a packed 24 bit sample, reading the next sample's low byte as well
+inline int32_t read_i24(const uint8_t *p)
+{
+    int32_t v;
+    memcpy(&v, p, sizeof(v));
+    return (int32_t)((uint32_t)v << 8) >> 8;
+}
+
+const float I24InvScale = 1.f / 8388608.f;
+
+inline void unpack_i24_taps(const uint8_t *p, float *taps)
+{
+    for (unsigned int k = 0; k < FIRipol_N; k++)
+        taps[k] = I24InvScale * read_i24(p + 3 * k);
+}
+
+// the positions the bound handling of a play mode below leaves as they are
+template <int playmode>
+inline void generator_free_range(const GeneratorState *GD, int Direction, int WaveSize, int &lo,
+                                 int &hi)
+{
+    switch (playmode)
+    {
+    case GSM_Normal:
+    case GSM_Shot:
+        lo = GD->LowerBound;
+        hi = GD->UpperBound;
+        break;
+    case GSM_Loop:
+        lo = 0;
+        hi = std::min(GD->UpperBound, WaveSize);
+        break;
+    case GSM_LoopUntilRelease:
+        // it loops while gated, then plays out to the end of the sample
+        lo = GD->Gated ? 0 : GD->SampleStart;
+        hi = GD->Gated ? std::min(GD->UpperBound, WaveSize) : GD->SampleStop;
+        break;
+    case GSM_Bidirectional:
+        // reaching the bound it moves towards turns it, the other one doesn't matter
+        lo = (Direction > 0) ? 0 : std::max(std::min(GD->UpperBound, GD->LowerBound + 1), 0);
+        hi = (Direction < 0) ? WaveSize : std::min(GD->UpperBound - 1, WaveSize);
+        break;
+    default:
+        lo = 1;
+        hi = 0;
+    }
+}
+
+// how many of the next n frames advance SamplePos to within [lo, hi], the position with
+// SampleSubPos (in 1/2^24ths of a sample) moving by step each frame
+inline int generator_free_frames(int pos, int subpos, int step, int lo, int hi, int n)
+{
+    if (lo > hi)
+        return 0;
+    int64_t p = (int64_t)pos * (1 << 24) + subpos;
+    int64_t bottom = (int64_t)lo * (1 << 24), top = ((int64_t)hi + 1) * (1 << 24);
+    int64_t k;
+    if (step > 0)
+        k = (p + step < bottom) ? 0 : (top - p - 1) / step;
+    else if (step < 0)
+        k = (p + step >= top) ? 0 : (p - bottom) / -step;
+    else
+        k = (p >= bottom && p < top) ? n : 0;
+    return (int)std::clamp<int64_t>(k, 0, n);
 }
 
-template <bool stereo, bool fp, int playmode, int SSE>
+template <bool stereo, int format, int playmode, int SSE, bool linear>
 void GeneratorSample(GeneratorState *__restrict GD, GeneratorIO *__restrict IO)
 {
+    const bool fp = (format == GSF_Float);
+    const bool i24 = (format == GSF_Int24);
     int SamplePos = GD->SamplePos;
     int SampleSubPos = GD->SampleSubPos;
     int LowerBound = GD->LowerBound;
@@ -110,6 +146,8 @@ void GeneratorSample(GeneratorState *__restrict GD, GeneratorIO *__restrict IO)
     short *__restrict SampleDataR;
     float *__restrict SampleDataFL;
     float *__restrict SampleDataFR;
+    const uint8_t *__restrict SampleData24L;
+    const uint8_t *__restrict SampleData24R;
     float *__restrict OutputL;
     float *__restrict OutputR;
 
@@ -118,6 +156,8 @@ void GeneratorSample(GeneratorState *__restrict GD, GeneratorIO *__restrict IO)
 
     if (fp)
         SampleDataFL = (float *)IO->SampleDataL;
+    else if (i24)
+        SampleData24L = (const uint8_t *)IO->SampleDataL;
     else
         SampleDataL = (short *)IO->SampleDataL;
     OutputL = IO->OutputL;
@@ -125,18 +165,69 @@ void GeneratorSample(GeneratorState *__restrict GD, GeneratorIO *__restrict IO)
     {
         if (fp)
             SampleDataFR = (float *)IO->SampleDataR;
+        if (i24)
+            SampleData24R = (const uint8_t *)IO->SampleDataR;
         SampleDataR = (short *)IO->SampleDataR;
         OutputR = IO->OutputR;
     }
     int NSamples = GD->BlockSize;
 
-    for (int i = 0; i < NSamples; i++)
-    {
-        // 2. Resample
+    // interpolates output frame i at SamplePos
+    auto render = [&](int i) {
         unsigned int m0 = ((SampleSubPos >> 12) & 0xff0);
-        if (fp)
+        if (linear)
         {
-            // float32 path (SSE)
+            // the sinc kernels are centred between taps FIRoffset - 1 and FIRoffset
+            const float x = SampleSubPos * (1.f / 16777216.f);
+            const int p = SamplePos + FIRoffset - 1;
+            if (fp)
+            {
+                OutputL[i] = SampleDataFL[p] + x * (SampleDataFL[p + 1] - SampleDataFL[p]);
+                if (stereo)
+                    OutputR[i] = SampleDataFR[p] + x * (SampleDataFR[p + 1] - SampleDataFR[p]);
+            }
+            else if (i24)
+            {
+                float a = I24InvScale * read_i24(SampleData24L + 3 * p);
+                float b = I24InvScale * read_i24(SampleData24L + 3 * p + 3);
+                OutputL[i] = a + x * (b - a);
+                if (stereo)
+                {
+                    a = I24InvScale * read_i24(SampleData24R + 3 * p);
+                    b = I24InvScale * read_i24(SampleData24R + 3 * p + 3);
+                    OutputR[i] = a + x * (b - a);
+                }
+            }
+            else
+            {
+                const float s16 = 1.f / 32768.f;
+                OutputL[i] = s16 * (SampleDataL[p] + x * (SampleDataL[p + 1] - SampleDataL[p]));
+                if (stereo)
+                    OutputR[i] =
+                        s16 * (SampleDataR[p] + x * (SampleDataR[p + 1] - SampleDataR[p]));
+            }
+        }
+        else if (fp || i24)
+        {
+            // float32 path (SSE), packed 24 bit taps are unpacked to float first
+            const float *__restrict srcL, *__restrict srcR;
+            float tapsL alignas(16)[FIRipol_N], tapsR alignas(16)[FIRipol_N];
+            if (i24)
+            {
+                unpack_i24_taps(SampleData24L + 3 * SamplePos, tapsL);
+                srcL = tapsL;
+                if (stereo)
+                {
+                    unpack_i24_taps(SampleData24R + 3 * SamplePos, tapsR);
+                    srcR = tapsR;
+                }
+            }
+            else
+            {
+                srcL = &SampleDataFL[SamplePos];
+                if (stereo)
+                    srcR = &SampleDataFR[SamplePos];
+            }
             __m128 lipol0, tmp[4], sL4, sR4;
             lipol0 = _mm_setzero_ps();
             lipol0 = _mm_cvtsi32_ss(lipol0, SampleSubPos & 0xffff);
@@ -149,21 +240,18 @@ void GeneratorSample(GeneratorState *__restrict GD, GeneratorIO *__restrict IO)
                                 *((__m128 *)&SincTableF32[m0 + 8]));
             tmp[3] = _mm_add_ps(_mm_mul_ps(*((__m128 *)&SincOffsetF32[m0 + 12]), lipol0),
                                 *((__m128 *)&SincTableF32[m0 + 12]));
-            sL4 = _mm_mul_ps(tmp[0], _mm_loadu_ps(&SampleDataFL[SamplePos]));
-            sL4 = _mm_add_ps(sL4, _mm_mul_ps(tmp[1], _mm_loadu_ps(&SampleDataFL[SamplePos + 4])));
-            sL4 = _mm_add_ps(sL4, _mm_mul_ps(tmp[2], _mm_loadu_ps(&SampleDataFL[SamplePos + 8])));
-            sL4 = _mm_add_ps(sL4, _mm_mul_ps(tmp[3], _mm_loadu_ps(&SampleDataFL[SamplePos + 12])));
+            sL4 = _mm_mul_ps(tmp[0], _mm_loadu_ps(srcL));
+            sL4 = _mm_add_ps(sL4, _mm_mul_ps(tmp[1], _mm_loadu_ps(srcL + 4)));
+            sL4 = _mm_add_ps(sL4, _mm_mul_ps(tmp[2], _mm_loadu_ps(srcL + 8)));
+            sL4 = _mm_add_ps(sL4, _mm_mul_ps(tmp[3], _mm_loadu_ps(srcL + 12)));
             sL4 = sum_ps_to_ss(sL4);
             _mm_store_ss(&OutputL[i], sL4);
             if (stereo)
             {
-                sR4 = _mm_mul_ps(tmp[0], _mm_loadu_ps(&SampleDataFR[SamplePos]));
-                sR4 =
-                    _mm_add_ps(sR4, _mm_mul_ps(tmp[1], _mm_loadu_ps(&SampleDataFR[SamplePos + 4])));
-                sR4 =
-                    _mm_add_ps(sR4, _mm_mul_ps(tmp[2], _mm_loadu_ps(&SampleDataFR[SamplePos + 8])));
-                sR4 = _mm_add_ps(sR4,
-                                 _mm_mul_ps(tmp[3], _mm_loadu_ps(&SampleDataFR[SamplePos + 12])));
+                sR4 = _mm_mul_ps(tmp[0], _mm_loadu_ps(srcR));
+                sR4 = _mm_add_ps(sR4, _mm_mul_ps(tmp[1], _mm_loadu_ps(srcR + 4)));
+                sR4 = _mm_add_ps(sR4, _mm_mul_ps(tmp[2], _mm_loadu_ps(srcR + 8)));
+                sR4 = _mm_add_ps(sR4, _mm_mul_ps(tmp[3], _mm_loadu_ps(srcR + 12)));
                 sR4 = sum_ps_to_ss(sR4);
                 _mm_store_ss(&OutputR[i], sR4);
             }
@@ -205,14 +293,36 @@ void GeneratorSample(GeneratorState *__restrict GD, GeneratorIO *__restrict IO)
             if (stereo)
                 _mm_store_ss(&OutputR[i], fR);
         }
-
-        // 3. Forward sample position
+    };
+    auto advance = [&]() {
         SampleSubPos += Ratio * Direction;
         int incr = SampleSubPos >> 24;
         SamplePos += incr;
         SampleSubPos = SampleSubPos - (incr << 24);
+    };
+
+    /*
+     * Rather than checking the bounds after every frame, work out how many frames can go by
+     * before the position reaches one and run those without, then handle the frame which does
+     * as before. Loops therefore cost a check per pass rather than per frame.
+     */
+    int i = 0;
+    while (i < NSamples)
+    {
+        int lo, hi;
+        generator_free_range<playmode>(GD, Direction, WaveSize, lo, hi);
+        int span =
+            generator_free_frames(SamplePos, SampleSubPos, Ratio * Direction, lo, hi, NSamples - i);
+        for (int end = i + span; i < end; i++)
+        {
+            render(i);
+            advance();
+        }
+        if (i == NSamples)
+            break;
 
-        // if (SamplePos > UpperBound) SamplePos = UpperBound;
+        render(i);
+        advance();
         switch (playmode)
         {
         case GSM_Normal:
@@ -427,6 +537,7 @@ store:
             }
         }
         }
+        i++;
     }
 
     GD->Direction = Direction * RatioSign;
@@ -47,9 +47,18 @@ enum GeneratorSampleModes
     GSM_LoopUntilRelease = 4
 };
 
+// how GeneratorIO::SampleData is laid out, see sample::UseInt16/UseInt24
+enum GeneratorSampleFormats
+{
+    GSF_Int16 = 0,
+    GSF_Float = 1,
+    GSF_Int24 = 2, // packed little endian, read 4 bytes at a time
+};
+
 typedef void (*GeneratorFPtr)(GeneratorState *__restrict, GeneratorIO *__restrict);
 
-GeneratorFPtr GetFPtrGeneratorSample(bool Stereo, bool Float, int LoopMode);
+// Linear swaps the windowed sinc interpolator for a cheaper, aliasing linear one
+GeneratorFPtr GetFPtrGeneratorSample(bool Stereo, int Format, int LoopMode, bool Linear = false);
 
 // GeneratorFPtr GetFPtrGeneratorStretching(bool Stereo, bool Float);
 
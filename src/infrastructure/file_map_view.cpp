@@ -58,9 +58,15 @@ struct WinImpl : FileMapView::Impl
 
         hf = CreateFileW(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
                          FILE_FLAG_SEQUENTIAL_SCAN, NULL);
-        if (!hf)
+        if (hf == INVALID_HANDLE_VALUE)
+        {
+            hf = 0;
+            return;
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(hf, &fileSize))
             return;
-        dataSize = GetFileSize(hf, NULL);
+        dataSize = (size_t)fileSize.QuadPart;
 
         hmf = CreateFileMappingW(hf, 0, PAGE_READONLY, 0, 0, 0);
         if (!hmf)
@@ -107,12 +113,17 @@ struct posixImpl : FileMapView::Impl
         struct stat sb;
         // TODO AS does open assume utf8?
         fd = open(path_to_string(fname).c_str(), O_RDONLY);
-        if (!fd)
+        if (fd < 0)
+        {
+            isMapped = false;
+            return;
+        }
+        if (fstat(fd, &sb) != 0 || sb.st_size <= 0)
         {
             isMapped = false;
+            close(fd);
             return;
         }
-        fstat(fd, &sb);
         data = mmap(nullptr, sb.st_size, PROT_WRITE, MAP_PRIVATE, fd, 0);
         if (data == MAP_FAILED)
         {
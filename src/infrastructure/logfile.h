@@ -98,6 +98,9 @@ class StreamLogger : public std::ostream
         // avoid unnecessary stream evaluations
         return (buff.mCB && buff.mCB->getLevel() >= buff.mLevel);
     }
+
+    // StreamLoggers aren't thread-safe, so worker threads make their own with the same callback
+    LoggingCallback *getCallback() const { return buff.mCB; }
 };
 
 inline const char *getShortLevelStr(Level lev)
@@ -0,0 +1,185 @@
+/*
+** Shortcircuit XT is Free and Open Source Software
+**
+** Shortcircuit is made available under the Gnu General Public License, v3.0
+** https://www.gnu.org/licenses/gpl-3.0.en.html; The authors of the code
+** reserve the right to re-license their contributions under the MIT license in the
+** future at the discretion of the project maintainers.
+**
+** Copyright 2004-2021 by various individuals as described by the git transaction log
+**
+** All source at: https://github.com/surge-synthesizer/surge.git
+**
+** Shortcircuit was a commercial product from 2004-2018, with copyright and ownership
+** in that period held by Claes Johanson at Vember Audio. Claes made Shortcircuit
+** open source in December 2020.
+*/
+
+#include "infrastructure/reclaimer.h"
+
+#include <chrono>
+
+namespace scxt
+{
+
+Reclaimer &Reclaimer::get()
+{
+    static Reclaimer reclaimer;
+    return reclaimer;
+}
+
+Reclaimer::~Reclaimer()
+{
+    // only reached with participants left if they leaked, their objects leak along with them
+    {
+        std::lock_guard<std::mutex> g(threadMutex);
+        stopping = true;
+    }
+    threadCV.notify_all();
+    if (collector.joinable())
+        collector.join();
+}
+
+int Reclaimer::registerParticipant()
+{
+    std::lock_guard<std::mutex> l(lifecycleMutex);
+    int id = -1;
+    for (int i = 0; i < maxParticipants; i++)
+    {
+        if (!slotUsed[i])
+        {
+            slotUsed[i] = true;
+            activeEpoch[i] = 0;
+            id = i;
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> g(threadMutex);
+    if (participants++ == 0)
+    {
+        stopping = false;
+        running = true;
+        collector = std::thread([this]() { collectLoop(); });
+    }
+    return id;
+}
+
+void Reclaimer::unregisterParticipant(int id)
+{
+    std::lock_guard<std::mutex> l(lifecycleMutex);
+    if (id >= 0)
+    {
+        activeEpoch[id] = 0;
+        slotUsed[id] = false;
+    }
+    {
+        std::lock_guard<std::mutex> g(threadMutex);
+        if (--participants > 0)
+            return;
+        running = false; // from here on retire destroys right away
+        stopping = true;
+    }
+    threadCV.notify_all();
+    collector.join();
+
+    // nothing is in a block any more, so one pass frees everything
+    while (getPendingCount())
+        collect();
+}
+
+Reclaimer::Block::Block(int id) : participant(id)
+{
+    if (participant < 0)
+        return;
+    auto &r = get();
+    r.activeEpoch[participant] = r.epoch.load();
+}
+
+Reclaimer::Block::~Block()
+{
+    if (participant >= 0)
+        get().activeEpoch[participant] = 0;
+}
+
+void Reclaimer::retire(Reclaimable *r, void (*destroy)(Reclaimable *))
+{
+    if (!r)
+        return;
+    if (!running)
+    {
+        destroy(r);
+        return;
+    }
+
+    r->reclaimDestroy = destroy;
+    r->reclaimEpoch = epoch.load();
+    pending++;
+    auto head = retired.load(std::memory_order_relaxed);
+    do
+    {
+        r->reclaimNext = head;
+    } while (!retired.compare_exchange_weak(head, r, std::memory_order_release,
+                                            std::memory_order_relaxed));
+}
+
+size_t Reclaimer::collect()
+{
+    std::lock_guard<std::mutex> g(collectMutex);
+
+    // the retired list is only ever taken whole, so pushes never race a pop
+    auto r = retired.exchange(nullptr, std::memory_order_acquire);
+    while (r)
+    {
+        auto next = r->reclaimNext;
+        r->reclaimNext = held;
+        held = r;
+        r = next;
+    }
+    if (!held)
+        return 0;
+
+    // anything retired before the bump is older than the new epoch; a block still running
+    // from an earlier epoch holds back what was retired since it started
+    auto safe = epoch.fetch_add(1) + 1;
+    for (auto &a : activeEpoch)
+    {
+        auto e = a.load();
+        if (e && e < safe)
+            safe = e;
+    }
+
+    size_t n = 0;
+    auto p = &held;
+    while (*p)
+    {
+        auto c = *p;
+        if (c->reclaimEpoch < safe)
+        {
+            *p = c->reclaimNext;
+            c->reclaimDestroy(c); // may retire further objects, they go on the retired list
+            n++;
+        }
+        else
+            p = &c->reclaimNext;
+    }
+    pending -= n;
+    return n;
+}
+
+size_t Reclaimer::getPendingCount() { return pending; }
+
+void Reclaimer::collectLoop()
+{
+    std::unique_lock<std::mutex> lk(threadMutex);
+    while (!threadCV.wait_for(lk, std::chrono::milliseconds(collectIntervalMs),
+                              [this]() { return stopping; }))
+    {
+        lk.unlock();
+        if (pending)
+            collect();
+        lk.lock();
+    }
+}
+
+} // namespace scxt
@@ -0,0 +1,111 @@
+/*
+** Shortcircuit XT is Free and Open Source Software
+**
+** Shortcircuit is made available under the Gnu General Public License, v3.0
+** https://www.gnu.org/licenses/gpl-3.0.en.html; The authors of the code
+** reserve the right to re-license their contributions under the MIT license in the
+** future at the discretion of the project maintainers.
+**
+** Copyright 2004-2021 by various individuals as described by the git transaction log
+**
+** All source at: https://github.com/surge-synthesizer/surge.git
+**
+** Shortcircuit was a commercial product from 2004-2018, with copyright and ownership
+** in that period held by Claes Johanson at Vember Audio. Claes made Shortcircuit
+** open source in December 2020.
+*/
+
+#ifndef SHORTCIRCUIT_RECLAIMER_H
+#define SHORTCIRCUIT_RECLAIMER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+/*
+ * Deferred destruction of objects the audio thread may still be using. Freeing a large
+ * sample or a reverb's buffers can take milliseconds in free/munmap, so rather than deleting
+ * them where they are unlinked (often under cs_patch, or on the audio thread itself) they are
+ * retired: pushed on a lock-free list and destroyed later on a background thread.
+ *
+ * Retirement is epoch based. Each audio thread (participant) marks the blocks it renders with
+ * a Block guard, which records the global epoch the block started in. A retired object is
+ * stamped with the epoch it was retired in and destroyed once every participant has either
+ * left its block or started a later one, so no block which might have seen the object before
+ * it was unlinked is still running.
+ *
+ * While no participant is registered (eg. in tests or tools using filters on their own)
+ * retire destroys the object immediately.
+ */
+
+namespace scxt
+{
+
+// intrusive list link for retired objects, no allocation is needed to retire one
+class Reclaimable
+{
+    friend class Reclaimer;
+    Reclaimable *reclaimNext{nullptr};
+    uint64_t reclaimEpoch{0};
+    void (*reclaimDestroy)(Reclaimable *){nullptr};
+};
+
+class Reclaimer
+{
+  public:
+    static Reclaimer &get();
+    ~Reclaimer();
+
+    // the first participant starts the background thread and the last one stops it, destroying
+    // everything still retired. Returns -1 when all slots are taken; such a participant's
+    // blocks are not tracked.
+    static constexpr int maxParticipants = 64;
+    int registerParticipant();
+    void unregisterParticipant(int id);
+
+    struct Block
+    {
+        Block(int id);
+        ~Block();
+        int participant;
+    };
+
+    // unlink first; destroy is called later on another thread. Lock-free and allocation free,
+    // so it may be called from the audio thread.
+    void retire(Reclaimable *r, void (*destroy)(Reclaimable *));
+
+    // advance the epoch and destroy what is safe to, returning how many objects were
+    // destroyed. The background thread calls this every collectInterval.
+    size_t collect();
+    size_t getPendingCount();
+
+    static constexpr int collectIntervalMs = 20;
+
+  private:
+    Reclaimer() = default;
+    void collectLoop();
+
+    std::atomic<uint64_t> epoch{1};
+    std::atomic<uint64_t> activeEpoch[maxParticipants]{}; // 0 while not in a block
+    std::atomic<bool> slotUsed[maxParticipants]{};
+    std::atomic<Reclaimable *> retired{nullptr};
+    std::atomic<bool> running{false};
+    std::atomic<size_t> pending{0};
+
+    std::mutex collectMutex; // one collector at a time, guards held
+    Reclaimable *held{nullptr}; // taken off retired but not yet safe to destroy
+
+    std::mutex lifecycleMutex; // serialises starting and stopping the thread
+    std::mutex threadMutex;    // guards the members below
+    std::condition_variable threadCV;
+    std::thread collector;
+    int participants{0};
+    bool stopping{false};
+};
+
+} // namespace scxt
+
+#endif // SHORTCIRCUIT_RECLAIMER_H
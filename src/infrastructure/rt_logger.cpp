@@ -0,0 +1,134 @@
+/*
+** Shortcircuit XT is Free and Open Source Software
+**
+** Shortcircuit is made available under the Gnu General Public License, v3.0
+** https://www.gnu.org/licenses/gpl-3.0.en.html; The authors of the code
+** reserve the right to re-license their contributions under the MIT license in the
+** future at the discretion of the project maintainers.
+**
+** Copyright 2004-2021 by various individuals as described by the git transaction log
+**
+** All source at: https://github.com/surge-synthesizer/surge.git
+**
+** Shortcircuit was a commercial product from 2004-2018, with copyright and ownership
+** in that period held by Claes Johanson at Vember Audio. Claes made Shortcircuit
+** open source in December 2020.
+*/
+
+#include "infrastructure/rt_logger.h"
+#include "filesystem/import.h"
+
+#include <chrono>
+#include <cstdio>
+
+namespace scxt::log
+{
+
+RealtimeLogger::RealtimeLogger(LoggingCallback *cb) : mCB(cb)
+{
+    for (size_t i = 0; i < capacity; i++)
+        slots[i].seq.store(i, std::memory_order_relaxed);
+    if (!mCB)
+        return;
+    cbLevel = (int)mCB->getLevel();
+    dispatcher = std::thread([this]() { dispatchLoop(); });
+}
+
+RealtimeLogger::~RealtimeLogger()
+{
+    {
+        std::lock_guard<std::mutex> g(threadMutex);
+        stopping = true;
+    }
+    threadCV.notify_all();
+    if (dispatcher.joinable())
+        dispatcher.join();
+    if (mCB)
+        flush();
+}
+
+void RealtimeLogger::flush()
+{
+    std::lock_guard<std::mutex> g(drainMutex);
+    cbLevel = (int)mCB->getLevel();
+    drain();
+}
+
+void RealtimeLogger::dispatchLoop()
+{
+    // loggers don't wake us, a notify isn't something to do on the audio thread
+    std::unique_lock<std::mutex> lk(threadMutex);
+    while (!threadCV.wait_for(lk, std::chrono::milliseconds(dispatchIntervalMs),
+                              [this]() { return stopping; }))
+    {
+        lk.unlock();
+        flush();
+        lk.lock();
+    }
+}
+
+void RealtimeLogger::drain()
+{
+    auto lev = mCB->getLevel();
+    for (;;)
+    {
+        auto &s = slots[head & (capacity - 1)];
+        if (s.seq.load(std::memory_order_acquire) != head + 1)
+            break; // empty, or the next writer hasn't finished its record yet
+        if (s.rec.level <= lev)
+            mCB->message(s.rec.level, format(s.rec));
+        s.seq.store(head + capacity, std::memory_order_release);
+        head++;
+    }
+
+    auto d = dropped.exchange(0);
+    if (d)
+    {
+        droppedTotal += d;
+        if (lev >= Level::Warning)
+            mCB->message(Level::Warning, "Log ring full, dropped " + std::to_string(d) +
+                                             " realtime log records");
+    }
+}
+
+std::string RealtimeLogger::format(const Record &r)
+{
+    // the same prefix the stream LOG macros write
+    std::string res = fs::path{r.file}.filename().u8string() + ":" + std::to_string(r.line) + " ";
+    int n = 0;
+    for (auto c = r.fmt; *c; c++)
+    {
+        if (c[0] != '{' || c[1] != '}' || n >= r.nargs)
+        {
+            res += *c;
+            continue;
+        }
+        switch (r.type[n])
+        {
+        case INT:
+            res += std::to_string(r.arg[n].i);
+            break;
+        case UINT:
+            res += std::to_string(r.arg[n].u);
+            break;
+        case DOUBLE:
+        {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%g", r.arg[n].d);
+            res += buf;
+            break;
+        }
+        case BOOL:
+            res += r.arg[n].i ? "true" : "false";
+            break;
+        case TEXT:
+            res += r.text + r.arg[n].text;
+            break;
+        }
+        n++;
+        c++;
+    }
+    return res;
+}
+
+} // namespace scxt::log
@@ -0,0 +1,254 @@
+/*
+** Shortcircuit XT is Free and Open Source Software
+**
+** Shortcircuit is made available under the Gnu General Public License, v3.0
+** https://www.gnu.org/licenses/gpl-3.0.en.html; The authors of the code
+** reserve the right to re-license their contributions under the MIT license in the
+** future at the discretion of the project maintainers.
+**
+** Copyright 2004-2021 by various individuals as described by the git transaction log
+**
+** All source at: https://github.com/surge-synthesizer/surge.git
+**
+** Shortcircuit was a commercial product from 2004-2018, with copyright and ownership
+** in that period held by Claes Johanson at Vember Audio. Claes made Shortcircuit
+** open source in December 2020.
+*/
+
+#ifndef __SCXT_INFRA_RT_LOGGER_H
+#define __SCXT_INFRA_RT_LOGGER_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include "logging.h"
+
+/*
+ * Logging which is safe on the audio thread. StreamLogger formats into a stringstream and
+ * calls the LoggingCallback there and then, which allocates and, in the plugin, goes through
+ * the editor's log queue. RealtimeLogger only copies a fixed size record (level, source
+ * location, format and up to maxArgs arguments) into a preallocated lock-free ring; a
+ * background thread formats the records and hands them to the callback.
+ *
+ *   RTLOGWARNING(mRTLogger, "voice {} of {} has no zone", v, polyphony);
+ *
+ * The format is a string literal with {} where each argument goes. Only its pointer is kept,
+ * it serves as the record's format id. Numbers and bools are stored as they are and string
+ * arguments copied into the record, truncated to what is left of its textSize bytes.
+ *
+ * Any thread may log. When the ring is full the record is dropped and counted, and the
+ * background thread reports how many were lost. Levels above RTLOG_LEVEL compile to nothing,
+ * their arguments aren't evaluated either.
+ */
+
+// the most verbose level compiled in, as scxt::log::Level: 1 errors only ... 4 debug
+#ifndef RTLOG_LEVEL
+#ifdef NDEBUG
+#define RTLOG_LEVEL 3
+#else
+#define RTLOG_LEVEL 4
+#endif
+#endif
+
+#if RTLOG_LEVEL >= 4
+#define RTLOGDEBUG(x, ...) (x).log(scxt::log::Level::Debug, __FILE__, __LINE__, __VA_ARGS__)
+#else
+#define RTLOGDEBUG(x, ...) ((void)0)
+#endif
+#if RTLOG_LEVEL >= 3
+#define RTLOGINFO(x, ...) (x).log(scxt::log::Level::Info, __FILE__, __LINE__, __VA_ARGS__)
+#else
+#define RTLOGINFO(x, ...) ((void)0)
+#endif
+#if RTLOG_LEVEL >= 2
+#define RTLOGWARNING(x, ...) (x).log(scxt::log::Level::Warning, __FILE__, __LINE__, __VA_ARGS__)
+#else
+#define RTLOGWARNING(x, ...) ((void)0)
+#endif
+#if RTLOG_LEVEL >= 1
+#define RTLOGERROR(x, ...) (x).log(scxt::log::Level::Error, __FILE__, __LINE__, __VA_ARGS__)
+#else
+#define RTLOGERROR(x, ...) ((void)0)
+#endif
+
+namespace scxt::log
+{
+
+class RealtimeLogger
+{
+  public:
+    static constexpr int maxArgs = 4;
+    static constexpr int textSize = 64;
+    static constexpr size_t capacity = 1024; // records, a power of two
+    static constexpr int dispatchIntervalMs = 20;
+
+    // starts the background thread unless cb is null, in which case nothing is logged
+    RealtimeLogger(LoggingCallback *cb);
+    // dispatches what is still queued
+    ~RealtimeLogger();
+
+    RealtimeLogger(const RealtimeLogger &) = delete;
+    RealtimeLogger &operator=(const RealtimeLogger &) = delete;
+
+    // lock-free and allocation free, use the RTLOG macros rather than calling it directly
+    template <typename... Args>
+    void log(Level lev, const char *file, int line, const char *fmt, const Args &...args)
+    {
+        static_assert(sizeof...(Args) <= maxArgs, "too many arguments for a log record");
+        if (!mCB || (int)lev > cbLevel.load(std::memory_order_relaxed))
+            return;
+        size_t pos;
+        auto slot = claim(pos);
+        if (!slot)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        auto &r = slot->rec;
+        r.level = lev;
+        r.file = file;
+        r.line = line;
+        r.fmt = fmt;
+        r.nargs = 0;
+        r.textUsed = 0;
+        r.text[textSize - 1] = 0;
+        (put(r, args), ...);
+        slot->seq.store(pos + 1, std::memory_order_release);
+    }
+
+    // format and dispatch everything queued so far on the calling thread. The level the
+    // callback asks for is picked up here too; the background thread does this every
+    // dispatchIntervalMs.
+    void flush();
+
+    LoggingCallback *getCallback() const { return mCB; }
+    uint32_t getDroppedCount() const { return droppedTotal.load(); }
+
+  private:
+    enum ArgType : uint8_t
+    {
+        INT,
+        UINT,
+        DOUBLE,
+        BOOL,
+        TEXT
+    };
+    struct Record
+    {
+        Level level;
+        int line;
+        const char *file;
+        const char *fmt;
+        uint8_t nargs;
+        ArgType type[maxArgs];
+        union
+        {
+            int64_t i;
+            uint64_t u;
+            double d;
+            uint16_t text; // offset into text
+        } arg[maxArgs];
+        uint16_t textUsed;
+        char text[textSize];
+    };
+    struct Slot
+    {
+        std::atomic<size_t> seq;
+        Record rec;
+    };
+
+    Slot *claim(size_t &pos)
+    {
+        pos = tail.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            auto &s = slots[pos & (capacity - 1)];
+            auto seq = s.seq.load(std::memory_order_acquire);
+            auto dif = (intptr_t)seq - (intptr_t)pos;
+            if (dif == 0)
+            {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    return &s;
+            }
+            else if (dif < 0)
+                return nullptr; // the reader hasn't got to this one yet
+            else
+                pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    template <typename T> static void put(Record &r, const T &v)
+    {
+        auto n = r.nargs++;
+        if constexpr (std::is_same_v<T, bool>)
+        {
+            r.type[n] = BOOL;
+            r.arg[n].i = v;
+        }
+        else if constexpr (std::is_enum_v<T>)
+        {
+            r.type[n] = INT;
+            r.arg[n].i = (int64_t)v;
+        }
+        else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+        {
+            r.type[n] = INT;
+            r.arg[n].i = v;
+        }
+        else if constexpr (std::is_integral_v<T>)
+        {
+            r.type[n] = UINT;
+            r.arg[n].u = v;
+        }
+        else if constexpr (std::is_floating_point_v<T>)
+        {
+            r.type[n] = DOUBLE;
+            r.arg[n].d = v;
+        }
+        else if constexpr (std::is_same_v<T, std::string>)
+            putText(r, n, v.c_str());
+        else
+        {
+            static_assert(std::is_convertible_v<T, const char *>, "unsupported log argument");
+            putText(r, n, v);
+        }
+    }
+    static void putText(Record &r, int n, const char *s)
+    {
+        // the last byte is always a terminator, arguments past it come out empty
+        size_t len = s ? strnlen(s, textSize - 1 - r.textUsed) : 0;
+        r.type[n] = TEXT;
+        r.arg[n].text = r.textUsed;
+        if (len)
+            memcpy(r.text + r.textUsed, s, len);
+        r.text[r.textUsed + len] = 0;
+        r.textUsed = std::min<size_t>(r.textUsed + len + 1, textSize - 1);
+    }
+
+    void dispatchLoop();
+    void drain();
+    std::string format(const Record &r);
+
+    LoggingCallback *mCB;
+    Slot slots[capacity];
+    std::atomic<size_t> tail{0};
+    size_t head{0}; // guarded by drainMutex
+    std::atomic<int> cbLevel{0};
+    std::atomic<uint32_t> dropped{0}, droppedTotal{0};
+
+    std::mutex drainMutex; // one reader at a time
+    std::mutex threadMutex;
+    std::condition_variable threadCV;
+    std::thread dispatcher;
+    bool stopping{false};
+};
+
+} // namespace scxt::log
+
+#endif // __SCXT_INFRA_RT_LOGGER_H
@@ -0,0 +1,369 @@
+/*
+** Shortcircuit XT is Free and Open Source Software
+**
+** Shortcircuit is made available under the Gnu General Public License, v3.0
+** https://www.gnu.org/licenses/gpl-3.0.en.html; The authors of the code
+** reserve the right to re-license their contributions under the MIT license in the
+** future at the discretion of the project maintainers.
+**
+** Copyright 2004-2021 by various individuals as described by the git transaction log
+**
+** All source at: https://github.com/surge-synthesizer/surge.git
+**
+** Shortcircuit was a commercial product from 2004-2018, with copyright and ownership
+** in that period held by Claes Johanson at Vember Audio. Claes made Shortcircuit
+** open source in December 2020.
+*/
+
+#include "infrastructure/sample_arena.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#if WINDOWS
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+namespace scxt
+{
+
+namespace
+{
+// precedes every buffer, keeping it 16 (and for mapped ones 64) byte aligned
+struct alignas(64) BlockHeader
+{
+    static constexpr uint32_t magicValue = 0x53435841; // SCXA
+    uint32_t magic;
+    bool huge;
+    size_t bytes;  // as requested
+    size_t mapped; // length of the mapping starting at the header, 0 for heap blocks
+    size_t locked;
+};
+
+size_t pageSize()
+{
+#if WINDOWS
+    static size_t ps = []() {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        return (size_t)si.dwPageSize;
+    }();
+#else
+    static size_t ps = (size_t)sysconf(_SC_PAGESIZE);
+#endif
+    return ps;
+}
+
+size_t roundUp(size_t n, size_t to) { return (n + to - 1) / to * to; }
+
+void touchPages(const void *p, size_t bytes, bool write)
+{
+    auto c = (volatile char *)p;
+    auto ps = pageSize();
+    for (size_t i = 0; i < bytes; i += ps)
+    {
+        if (write)
+            c[i] = 0;
+        else
+            (void)c[i];
+    }
+    if (bytes)
+        (void)c[bytes - 1];
+}
+
+void *mapPages(size_t len, SampleArena::HugePages hp, size_t &mapped, bool &huge)
+{
+    huge = false;
+#if WINDOWS
+    mapped = roundUp(len, pageSize());
+    return VirtualAlloc(nullptr, mapped, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+#if LINUX
+    auto hps = SampleArena::hugePageSize;
+    if (hp == SampleArena::hugePagesExplicit && len >= hps)
+    {
+        mapped = roundUp(len, hps);
+        auto p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED)
+        {
+            huge = true;
+            return p;
+        }
+        // the pool is empty or not set up, transparent huge pages are the next best thing
+    }
+    if (hp != SampleArena::hugePagesOff && len >= hps)
+    {
+        // huge pages need a 2MB aligned range, so map more and trim both ends
+        mapped = roundUp(len, pageSize());
+        size_t over = mapped + hps;
+        auto p = (char *)mmap(nullptr, over, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == (char *)MAP_FAILED)
+            return nullptr;
+        auto a = (char *)roundUp((uintptr_t)p, hps);
+        if (a > p)
+            munmap(p, a - p);
+        if (p + over > a + mapped)
+            munmap(a + mapped, p + over - (a + mapped));
+        huge = (madvise(a, mapped, MADV_HUGEPAGE) == 0);
+        return a;
+    }
+#endif
+    mapped = roundUp(len, pageSize());
+    auto p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (p == MAP_FAILED) ? nullptr : p;
+#endif
+}
+
+void unmapPages(void *p, size_t mapped)
+{
+#if WINDOWS
+    VirtualFree(p, 0, MEM_RELEASE);
+#else
+    munmap(p, mapped);
+#endif
+}
+
+bool lockPages(const void *p, size_t len)
+{
+#if WINDOWS
+    return VirtualLock((LPVOID)p, len);
+#else
+    return mlock(p, len) == 0;
+#endif
+}
+
+void unlockPages(const void *p, size_t len)
+{
+#if WINDOWS
+    VirtualUnlock((LPVOID)p, len);
+#else
+    munlock(p, len);
+#endif
+}
+} // namespace
+
+SampleArena &SampleArena::get()
+{
+    static SampleArena arena;
+    return arena;
+}
+
+void SampleArena::configure(const Config &c)
+{
+    std::lock_guard<std::mutex> g(mutex);
+    config = c;
+    stats.lockBudget = c.lockBudget;
+}
+
+SampleArena::Config SampleArena::getConfig()
+{
+    std::lock_guard<std::mutex> g(mutex);
+    return config;
+}
+
+bool SampleArena::tryLock(const void *p, size_t bytes)
+{
+    {
+        std::lock_guard<std::mutex> g(mutex);
+        if (stats.lockedBytes + bytes > config.lockBudget)
+            return false;
+        stats.lockedBytes += bytes; // reserve, so concurrent loads can't overshoot
+    }
+    if (lockPages(p, bytes))
+        return true;
+    std::lock_guard<std::mutex> g(mutex);
+    stats.lockedBytes -= bytes;
+    stats.lockFailures++;
+    return false;
+}
+
+void *SampleArena::allocate(size_t bytes)
+{
+    auto cfg = getConfig();
+    size_t len = sizeof(BlockHeader) + bytes;
+    BlockHeader *h;
+    size_t mapped = 0;
+    bool huge = false;
+    if (len < mapThreshold)
+    {
+        h = (BlockHeader *)malloc(len);
+        if (!h)
+            return nullptr;
+        if (cfg.prefault)
+            touchPages(h, len, true);
+    }
+    else
+    {
+        h = (BlockHeader *)mapPages(len, cfg.hugePages, mapped, huge);
+        if (!h)
+            return nullptr;
+        // fresh mappings are backed by the shared zero page until written, so write
+        if (cfg.prefault)
+            touchPages(h, mapped, true);
+    }
+
+    h->magic = BlockHeader::magicValue;
+    h->huge = huge;
+    h->bytes = bytes;
+    h->mapped = mapped;
+    h->locked = (mapped && tryLock(h, mapped)) ? mapped : 0;
+
+    std::lock_guard<std::mutex> g(mutex);
+    stats.allocatedBytes += bytes;
+    stats.mappedBytes += mapped;
+    if (huge)
+        stats.hugePageBytes += mapped;
+    return h + 1;
+}
+
+void *SampleArena::reallocate(void *p, size_t bytes)
+{
+    if (!p)
+        return allocate(bytes);
+    auto h = (BlockHeader *)p - 1;
+    assert(h->magic == BlockHeader::magicValue);
+    auto n = allocate(bytes);
+    if (!n)
+        return nullptr;
+    memcpy(n, p, std::min(bytes, h->bytes));
+    release(p);
+    return n;
+}
+
+void SampleArena::release(void *p)
+{
+    if (!p)
+        return;
+    auto h = (BlockHeader *)p - 1;
+    assert(h->magic == BlockHeader::magicValue);
+    h->magic = 0;
+    {
+        std::lock_guard<std::mutex> g(mutex);
+        stats.allocatedBytes -= h->bytes;
+        stats.mappedBytes -= h->mapped;
+        if (h->huge)
+            stats.hugePageBytes -= h->mapped;
+        stats.lockedBytes -= h->locked;
+    }
+    if (!h->mapped)
+    {
+        free(h);
+        return;
+    }
+    if (h->locked)
+        unlockPages(h, h->locked);
+    unmapPages(h, h->mapped);
+}
+
+size_t SampleArena::prepareRange(const void *p, size_t bytes)
+{
+    if (!p || !bytes)
+        return 0;
+    prefaultRange(p, bytes);
+    if (tryLock(p, bytes))
+        return bytes;
+    return 0;
+}
+
+void SampleArena::prefaultRange(const void *p, size_t bytes)
+{
+    if (!p || !bytes)
+        return;
+#if !WINDOWS
+    auto start = (uintptr_t)p & ~(uintptr_t)(pageSize() - 1);
+    posix_madvise((void *)start, bytes + ((uintptr_t)p - start), POSIX_MADV_WILLNEED);
+#endif
+    if (getConfig().prefault)
+        touchPages(p, bytes, false);
+}
+
+void SampleArena::discardRange(const void *p, size_t bytes)
+{
+    // only whole pages inside the range, the ones at the ends may be shared with neighbours
+    auto ps = pageSize();
+    auto start = roundUp((uintptr_t)p, ps);
+    auto end = ((uintptr_t)p + bytes) & ~(uintptr_t)(ps - 1);
+    if (!p || end <= start)
+        return;
+#if WINDOWS
+    // unlocking pages which aren't locked takes them out of the working set
+    VirtualUnlock((LPVOID)start, end - start);
+#else
+    madvise((void *)start, end - start, MADV_DONTNEED);
+#endif
+}
+
+void SampleArena::discardTail(void *p, size_t keep)
+{
+    if (!p)
+        return;
+    auto h = (BlockHeader *)p - 1;
+    assert(h->magic == BlockHeader::magicValue);
+    if (!h->mapped || keep >= h->bytes)
+        return;
+    if (h->locked)
+    {
+        unlockRange(h, h->locked);
+        h->locked = 0;
+    }
+    discardRange((char *)p + keep, h->bytes - keep);
+}
+
+void SampleArena::relock(void *p)
+{
+    if (!p)
+        return;
+    auto h = (BlockHeader *)p - 1;
+    assert(h->magic == BlockHeader::magicValue);
+    if (h->mapped && !h->locked && tryLock(h, h->mapped))
+        h->locked = h->mapped;
+}
+
+void SampleArena::unlockRange(const void *p, size_t locked)
+{
+    if (!locked)
+        return;
+    unlockPages(p, locked);
+    std::lock_guard<std::mutex> g(mutex);
+    stats.lockedBytes -= locked;
+}
+
+SampleArena::Stats SampleArena::getStats()
+{
+    std::lock_guard<std::mutex> g(mutex);
+    auto s = stats;
+    s.audioMinorFaults = audioMinorFaults;
+    s.audioMajorFaults = audioMajorFaults;
+    return s;
+}
+
+bool SampleArena::getThreadFaults(uint64_t &minor, uint64_t &major)
+{
+#if LINUX
+    rusage ru;
+    if (getrusage(RUSAGE_THREAD, &ru))
+        return false;
+    minor = ru.ru_minflt;
+    major = ru.ru_majflt;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void SampleArena::addAudioFaults(uint64_t minor, uint64_t major)
+{
+    audioMinorFaults.fetch_add(minor, std::memory_order_relaxed);
+    audioMajorFaults.fetch_add(major, std::memory_order_relaxed);
+}
+
+} // namespace scxt
@@ -0,0 +1,119 @@
+/*
+** Shortcircuit XT is Free and Open Source Software
+**
+** Shortcircuit is made available under the Gnu General Public License, v3.0
+** https://www.gnu.org/licenses/gpl-3.0.en.html; The authors of the code
+** reserve the right to re-license their contributions under the MIT license in the
+** future at the discretion of the project maintainers.
+**
+** Copyright 2004-2021 by various individuals as described by the git transaction log
+**
+** All source at: https://github.com/surge-synthesizer/surge.git
+**
+** Shortcircuit was a commercial product from 2004-2018, with copyright and ownership
+** in that period held by Claes Johanson at Vember Audio. Claes made Shortcircuit
+** open source in December 2020.
+*/
+
+#ifndef SHORTCIRCUIT_SAMPLE_ARENA_H
+#define SHORTCIRCUIT_SAMPLE_ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+/*
+ * Memory for decoded sample data. Voices read sample buffers from the audio thread, and the
+ * first read of a page which was never touched, was swapped out or belongs to a mapped cache
+ * file not read yet is a page fault, sometimes one waiting on the disk. The arena avoids them:
+ *
+ * - buffers of mapThreshold bytes or more get pages of their own, which are pre-faulted and,
+ *   while the lock budget lasts, mlocked. Small buffers come from the heap and are only
+ *   pre-faulted, locking them would lock pages shared with other allocations.
+ * - large buffers can be backed by huge pages, transparent ones (madvise) or explicit ones
+ *   from the hugetlbfs pool (MAP_HUGETLB, falling back to normal pages when the pool is
+ *   empty). Both are Linux only.
+ * - prepareRange does the pre-faulting and locking for memory the arena didn't allocate,
+ *   the mapped files of the sample cache.
+ *
+ * The arena is shared by all sampler instances in the process; the lock budget is too.
+ * Nothing here is meant to be called from the audio thread, except for addAudioFaults.
+ */
+
+namespace scxt
+{
+
+class SampleArena
+{
+  public:
+    static SampleArena &get();
+
+    enum HugePages
+    {
+        hugePagesOff,
+        hugePagesTransparent,
+        hugePagesExplicit,
+    };
+    struct Config
+    {
+        size_t lockBudget{0}; // bytes which may be locked, 0 disables locking
+        bool prefault{true};
+        HugePages hugePages{hugePagesTransparent};
+    };
+    // applies to buffers allocated from now on
+    void configure(const Config &c);
+    Config getConfig();
+
+    static constexpr size_t mapThreshold = 64 * 1024;
+    static constexpr size_t hugePageSize = 2 * 1024 * 1024;
+
+    // the usual malloc/realloc/free contract; buffers are 16 byte aligned
+    void *allocate(size_t bytes);
+    void *reallocate(void *p, size_t bytes);
+    void release(void *p);
+
+    // pre-fault and, within the budget, lock memory allocated elsewhere. Returns the bytes
+    // locked, to be handed to unlockRange before the memory goes away.
+    size_t prepareRange(const void *p, size_t bytes);
+    void unlockRange(const void *p, size_t locked);
+    // pre-fault only, or drop the resident pages of a file mapping so they are read again
+    // from the file when next touched (which must be unlocked)
+    void prefaultRange(const void *p, size_t bytes);
+    void discardRange(const void *p, size_t bytes);
+    // for buffers from allocate: unlock one and drop its pages past the first keep bytes,
+    // which are to be written again before they are read. Buffers from the heap stay as
+    // they are, their pages are shared. relock locks one again, within the budget.
+    void discardTail(void *p, size_t keep);
+    void relock(void *p);
+
+    struct Stats
+    {
+        size_t allocatedBytes{0}; // as requested, heap and mapped
+        size_t mappedBytes{0};    // pages of their own, including rounding
+        size_t hugePageBytes{0};  // of those, backed by (or advised to use) huge pages
+        size_t lockedBytes{0};    // arena buffers and prepared ranges
+        size_t lockBudget{0};
+        uint64_t lockFailures{0}; // mlock refused within the budget, eg. by RLIMIT_MEMLOCK
+        uint64_t audioMinorFaults{0}, audioMajorFaults{0};
+    };
+    Stats getStats();
+
+    // page faults of the calling thread so far; false where the platform doesn't say
+    static bool getThreadFaults(uint64_t &minor, uint64_t &major);
+    // the audio thread reports the faults it took while rendering
+    void addAudioFaults(uint64_t minor, uint64_t major);
+
+  private:
+    SampleArena() = default;
+    bool tryLock(const void *p, size_t bytes);
+
+    std::mutex mutex; // guards config and stats
+    Config config;
+    Stats stats;
+    std::atomic<uint64_t> audioMinorFaults{0}, audioMajorFaults{0};
+};
+
+} // namespace scxt
+
+#endif // SHORTCIRCUIT_SAMPLE_ARENA_H
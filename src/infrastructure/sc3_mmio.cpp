@@ -56,8 +56,20 @@ HMMIO mmioOpenSTR(std::ifstream &ifs, int mode)
 
 HMMIO mmioOpenFromPath(const fs::path &fn, void *, int mode)
 {
-    auto ifs = std::ifstream(fn, std::ios::binary);
-    return mmioOpenSTR(ifs, mode);
+    // Map the file rather than copying it; sample banks can be larger than we want to read whole
+    auto mapper = std::make_unique<scxt::FileMapView>(fn);
+    if (!mapper->isMapped())
+    {
+        return nullptr;
+    }
+
+    auto res = std::make_shared<sc3mmio_hand>();
+    res->is_open = true;
+    res->rawDataSize = mapper->dataSize();
+    res->memFile = scxt::Memfile::RIFFMemFile(mapper->data(), res->rawDataSize);
+    res->mapper = std::move(mapper);
+
+    return res;
 }
 HMMIO mmioOpenW(const wchar_t *fn, void *, int mode)
 {
@@ -35,6 +35,7 @@
 #include <iostream>
 #include <memory>
 
+#include "infrastructure/file_map_view.h"
 #include "infrastructure/logfile.h"
 #include "riff_memfile.h"
 
@@ -43,6 +44,7 @@ struct sc3mmio_hand
     bool is_open = false;
     char *rawData = nullptr;
     size_t rawDataSize = 0;
+    std::unique_ptr<scxt::FileMapView> mapper; // set instead of rawData for mapped files
     scxt::Memfile::RIFFMemFile memFile;
 
     void close()
@@ -53,6 +55,7 @@ struct sc3mmio_hand
             delete[] rawData;
             rawData = nullptr;
             rawDataSize = 0;
+            mapper.reset();
         }
     }
 
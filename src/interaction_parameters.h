@@ -33,7 +33,8 @@ enum InteractionId
     ip_select_all,
     ip_polyphony,
     ip_vumeter,
-    n_ip_free_items = ip_vumeter,
+    ip_sample_memory,
+    n_ip_free_items = ip_sample_memory,
     ip_zone_name,
     ip_zone_params_begin = ip_zone_name, // start: properties that should be handled by multiselect
     ip_channel,
@@ -559,6 +560,14 @@ static const interactiondata ip_data[] = {
         0,
         "VU",
     },
+    {
+        ip_sample_memory,
+        ipvt_int,
+        0,
+        1,
+        0,
+        "sample memory",
+    },
     {
         ip_zone_name,
         ipvt_string,
@@ -0,0 +1,68 @@
+/*
+** Shortcircuit XT is Free and Open Source Software
+**
+** Shortcircuit is made available under the Gnu General Public License, v3.0
+** https://www.gnu.org/licenses/gpl-3.0.en.html; The authors of the code
+** reserve the right to re-license their contributions under the MIT license in the
+** future at the discretion of the project maintainers.
+**
+** Copyright 2004-2021 by various individuals as described by the git transaction log
+**
+** All source at: https://github.com/surge-synthesizer/surge.git
+**
+** Shortcircuit was a commercial product from 2004-2018, with copyright and ownership
+** in that period held by Claes Johanson at Vember Audio. Claes made Shortcircuit
+** open source in December 2020.
+*/
+
+#include "load_shedder.h"
+#include <algorithm>
+
+void load_shedder::set_max_stage(int s)
+{
+    max_stage = std::clamp(s, (int)ls_none, (int)ls_n_stages - 1);
+    stage = std::min(stage, max_stage);
+}
+
+int load_shedder::update(float seconds, float budget)
+{
+    if (budget <= 0.f)
+        return stage;
+
+    // around 40ms at 48k, so a single slow block (a page fault, a note on burst) doesn't count
+    const float smoothing = 1.f / 64.f;
+    load += (seconds / budget - load) * smoothing;
+
+    if (load > overload_load)
+    {
+        under_blocks = 0;
+        if (++over_blocks >= escalate_blocks && stage < max_stage)
+        {
+            stage++;
+            over_blocks = 0;
+        }
+    }
+    else if (load < recover_load)
+    {
+        over_blocks = 0;
+        if (++under_blocks >= restore_blocks && stage > ls_none)
+        {
+            stage--;
+            under_blocks = 0;
+        }
+    }
+    else
+    {
+        over_blocks = 0;
+        under_blocks = 0;
+    }
+    return stage;
+}
+
+void load_shedder::reset()
+{
+    load = 0.f;
+    stage = ls_none;
+    over_blocks = 0;
+    under_blocks = 0;
+}
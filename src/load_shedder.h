@@ -0,0 +1,66 @@
+/*
+** Shortcircuit XT is Free and Open Source Software
+**
+** Shortcircuit is made available under the Gnu General Public License, v3.0
+** https://www.gnu.org/licenses/gpl-3.0.en.html; The authors of the code
+** reserve the right to re-license their contributions under the MIT license in the
+** future at the discretion of the project maintainers.
+**
+** Copyright 2004-2021 by various individuals as described by the git transaction log
+**
+** All source at: https://github.com/surge-synthesizer/surge.git
+**
+** Shortcircuit was a commercial product from 2004-2018, with copyright and ownership
+** in that period held by Claes Johanson at Vember Audio. Claes made Shortcircuit
+** open source in December 2020.
+*/
+
+#ifndef SHORTCIRCUIT_LOAD_SHEDDER_H
+#define SHORTCIRCUIT_LOAD_SHEDDER_H
+
+/*
+ * Watches how long each block takes to render against the time it has in real time and,
+ * under sustained pressure, steps through stages which each give up a little more quality
+ * to get the engine back inside its budget. Stages are cumulative and are walked back one
+ * at a time once the load has stayed low for a while.
+ */
+class load_shedder
+{
+  public:
+    enum stage
+    {
+        ls_none = 0,
+        ls_steal_released, // uberrelease the quietest released voices while overloaded
+        ls_reduce_quality, // new voices use linear interpolation
+        ls_skip_filter2,   // new voices skip their second zone filter
+        ls_n_stages,
+    };
+
+    // smoothed render time / budget above which a block counts as overloaded, and below
+    // which it counts towards restoring quality
+    static constexpr float overload_load = 0.9f;
+    static constexpr float recover_load = 0.6f;
+    // blocks the load has to stay past a threshold before the stage changes
+    static constexpr int escalate_blocks = 64;
+    static constexpr int restore_blocks = 1024;
+
+    // ls_none disables shedding
+    void set_max_stage(int s);
+    int get_max_stage() const { return max_stage; }
+
+    // seconds the last block took to render and the seconds of audio it held, returns the
+    // current stage
+    int update(float seconds, float budget);
+    void reset();
+
+    int get_stage() const { return stage; }
+    float get_load() const { return load; }
+    bool is_overloaded() const { return load > overload_load; }
+
+  private:
+    float load{0.f};
+    int stage{ls_none}, max_stage{ls_skip_filter2};
+    int over_blocks{0}, under_blocks{0};
+};
+
+#endif // SHORTCIRCUIT_LOAD_SHEDDER_H
@@ -21,6 +21,8 @@
 #include "util/scxtstring.h"
 
 #include <algorithm>
+#include <mutex>
+#include <vector>
 using std::max;
 using std::min;
 
@@ -315,6 +317,20 @@ bool sampler::load_akai_s6k_program(const fs::path &filename, char channel, bool
         mmioAscend(hmmio, &mmckinfoSubchunk, 0);
     }
 
+    // all keygroups are read, so decode their samples concurrently before creating the zones
+    std::vector<fs::path> sample_filenames;
+    for (int k = 0; k < s6k_prg.n_keygroups; k++)
+    {
+        for (int z = 0; z < 4; z++)
+        {
+            if (zone_present[k][z])
+                sample_filenames.push_back(
+                    build_path(path, (char *)(s6k_zone[k][z].samplename), "wav"));
+        }
+    }
+    auto preloaded = preload_samples(sample_filenames);
+
+    std::lock_guard g(cs_patch);
     for (int k = 0; k < s6k_prg.n_keygroups; k++)
     {
         bool do_vel_xfade = (s6k_kloc[k].zone_xfade == 1);
@@ -344,7 +360,8 @@ bool sampler::load_akai_s6k_program(const fs::path &filename, char channel, bool
                 fs::path sample_filename =
                     build_path(path, (char *)(s6k_zone[k][z].samplename), "wav");
                 int newzone;
-                if (add_zone(sample_filename, &newzone, channel, true))
+                if (!preloaded.failed_to_load(sample_filename) &&
+                    add_zone(sample_filename, &newzone, channel, true))
                 {
                     zones[newzone].key_low = s6k_kloc[k].key_low + (keylo_xfade >> 1);
                     zones[newzone].key_high =
@@ -413,5 +430,6 @@ bool sampler::load_akai_s6k_program(const fs::path &filename, char channel, bool
             }
         }
     }
+    release_unused_samples(preloaded);
     return true;
 }
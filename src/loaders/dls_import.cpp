@@ -17,6 +17,9 @@
 
 #include "infrastructure/file_map_view.h"
 
+#include <mutex>
+#include <vector>
+
 #pragma pack(push, 1)
 
 struct giga_3lnk
@@ -160,34 +163,34 @@ int get_dls_patchlist(const fs::path &filename, void **plist)
     return result;
 }
 
-bool sampler::parse_dls_preset(void *data, size_t filesize, char channel, int patch,
-                               const fs::path &filename)
+// a (sub-)region of a DLS/GIG instrument, turned into a zone once all samples are decoded
+struct dls_region
 {
-    if (patch < 0)
-        return false;
-    size_t datasize;
-    scxt::Memfile::RIFFMemFile mf(data, filesize);
-    if (!mf.riff_descend_RIFF_or_LIST('DLS ', &datasize))
-        return false;
-    off_t startpos = mf.TellI(); // store for later use
-    if (!mf.riff_descend_RIFF_or_LIST('lins', &datasize))
-        return false;
-    if (!mf.riff_descend_RIFF_or_LIST('ins ', &datasize, patch))
-        return false;
-    off_t startins = mf.TellI(); // store for later use
-    if (!mf.riff_descend('insh', &datasize))
-        return false;
-    INSTHEADER insh;
-    mf.Read(&insh, sizeof(insh));
-    mf.SeekI(startins);
-    if (!mf.riff_descend_RIFF_or_LIST('lrgn', &datasize))
-        return false;
-    size_t startrgn = mf.TellI();
+    unsigned int sample_index;
+    RGNHEADER rgnh;
+    WSMPL wsmp;
+    bool giga;
+    giga_3lnk _3lnk;
+    giga_3ewa _3ewa;
+    struct
+    {
+        unsigned int low, high, type, i;
+    } dims[5];
+};
 
-    // ok so far, init part
-    part_init(channel, true, true);
+static fs::path dls_sample_path(const fs::path &filename, unsigned int sample_index)
+{
+    std::string fn = path_to_string(filename);
+    fn += "|";
+    fn += std::to_string(sample_index);
+    return string_to_path(fn);
+}
 
-    for (unsigned int i = 0; i < insh.cRegions; i++)
+static bool parse_dls_regions(scxt::Memfile::RIFFMemFile &mf, unsigned int n_regions,
+                              std::vector<dls_region> &regions)
+{
+    size_t datasize;
+    for (unsigned int i = 0; i < n_regions; i++)
     {
         if (!mf.riff_descend_RIFF_or_LIST('rgn ', &datasize))
             return false;
@@ -239,121 +242,32 @@ bool sampler::parse_dls_preset(void *data, size_t filesize, char channel, int pa
                     return false;
                 if (!mf.Read(&_3ewa, sizeof(_3ewa)))
                     return false;
-                {
-                    bool do_load = true;
-                    struct
-                    {
-                        unsigned int low, high, type, i;
-                    } dims[5];
 
-                    for (unsigned int k = 0; k < 5; k++)
-                    {
-                        dims[k].type = _3lnk.Split[k].DimensionType;
-                        unsigned int e = j >> _3lnk.Split[k].DimensionBitStart;
-                        unsigned int n = 1 << _3lnk.Split[k].DimensionBitCount;
-                        e = e & (n - 1);
-                        dims[k].i = e;
-                        unsigned int stepsize = 0x80 >> _3lnk.Split[k].DimensionBitCount;
-                        dims[k].low = limit_range(e * stepsize, 0U, 127U);
-                        dims[k].high = limit_range((e + 1) * stepsize - 1, 0U, 127U);
-                        if ((dims[k].type == 0x80) && (e > 0))
-                            do_load = false;
-                    }
+                dls_region r;
+                bool do_load = true;
+                for (unsigned int k = 0; k < 5; k++)
+                {
+                    r.dims[k].type = _3lnk.Split[k].DimensionType;
+                    unsigned int e = j >> _3lnk.Split[k].DimensionBitStart;
+                    unsigned int n = 1 << _3lnk.Split[k].DimensionBitCount;
+                    e = e & (n - 1);
+                    r.dims[k].i = e;
+                    unsigned int stepsize = 0x80 >> _3lnk.Split[k].DimensionBitCount;
+                    r.dims[k].low = limit_range(e * stepsize, 0U, 127U);
+                    r.dims[k].high = limit_range((e + 1) * stepsize - 1, 0U, 127U);
+                    if ((r.dims[k].type == 0x80) && (e > 0))
+                        do_load = false;
+                }
 
-                    int newzone;
-                    std::string fn = path_to_string(filename);
-                    fn += "|";
-                    fn += std::to_string(_3lnk.RegionSampleID[j]);
-                    if (do_load && add_zone(string_to_path(fn), &newzone, channel))
-                    {
-                        sample_zone *z = &zones[newzone];
-                        z->key_low = rgnh.RangeKey.usLow;
-                        z->key_high = rgnh.RangeKey.usHigh;
-                        z->velocity_low = rgnh.RangeVelocity.usLow;
-                        z->velocity_high = rgnh.RangeVelocity.usHigh;
-                        z->mute_group = rgnh.usKeyGroup;
-                        z->key_root = wsmp.usUnityNote;
-                        z->AEG.attack = timecent_to_envtime_GIGA(_3ewa.EG1Attack);
-                        z->AEG.decay = timecent_to_envtime_GIGA(_3ewa.EG1Decay1);
-                        z->AEG.release = timecent_to_envtime_GIGA(_3ewa.EG1Release);
-                        z->AEG.sustain = 0.001f * ((_3ewa.EG1Sustain1 >> 16) & 0xffff);
-                        //_3ewa.
-                        if (_3ewa.pitchTrackDimensionBypass & 1)
-                            z->keytrack = 0.f;
-
-                        unsigned int ncid = 0;
-                        for (unsigned int k = 0; k < 5; k++)
-                        {
-                            if (!_3lnk.Split[k].DimensionBitCount)
-                                break;
-
-                            unsigned ncsource = 0;
-                            switch (_3lnk.Split[k].DimensionType)
-                            {
-                            case 0x80: // dimension_samplechannel
-                                break;
-                            case 0x81: // dimension_layer
-                                break;
-                            case 0x82:
-                                z->velocity_low = dims[k].low;
-                                z->velocity_high = dims[k].high;
-                                break;
-                            case 0x83:
-                                ncsource = get_mm_source_id("channelAT");
-                                break;
-                            case 0x84: // dimension_releasetrigger
-                                break;
-                            case 0x85: // dimension_keyboard
-                                break;
-                            case 0x86: // dimension_roundrobin
-                                break;
-                            case 0x87: // dimension_random
-                                break;
-                            case 0x01:
-                                ncsource = get_mm_source_id("modwheel");
-                                break;
-                            /*case 0x04:
-                                    ncsource = get_mm_source_id("footpedal");
-                                    break;*/
-                            case 0x43: // dimension_softpedal (MIDI Controller 67)
-                                break;
-                            case 0x10:
-                                ncsource = get_mm_source_id("c1");
-                                break;
-                            case 0x11:
-                                ncsource = get_mm_source_id("c2");
-                                break;
-                            case 0x12:
-                                ncsource = get_mm_source_id("c3");
-                                break;
-                            case 0x13:
-                                ncsource = get_mm_source_id("c4");
-                                break;
-                            case 0x30:
-                                ncsource = get_mm_source_id("c5");
-                                break;
-                            case 0x31:
-                                ncsource = get_mm_source_id("c6");
-                                break;
-                            case 0x32:
-                                ncsource = get_mm_source_id("c7");
-                                break;
-                            case 0x33:
-                                ncsource = get_mm_source_id("c8");
-                                break;
-                            };
-                            if (ncsource)
-                            {
-                                if (ncid < nc_entries)
-                                {
-                                    z->nc[ncid].source = ncsource;
-                                    z->nc[ncid].low = dims[k].low;
-                                    z->nc[ncid].high = dims[k].high;
-                                    ncid++;
-                                }
-                            }
-                        }
-                    }
+                if (do_load)
+                {
+                    r.sample_index = _3lnk.RegionSampleID[j];
+                    r.rgnh = rgnh;
+                    r.wsmp = wsmp;
+                    r.giga = true;
+                    r._3lnk = _3lnk;
+                    r._3ewa = _3ewa;
+                    regions.push_back(r);
                 }
                 mf.SeekI(nextewl);
             }
@@ -361,22 +275,164 @@ bool sampler::parse_dls_preset(void *data, size_t filesize, char channel, int pa
         else
         {
             // no sub-regions, read as normal DLS
+            dls_region r;
+            memset(&r, 0, sizeof(r));
+            r.sample_index = wlnk.ulTableIndex;
+            r.rgnh = rgnh;
+            r.wsmp = wsmp;
+            r.giga = false;
+            regions.push_back(r);
+        }
+        mf.SeekI(next);
+    }
+    return true;
+}
+
+bool sampler::parse_dls_preset(void *data, size_t filesize, char channel, int patch,
+                               const fs::path &filename)
+{
+    if (patch < 0)
+        return false;
+    size_t datasize;
+    scxt::Memfile::RIFFMemFile mf(data, filesize);
+    if (!mf.riff_descend_RIFF_or_LIST('DLS ', &datasize))
+        return false;
+    off_t startpos = mf.TellI(); // store for later use
+    if (!mf.riff_descend_RIFF_or_LIST('lins', &datasize))
+        return false;
+    if (!mf.riff_descend_RIFF_or_LIST('ins ', &datasize, patch))
+        return false;
+    off_t startins = mf.TellI(); // store for later use
+    if (!mf.riff_descend('insh', &datasize))
+        return false;
+    INSTHEADER insh;
+    mf.Read(&insh, sizeof(insh));
+    mf.SeekI(startins);
+    if (!mf.riff_descend_RIFF_or_LIST('lrgn', &datasize))
+        return false;
+    size_t startrgn = mf.TellI();
+
+    // ok so far, init part
+    part_init(channel, true, true);
+
+    // collect the regions first, so the samples can be decoded concurrently before the zones
+    // are created in one step. Regions read before a parse error are still added.
+    std::vector<dls_region> regions;
+    bool parsed = parse_dls_regions(mf, insh.cRegions, regions);
+
+    std::vector<fs::path> sample_paths;
+    for (auto &r : regions)
+        sample_paths.push_back(dls_sample_path(filename, r.sample_index));
+    auto preloaded = preload_samples(sample_paths);
+
+    {
+        std::lock_guard g(cs_patch);
+        for (auto &r : regions)
+        {
             int newzone;
-            std::string fn = path_to_string(filename);
-            fn += "|";
-            fn += std::to_string(wlnk.ulTableIndex);
-            if (add_zone(string_to_path(fn), &newzone, channel))
+            auto sample_path = dls_sample_path(filename, r.sample_index);
+            if (preloaded.failed_to_load(sample_path) || !add_zone(sample_path, &newzone, channel))
+                continue;
+
+            auto &rgnh = r.rgnh;
+            auto &wsmp = r.wsmp;
+            sample_zone *z = &zones[newzone];
+            z->key_low = rgnh.RangeKey.usLow;
+            z->key_high = rgnh.RangeKey.usHigh;
+            z->velocity_low = rgnh.RangeVelocity.usLow;
+            z->velocity_high = rgnh.RangeVelocity.usHigh;
+            z->mute_group = rgnh.usKeyGroup;
+            z->key_root = wsmp.usUnityNote;
+
+            if (!r.giga)
+                continue;
+
+            auto &_3lnk = r._3lnk;
+            auto &_3ewa = r._3ewa;
+            auto &dims = r.dims;
+            z->AEG.attack = timecent_to_envtime_GIGA(_3ewa.EG1Attack);
+            z->AEG.decay = timecent_to_envtime_GIGA(_3ewa.EG1Decay1);
+            z->AEG.release = timecent_to_envtime_GIGA(_3ewa.EG1Release);
+            z->AEG.sustain = 0.001f * ((_3ewa.EG1Sustain1 >> 16) & 0xffff);
+            //_3ewa.
+            if (_3ewa.pitchTrackDimensionBypass & 1)
+                z->keytrack = 0.f;
+
+            unsigned int ncid = 0;
+            for (unsigned int k = 0; k < 5; k++)
             {
-                sample_zone *z = &zones[newzone];
-                z->key_low = rgnh.RangeKey.usLow;
-                z->key_high = rgnh.RangeKey.usHigh;
-                z->velocity_low = rgnh.RangeVelocity.usLow;
-                z->velocity_high = rgnh.RangeVelocity.usHigh;
-                z->mute_group = rgnh.usKeyGroup;
-                z->key_root = wsmp.usUnityNote;
+                if (!_3lnk.Split[k].DimensionBitCount)
+                    break;
+
+                unsigned ncsource = 0;
+                switch (_3lnk.Split[k].DimensionType)
+                {
+                case 0x80: // dimension_samplechannel
+                    break;
+                case 0x81: // dimension_layer
+                    break;
+                case 0x82:
+                    z->velocity_low = dims[k].low;
+                    z->velocity_high = dims[k].high;
+                    break;
+                case 0x83:
+                    ncsource = get_mm_source_id("channelAT");
+                    break;
+                case 0x84: // dimension_releasetrigger
+                    break;
+                case 0x85: // dimension_keyboard
+                    break;
+                case 0x86: // dimension_roundrobin
+                    break;
+                case 0x87: // dimension_random
+                    break;
+                case 0x01:
+                    ncsource = get_mm_source_id("modwheel");
+                    break;
+                /*case 0x04:
+                        ncsource = get_mm_source_id("footpedal");
+                        break;*/
+                case 0x43: // dimension_softpedal (MIDI Controller 67)
+                    break;
+                case 0x10:
+                    ncsource = get_mm_source_id("c1");
+                    break;
+                case 0x11:
+                    ncsource = get_mm_source_id("c2");
+                    break;
+                case 0x12:
+                    ncsource = get_mm_source_id("c3");
+                    break;
+                case 0x13:
+                    ncsource = get_mm_source_id("c4");
+                    break;
+                case 0x30:
+                    ncsource = get_mm_source_id("c5");
+                    break;
+                case 0x31:
+                    ncsource = get_mm_source_id("c6");
+                    break;
+                case 0x32:
+                    ncsource = get_mm_source_id("c7");
+                    break;
+                case 0x33:
+                    ncsource = get_mm_source_id("c8");
+                    break;
+                };
+                if (ncsource)
+                {
+                    if (ncid < nc_entries)
+                    {
+                        z->nc[ncid].source = ncsource;
+                        z->nc[ncid].low = dims[k].low;
+                        z->nc[ncid].high = dims[k].high;
+                        ncid++;
+                    }
+                }
             }
         }
-        mf.SeekI(next);
     }
-    return true;
+    release_unused_samples(preloaded);
+
+    return parsed;
 }
@@ -15,15 +15,20 @@
 #include "riff_memfile.h"
 #include "riff_wave.h"
 #include "sampler_state.h"
+#include <algorithm>
 #include <assert.h>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <vector>
 
 size_t sample::SaveWaveChunk(void *data)
 {
     // save the sample in a WAVE-compatible chunk
     // both used for persistance and .wav export
-    size_t samplesize = channels * sample_length * (UseInt16 ? 2 : 4);
-    size_t datasize = (8 + sizeof(wavheader)) + (8 + samplesize) +
+    size_t samplesize = (size_t)channels * sample_length * get_bytes_per_sample();
+    // odd sized (24 bit) data is followed by a pad byte, as RIFF chunks must be
+    size_t datasize = (8 + sizeof(wavheader)) + (8 + samplesize + (samplesize & 1)) +
                       (12 + scxt::Memfile::RIFFMemFile::RIFFTextChunkSize(name));
 
     if (!data)
@@ -32,10 +37,11 @@ size_t sample::SaveWaveChunk(void *data)
     scxt::Memfile::RIFFMemFile mf(data, datasize);
 
     wavheader header;
-    header.wFormatTag = vt_write_int16LE(UseInt16 ? WAVE_FORMAT_PCM : WAVE_FORMAT_IEEE_FLOAT);
-    header.wBitsPerSample = vt_write_int16LE(UseInt16 ? 16 : 32);
+    int bytes = get_bytes_per_sample();
+    header.wFormatTag = vt_write_int16LE((bytes < 4) ? WAVE_FORMAT_PCM : WAVE_FORMAT_IEEE_FLOAT);
+    header.wBitsPerSample = vt_write_int16LE(bytes * 8);
     header.nChannels = vt_write_int16LE(channels);
-    header.nBlockAlign = vt_write_int16LE(channels * (UseInt16 ? 2 : 4));
+    header.nBlockAlign = vt_write_int16LE(channels * bytes);
     header.nSamplesPerSec = vt_write_int32LE(this->sample_rate);
     header.nAvgBytesPerSec = vt_write_int32LE(header.nBlockAlign * header.nSamplesPerSec);
 
@@ -48,15 +54,35 @@ size_t sample::SaveWaveChunk(void *data)
     if (UseInt16)
     {
         short *sp = (short *)mf.GetPtr();
+        std::vector<short> decoded;
         for (int c = 0; c < channels; c++)
         {
             short *rp = GetSamplePtrI16(c);
+            if (is_compressed())
+            {
+                decoded.resize(sample_length);
+                read_i16(c, decoded.data());
+                rp = decoded.data();
+            }
             for (int s = 0; s < sample_length; s++)
             {
                 sp[s * channels + c] = vt_write_int16LE(rp[s]);
             }
         }
     }
+    else if (UseInt24)
+    {
+        // already little endian
+        uint8_t *bp = (uint8_t *)mf.GetPtr();
+        for (int c = 0; c < channels; c++)
+        {
+            uint8_t *rp = GetSamplePtrI24(c);
+            for (int s = 0; s < sample_length; s++)
+                memcpy(bp + 3 * (s * channels + c), rp + 3 * s, 3);
+        }
+        if (samplesize & 1)
+            bp[samplesize] = 0;
+    }
     else
     {
         float *fp = (float *)mf.GetPtr();
@@ -98,47 +124,229 @@ bool sample::save_wave_file(const fs::path &filename)
     return true;
 }
 
+namespace
+{
+// Wave64 ids are GUIDs. The RIFF ones are the fourcc followed by the same 12 bytes, except the
+// outer 'riff' (and 'list', which we don't read).
+const uint8_t w64_riff_guid[16] = {'r',  'i',  'f',  'f',  0x2E, 0x91, 0xCF, 0x11,
+                                   0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00};
+const uint8_t w64_wave_guid[16] = {'w',  'a',  'v',  'e',  0xF3, 0xAC, 0xD3, 0x11,
+                                   0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+
+int read_fourcc(const uint8_t *p)
+{
+    int32_t v;
+    memcpy(&v, p, 4);
+    return vt_read_int32BE(v);
+}
+
+uint32_t read_uint32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return vt_read_int32LE(v);
+}
+
+uint64_t read_uint64(const uint8_t *p)
+{
+    return (uint64_t)read_uint32(p) | ((uint64_t)read_uint32(p + 4) << 32);
+}
+
+struct wave_chunk
+{
+    const uint8_t *data{nullptr};
+    size_t size{0};
+};
+
+/*
+ * The chunks parse_riff_wave() reads, located in one pass over the file instead of
+ * re-descending from the top for each of them. The first occurrence of each wins.
+ */
+struct wave_chunks
+{
+    wave_chunk fmt, data, smpl, inst, acid, info, cue, strc;
+    const uint8_t *end{nullptr};
+
+    void add(int tag, const uint8_t *d, size_t s)
+    {
+        wave_chunk *c = nullptr;
+        switch (tag)
+        {
+        case 'fmt ':
+            c = &fmt;
+            break;
+        case 'data':
+            c = &data;
+            break;
+        case 'smpl':
+            c = &smpl;
+            break;
+        case 'inst':
+            c = &inst;
+            break;
+        case 'acid':
+            c = &acid;
+            break;
+        case 'cue ':
+            c = &cue;
+            break;
+        case 'strc':
+            c = &strc;
+            break;
+        case 'LIST':
+            if (s >= 4 && (size_t)(end - d) >= 4 && read_fourcc(d) == 'INFO')
+            {
+                d += 4;
+                s -= 4;
+                c = &info;
+            }
+            break;
+        }
+        if (c && !c->data)
+        {
+            c->data = d;
+            c->size = s;
+        }
+    }
+
+    // true if the chunk exists and holds at least n bytes within the file
+    bool has(const wave_chunk &c, size_t n) const
+    {
+        return c.data && c.size >= n && (size_t)(end - c.data) >= n;
+    }
+};
+
+// a 0xFFFFFFFF size in an RF64 file is looked up in the ds64 chunk
+uint64_t rf64_chunk_size(int tag, const wave_chunk &ds64)
+{
+    if (ds64.size < sizeof(rf64_ds64_chunk))
+        return 0;
+    if (tag == 'data')
+        return read_uint64(ds64.data + offsetof(rf64_ds64_chunk, dataSize));
+
+    size_t n = read_uint32(ds64.data + offsetof(rf64_ds64_chunk, tableLength));
+    n = std::min(n, (ds64.size - sizeof(rf64_ds64_chunk)) / sizeof(rf64_ds64_entry));
+    auto e = ds64.data + sizeof(rf64_ds64_chunk);
+    for (size_t i = 0; i < n; i++, e += sizeof(rf64_ds64_entry))
+    {
+        if (read_fourcc(e) == tag)
+            return read_uint64(e + offsetof(rf64_ds64_entry, chunkSize));
+    }
+    return 0;
+}
+
+void scan_riff_chunks(const uint8_t *p, wave_chunks &wc, bool rf64)
+{
+    wave_chunk ds64;
+    while (wc.end - p >= 8)
+    {
+        int tag = read_fourcc(p);
+        uint64_t size = read_uint32(p + 4);
+        const uint8_t *d = p + 8;
+        size_t avail = wc.end - d;
+
+        if (rf64 && size == 0xFFFFFFFF)
+            size = rf64_chunk_size(tag, ds64);
+        if (rf64 && tag == 'ds64' && !ds64.data)
+        {
+            ds64.data = d;
+            ds64.size = std::min((size_t)size, avail);
+        }
+
+        wc.add(tag, d, (size_t)std::min(size, (uint64_t)SIZE_MAX));
+        if (size >= avail)
+            break;
+        p = d + size + (size & 1);
+    }
+}
+
+void scan_w64_chunks(const uint8_t *p, wave_chunks &wc)
+{
+    while ((size_t)(wc.end - p) >= sizeof(w64_chunk_header))
+    {
+        uint64_t size = read_uint64(p + offsetof(w64_chunk_header, size));
+        if (size < sizeof(w64_chunk_header))
+            break;
+
+        const uint8_t *d = p + sizeof(w64_chunk_header);
+        size_t avail = wc.end - d;
+        uint64_t datasize = size - sizeof(w64_chunk_header);
+
+        if (!memcmp(p + 4, w64_wave_guid + 4, 12))
+            wc.add(read_fourcc(p), d, (size_t)std::min(datasize, (uint64_t)SIZE_MAX));
+        if (datasize >= avail)
+            break;
+        p += (size + 7) & ~(uint64_t)7; // chunks are 8 byte aligned
+    }
+}
+
+bool scan_wave_file(const uint8_t *p, size_t filesize, bool skip_riffchunk, wave_chunks &wc)
+{
+    wc.end = p + filesize;
+    if (skip_riffchunk)
+    {
+        scan_riff_chunks(p, wc, false);
+        return true;
+    }
+
+    if (filesize >= 12 && read_fourcc(p + 8) == 'WAVE')
+    {
+        int tag = read_fourcc(p);
+        if (tag == 'RIFF' || tag == 'RF64' || tag == 'BW64')
+        {
+            scan_riff_chunks(p + 12, wc, tag != 'RIFF');
+            return true;
+        }
+    }
+
+    if (filesize >= 40 && !memcmp(p, w64_riff_guid, 16) && !memcmp(p + 24, w64_wave_guid, 16))
+    {
+        scan_w64_chunks(p + 40, wc);
+        return true;
+    }
+
+    return false;
+}
+} // namespace
+
 // TODO parse INAM etc etc metadata
 bool sample::parse_riff_wave(void *data, size_t filesize, bool skip_riffchunk)
 {
-    size_t datasize;
-    scxt::Memfile::RIFFMemFile mf(data, filesize);
-    if (!skip_riffchunk && !mf.riff_descend_RIFF_or_LIST('WAVE', &datasize))
+    wave_chunks wc;
+    if (!scan_wave_file((const uint8_t *)data, filesize, skip_riffchunk, wc))
         return false;
 
     wavheader wh;
-    off_t wr = mf.TellI();
-    if (!mf.riff_descend('fmt ', &datasize))
+    if (!wc.has(wc.fmt, sizeof(wavheader)))
         return false;
 
     // read header
-    mf.Read(&wh, sizeof(wavheader));
+    memcpy(&wh, wc.fmt.data, sizeof(wavheader));
 
     if (!wh.nSamplesPerSec)
         return false;
-    if (!wh.nChannels)
-        return false;
-    if (!wh.wBitsPerSample)
+    if (wh.nChannels <= 0)
         return false;
-
-    mf.SeekI(wr);
-    if (!mf.riff_descend('data', &datasize))
+    if (wh.wBitsPerSample <= 0)
         return false;
 
-    int32_t WaveDataSize = datasize;
+    size_t WaveDataSize = wc.data.size;
     if (!WaveDataSize)
         return false;
-    int32_t WaveDataSamples = 8 * WaveDataSize / (wh.wBitsPerSample * wh.nChannels);
 
     /* get pointer to the sampledata */
 
-    unsigned char *loaddata = (unsigned char *)mf.ReadPtr(WaveDataSize);
-    if (!loaddata)
+    if (!wc.has(wc.data, WaveDataSize))
         return false;
+    unsigned char *loaddata = (unsigned char *)wc.data.data;
 
-    if (!SetMeta(wh.nChannels, wh.nSamplesPerSec, WaveDataSamples))
+    // sample positions are still 32 bit further down, so refuse anything longer than that
+    uint64_t WaveDataSamples = 8 * (uint64_t)WaveDataSize / (wh.wBitsPerSample * wh.nChannels);
+    if (WaveDataSamples > (uint64_t)(INT32_MAX - FIRipol_N))
         return false;
 
+    if (!SetMeta(wh.nChannels, wh.nSamplesPerSec, WaveDataSamples))
+        return false;
     if (wh.wFormatTag == WAVE_FORMAT_PCM)
     {
         if (wh.wBitsPerSample == 8)
@@ -215,20 +423,20 @@ bool sample::parse_riff_wave(void *data, size_t filesize, bool skip_riffchunk)
     this->sample_loaded = true;
 
     // read smpl chunk
-    mf.SeekI(wr, scxt::Memfile::mf_FromStart);
-    if (mf.riff_descend('smpl', &datasize))
+    if (wc.has(wc.smpl, sizeof(SamplerChunk)))
     {
         SamplerChunk smpl_chunk;
         SampleLoop smpl_loop;
 
-        mf.Read(&smpl_chunk, sizeof(SamplerChunk));
+        memcpy(&smpl_chunk, wc.smpl.data, sizeof(SamplerChunk));
         meta.key_root = smpl_chunk.dwMIDIUnityNote & 0xFF;
         meta.rootkey_present = true;
 
-        if (smpl_chunk.cSampleLoops > 0)
+        if (smpl_chunk.cSampleLoops > 0 &&
+            wc.has(wc.smpl, sizeof(SamplerChunk) + sizeof(SampleLoop)))
         {
             meta.loop_present = true;
-            mf.Read(&smpl_loop, sizeof(SampleLoop));
+            memcpy(&smpl_loop, wc.smpl.data + sizeof(SamplerChunk), sizeof(SampleLoop));
             // smpl_loop.dwEnd++;	// SC wants the loop end point to be the first sample AFTER
             // the loop
             meta.loop_start = smpl_loop.dwStart;
@@ -241,11 +449,10 @@ bool sample::parse_riff_wave(void *data, size_t filesize, bool skip_riffchunk)
     }
 
     // read inst chunk
-    mf.SeekI(wr);
-    if (mf.riff_descend('inst', &datasize))
+    if (wc.has(wc.inst, sizeof(wave_inst_chunk)))
     {
         wave_inst_chunk INST;
-        mf.Read(&INST, sizeof(INST));
+        memcpy(&INST, wc.inst.data, sizeof(INST));
         meta.key_root = INST.key_root;
         meta.key_low = INST.key_low;
         meta.key_high = INST.key_high;
@@ -258,19 +465,19 @@ bool sample::parse_riff_wave(void *data, size_t filesize, bool skip_riffchunk)
     }
 
     // read acid chunk
-    mf.SeekI(wr);
-    if (mf.riff_descend('acid', &datasize))
+    if (wc.has(wc.acid, sizeof(wave_acid_chunk)))
     {
         wave_acid_chunk ACID;
-        mf.Read(&ACID, sizeof(ACID));
+        memcpy(&ACID, wc.acid.data, sizeof(ACID));
         if (!(ACID.type & 0x01))
             meta.n_beats = ACID.n_beats;
     }
 
     // read LIST:INFO chunk & subchunks
-    mf.SeekI(wr);
-    if (mf.RIFFDescendSearch('INFO'))
+    if (wc.has(wc.info, 8))
     {
+        scxt::Memfile::RIFFMemFile mf(wc.info.data,
+                                      std::min(wc.info.size, (size_t)(wc.end - wc.info.data)));
         size_t chunksize;
         int tag;
         while (mf.RIFFPeekChunk(&tag, &chunksize))
@@ -285,14 +492,14 @@ bool sample::parse_riff_wave(void *data, size_t filesize, bool skip_riffchunk)
                 break;
             };
         }
-        mf.RIFFAscend(true);
     }
 
     // read cuepoints (as slices)
-    mf.SeekI(wr);
-    if (mf.riff_descend('cue ', &datasize))
+    if (wc.has(wc.cue, 4))
     {
-        int32_t cuepoints = mf.ReadDWORD();
+        int32_t cuepoints = read_uint32(wc.cue.data);
+        size_t cuespace = std::min(wc.cue.size, (size_t)(wc.end - wc.cue.data)) - 4;
+        cuepoints = std::min((size_t)std::max(cuepoints, 0), cuespace / sizeof(CuePoint));
 
         if (cuepoints > 1)
         {
@@ -306,46 +513,49 @@ bool sample::parse_riff_wave(void *data, size_t filesize, bool skip_riffchunk)
             for (int i = 0; i < cuepoints; i++)
             {
                 CuePoint cp;
-                mf.Read(&cp, sizeof(CuePoint));
+                memcpy(&cp, wc.cue.data + 4 + i * sizeof(CuePoint), sizeof(CuePoint));
                 meta.slice_start[i] = cp.dwSampleOffset;
                 if (i)
                     meta.slice_end[i - 1] = cp.dwSampleOffset;
             }
         }
     }
-    else
+    else if (wc.has(wc.strc, sizeof(wave_strc_header)))
     {
         // read acidpoints (as slices)
-        mf.SeekI(wr);
-        if (mf.riff_descend('strc', &datasize))
+        wave_strc_header header;
+        memcpy(&header, wc.strc.data, sizeof(header));
+        int32_t subchunks = header.subchunks - 1; // first entry seem different
+        size_t strcspace = std::min(wc.strc.size, (size_t)(wc.end - wc.strc.data)) -
+                           sizeof(wave_strc_header);
+        if (strcspace >= sizeof(wave_strc_entry))
+            subchunks = std::min((size_t)std::max(subchunks, 0),
+                                 strcspace / sizeof(wave_strc_entry) - 1);
+        else
+            subchunks = 0;
+
+        if (subchunks > 1)
         {
-            wave_strc_header header;
-            mf.Read(&header, sizeof(header));
-            int32_t subchunks = header.subchunks - 1; // first entry seem different
+            meta.slice_start = new int[subchunks];
+            meta.slice_end = new int[subchunks];
+            meta.slice_end[subchunks - 1] = sample_length;
+            meta.n_slices = subchunks;
+            meta.playmode = pm_forward_hitpoints;
+            meta.playmode_present = true;
+
+            // skip first entry
+            auto entries = wc.strc.data + sizeof(wave_strc_header) + sizeof(wave_strc_entry);
 
-            if (subchunks > 1)
+            for (int i = 0; i < subchunks; i++)
             {
-                meta.slice_start = new int[subchunks];
-                meta.slice_end = new int[subchunks];
-                meta.slice_end[subchunks - 1] = sample_length;
-                meta.n_slices = subchunks;
-                meta.playmode = pm_forward_hitpoints;
-                meta.playmode_present = true;
-
-                mf.SeekI(sizeof(wave_strc_entry),
-                         scxt::Memfile::mf_FromCurrent); // skip first entry
-
-                for (int i = 0; i < subchunks; i++)
-                {
-                    wave_strc_entry entry;
-                    mf.Read(&entry, sizeof(wave_strc_entry));
-                    meta.slice_start[i] = entry.spos1;
-                    if (i)
-                        meta.slice_end[i - 1] = entry.spos1;
-                }
+                wave_strc_entry entry;
+                memcpy(&entry, entries + i * sizeof(wave_strc_entry), sizeof(wave_strc_entry));
+                meta.slice_start[i] = entry.spos1;
+                if (i)
+                    meta.slice_end[i - 1] = entry.spos1;
             }
         }
     }
 
     return true;
-}
\ No newline at end of file
+}
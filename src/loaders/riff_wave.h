@@ -92,6 +92,28 @@ struct wave_inst_chunk
     char vel_low, vel_high;
 };
 
+// RF64/BW64 (EBU Tech 3306) replaces 32-bit sizes of 0xFFFFFFFF with the values in this chunk
+struct rf64_ds64_chunk
+{
+    uint64_t riffSize;
+    uint64_t dataSize;
+    uint64_t sampleCount;
+    uint32_t tableLength; // followed by tableLength rf64_ds64_entry
+};
+
+struct rf64_ds64_entry
+{
+    char chunkId[4];
+    uint64_t chunkSize;
+};
+
+// Sony Wave64 uses 16-byte GUIDs as chunk ids and 64-bit chunk sizes which include this header
+struct w64_chunk_header
+{
+    uint8_t guid[16];
+    uint64_t size;
+};
+
 #pragma pack(pop)
 
 // from MMsystem.h
@@ -0,0 +1,354 @@
+/*
+** Shortcircuit XT is Free and Open Source Software
+**
+** Shortcircuit is made available under the Gnu General Public License, v3.0
+** https://www.gnu.org/licenses/gpl-3.0.en.html; The authors of the code
+** reserve the right to re-license their contributions under the MIT license in the
+** future at the discretion of the project maintainers.
+**
+** Copyright 2004-2021 by various individuals as described by the git transaction log
+**
+** All source at: https://github.com/surge-synthesizer/surge.git
+**
+** Shortcircuit was a commercial product from 2004-2018, with copyright and ownership
+** in that period held by Claes Johanson at Vember Audio. Claes made Shortcircuit
+** open source in December 2020.
+*/
+
+#include "loaders/sample_cache.h"
+#include "infrastructure/file_map_view.h"
+#include "infrastructure/sample_arena.h"
+#include "resampling.h"
+#include "sample.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+uint64_t align_cache_offset(uint64_t off)
+{
+    return (off + sample_cache_align - 1) & ~(sample_cache_align - 1);
+}
+
+// the entry still describes its source as it is on disk
+bool is_sample_cache_entry_current(const fs::path &entry)
+{
+    std::ifstream ifs(entry, std::ios::binary);
+    sample_cache_header h;
+    if (!ifs.read((char *)&h, sizeof(h)) ||
+        memcmp(h.magic, sample_cache_magic, sizeof(h.magic)) ||
+        h.version != sample_cache_version || h.path_length > 0x10000)
+        return false;
+    std::string path(h.path_length, '\0');
+    if (!ifs.read(&path[0], path.size()))
+        return false;
+
+    sample_cache_key key;
+    return get_sample_cache_key(string_to_path(path), h.source_sample_id, key) &&
+           key.size == h.source_size && key.mtime == h.source_mtime;
+}
+
+} // namespace
+
+bool get_sample_cache_key(const fs::path &source, int sample_id, sample_cache_key &key)
+{
+    std::error_code ec;
+    key.source = fs::absolute(source, ec);
+    if (ec)
+        return false;
+    key.size = fs::file_size(key.source, ec);
+    if (ec)
+        return false;
+    auto t = fs::last_write_time(key.source, ec);
+    if (ec)
+        return false;
+    key.mtime = (int64_t)t.time_since_epoch().count();
+    key.sample_id = sample_id;
+    return true;
+}
+
+fs::path get_sample_cache_file(const fs::path &cache_dir, const sample_cache_key &key)
+{
+    // FNV-1a of path and sample id names the file, the header holds the full key
+    uint64_t h = 0xcbf29ce484222325ULL;
+    auto mix = [&h](const void *d, size_t n) {
+        for (size_t i = 0; i < n; i++)
+        {
+            h ^= ((const uint8_t *)d)[i];
+            h *= 0x100000001b3ULL;
+        }
+    };
+    auto p = path_to_string(key.source);
+    mix(p.data(), p.size());
+    mix(&key.sample_id, sizeof(key.sample_id));
+
+    char fn[32];
+    snprintf(fn, sizeof(fn), "%016llx.scxtcache", (unsigned long long)h);
+    return cache_dir / fn;
+}
+
+uint64_t prune_sample_cache(const fs::path &cache_dir, uint64_t budget_bytes)
+{
+    struct entry
+    {
+        fs::path path;
+        uint64_t size;
+        fs::file_time_type used;
+    };
+    std::vector<entry> entries;
+    uint64_t total = 0, freed = 0;
+    // a writer renames its temp file within moments, older ones are debris
+    auto stale_tmp = fs::file_time_type::clock::now() - std::chrono::hours(1);
+
+    std::error_code ec;
+    auto drop = [&](const fs::path &p, uint64_t size) {
+        std::error_code rec;
+        if (fs::remove(p, rec))
+            freed += size;
+        else
+            total += size; // still taking up space
+    };
+    for (auto it = fs::directory_iterator(cache_dir, ec); !ec && it != fs::directory_iterator();
+         it.increment(ec))
+    {
+        std::error_code fec;
+        if (!it->is_regular_file(fec))
+            continue;
+        auto &p = it->path();
+        auto size = it->file_size(fec);
+        auto used = it->last_write_time(fec);
+        if (fec)
+            continue;
+        if (p.extension() == ".tmp")
+        {
+            if (used < stale_tmp)
+                drop(p, size);
+        }
+        else if (p.extension() == ".scxtcache")
+        {
+            if (!is_sample_cache_entry_current(p))
+                drop(p, size);
+            else
+            {
+                entries.push_back({p, size, used});
+                total += size;
+            }
+        }
+    }
+
+    if (budget_bytes && total > budget_bytes)
+    {
+        std::sort(entries.begin(), entries.end(),
+                  [](const entry &a, const entry &b) { return a.used < b.used; });
+        for (auto &e : entries)
+        {
+            if (total <= budget_bytes)
+                break;
+            std::error_code rec;
+            if (fs::remove(e.path, rec))
+            {
+                total -= e.size;
+                freed += e.size;
+            }
+        }
+    }
+    return freed;
+}
+
+bool sample::load_cached(const fs::path &cachefile, const sample_cache_key &key)
+{
+    std::error_code ec;
+    if (!fs::exists(cachefile, ec))
+        return false;
+
+    auto mapper = std::make_unique<scxt::FileMapView>(cachefile);
+    if (!mapper->isMapped())
+        return false;
+    auto d = (const uint8_t *)mapper->data();
+    size_t size = mapper->dataSize();
+
+    sample_cache_header h;
+    if (size < sizeof(h))
+        return false;
+    memcpy(&h, d, sizeof(h));
+
+    auto path = path_to_string(key.source);
+    if (memcmp(h.magic, sample_cache_magic, sizeof(h.magic)) ||
+        h.version != sample_cache_version || h.source_size != key.size ||
+        h.source_mtime != key.mtime || h.source_sample_id != key.sample_id ||
+        h.path_length != path.size() || size - sizeof(h) < path.size() ||
+        memcmp(d + sizeof(h), path.data(), path.size()))
+        return false;
+
+    // the data was narrowed or analysed for another configuration
+    if (h.storage != storage || h.analysis != analysis)
+        return false;
+
+    // stale or foreign files were rejected above, this guards against truncated ones
+    if (h.channels < 1 || h.channels > 2 || h.n_slices < 0 || h.bytes_per_sample < 2 ||
+        h.bytes_per_sample > 4 || h.source_length < h.sample_length)
+        return false;
+    size_t bytes = channel_bytes(h.sample_length, h.bytes_per_sample);
+    for (int c = 0; c < h.channels; c++)
+    {
+        auto off = h.channel_offset[c];
+        if (off % sample_cache_align || off > size || size - off < bytes)
+            return false;
+    }
+    if (h.slice_offset > size ||
+        (size - h.slice_offset) / (2 * sizeof(int32_t)) < (size_t)h.n_slices)
+        return false;
+
+    if (!SetMeta(h.channels, h.sample_rate, h.sample_length))
+        return false;
+
+    source_length = h.source_length;
+    UseInt16 = (h.bytes_per_sample == 2);
+    UseInt24 = (h.bytes_per_sample == 3);
+    for (int c = 0; c < h.channels; c++)
+        SampleData[c] = (void *)(d + h.channel_offset[c]);
+
+    meta.key_low = h.key_low;
+    meta.key_high = h.key_high;
+    meta.key_root = h.key_root;
+    meta.vel_low = h.vel_low;
+    meta.vel_high = h.vel_high;
+    meta.playmode = h.playmode;
+    meta.rootkey_present = h.rootkey_present;
+    meta.key_present = h.key_present;
+    meta.vel_present = h.vel_present;
+    meta.loop_present = h.loop_present;
+    meta.playmode_present = h.playmode_present;
+    meta.detune = h.detune;
+    meta.loop_start = h.loop_start;
+    meta.loop_end = h.loop_end;
+    meta.n_beats = h.n_beats;
+    if (h.n_slices)
+    {
+        meta.n_slices = h.n_slices;
+        meta.slice_start = new int[h.n_slices];
+        meta.slice_end = new int[h.n_slices];
+        memcpy(meta.slice_start, d + h.slice_offset, h.n_slices * sizeof(int32_t));
+        memcpy(meta.slice_end, d + h.slice_offset + h.n_slices * sizeof(int32_t),
+               h.n_slices * sizeof(int32_t));
+    }
+
+    {
+        // sample_memory may look to page it out from the moment it is mapped
+        std::lock_guard<std::mutex> g(residency_mutex);
+        mCacheMap = std::move(mapper);
+        // read it in now rather than on the audio thread when a voice first plays it
+        if (on_demand && sample_length > preload_frames)
+            prefault_head();
+        else
+            mCacheLocked = scxt::SampleArena::get().prepareRange(mCacheMap->data(), size);
+        update_resident_bytes();
+    }
+    // recently used as far as prune_sample_cache is concerned
+    fs::last_write_time(cachefile, fs::file_time_type::clock::now(), ec);
+    sample_loaded = true;
+    return true;
+}
+
+bool sample::save_cached(const fs::path &cachefile, const sample_cache_key &key) const
+{
+    auto path = path_to_string(key.source);
+
+    sample_cache_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, sample_cache_magic, sizeof(h.magic));
+    h.version = sample_cache_version;
+    h.path_length = path.size();
+    h.source_size = key.size;
+    h.source_mtime = key.mtime;
+    h.source_sample_id = key.sample_id;
+    h.sample_rate = sample_rate;
+    h.sample_length = sample_length;
+    h.channels = channels;
+    h.bytes_per_sample = get_bytes_per_sample();
+    h.storage = storage;
+    h.analysis = analysis;
+    h.source_length = source_length;
+
+    size_t bytes = channel_bytes(sample_length, h.bytes_per_sample);
+    uint64_t off = align_cache_offset(sizeof(h) + path.size());
+    for (int c = 0; c < channels; c++)
+    {
+        h.channel_offset[c] = off;
+        off = align_cache_offset(off + bytes);
+    }
+    h.slice_offset = off;
+
+    h.key_low = meta.key_low;
+    h.key_high = meta.key_high;
+    h.key_root = meta.key_root;
+    h.vel_low = meta.vel_low;
+    h.vel_high = meta.vel_high;
+    h.playmode = meta.playmode;
+    h.rootkey_present = meta.rootkey_present;
+    h.key_present = meta.key_present;
+    h.vel_present = meta.vel_present;
+    h.loop_present = meta.loop_present;
+    h.playmode_present = meta.playmode_present;
+    h.detune = meta.detune;
+    h.loop_start = meta.loop_start;
+    h.loop_end = meta.loop_end;
+    h.n_slices = (meta.slice_start && meta.slice_end) ? meta.n_slices : 0;
+    h.n_beats = meta.n_beats;
+
+    // write next to the entry and rename, so a reader never maps a half written file
+    std::error_code ec;
+    fs::create_directories(cachefile.parent_path(), ec);
+    auto tmp = cachefile;
+    tmp += "." + std::to_string((uintptr_t)this) + ".tmp";
+    {
+        std::ofstream ofs(tmp, std::ios::binary);
+        if (!ofs)
+            return false;
+
+        uint64_t pos = 0;
+        auto write = [&](const void *d, size_t n) {
+            ofs.write((const char *)d, n);
+            pos += n;
+        };
+        auto pad = [&](uint64_t to) {
+            static const char zeros[sample_cache_align] = {};
+            while (pos < to)
+                write(zeros, std::min(to - pos, sample_cache_align));
+        };
+
+        write(&h, sizeof(h));
+        write(path.data(), path.size());
+        for (int c = 0; c < channels; c++)
+        {
+            pad(h.channel_offset[c]);
+            write(SampleData[c], bytes);
+        }
+        pad(h.slice_offset);
+        if (h.n_slices)
+        {
+            write(meta.slice_start, h.n_slices * sizeof(int32_t));
+            write(meta.slice_end, h.n_slices * sizeof(int32_t));
+        }
+
+        if (!ofs)
+        {
+            ofs.close();
+            fs::remove(tmp, ec);
+            return false;
+        }
+    }
+    fs::rename(tmp, cachefile, ec);
+    if (ec)
+    {
+        fs::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
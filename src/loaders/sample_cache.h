@@ -0,0 +1,91 @@
+/*
+** Shortcircuit XT is Free and Open Source Software
+**
+** Shortcircuit is made available under the Gnu General Public License, v3.0
+** https://www.gnu.org/licenses/gpl-3.0.en.html; The authors of the code
+** reserve the right to re-license their contributions under the MIT license in the
+** future at the discretion of the project maintainers.
+**
+** Copyright 2004-2021 by various individuals as described by the git transaction log
+**
+** All source at: https://github.com/surge-synthesizer/surge.git
+**
+** Shortcircuit was a commercial product from 2004-2018, with copyright and ownership
+** in that period held by Claes Johanson at Vember Audio. Claes made Shortcircuit
+** open source in December 2020.
+*/
+
+#ifndef SHORTCIRCUIT_SAMPLE_CACHE_H
+#define SHORTCIRCUIT_SAMPLE_CACHE_H
+
+#include <cstdint>
+#include "filesystem/import.h"
+
+/*
+ * Decoded samples are kept on disk so a session can be reopened by mapping them rather than
+ * parsing and converting every source file again. Each cache file holds one sample in the
+ * engine's own layout:
+ *
+ * - a sample_cache_header
+ * - the utf8 source path
+ * - each channel buffer exactly as sample::AllocateI16/F32/I24 lays it out, FIRoffset margins
+ *   included, starting on a sample_cache_align boundary
+ * - n_slices slice starts followed by n_slices slice ends
+ *
+ * Everything is host endian; the cache is local to the machine which wrote it. An entry is
+ * only used while the source file's size and modification time still match.
+ *
+ * The cache is opt in (the sampleCache user default). A hit touches the entry's modification
+ * time, which prune_sample_cache uses to drop the least recently used entries when the cache
+ * grows past its budget.
+ */
+
+struct sample_cache_key
+{
+    fs::path source; // absolute
+    int sample_id;   // for files holding several samples (sf2, dls)
+    uint64_t size;
+    int64_t mtime;
+};
+
+bool get_sample_cache_key(const fs::path &source, int sample_id, sample_cache_key &key);
+fs::path get_sample_cache_file(const fs::path &cache_dir, const sample_cache_key &key);
+// deletes entries whose source changed or went away, temp files left behind by a crashed writer
+// and then the least recently used entries until the rest fit in budget_bytes (0 for no limit).
+// Returns the bytes freed. Entries mapped by another instance may survive on some platforms.
+uint64_t prune_sample_cache(const fs::path &cache_dir, uint64_t budget_bytes);
+
+static constexpr char sample_cache_magic[8] = {'S', 'C', 'X', 'T', 'S', 'M', 'P', 'C'};
+static constexpr uint32_t sample_cache_version = 3;
+static constexpr uint64_t sample_cache_align = 64;
+
+struct sample_cache_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t path_length;
+    uint64_t source_size;
+    int64_t source_mtime;
+    int32_t source_sample_id;
+    uint32_t sample_rate;
+    uint32_t sample_length;
+    uint32_t source_length; // before sample::trim_silence
+    uint16_t channels;
+    uint16_t bytes_per_sample; // 2 int16, 3 packed int24, 4 float
+    uint64_t channel_offset[2];
+    uint64_t slice_offset;
+
+    // sample::meta without the slice pointers
+    int8_t key_low, key_high, key_root;
+    int8_t vel_low, vel_high;
+    int8_t playmode;
+    uint8_t rootkey_present, key_present, vel_present, loop_present, playmode_present;
+    uint8_t storage;  // the sample_storage the data was loaded with
+    uint8_t analysis; // and the sample_analysis run on it
+    float detune;
+    uint32_t loop_start, loop_end;
+    int32_t n_slices;
+    int32_t n_beats;
+};
+
+#endif // SHORTCIRCUIT_SAMPLE_CACHE_H
@@ -53,6 +53,16 @@ const int ff_revision = 10;
 
 // rev 10: SC V2.. HUGE amount of changes
 
+namespace
+{
+// the importers fill in zones directly, so rebuild the hot index once they are done
+struct zone_index_on_exit
+{
+    sampler *s;
+    ~zone_index_on_exit() { s->invalidate_zone_index(); }
+};
+} // namespace
+
 /*bool sampler::load_file(const WCHAR *filename, char part, int *new_z)
 {
         // syntax:
@@ -78,7 +88,8 @@ bool sampler::is_multisample_file(const fs::path &file_name)
 
 bool sampler::is_multisample_extension(const std::string &extension)
 {
-    if ((!extension.compare("wav")) || (!extension.compare("aif")) ||
+    if ((!extension.compare("wav")) || (!extension.compare("w64")) ||
+        (!extension.compare("rf64")) || (!extension.compare("aif")) ||
         (!extension.compare("aiff")) || (!extension.compare("rcy")) ||
         (!extension.compare("rex")) || (!extension.compare("rx2")))
     {
@@ -92,6 +103,8 @@ bool sampler::load_file(const fs::path &file_name, int *new_g, int *new_z, bool
                         char channel, int add_zones_to_groupid, bool replace)
 {
     LOGDEBUG(mLogger) << "load_file " << file_name.string() << std::flush;
+    zone_index_on_exit reindex{this};
+    load_in_progress loading{this};
 
     // AS TODO any fn taking a filename should be fixed to propagate this path object downward
     fs::path validFileName;
@@ -1126,6 +1139,9 @@ string recursive_search(string filename, string path)
 bool sampler::load_all_from_xml(const void *data, int datasize, const fs::path &filename,
                                 bool replace, int part_id)
 {
+    zone_index_on_exit reindex{this};
+    load_in_progress loading{this};
+
     if (datasize && (*(int *)data == 'FFIR'))
     {
         return LoadAllFromRIFF(data, datasize, replace, part_id);
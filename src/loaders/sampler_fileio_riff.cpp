@@ -9,8 +9,11 @@
 #include "sampler.h"
 #include <algorithm>
 #include <assert.h>
+#include <cstring>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <unordered_map>
 
 #if WINDOWS
 #include <windows.h>
@@ -246,67 +249,204 @@ size_t RIFF_StorePart(sample_part *p, void *data)
     return partsize;
 }
 
+namespace
+{
+// the chunk store(data) writes, sized by store(0) like the RIFF_Store functions above
+template <typename F> std::vector<char> riff_chunk(F store)
+{
+    std::vector<char> c(store(nullptr));
+    store(c.data());
+    return c;
+}
+
+// the zone and part fields voices update while playing, which are never saved
+void clear_runtime_state(sample_zone &z)
+{
+    z.last_note = 0;
+    z.last_voice = 0;
+    z.alternate = 0;
+}
+void clear_runtime_state(sample_part &p)
+{
+    memset(p.userparameter_smoothed, 0, sizeof(p.userparameter_smoothed));
+    p.last_note = 0;
+}
+} // namespace
+
+/*
+ * Hosts ask for the state often, usually with little or nothing changed since the last time.
+ * Each save keeps the chunks it wrote together with the zone and part state they were written
+ * from, and the next one reuses any whose state still compares equal. Embedded sample chunks
+ * are kept on the sample itself (sample::saved_chunk) until its data changes.
+ */
+struct sampler::riff_save_cache
+{
+    struct zone_entry
+    {
+        sample_zone state;
+        int sample_index;
+        std::vector<char> chunk;
+    };
+    std::unordered_map<int, zone_entry> zones;
+    struct part_entry
+    {
+        sample_part state;
+        bool valid{false};
+        std::vector<char> chunk;
+    } parts[n_sampler_parts];
+};
+
 size_t sampler::SaveAllAsRIFF(void **dataptr, const fs::path &fileName, int PartID)
 {
+    std::lock_guard saveLock(riffSaveMutex);
+    if (!riffSaveCache)
+        riffSaveCache = std::make_shared<riff_save_cache>();
+    auto &cache = *riffSaveCache;
+
     // Phase 1
-    // Collect the size of all included zones/etc
+    // Copy what is saved while holding the patch, so the snapshot is consistent, but do nothing
+    // slower than a copy there. Samples without a chunk yet are pinned so they outlive the save.
 
     bool IsMulti = PartID < 0;
-    size_t PartsSize = 0;
-    size_t ZonesSize = 0;
-    size_t SamplesSize = 0;
-    size_t MultiSize = 0;
-    vector<size_t> PartListSize;
-    vector<size_t> SampleListSize;
-    vector<unsigned int> SampleListID;
-    vector<size_t> ZoneListSize;
+    int FirstPart = IsMulti ? 0 : PartID;
+    int NumParts = IsMulti ? n_sampler_parts : 1;
+    vector<sample_part> PartState(NumParts);
+    sample_multi MultiState;
     vector<unsigned int> ZoneListID;
-    vector<unsigned int> ZoneListSampleID;
-
-    if (IsMulti)
-    {
-        MultiSize = num_fxunits * (12 + 8 + sizeof(RIFF_FILTER) + 8 + sizeof(RIFF_FILTER_BUSSEX));
-        for (unsigned int i = 0; i < 16; i++)
-        {
-            PartListSize.push_back(RIFF_StorePart(&parts[i], 0));
-            PartsSize += PartListSize[i];
-        }
-    }
-    else
+    vector<sample_zone> ZoneState;
+    vector<int> ZoneListSampleID;
+    struct SampleEntry
     {
-        PartsSize = RIFF_StorePart(&parts[PartID], 0);
-    }
+        unsigned int id;
+        sample *pinned;
+        std::shared_ptr<const vector<char>> chunk;
+    };
+    vector<SampleEntry> SampleList;
+    bool ZoneExists[max_zones];
 
-    for (unsigned int z = 0; z < max_zones; z++)
     {
-        if (zone_exist(z) && ((zones[z].part == PartID) || (PartID < 0)))
+        std::lock_guard g(cs_patch);
+        if (IsMulti)
+            MultiState = multi;
+        for (int i = 0; i < NumParts; i++)
+            PartState[i] = parts[FirstPart + i];
+
+        for (unsigned int z = 0; z < max_zones; z++)
         {
-            size_t size = RIFF_StoreZone(&zones[z], 0, 0);
-            ZoneListSize.push_back(size);
+            ZoneExists[z] = zone_exist(z);
+            // a zone without a sample couldn't be loaded again
+            if (!ZoneExists[z] || !((zones[z].part == PartID) || (PartID < 0)) ||
+                (zones[z].sample_id < 0) || !samples[zones[z].sample_id])
+                continue;
+
             ZoneListID.push_back(z);
-            ZonesSize += size;
+            ZoneState.push_back(zones[z]);
             unsigned int s = zones[z].sample_id;
 
-            vector<unsigned int>::iterator result;
-            result = find(SampleListID.begin(), SampleListID.end(), s);
-            if (result == SampleListID.end())
+            auto result = std::find_if(SampleList.begin(), SampleList.end(),
+                                       [s](const SampleEntry &e) { return e.id == s; });
+            if (result == SampleList.end())
             {
-                size = RIFF_StoreSample(samples[s], 0);
-                ZoneListSampleID.push_back(SampleListID.size());
-                SampleListSize.push_back(size);
-                SampleListID.push_back(s);
-                SamplesSize += size;
+                ZoneListSampleID.push_back(SampleList.size());
+                SampleEntry e{s, nullptr, nullptr};
+                auto smp = samples[s];
+                if (!smp->Embedded)
+                    e.chunk = std::make_shared<vector<char>>(riff_chunk(
+                        [smp](void *data) { return RIFF_StoreSample(smp, data); }));
+                else if (!(e.chunk = smp->saved_chunk))
+                {
+                    smp->remember();
+                    smp->save_pins++;
+                    e.pinned = smp;
+                }
+                SampleList.push_back(std::move(e));
             }
             else
             {
-                ZoneListSampleID.push_back(result - SampleListID.begin());
+                ZoneListSampleID.push_back(result - SampleList.begin());
             }
         }
     }
 
     // Phase 2
+    // Write whatever changed since the last save, and the samples which have no chunk yet
+
+    for (int i = 0; i < NumParts; i++)
+    {
+        auto &e = cache.parts[FirstPart + i];
+        clear_runtime_state(PartState[i]);
+        if (!e.valid || memcmp(&e.state, &PartState[i], sizeof(sample_part)))
+        {
+            e.state = PartState[i];
+            e.chunk = riff_chunk([&e](void *data) { return RIFF_StorePart(&e.state, data); });
+            e.valid = true;
+        }
+    }
+
+    for (auto it = cache.zones.begin(); it != cache.zones.end();)
+        it = ZoneExists[it->first] ? std::next(it) : cache.zones.erase(it);
+    for (unsigned int i = 0; i < ZoneListID.size(); i++)
+    {
+        clear_runtime_state(ZoneState[i]);
+        auto f = cache.zones.find(ZoneListID[i]);
+        if (f != cache.zones.end() && f->second.sample_index == ZoneListSampleID[i] &&
+            !memcmp(&f->second.state, &ZoneState[i], sizeof(sample_zone)))
+            continue;
+
+        auto &e = cache.zones[ZoneListID[i]];
+        e.state = ZoneState[i];
+        e.sample_index = ZoneListSampleID[i];
+        e.chunk = riff_chunk(
+            [&e](void *data) { return RIFF_StoreZone(&e.state, data, e.sample_index); });
+    }
+
+    for (auto &e : SampleList)
+    {
+        // pinned, the data isn't converted or paged out while it is written out (see
+        // set_sample_storage and sample::page_out)
+        auto smp = e.pinned;
+        if (smp)
+        {
+            smp->page_in();
+            e.chunk = std::make_shared<vector<char>>(
+                riff_chunk([smp](void *data) { return RIFF_StoreSample(smp, data); }));
+            smp->saved_chunk = e.chunk;
+        }
+    }
+
+    {
+        std::lock_guard g(cs_patch);
+        for (auto &e : SampleList)
+        {
+            if (!e.pinned)
+                continue;
+            e.pinned->save_pins--;
+            if (e.pinned->forget())
+            {
+                // its zones went away during the save
+                if (samples[e.id] == e.pinned)
+                    samples[e.id] = 0;
+                sample::retire(e.pinned);
+            }
+        }
+    }
+
+    // Phase 3
     // Allocate memory block
 
+    size_t MultiSize = 0;
+    size_t PartsSize = 0;
+    size_t ZonesSize = 0;
+    size_t SamplesSize = 0;
+    if (IsMulti)
+        MultiSize = num_fxunits * (12 + 8 + sizeof(RIFF_FILTER) + 8 + sizeof(RIFF_FILTER_BUSSEX));
+    for (int i = 0; i < NumParts; i++)
+        PartsSize += cache.parts[FirstPart + i].chunk.size();
+    for (auto z : ZoneListID)
+        ZonesSize += cache.zones[z].chunk.size();
+    for (auto &e : SampleList)
+        SamplesSize += e.chunk->size();
+
     size_t datasize = 12 + (12 + ZonesSize) + (12 + SamplesSize) + (12 + PartsSize);
     if (IsMulti)
         datasize += (12 + MultiSize);
@@ -317,9 +457,13 @@ size_t sampler::SaveAllAsRIFF(void **dataptr, const fs::path &fileName, int Part
 
     // TODO, take into account vsts chunk ptr issues generosity (was Swedish, dunno)
 
-    // Phase 3
+    // Phase 4
     // Write data to RIFFMemFile
 
+    auto put = [&mf](const vector<char> &chunk) {
+        memcpy(mf.ReadPtr(chunk.size()), chunk.data(), chunk.size());
+    };
+
     mf.WriteDWORD(vt_write_int32BE('RIFF'));
     mf.WriteDWORD(datasize - 8);
     if (IsMulti)
@@ -336,44 +480,28 @@ size_t sampler::SaveAllAsRIFF(void **dataptr, const fs::path &fileName, int Part
                                     sizeof(RIFF_FILTER) + 8 + sizeof(RIFF_FILTER_BUSSEX) + 8);
 
             RIFF_FILTER f;
-            WriteChunkFltD(&f, &multi.Filter[i]);
+            WriteChunkFltD(&f, &MultiState.Filter[i]);
             mf.RIFFCreateChunk('FltD', &f, sizeof(RIFF_FILTER));
 
             RIFF_FILTER_BUSSEX send;
-            WriteChunkFltB(&send, &multi, i);
+            WriteChunkFltB(&send, &MultiState, i);
             mf.RIFFCreateChunk('FltB', &send, sizeof(RIFF_FILTER_BUSSEX));
         }
     }
 
     mf.RIFFCreateLISTHeader('PtLs', PartsSize);
-
-    if (IsMulti)
-    {
-        for (unsigned int i = 0; i < 16; i++)
-        {
-            RIFF_StorePart(&parts[i], mf.ReadPtr(PartListSize[i]));
-        }
-    }
-    else
-    {
-        RIFF_StorePart(&parts[PartID], mf.ReadPtr(PartsSize));
-    }
+    for (int i = 0; i < NumParts; i++)
+        put(cache.parts[FirstPart + i].chunk);
 
     mf.RIFFCreateLISTHeader('ZnLs', ZonesSize);
-
-    for (unsigned int i = 0; i < ZoneListID.size(); i++)
-    {
-        RIFF_StoreZone(&zones[ZoneListID[i]], mf.ReadPtr(ZoneListSize[i]), ZoneListSampleID[i]);
-    }
+    for (auto z : ZoneListID)
+        put(cache.zones[z].chunk);
 
     mf.RIFFCreateLISTHeader('SmLs', SamplesSize);
+    for (auto &e : SampleList)
+        put(*e.chunk);
 
-    for (unsigned int i = 0; i < SampleListID.size(); i++)
-    {
-        RIFF_StoreSample(samples[SampleListID[i]], mf.ReadPtr(SampleListSize[i]));
-    }
-
-    // Phase 4
+    // Phase 5
     // Write file and/or output pointer
 
     if (dataptr)
@@ -399,7 +527,7 @@ size_t sampler::SaveAllAsRIFF(void **dataptr, const fs::path &fileName, int Part
         return 1;
     }
 
-    // Phase 5
+    // Phase 6
     // Cleanup
 abort:
     free(chunkDataPtr);
@@ -409,6 +537,8 @@ abort:
 
 bool sampler::LoadAllFromRIFF(const void *data, size_t datasize, bool Replace, int PartID)
 {
+    load_in_progress loading{this};
+
     size_t chunksize;
     int tag, LISTtag;
     bool IsLIST;
@@ -605,6 +735,8 @@ bool sampler::LoadAllFromRIFF(const void *data, size_t datasize, bool Replace, i
                         delete samples[s];
                         samples[s] = 0;
                     }
+                    else if (!samples[s]->prepare_rate_conversion(conf))
+                        samples[s]->finish_load(); // as load() does
                     mf.RIFFAscend();
                 }
             }
@@ -22,10 +22,27 @@
 #include <cstring>
 #include "util/scxtstring.h"
 #include <algorithm>
+#include <mutex>
+#include <vector>
 
 using std::max;
 using std::min;
 
+// an instrument zone with the preset level offsets applied
+struct sf2_region
+{
+    genAmountType generators[sf2_numgenerators];
+    bool generators_set[sf2_numgenerators];
+};
+
+static fs::path sf2_sample_path(const fs::path &filename, int sample_id)
+{
+    std::string tmpFilename = path_to_string(filename);
+    tmpFilename += "|";
+    tmpFilename += std::to_string(sample_id);
+    return string_to_path(tmpFilename);
+}
+
 int get_sf2_patchlist(const fs::path &filename, void **plist, scxt::log::StreamLogger &logger)
 {
     HMMIO hmmio;
@@ -443,6 +460,9 @@ spawn_patch_dialog((HWND)((AEffGUIEditor*)editor)->getFrame()->getSystemWindow()
     int pb, pb_first = preset_header[pre_id].wPresetBagNdx,
             pb_end = preset_header[pre_id + 1].wPresetBagNdx;
 
+    // the bags are only traversed to collect the regions, the zones are created afterwards
+    std::vector<sf2_region> regions;
+
     // global zone settings
     genAmountType p_globalzone_generators[sf2_numgenerators];
     memset(p_globalzone_generators, 0, sizeof(p_globalzone_generators));
@@ -590,191 +610,212 @@ spawn_patch_dialog((HWND)((AEffGUIEditor*)editor)->getFrame()->getSystemWindow()
                         };
                     }
 
-                    int newzone;
                     int sample_id = i_generators[sampleID].wAmount;
-                    std::string tmpFilename = path_to_string(filename);
-                    tmpFilename += "|";
-                    tmpFilename += std::to_string(sample_id);
                     if (i_generators_set[sampleID] &&
                         ((shdr[sample_id].sfSampleType == monoSample) ||
-                         (shdr[sample_id].sfSampleType == rightSample)) &&
-                        add_zone(string_to_path(tmpFilename), &newzone, channel))
+                         (shdr[sample_id].sfSampleType == rightSample)))
                     {
-                        // sample zone loaded ok..
-                        // set all the proper parameters
-
-                        sample_zone *z = &zones[newzone];
-
-                        z->mute = false;
-                        // z->layer = (pb-pb_first) & 7;		// layer by preset-bag test
-                        // (no good)
-                        /*char *comma = strrchr(fn,'|');
-                        if (comma) strcpy(z->name, comma+1);*/
-                        strncpy_0term(z->name, shdr[sample_id].achSampleName, 32);
-
-                        // get root key from sample
-                        z->key_root = shdr[sample_id].byOriginalKey;
-                        if (z->key_root > 127)
-                            z->key_root = 60;
-
-                        z->pitchcorrection = 0.01f * shdr[sample_id].chCorrection;
-                        z->keytrack = 0.01f * i_generators[scaleTuning].shAmount;
-
-                        // set instrument level generators
-
-                        if (i_generators_set[overridingRootKey] &&
-                            (i_generators[overridingRootKey].shAmount >= 0) &&
-                            (i_generators[overridingRootKey].shAmount < 128))
-                            z->key_root = (char)i_generators[overridingRootKey].shAmount;
-
-                        if (i_generators[sampleModes].wAmount & 1)
-                            z->playmode = pm_forward_loop;
-                        else
-                            z->playmode = pm_forward;
-
-                        z->key_high = i_generators[keyRange].ranges.byHi;
-                        z->key_low = i_generators[keyRange].ranges.byLo;
-
-                        z->velocity_high = i_generators[velRange].ranges.byHi;
-                        z->velocity_low = i_generators[velRange].ranges.byLo;
-
-                        z->transpose = i_generators[coarseTune].shAmount;
-                        z->finetune = 0.01f * i_generators[fineTune].shAmount;
-
-                        z->aux[0].level =
-                            min(0.f, 0.1f * i_generators[initialAttenuation].shAmount);
-
-                        const float egmult = 1.f / 2.7778f;
-
-                        z->AEG.attack = timecent_to_envtime(i_generators[attackVolEnv].shAmount);
-                        z->AEG.hold = timecent_to_envtime(i_generators[holdVolEnv].shAmount);
-                        z->AEG.decay =
-                            timecent_to_envtime(i_generators[decayVolEnv].shAmount) * egmult;
-                        z->AEG.release =
-                            timecent_to_envtime(i_generators[releaseVolEnv].shAmount) * egmult;
-                        z->AEG.sustain = dB_to_scamp(-0.1f * i_generators[sustainVolEnv].shAmount);
-                        z->AEG.shape[0] = 0.f; // sf2 attack is linear
-                        z->AEG.shape[1] = 3.f; // but decay and release is logarithmic
-                        z->AEG.shape[2] = 3.f;
-
-                        z->EG2.attack = timecent_to_envtime(i_generators[attackModEnv].shAmount);
-                        z->EG2.hold = timecent_to_envtime(i_generators[holdModEnv].shAmount);
-                        z->EG2.decay = timecent_to_envtime(i_generators[decayModEnv].shAmount);
-                        z->EG2.release = timecent_to_envtime(i_generators[releaseModEnv].shAmount);
-                        z->EG2.sustain = 0.001f * i_generators[sustainModEnv].shAmount;
-
-                        // LFO's
-                        load_lfo_preset(lp_tri, &z->LFO[0]);
-                        load_lfo_preset(lp_tri, &z->LFO[1]);
-                        z->LFO[0].rate = log2(8.176f * powf(2, i_generators[freqModLFO].shAmount /
-                                                                   1200.f)); // mod lfo
-                        z->LFO[0].triggermode = 0;
-                        z->LFO[1].rate = log2(8.176f * powf(2, i_generators[freqVibLFO].shAmount /
-                                                                   1200.f)); // vib lfo
-                        z->LFO[1].triggermode = 0;
-
-                        int mmslot = 0;
-
-                        // modulations
-                        if (i_generators[modLfoToPitch].shAmount)
-                        {
-                            z->mm[mmslot].source = get_mm_source_id("stepLFO1");
-                            z->mm[mmslot].destination = get_mm_dest_id("pitch");
-                            z->mm[mmslot++].strength = 0.01f * i_generators[modLfoToPitch].shAmount;
-                        }
-                        if (i_generators[vibLfoToPitch].shAmount)
-                        {
-                            z->mm[mmslot].source = get_mm_source_id("stepLFO2");
-                            z->mm[mmslot].destination = get_mm_dest_id("pitch");
-                            z->mm[mmslot++].strength = 0.01f * i_generators[vibLfoToPitch].shAmount;
-                        }
-                        if (i_generators[modEnvToPitch].shAmount)
-                        {
-                            z->mm[mmslot].source = get_mm_source_id("EG2");
-                            z->mm[mmslot].destination = get_mm_dest_id("pitch");
-                            z->mm[mmslot++].strength = 0.01f * i_generators[modEnvToPitch].shAmount;
-                        }
-                        if (i_generators[modLfoToFilterFc].shAmount)
-                        {
-                            z->mm[mmslot].source = get_mm_source_id("stepLFO1");
-                            z->mm[mmslot].destination = get_mm_dest_id("f1p1");
-                            z->mm[mmslot++].strength =
-                                i_generators[modLfoToFilterFc].shAmount / 1200.f;
-                        }
-                        if (i_generators[modEnvToFilterFc].shAmount)
-                        {
-                            z->mm[mmslot].source = get_mm_source_id("EG2");
-                            z->mm[mmslot].destination = get_mm_dest_id("f1p1");
-                            z->mm[mmslot++].strength =
-                                i_generators[modEnvToFilterFc].shAmount / 1200.f;
-                        }
-                        if (i_generators[modLfoToVolume].shAmount)
-                        {
-                            z->mm[mmslot].source = get_mm_source_id("stepLFO1");
-                            z->mm[mmslot].destination = get_mm_dest_id("amplitude");
-                            z->mm[mmslot++].strength = 0.1f * i_generators[modLfoToVolume].shAmount;
-                        }
-                        if (i_generators[keynumToVolEnvHold].shAmount)
-                        {
-                            z->mm[mmslot].source = get_mm_source_id("keytrack");
-                            z->mm[mmslot].destination = get_mm_dest_id("eg1h");
-                            z->mm[mmslot++].strength =
-                                0.01f * i_generators[keynumToVolEnvHold].shAmount;
-                        }
-                        if (i_generators[keynumToVolEnvDecay].shAmount)
-                        {
-                            z->mm[mmslot].source = get_mm_source_id("keytrack");
-                            z->mm[mmslot].destination = get_mm_dest_id("eg1d");
-                            z->mm[mmslot++].strength =
-                                0.01f * i_generators[keynumToVolEnvDecay].shAmount;
-                        }
-                        if (i_generators[keynumToModEnvHold].shAmount)
-                        {
-                            z->mm[mmslot].source = get_mm_source_id("keytrack");
-                            z->mm[mmslot].destination = get_mm_dest_id("eg2h");
-                            z->mm[mmslot++].strength =
-                                0.01f * i_generators[keynumToModEnvHold].shAmount;
-                        }
-                        if (i_generators[keynumToModEnvDecay].shAmount)
-                        {
-                            z->mm[mmslot].source = get_mm_source_id("keytrack");
-                            z->mm[mmslot].destination = get_mm_dest_id("eg2d");
-                            z->mm[mmslot++].strength =
-                                0.01f * i_generators[keynumToModEnvDecay].shAmount;
-                        }
+                        regions.emplace_back();
+                        memcpy(regions.back().generators, i_generators, sizeof(i_generators));
+                        memcpy(regions.back().generators_set, i_generators_set,
+                               sizeof(i_generators_set));
+                    }
+                }
+            }
+        }
+    }
+
+    // now decode all the samples concurrently and create the zones in one step
+    std::vector<fs::path> sample_paths;
+    for (auto &region : regions)
+        sample_paths.push_back(sf2_sample_path(filename, region.generators[sampleID].wAmount));
+    auto preloaded = preload_samples(sample_paths);
+
+    {
+        std::lock_guard g(cs_patch);
+        for (auto &region : regions)
+        {
+            auto &i_generators = region.generators;
+            auto &i_generators_set = region.generators_set;
+            int newzone;
+            int sample_id = i_generators[sampleID].wAmount;
+            auto sample_path = sf2_sample_path(filename, sample_id);
+            if (!preloaded.failed_to_load(sample_path) && add_zone(sample_path, &newzone, channel))
+            {
+                // sample zone loaded ok..
+                // set all the proper parameters
+
+                sample_zone *z = &zones[newzone];
+
+                z->mute = false;
+                // z->layer = (pb-pb_first) & 7;		// layer by preset-bag test
+                // (no good)
+                /*char *comma = strrchr(fn,'|');
+                if (comma) strcpy(z->name, comma+1);*/
+                strncpy_0term(z->name, shdr[sample_id].achSampleName, 32);
+
+                // get root key from sample
+                z->key_root = shdr[sample_id].byOriginalKey;
+                if (z->key_root > 127)
+                    z->key_root = 60;
+
+                z->pitchcorrection = 0.01f * shdr[sample_id].chCorrection;
+                z->keytrack = 0.01f * i_generators[scaleTuning].shAmount;
+
+                // set instrument level generators
+
+                if (i_generators_set[overridingRootKey] &&
+                    (i_generators[overridingRootKey].shAmount >= 0) &&
+                    (i_generators[overridingRootKey].shAmount < 128))
+                    z->key_root = (char)i_generators[overridingRootKey].shAmount;
+
+                if (i_generators[sampleModes].wAmount & 1)
+                    z->playmode = pm_forward_loop;
+                else
+                    z->playmode = pm_forward;
+
+                z->key_high = i_generators[keyRange].ranges.byHi;
+                z->key_low = i_generators[keyRange].ranges.byLo;
+
+                z->velocity_high = i_generators[velRange].ranges.byHi;
+                z->velocity_low = i_generators[velRange].ranges.byLo;
+
+                z->transpose = i_generators[coarseTune].shAmount;
+                z->finetune = 0.01f * i_generators[fineTune].shAmount;
+
+                z->aux[0].level =
+                    min(0.f, 0.1f * i_generators[initialAttenuation].shAmount);
+
+                const float egmult = 1.f / 2.7778f;
+
+                z->AEG.attack = timecent_to_envtime(i_generators[attackVolEnv].shAmount);
+                z->AEG.hold = timecent_to_envtime(i_generators[holdVolEnv].shAmount);
+                z->AEG.decay =
+                    timecent_to_envtime(i_generators[decayVolEnv].shAmount) * egmult;
+                z->AEG.release =
+                    timecent_to_envtime(i_generators[releaseVolEnv].shAmount) * egmult;
+                z->AEG.sustain = dB_to_scamp(-0.1f * i_generators[sustainVolEnv].shAmount);
+                z->AEG.shape[0] = 0.f; // sf2 attack is linear
+                z->AEG.shape[1] = 3.f; // but decay and release is logarithmic
+                z->AEG.shape[2] = 3.f;
+
+                z->EG2.attack = timecent_to_envtime(i_generators[attackModEnv].shAmount);
+                z->EG2.hold = timecent_to_envtime(i_generators[holdModEnv].shAmount);
+                z->EG2.decay = timecent_to_envtime(i_generators[decayModEnv].shAmount);
+                z->EG2.release = timecent_to_envtime(i_generators[releaseModEnv].shAmount);
+                z->EG2.sustain = 0.001f * i_generators[sustainModEnv].shAmount;
+
+                // LFO's
+                load_lfo_preset(lp_tri, &z->LFO[0]);
+                load_lfo_preset(lp_tri, &z->LFO[1]);
+                z->LFO[0].rate = log2(8.176f * powf(2, i_generators[freqModLFO].shAmount /
+                                                           1200.f)); // mod lfo
+                z->LFO[0].triggermode = 0;
+                z->LFO[1].rate = log2(8.176f * powf(2, i_generators[freqVibLFO].shAmount /
+                                                           1200.f)); // vib lfo
+                z->LFO[1].triggermode = 0;
+
+                int mmslot = 0;
+
+                // modulations
+                if (i_generators[modLfoToPitch].shAmount)
+                {
+                    z->mm[mmslot].source = get_mm_source_id("stepLFO1");
+                    z->mm[mmslot].destination = get_mm_dest_id("pitch");
+                    z->mm[mmslot++].strength = 0.01f * i_generators[modLfoToPitch].shAmount;
+                }
+                if (i_generators[vibLfoToPitch].shAmount)
+                {
+                    z->mm[mmslot].source = get_mm_source_id("stepLFO2");
+                    z->mm[mmslot].destination = get_mm_dest_id("pitch");
+                    z->mm[mmslot++].strength = 0.01f * i_generators[vibLfoToPitch].shAmount;
+                }
+                if (i_generators[modEnvToPitch].shAmount)
+                {
+                    z->mm[mmslot].source = get_mm_source_id("EG2");
+                    z->mm[mmslot].destination = get_mm_dest_id("pitch");
+                    z->mm[mmslot++].strength = 0.01f * i_generators[modEnvToPitch].shAmount;
+                }
+                if (i_generators[modLfoToFilterFc].shAmount)
+                {
+                    z->mm[mmslot].source = get_mm_source_id("stepLFO1");
+                    z->mm[mmslot].destination = get_mm_dest_id("f1p1");
+                    z->mm[mmslot++].strength =
+                        i_generators[modLfoToFilterFc].shAmount / 1200.f;
+                }
+                if (i_generators[modEnvToFilterFc].shAmount)
+                {
+                    z->mm[mmslot].source = get_mm_source_id("EG2");
+                    z->mm[mmslot].destination = get_mm_dest_id("f1p1");
+                    z->mm[mmslot++].strength =
+                        i_generators[modEnvToFilterFc].shAmount / 1200.f;
+                }
+                if (i_generators[modLfoToVolume].shAmount)
+                {
+                    z->mm[mmslot].source = get_mm_source_id("stepLFO1");
+                    z->mm[mmslot].destination = get_mm_dest_id("amplitude");
+                    z->mm[mmslot++].strength = 0.1f * i_generators[modLfoToVolume].shAmount;
+                }
+                if (i_generators[keynumToVolEnvHold].shAmount)
+                {
+                    z->mm[mmslot].source = get_mm_source_id("keytrack");
+                    z->mm[mmslot].destination = get_mm_dest_id("eg1h");
+                    z->mm[mmslot++].strength =
+                        0.01f * i_generators[keynumToVolEnvHold].shAmount;
+                }
+                if (i_generators[keynumToVolEnvDecay].shAmount)
+                {
+                    z->mm[mmslot].source = get_mm_source_id("keytrack");
+                    z->mm[mmslot].destination = get_mm_dest_id("eg1d");
+                    z->mm[mmslot++].strength =
+                        0.01f * i_generators[keynumToVolEnvDecay].shAmount;
+                }
+                if (i_generators[keynumToModEnvHold].shAmount)
+                {
+                    z->mm[mmslot].source = get_mm_source_id("keytrack");
+                    z->mm[mmslot].destination = get_mm_dest_id("eg2h");
+                    z->mm[mmslot++].strength =
+                        0.01f * i_generators[keynumToModEnvHold].shAmount;
+                }
+                if (i_generators[keynumToModEnvDecay].shAmount)
+                {
+                    z->mm[mmslot].source = get_mm_source_id("keytrack");
+                    z->mm[mmslot].destination = get_mm_dest_id("eg2d");
+                    z->mm[mmslot++].strength =
+                        0.01f * i_generators[keynumToModEnvDecay].shAmount;
+                }
 
 #ifdef SCPB
-                        int mmi = 8;
-                        z->mm[mmi].source = get_mm_source_id("c1");
-                        z->mm[mmi].destination = get_mm_dest_id("f1p1");
-                        z->mm[mmi++].strength = 6.f;
-                        z->mm[mmi].source = get_mm_source_id("c2");
-                        z->mm[mmi].destination = get_mm_dest_id("f1p2");
-                        z->mm[mmi++].strength = 1.f;
+                int mmi = 8;
+                z->mm[mmi].source = get_mm_source_id("c1");
+                z->mm[mmi].destination = get_mm_dest_id("f1p1");
+                z->mm[mmi++].strength = 6.f;
+                z->mm[mmi].source = get_mm_source_id("c2");
+                z->mm[mmi].destination = get_mm_dest_id("f1p2");
+                z->mm[mmi++].strength = 1.f;
 
 #endif
 
-                        if (shdr[sample_id].sfSampleType == monoSample)
-                            z->aux[0].balance = 0.002f * i_generators[pan].shAmount;
-                        else
-                            z->aux[0].balance = 0.f;
-
-                        if (i_generators_set[initialFilterFc] &&
-                            (i_generators[initialFilterFc].wAmount > 1200))
-                            z->Filter[0].type = ft_biquadSBQ;
-                        else
-                            z->Filter[0].type = ft_none;
-
-                        z->Filter[0].p[0] =
-                            -4.45943f + float(i_generators[initialFilterFc].wAmount - 1500) / 1200;
-                        z->Filter[0].p[1] =
-                            max(0.f, min(1.f, float(i_generators[initialFilterQ].wAmount / 960)));
-                        update_zone_switches(newzone);
-                    }
-                }
+                if (shdr[sample_id].sfSampleType == monoSample)
+                    z->aux[0].balance = 0.002f * i_generators[pan].shAmount;
+                else
+                    z->aux[0].balance = 0.f;
+
+                if (i_generators_set[initialFilterFc] &&
+                    (i_generators[initialFilterFc].wAmount > 1200))
+                    z->Filter[0].type = ft_biquadSBQ;
+                else
+                    z->Filter[0].type = ft_none;
+
+                z->Filter[0].p[0] =
+                    -4.45943f + float(i_generators[initialFilterFc].wAmount - 1500) / 1200;
+                z->Filter[0].p[1] =
+                    max(0.f, min(1.f, float(i_generators[initialFilterQ].wAmount / 960)));
+                update_zone_switches(newzone);
             }
         }
     }
+    release_unused_samples(preloaded);
 
     delete preset_header;
     delete preset_bag;
@@ -21,14 +21,20 @@
 
 #include "globals.h"
 #include "sampler.h"
+#include "loaders/sfz_import.h"
 
 #include "configuration.h"
 #include "synthesis/modmatrix.h"
 #include "util/unitconversion.h"
 
-#include <map>
-#include <string>
 #include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 using std::max;
 
@@ -89,232 +95,378 @@ static int keyname_to_keynumber(const char *name) // using C4 == 60
     return 12 * octave + key;
 }
 
+namespace
+{
+/*
+ * The opcodes create_sfz_zone() knows about. They are applied to a zone in this order, so the
+ * key macro has to come before the more specific lokey/hikey/pitch_keycenter.
+ */
+enum sfz_opcode
+{
+    sfz_sample,
+    sfz_key,
+    sfz_lokey,
+    sfz_hikey,
+    sfz_pitch_keycenter,
+    sfz_lovel,
+    sfz_hivel,
+    sfz_pitch_keytrack,
+    sfz_transpose,
+    sfz_tune,
+    sfz_volume,
+    sfz_pan,
+    sfz_ampeg_attack,
+    sfz_ampeg_hold,
+    sfz_ampeg_decay,
+    sfz_ampeg_sustain,
+    sfz_ampeg_release,
+    sfz_loop_mode,
+    sfz_amp_velcurve,
+    sfz_seq_length,
+    sfz_seq_position,
+    sfz_xfin_lokey,
+    sfz_xfin_hikey,
+    sfz_xfout_lokey,
+    sfz_xfout_hikey,
+    sfz_xfin_lovel,
+    sfz_xfin_hivel,
+    sfz_xfout_lovel,
+    sfz_xfout_hivel,
+    n_sfz_opcodes
+};
+
+constexpr std::string_view sfz_opcode_names[n_sfz_opcodes] = {
+    "sample",        "key",          "lokey",        "hikey",       "pitch_keycenter",
+    "lovel",         "hivel",        "pitch_keytrack", "transpose", "tune",
+    "volume",        "pan",          "ampeg_attack", "ampeg_hold",  "ampeg_decay",
+    "ampeg_sustain", "ampeg_release", "loop_mode",   "amp_velcurve", "seq_length",
+    "seq_position",  "xfin_lokey",   "xfin_hikey",   "xfout_lokey", "xfout_hikey",
+    "xfin_lovel",    "xfin_hivel",   "xfout_lovel",  "xfout_hivel"};
+
+// Opcode names are case insensitive, and some players accept whitespace in them, so
+// "Ampeg Attack" is treated as ampeg_attack.
+constexpr char sfz_opcode_char(char c)
+{
+    if (c <= ' ')
+        return '_';
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A' + 'a';
+    return c;
+}
+
+// FNV-1a
+constexpr uint32_t sfz_opcode_hash(std::string_view name)
+{
+    uint32_t h = 2166136261u;
+    for (auto c : name)
+    {
+        h ^= (uint8_t)sfz_opcode_char(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// The smallest table size for which every known opcode gets a slot of its own
+constexpr size_t sfz_opcode_table_size = 159;
+
+struct sfz_opcode_table
+{
+    int8_t slot[sfz_opcode_table_size]{};
+    bool perfect{true};
+
+    constexpr sfz_opcode_table()
+    {
+        for (auto &sl : slot)
+            sl = -1;
+        for (int i = 0; i < n_sfz_opcodes; ++i)
+        {
+            auto h = sfz_opcode_hash(sfz_opcode_names[i]) % sfz_opcode_table_size;
+            if (slot[h] >= 0)
+                perfect = false;
+            slot[h] = i;
+        }
+    }
+};
+constexpr sfz_opcode_table sfz_opcodes;
+static_assert(sfz_opcodes.perfect, "SFZ opcode hash collides, pick another sfz_opcode_table_size");
+
+// returns n_sfz_opcodes for unsupported opcodes
+sfz_opcode lookup_sfz_opcode(std::string_view name)
+{
+    auto i = sfz_opcodes.slot[sfz_opcode_hash(name) % sfz_opcode_table_size];
+    if (i < 0 || sfz_opcode_names[i].size() != name.size())
+        return n_sfz_opcodes;
+    for (size_t c = 0; c < name.size(); ++c)
+        if (sfz_opcode_char(name[c]) != sfz_opcode_names[i][c])
+            return n_sfz_opcodes;
+    return (sfz_opcode)i;
+}
+
+bool sfz_iequals(std::string_view a, const char *b)
+{
+    return a.size() == strlen(b) && strnicmp(a.data(), b, a.size()) == 0;
+}
+
+/*
+ * The tokenizer doesn't copy anything, opcodes point right into the SFZ data. Each header
+ * owns a contiguous range of one flat opcode list, and <region>s and <group>s refer to the
+ * header they inherit from by index.
+ */
+struct sfz_opcode_value
+{
+    sfz_opcode op;
+    std::string_view value;
+};
+
+struct sfz_header
+{
+    int parent; // index into sfz_parse::scopes, or -1
+    uint32_t first, last;
+    int unsupported;
+    std::string_view default_path; // of the <control> header before it
+};
+
+struct sfz_parse
+{
+    std::vector<sfz_opcode_value> opcodes;
+    std::vector<sfz_header> scopes; // <global> and <group>
+    std::vector<sfz_header> regions;
+};
+
+// A region with its <group> and <global> opcodes resolved
+struct sfz_region_opcodes
+{
+    std::string_view value[n_sfz_opcodes];
+    std::bitset<n_sfz_opcodes> set;
+    int unsupported{0};
+
+    void apply(const sfz_parse &sfz, const sfz_header &h)
+    {
+        for (auto i = h.first; i < h.last; ++i)
+        {
+            value[sfz.opcodes[i].op] = sfz.opcodes[i].value;
+            set[sfz.opcodes[i].op] = true;
+        }
+        unsupported += h.unsupported;
+    }
+
+    // later opcodes override earlier ones, and region opcodes override group and global ones
+    void resolve(const sfz_parse &sfz, const sfz_header &region)
+    {
+        const sfz_header *chain[3];
+        int n = 0;
+        for (auto p = region.parent; p >= 0 && n < 2; p = sfz.scopes[p].parent)
+            chain[n++] = &sfz.scopes[p];
+        while (n > 0)
+            apply(sfz, *chain[--n]);
+        apply(sfz, region);
+    }
+};
+
+// Values aren't null terminated, so convert them through a small buffer on the stack
+struct sfz_value_buffer
+{
+    char buf[64];
+    sfz_value_buffer(std::string_view v)
+    {
+        auto n = std::min(v.size(), sizeof(buf) - 1);
+        memcpy(buf, v.data(), n);
+        buf[n] = 0;
+    }
+};
+
+float sfz_float(std::string_view v) { return atof(sfz_value_buffer(v).buf); }
+int sfz_int(std::string_view v) { return atoi(sfz_value_buffer(v).buf); }
+int sfz_keynumber(std::string_view v) { return keyname_to_keynumber(sfz_value_buffer(v).buf); }
+bool sfz_value_is(std::string_view v, const char *s) { return sfz_iequals(v, s); }
+
+} // namespace
+
 /**
  * Useful for debugging unsupported SFZ opcodes for a given zone.
  */
-inline void dump_opcodes(sampler *s, std::map<std::string, std::string> &working_opcodes)
+static void dump_opcodes(sampler *s, const sfz_region_opcodes &opcodes)
 {
     LOGDEBUG(s->mLogger) << "Opcode dump for incomplete SFZ zone created: {" << std::endl
                          << std::flush;
-    for (auto [k, v] : working_opcodes)
-        LOGDEBUG(s->mLogger) << '\t' << k << ": " << v << std::endl << std::flush;
+    for (int op = 0; op < n_sfz_opcodes; ++op)
+        if (opcodes.set[op])
+            LOGDEBUG(s->mLogger) << '\t' << sfz_opcode_names[op] << ": " << opcodes.value[op]
+                                 << std::endl
+                                 << std::flush;
+    if (opcodes.unsupported)
+        LOGDEBUG(s->mLogger) << '\t' << opcodes.unsupported << " unsupported opcodes" << std::endl
+                             << std::flush;
     LOGDEBUG(s->mLogger) << '}' << std::flush;
 }
 
 /**
- * Take the current SFZ <region> opcodes and create a sample zone out of it.
- * This assumes <group> opcodes have already been integrated into the std::map.
+ * Resolve the sample opcode of a region relative to the SFZ file location and the
+ * default_path of its <control> header.
  */
-bool create_sfz_zone(sampler *s, std::map<std::string, std::string> &sfz_zone_opcodes,
-                     const fs::path &path, const char &channel)
+static fs::path sfz_sample_path(const fs::path &path, std::string_view default_path,
+                                std::string_view sample)
 {
-    if (sfz_zone_opcodes.empty())
-        return false;
+    // TODO: Pseudo-samples eg: *saw *sine *triangle etc. TBI
+    std::string sample_path_str = path_to_string(path);
+    sample_path_str += static_cast<char>(fs::path::preferred_separator);
+    sample_path_str += default_path;
+    sample_path_str += sample;
+    std::replace(sample_path_str.begin(), sample_path_str.end(), '\\',
+                 static_cast<char>(fs::path::preferred_separator));
+
+    return fs::absolute(string_to_path(sample_path_str));
+}
 
-    // Create zone (assuming region with group opcodes already integrated)
-    uint8_t num_opcodes_processed = 0;
+/**
+ * Take the resolved SFZ <region> opcodes and create a sample zone out of it.
+ * The sample path has already been resolved and checked by the caller.
+ */
+static bool create_sfz_zone(sampler *s, sfz_region_opcodes &opcodes, const fs::path &sample_path,
+                            const char &channel)
+{
     int z_id;
 
     // Transient zone values (Crossfade)
     int xfin_lokey = -1, xfin_hikey = -1, xfout_lokey = -1, xfout_hikey = -1;
     int xfin_lovel = -1, xfin_hivel = -1, xfout_lovel = -1, xfout_hivel = -1;
 
-    // First check if a zone CAN be created - does it even have a sample?
-    if (sfz_zone_opcodes.find("sample") == sfz_zone_opcodes.end())
-    {
-        LOGERROR(s->mLogger) << "Zone not created due to missing SFZ sample opcode." << std::flush;
-        return false;
-    }
-
-    std::stringstream ss;
-    sample_zone *z;
-
-    // Normalise sample path first before creating a zone to load it.
-    // TODO: Pseudo-samples eg: *saw *sine *triangle etc. TBI
-    ss << path_to_string(path) << static_cast<char>(fs::path::preferred_separator)
-       << sfz_zone_opcodes["sample"];
-
-    std::string sample_path_str = ss.str();
-    std::replace(sample_path_str.begin(), sample_path_str.end(), '\\',
-                 static_cast<char>(fs::path::preferred_separator));
-
-    auto sample_path = fs::absolute(string_to_path(sample_path_str));
-
-    if (!fs::exists(sample_path))
+    if (!s->add_zone(sample_path, &z_id, channel, false))
     {
-        LOGERROR(s->mLogger) << "Zone not created due to invalid sample path: " << sample_path
+        LOGERROR(s->mLogger) << "Failed to create zone for SFZ sample: " << sample_path
                              << std::flush;
         return false;
     }
 
-    if (s->add_zone(sample_path, &z_id, channel, false))
-    {
-        z = &s->zones[z_id];
-
-        // Apply zone defaults where opcodes are missing
-        // (behaviour matches Polyphone and some other sfz players)
-        bool no_key_macro = (sfz_zone_opcodes.find("key") == sfz_zone_opcodes.end());
-        bool no_low_key = (sfz_zone_opcodes.find("lokey") == sfz_zone_opcodes.end());
-        bool no_high_key = (sfz_zone_opcodes.find("hikey") == sfz_zone_opcodes.end());
-        bool no_keycenter = (sfz_zone_opcodes.find("pitch_keycenter") == sfz_zone_opcodes.end());
+    sample_zone *z = &s->zones[z_id];
 
-        if (no_key_macro)
-        {
-            if (no_keycenter)
-                sfz_zone_opcodes.insert({"pitch_keycenter", "60"});
-            if (no_low_key)
-                sfz_zone_opcodes.insert({"lokey", "0"});
-            if (no_high_key)
-                sfz_zone_opcodes.insert({"hikey", "127"});
-        }
-    }
-    else
+    // Apply zone defaults where opcodes are missing
+    // (behaviour matches Polyphone and some other sfz players)
+    if (!opcodes.set[sfz_key])
     {
-        LOGERROR(s->mLogger) << "Failed to create zone for SFZ sample: " << sample_path
-                             << std::flush;
-        return false;
+        auto set_default = [&opcodes](sfz_opcode op, std::string_view v) {
+            if (!opcodes.set[op])
+            {
+                opcodes.value[op] = v;
+                opcodes.set[op] = true;
+            }
+        };
+        set_default(sfz_pitch_keycenter, "60");
+        set_default(sfz_lokey, "0");
+        set_default(sfz_hikey, "127");
     }
 
     // Apply each opcode to the newly created zone.
-    for (auto [k, v] : sfz_zone_opcodes)
+    for (int op = 0; op < n_sfz_opcodes; ++op)
     {
-        const char *opcode = k.c_str(), *val = v.c_str();
+        if (!opcodes.set[op])
+            continue;
 
-        if (stricmp(opcode, "sample") == 0)
+        auto val = opcodes.value[op];
+        switch (op)
         {
-            ++num_opcodes_processed;
+        case sfz_sample:
             // already used it above.
-        }
-        else if (stricmp(opcode, "key") == 0)
-        {
-            z->key_root = keyname_to_keynumber(val);
-            z->key_low = keyname_to_keynumber(val);
-            z->key_high = keyname_to_keynumber(val);
-            ++num_opcodes_processed;
-        }
-        else if (stricmp(opcode, "lokey") == 0)
-        {
-            z->key_low = keyname_to_keynumber(val);
-            ++num_opcodes_processed;
-        }
-        else if (stricmp(opcode, "hikey") == 0)
-        {
-            z->key_high = keyname_to_keynumber(val);
-            ++num_opcodes_processed;
-        }
-        else if (stricmp(opcode, "pitch_keycenter") == 0)
-        {
-            z->key_root = keyname_to_keynumber(val);
-            ++num_opcodes_processed;
-        }
-        else if (stricmp(opcode, "lovel") == 0)
-        {
-            z->velocity_low = atol(val);
-            ++num_opcodes_processed;
-        }
-        else if (stricmp(opcode, "hivel") == 0)
-        {
-            z->velocity_high = atol(val);
-            ++num_opcodes_processed;
-        }
-        else if (stricmp(opcode, "pitch_keytrack") == 0)
-        {
-            z->keytrack = atof(val);
-            ++num_opcodes_processed;
-        }
-        else if (stricmp(opcode, "transpose") == 0)
-        {
-            z->transpose = atoi(val);
-            ++num_opcodes_processed;
-        }
-        else if (stricmp(opcode, "tune") == 0)
-        {
-            z->finetune = (float)0.01f * atoi(val);
-            ++num_opcodes_processed;
-        }
-        else if (stricmp(opcode, "volume") == 0)
-        {
-            z->aux[0].level = atof(val);
-            ++num_opcodes_processed;
-        }
-        else if (stricmp(opcode, "pan") == 0)
-        {
-            z->aux[0].balance = (float)0.01f * atof(val);
-            ++num_opcodes_processed;
-        }
-        else if (stricmp(opcode, "ampeg_attack") == 0)
-        {
-            z->AEG.attack = log2(atof(val));
-            ++num_opcodes_processed;
-        }
-        else if (stricmp(opcode, "ampeg_hold") == 0)
-        {
-            z->AEG.hold = log2(atof(val));
-            ++num_opcodes_processed;
-        }
-        else if (stricmp(opcode, "ampeg_decay") == 0)
-        {
-            z->AEG.decay = log2(atof(val));
-            ++num_opcodes_processed;
-        }
-        else if (stricmp(opcode, "ampeg_release") == 0)
-        {
-            z->AEG.release = log2(atof(val));
-            ++num_opcodes_processed;
-        }
-        else if (stricmp(opcode, "ampeg_sustain") == 0)
-        {
-            z->AEG.sustain = 0.01f * atof(val);
-            ++num_opcodes_processed;
-        }
-        else if (stricmp(opcode, "loop_mode") == 0)
-        {
-            if (stricmp(val, "loop_continuous") == 0)
+            break;
+        case sfz_key:
+            z->key_root = sfz_keynumber(val);
+            z->key_low = sfz_keynumber(val);
+            z->key_high = sfz_keynumber(val);
+            break;
+        case sfz_lokey:
+            z->key_low = sfz_keynumber(val);
+            break;
+        case sfz_hikey:
+            z->key_high = sfz_keynumber(val);
+            break;
+        case sfz_pitch_keycenter:
+            z->key_root = sfz_keynumber(val);
+            break;
+        case sfz_lovel:
+            z->velocity_low = sfz_int(val);
+            break;
+        case sfz_hivel:
+            z->velocity_high = sfz_int(val);
+            break;
+        case sfz_pitch_keytrack:
+            z->keytrack = sfz_float(val);
+            break;
+        case sfz_transpose:
+            z->transpose = sfz_int(val);
+            break;
+        case sfz_tune:
+            z->finetune = (float)0.01f * sfz_int(val);
+            break;
+        case sfz_volume:
+            z->aux[0].level = sfz_float(val);
+            break;
+        case sfz_pan:
+            z->aux[0].balance = (float)0.01f * sfz_float(val);
+            break;
+        case sfz_ampeg_attack:
+            z->AEG.attack = log2(sfz_float(val));
+            break;
+        case sfz_ampeg_hold:
+            z->AEG.hold = log2(sfz_float(val));
+            break;
+        case sfz_ampeg_decay:
+            z->AEG.decay = log2(sfz_float(val));
+            break;
+        case sfz_ampeg_release:
+            z->AEG.release = log2(sfz_float(val));
+            break;
+        case sfz_ampeg_sustain:
+            z->AEG.sustain = 0.01f * sfz_float(val);
+            break;
+        case sfz_loop_mode:
+            if (sfz_value_is(val, "loop_continuous"))
                 z->playmode = pm_forward_loop;
-            else if (stricmp(val, "loop_sustain") == 0)
+            else if (sfz_value_is(val, "loop_sustain"))
                 z->playmode = pm_forward_loop_until_release;
-            else if (stricmp(val, "one_shot") == 0)
+            else if (sfz_value_is(val, "one_shot"))
                 z->playmode = pm_forward_shot;
             else // "no_loop" or invalid values will use default
                 z->playmode = pm_forward;
-            ++num_opcodes_processed;
-        }
-        else if (stricmp(opcode, "amp_velcurve") == 0)
-        {
+            break;
+        case sfz_amp_velcurve:
             // TODO verify alignment of SFZ curvature to SC values
-            z->velsense = atof(val);
-            ++num_opcodes_processed;
-        }
-        else if (stricmp(opcode, "seq_length") == 0)
-        {
+            z->velsense = sfz_float(val);
+            break;
+        case sfz_seq_length:
             // TBI: need note groups properly implemented/testable first.
             LOGWARNING(s->mLogger) << "SFZ 1.0 seq_length not yet implemented" << std::flush;
-        }
-        else if (stricmp(opcode, "seq_position") == 0)
-        {
+            opcodes.unsupported++;
+            break;
+        case sfz_seq_position:
             // TBI: need note groups properly implemented/testable first.
             LOGWARNING(s->mLogger) << "SFZ 1.0 seq_position not yet implemented" << std::flush;
-        }
-        else
-        {
-            // TODO check if crossfading implementation is correct
-            if (stricmp(opcode, "xfin_lokey") == 0)
-                xfin_lokey = keyname_to_keynumber(val);
-            else if (stricmp(opcode, "xfin_hikey") == 0)
-                xfin_hikey = keyname_to_keynumber(val);
-            else if (stricmp(opcode, "xfout_lokey") == 0)
-                xfout_lokey = keyname_to_keynumber(val);
-            else if (stricmp(opcode, "xfout_hikey") == 0)
-                xfout_hikey = keyname_to_keynumber(val);
-            else if (stricmp(opcode, "xfin_lovel") == 0)
-                xfin_lovel = atoi(val);
-            else if (stricmp(opcode, "xfin_hivel") == 0)
-                xfin_hivel = atoi(val);
-            else if (stricmp(opcode, "xfout_lovel") == 0)
-                xfout_lovel = atoi(val);
-            else if (stricmp(opcode, "xfout_hivel") == 0)
-                xfout_hivel = atoi(val);
-
+            opcodes.unsupported++;
+            break;
+        // TODO check if crossfading implementation is correct
+        case sfz_xfin_lokey:
+            xfin_lokey = sfz_keynumber(val);
+            break;
+        case sfz_xfin_hikey:
+            xfin_hikey = sfz_keynumber(val);
+            break;
+        case sfz_xfout_lokey:
+            xfout_lokey = sfz_keynumber(val);
+            break;
+        case sfz_xfout_hikey:
+            xfout_hikey = sfz_keynumber(val);
+            break;
+        case sfz_xfin_lovel:
+            xfin_lovel = sfz_int(val);
+            break;
+        case sfz_xfin_hivel:
+            xfin_hivel = sfz_int(val);
+            break;
+        case sfz_xfout_lovel:
+            xfout_lovel = sfz_int(val);
+            break;
+        case sfz_xfout_hivel:
+            xfout_hivel = sfz_int(val);
+            break;
             // TODO other opcodes not yet mapped:
             // see https://sfzformat.com/legacy/
         }
@@ -322,49 +474,25 @@ bool create_sfz_zone(sampler *s, std::map<std::string, std::string> &sfz_zone_op
 
     // Crossfade handler has to be done per-zone (to be order independent).
     if (xfin_lokey >= 0)
-    {
         z->key_low = xfin_lokey + 1;
-        ++num_opcodes_processed;
-    }
     if (xfin_hikey >= 0)
-    {
         z->key_low_fade = xfin_hikey - z->key_low;
-        ++num_opcodes_processed;
-    }
     if (xfout_hikey >= 0)
-    {
         z->key_high = xfout_lokey + 1;
-        ++num_opcodes_processed;
-    }
     if (xfout_lokey >= 0)
-    {
         z->key_high_fade = xfout_hikey - z->key_high;
-        ++num_opcodes_processed;
-    }
     if (xfin_lovel >= 0)
-    {
         z->velocity_low = xfin_lovel + 1;
-        ++num_opcodes_processed;
-    }
     if (xfin_hivel >= 0)
-    {
         z->velocity_low_fade = xfin_hivel - z->velocity_low;
-        ++num_opcodes_processed;
-    }
     if (xfout_hivel >= 0)
-    {
         z->velocity_high = xfout_lovel + 1;
-        ++num_opcodes_processed;
-    }
     if (xfout_lovel >= 0)
-    {
         z->velocity_high_fade = xfout_hivel - z->velocity_high;
-        ++num_opcodes_processed;
-    }
 
     s->update_zone_switches(z_id);
 
-    if (num_opcodes_processed < sfz_zone_opcodes.size())
+    if (opcodes.unsupported)
     {
         LOGWARNING(s->mLogger) << "Zone creation did not process all SFZ opcodes." << std::flush;
         return false;
@@ -373,211 +501,205 @@ bool create_sfz_zone(sampler *s, std::map<std::string, std::string> &sfz_zone_op
     return true;
 }
 
+static bool sfz_is_space(char c) { return c <= ' ' || c >= 127; }
+
+static bool sfz_is_opcode_char(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+           c == '_';
+}
+
 /**
- * If next data is typable, read in all opcudes until the next sfz <tag> is encountered
- * or otherwise reached the end.
+ * Regular values end at the first whitespace.
  */
-void parse_opcodes(sampler *s, const char *&r, const char *data_end, const fs::path &path,
-                   std::map<std::string, std::string> &working_opcodes)
+static std::string_view read_sfz_value(const char *&r, const char *data_end)
 {
-    if (r == nullptr || r >= data_end)
-    {
-        // TODO may need to refactor these loader functions rather than passing the mLogger object.
-        LOGWARNING(s->mLogger) << "SFZ opcode parsing appears to have reached an unstable state."
-                               << std::flush;
-        return;
-    }
+    const char *v = r;
+    while (r < data_end && !sfz_is_space(*r) && *r != '<')
+        ++r;
+    return std::string_view(v, r - v);
+}
 
-    // Find the next tag start to mark end of processing opcodes for the current zone.
-    const char *working_data_end = r;
-    char buf[256];
-    int copy_size;
+/**
+ * Sample paths may contain spaces. Quoted paths end at the closing quote on the same line,
+ * unquoted ones at the end of the line, a comment or where the next opcode starts.
+ */
+static std::string_view read_sfz_path(sampler *s, const char *&r, const char *data_end)
+{
+    auto is_eol = [](char c) { return c == '\n' || c == '\r'; };
 
-    while (working_data_end < data_end && *working_data_end != '<')
-        ++working_data_end;
+    if (r < data_end && *r == '"')
+    {
+        const char *v = ++r;
+        while (r < data_end && *r != '"' && !is_eol(*r))
+            ++r;
+        std::string_view value(v, r - v);
+        if (r < data_end && *r == '"')
+            ++r;
+        else
+            LOGWARNING(s->mLogger) << "Unterminated quote value found: sample=" << value
+                                   << std::flush;
+        return value;
+    }
 
-    // Read all opcodes
-    while (r < working_data_end)
+    const char *v = r, *e = r;
+    while (e < data_end && !is_eol(*e) && *e != '<')
     {
-        // comment, skip ahead until the rest of the line
-        if (*r == '/')
+        if (*e == ' ' || *e == '\t')
         {
-            while (r < working_data_end && *r != '\n' && *r != '\r')
-                r++;
+            const char *n = e;
+            while (n < data_end && (*n == ' ' || *n == '\t'))
+                ++n;
+            if (n + 1 < data_end && n[0] == '/' && n[1] == '/')
+                break;
+            const char *o = n;
+            while (o < data_end && sfz_is_opcode_char(*o))
+                ++o;
+            if (o > n && o < data_end && *o == '=')
+                break;
+            e = n;
             continue;
         }
+        ++e;
+    }
+    r = e;
+    while (e > v && sfz_is_space(e[-1]))
+        --e;
+    return std::string_view(v, e - v);
+}
 
-        // Ignore whitespace, CRLF and control characters when looking for the start of an opcode.
-        if (*r <= 32 || *r >= 127)
-        {
-            ++r;
-            continue;
-        }
+/**
+ * Single pass over the SFZ data collecting the headers and their opcodes.
+ */
+static void tokenize_sfz(sampler *s, const char *data, size_t datasize, sfz_parse &sfz)
+{
+    const char *r = data, *data_end = data + datasize;
+    std::vector<sfz_header> *current = nullptr;
+    int cur_global = -1, cur_group = -1;
+    bool in_control = false;
+    std::string_view default_path;
 
-        // Now look for the = operator (sfz spec says no spaces between opcode and value, but we'll
-        // pretend they're not there in this case)
-        const char *v = r;
-        bool opcode_found = false;
-        ++v;
+    auto open_header = [&](std::vector<sfz_header> &list, int parent) {
+        auto first = (uint32_t)sfz.opcodes.size();
+        list.push_back({parent, first, first, 0, default_path});
+    };
 
-        while (v < working_data_end)
+    while (r < data_end)
+    {
+        if (*r == '<') // global -> group -> region
         {
-            // TODO really should use a regex here to only accept [\s0-9A-Za-z_]+ opcode labels
-            // Annoyingly, some SFZ players allow incorrect opcodes such as "ampeg attack"
-            // to work when they're not meant to... so white-space will be normalised later...
-            if (*v != ' ' && *v < '0' && *v > '9' && *v < 'A' && *v > 'Z' && *v < 'a' && *v > 'z')
-            {
-                // If opcode name is not valid text, log invalid string and find the next one.
-                copy_size = (v - r);
-                strncpy(buf, r, copy_size);
-                buf[copy_size] = '\0';
-                LOGERROR(s->mLogger) << "Invalid SFZ opcode found: " << buf << std::flush;
-                r = v; // scan forward for the next SFZ opcode
-                break;
-            }
+            const char *t = ++r;
+            while (r < data_end && *r != '>')
+                ++r;
+            std::string_view tag(t, r - t);
+            if (r < data_end)
+                ++r;
+            in_control = false;
 
-            if (*v == '=' && v < working_data_end)
+            if (sfz_iequals(tag, "region"))
             {
-                opcode_found = true;
-                break;
+                open_header(sfz.regions, cur_group >= 0 ? cur_group : cur_global);
+                current = &sfz.regions;
             }
-            ++v;
-        }
-
-        if (opcode_found)
-        {
-            // Retain opcode name, normalise whitespace to _ and lowercase.
-            copy_size = (v - r);
-            for (int i = 0; i < copy_size; ++i)
-            {
-                if (r[i] <= ' ')
-                    buf[i] = '_';
-                else
-                    buf[i] = tolower(r[i]);
-            }
-            buf[copy_size] = '\0';
-            ++v;
-
-            std::string opcode(buf), value;
-
-            // Now obtain the value.
-            const char *w = v;
-            bool is_sample = false, parsed = false;
-            bool is_quoted = false, quote_ended = false;
-
-            // All opcode=value pairs can be space-delimited or across multiple lines, however due
-            // care required for sample paths containing spaces. Note these are always relative to
-            // the SFZ file location.
-            // Valid cases:
-            //   - Paths with no quotes around path value will assume entire line
-            //     remainder until '.' is encountered in the path string (TODO can improve)
-            //   - Paths with quotes will end at the next corresponding quote provided
-            //     it is on the same line.
-            if (stricmp(opcode.c_str(), "sample") == 0)
+            else if (sfz_iequals(tag, "group"))
             {
-                is_sample = true;
-
-                // Note: other SFZ players eg: Polyphone, may not support quoted path strings.
-                if (*w == '"')
-                    is_quoted = true;
-
-                ++w;
+                // TODO: as SCG/SCM zone groups from SC1.1.2 are not implemented in SC2/3, for now
+                // these act as 'pre-fills' to regions parsed to zones assigned to a single sample.
+                // Eventually some group settings could apply similarly to SC1.1.2
+                open_header(sfz.scopes, cur_global);
+                cur_group = (int)sfz.scopes.size() - 1;
+                current = &sfz.scopes;
             }
-
-            while (w < working_data_end && !parsed)
+            else if (sfz_iequals(tag, "global"))
             {
-                if (is_sample)
-                {
-                    if (is_quoted && !quote_ended)
-                    {
-                        // Where paths are quoted, find the corresponding end quote
-                        // unless it's CRLF, which then we assume that's the value end.
-                        if (*w != '"')
-                        {
-                            ++w;
-                            if (*w == '\r' || *w == '\n')
-                                is_sample = false;
-                            else
-                                continue;
-                        }
-                        else
-                            quote_ended = true;
-                    }
-                    else if (!is_quoted)
-                    {
-                        copy_size = (w - v);
-                        strncpy(buf, v, copy_size);
-                        buf[copy_size] = '\0';
-
-                        std::stringstream ss;
-                        ss << path_to_string(path)
-                           << static_cast<char>(fs::path::preferred_separator) << buf;
-                        std::string test_path_str = ss.str();
-                        std::replace(test_path_str.begin(), test_path_str.end(), '\\',
-                                     static_cast<char>(fs::path::preferred_separator));
-                        fs::path test_path = fs::absolute(string_to_path(test_path_str));
-
-                        if (fs::exists(test_path) && !fs::is_directory(test_path))
-                            is_sample = false;
-                    }
-                }
-
-                // Condition to parse opcode value - have we got everything by this point?
-                if ((is_sample && *w < 32) || *w >= 127 || (!is_sample && *w <= 32))
-                {
-                    if (is_quoted && quote_ended)
-                    {
-                        --w;
-                        ++v;
-                    }
-
-                    copy_size = (w - v);
-                    strncpy(buf, v, copy_size);
-                    buf[copy_size] = '\0';
-                    value = buf;
-
-                    if (is_quoted)
-                    {
-                        if (quote_ended)
-                        {
-                            ++w;
-                            --v;
-                        }
-                        else
-                        {
-                            LOGWARNING(s->mLogger) << "Unterminated quote value found: " << opcode
-                                                   << "=" << value << std::flush;
-                        }
-                    }
-
-                    parsed = (!opcode.empty() && !value.empty());
-                }
-                ++w;
+                // SFZ v2. There should only be one but...yeah.
+                open_header(sfz.scopes, -1);
+                cur_global = (int)sfz.scopes.size() - 1;
+                cur_group = -1;
+                current = &sfz.scopes;
             }
-
-            // Once here, if parsing had failed then log an error.
-            if (!parsed)
+            else if (sfz_iequals(tag, "control"))
             {
-                LOGERROR(s->mLogger)
-                    << "Unexpected SFZ opcode-value pair: " << opcode << "=" << value << std::flush;
+                // only default_path is read, see below
+                in_control = true;
+                current = nullptr;
             }
             else
             {
-                // Save the SFZ opcode=value pair
-                working_opcodes.insert({opcode, value});
+                // Unknown tag, ignore it and its opcodes
+                LOGDEBUG(s->mLogger) << "Unsupported SFZ header <" << tag << ">" << std::flush;
+                current = nullptr;
             }
-
-            // move forward to the next opcode scan.
-            r = w;
+        }
+        else if (*r == '/') // comment, skip ahead until the rest of the line
+        {
+            while (r < data_end && *r != '\n' && *r != '\r')
+                r++;
+        }
+        else if (sfz_is_space(*r)) // ignore whitespace/CR/LF, control characters
+        {
+            r++;
         }
         else
         {
-            // Nothing to parse from this point.
-            r = v;
+            // opcode=value (sfz spec says no spaces between opcode and value, but we'll
+            // pretend they're not there in this case)
+            const char *o = r;
+            while (r < data_end && *r != '=' && *r != '<' && *r != '\n' && *r != '\r')
+                ++r;
+            const char *oe = r;
+            while (oe > o && sfz_is_space(oe[-1]))
+                --oe;
+            std::string_view opcode(o, oe - o);
+
+            if (r >= data_end || *r != '=')
+            {
+                LOGERROR(s->mLogger) << "Invalid SFZ opcode found: " << opcode << std::flush;
+                continue;
+            }
+            ++r;
+
+            auto op = lookup_sfz_opcode(opcode);
+            bool is_default_path = in_control && sfz_iequals(opcode, "default_path");
+            auto value = (op == sfz_sample || is_default_path) ? read_sfz_path(s, r, data_end)
+                                                               : read_sfz_value(r, data_end);
+            if (value.empty())
+            {
+                LOGERROR(s->mLogger) << "Unexpected SFZ opcode-value pair: " << opcode << "="
+                                     << std::flush;
+                continue;
+            }
+            if (is_default_path)
+                default_path = value;
+            if (!current)
+                continue;
+
+            if (op == n_sfz_opcodes)
+            {
+                LOGDEBUG(s->mLogger) << "Unsupported SFZ opcode: " << opcode << std::flush;
+                current->back().unsupported++;
+                continue;
+            }
+            sfz.opcodes.push_back({op, value});
+            current->back().last = (uint32_t)sfz.opcodes.size();
         }
     }
 }
 
+size_t resolve_sfz_regions(sampler *s, const char *data, size_t datasize)
+{
+    sfz_parse sfz;
+    tokenize_sfz(s, data, datasize, sfz);
+    size_t n = 0;
+    for (auto &region : sfz.regions)
+    {
+        sfz_region_opcodes opcodes;
+        opcodes.resolve(sfz, region);
+        n += opcodes.set[sfz_sample];
+    }
+    return n;
+}
+
 /**
  * Entrypoint for SFZ loading.
  *
@@ -588,21 +710,19 @@ void parse_opcodes(sampler *s, const char *&r, const char *data_end, const fs::p
  * - ASCII-formatted SFZ data only.
  * - Apply default values where opcodes are unspecified (see behaviour of other existing
  *   SFZ players for guidance)
- * - Opcodes are procedurally parsed top-down with some nuance on group opcodes applied to regions.
+ * - <region> opcodes override <group> ones, which override <global> ones.
  *
- * Rewrite SFZ parser... pseudocode
- *   1. (SFZ v1) Load group-region pairs.  (only create zones per group).
- *      a. Collect opcodes for <group>
- *      b. Collect opcodes for <region> until no more regions (eg: EOF or next <group>
- *      c. Create sample zones based on parsed groups, noting that:
+ * Loading happens in three steps:
+ *   1. Tokenize the whole file in one pass. Opcodes are looked up in a perfect hash and
+ *      stored as views into the data, grouped per header.
+ *   2. Resolve each region's sample and decode all unique samples concurrently.
+ *   3. Resolve each region's opcodes through its group and global and create the zones
+ *      in one step. Where opcodes are missing:
  *          i. If no key ranges are specified, assume keys 0-127
  *         ii. If no vel ranges are specified, assume vels 0-127
  *        iii. If no ampeg settings, assume default ADSR.
- *         iv. group opcodes apply to all regions after it and before the next group.
- *             then region opcodes take precedence for each zone generated.
  *          v. (TODO) If using *sine *saw etc. possibly pre-load inbuilt sample in its place?
  *             (used for synthesized sfz presets)
- *      d. Repeat until there are no more groups/region tags.
  * TODO:
  *   2. (SFZ v2) Apply additional tags and follow similar pattern as 1.
  *      a. Pre-processor handling for #include etc.
@@ -611,101 +731,69 @@ void parse_opcodes(sampler *s, const char *&r, const char *data_end, const fs::p
 bool sampler::load_sfz(const char *data, size_t datasize, const fs::path &path, int *new_g,
                        char channel)
 {
-    const char *r = data, *data_end = (data + datasize);
-    std::map<std::string, std::string> global_opcodes, cur_group_opcodes, cur_region_opcodes,
-        *working_opcodes = &cur_region_opcodes;
-
-    // apply groups, then regions containing group-defined opcodes as relevant.
-    // TODO do we need to work out how to re-use already loaded samples for multiple zones from
-    // here?
-
-    while (r < data_end)
+    sfz_parse sfz;
+    tokenize_sfz(this, data, datasize, sfz);
+
+    // most libraries use a handful of samples for many regions, so only check each one once
+    std::unordered_map<std::string_view, fs::path> resolved_samples;
+    std::string_view default_path;
+    std::vector<fs::path> sample_paths(sfz.regions.size());
+    for (size_t i = 0; i < sfz.regions.size(); ++i)
     {
-        if (*r == '<') // global -> group -> region
-        {
-            if (strnicmp(r, "<global>", 8) == 0)
-            {
-                // SFZ v2. There should only be one but...yeah.
-                global_opcodes.clear();
-                working_opcodes = &global_opcodes;
-                r += 8;
-            }
-            else if (strnicmp(r, "<group>", 7) == 0)
-            {
-                // TODO: as SCG/SCM zone groups from SC1.1.2 are not implemented in SC2/3, for now
-                // these act as 'pre-fills' to regions parsed to zones assigned to a single sample.
-                // Eventually some group settings could apply similarly to SC1.1.2
+        sfz_region_opcodes opcodes;
+        opcodes.resolve(sfz, sfz.regions[i]);
 
-                if (!cur_group_opcodes.empty())
-                    cur_group_opcodes.clear();
-
-                // At this point, all opcodes for a <region>/<group> would have been accumulated and
-                // so should be processed.
-                if (!cur_region_opcodes.empty())
-                {
-                    if (!create_sfz_zone(this, cur_region_opcodes, path, channel))
-                        dump_opcodes(this, cur_region_opcodes);
-                    cur_region_opcodes.clear();
-                }
-
-                // Where present, accumulate <global> opcodes.
-                for (auto const &[opcode, val] : global_opcodes)
-                    cur_region_opcodes.insert({opcode, val});
-
-                working_opcodes = &cur_group_opcodes;
-                r += 7;
-            }
-            else if (strnicmp(r, "<region>", 8) == 0)
-            {
-                if (!cur_region_opcodes.empty())
-                {
-                    if (!create_sfz_zone(this, cur_region_opcodes, path, channel))
-                        dump_opcodes(this, cur_region_opcodes);
-                    cur_region_opcodes.clear();
-                }
-
-                // Collect opcodes from last group read. If empty, ensure <global> is read.
-                if (!cur_group_opcodes.empty())
-                    for (auto const &[opcode, val] : cur_group_opcodes)
-                        cur_region_opcodes.insert({opcode, val});
-                else
-                    for (auto const &[opcode, val] : global_opcodes)
-                        cur_region_opcodes.insert({opcode, val});
-
-                working_opcodes = &cur_region_opcodes;
-                r += 8;
-            }
-            else
-            {
-                // Unknown tag, ignore
-                while (r < data_end && *r != '>')
-                {
-                    r++;
-                }
-                r++;
-            }
+        // First check if a zone CAN be created - does it even have a sample?
+        if (!opcodes.set[sfz_sample])
+        {
+            LOGERROR(mLogger) << "Zone not created due to missing SFZ sample opcode."
+                              << std::flush;
+            dump_opcodes(this, opcodes);
+            continue;
         }
-        else if (*r == '/') // comment, skip ahead until the rest of the line
+
+        // which a later <control> header may put somewhere else
+        if (sfz.regions[i].default_path != default_path)
         {
-            while (r < data_end && *r != '\n' && *r != '\r')
-                r++;
+            default_path = sfz.regions[i].default_path;
+            resolved_samples.clear();
         }
-        else if (*r <= 32 || *r >= 127) // ignore whitespace/CR/LF, control characters
+        auto sample = opcodes.value[sfz_sample];
+        auto known = resolved_samples.find(sample);
+        if (known == resolved_samples.end())
         {
-            r++;
+            auto sample_path = sfz_sample_path(path, default_path, sample);
+            if (!fs::exists(sample_path))
+                sample_path.clear();
+            known = resolved_samples.emplace(sample, sample_path).first;
         }
-        else
+
+        if (known->second.empty())
         {
-            parse_opcodes(this, r, data_end, path, *working_opcodes);
+            LOGERROR(mLogger) << "Zone not created due to invalid sample path: "
+                              << sfz_sample_path(path, default_path, sample) << std::flush;
+            dump_opcodes(this, opcodes);
+            continue;
         }
+        sample_paths[i] = known->second;
     }
+    auto preloaded = preload_samples(sample_paths);
 
-    // If a region has not been processed, add it.
-    if (!cur_region_opcodes.empty())
     {
-        if (!create_sfz_zone(this, cur_region_opcodes, path, channel))
-            dump_opcodes(this, cur_region_opcodes);
+        std::lock_guard g(cs_patch);
+        for (size_t i = 0; i < sfz.regions.size(); ++i)
+        {
+            if (sample_paths[i].empty())
+                continue;
+
+            sfz_region_opcodes opcodes;
+            opcodes.resolve(sfz, sfz.regions[i]);
+            if (preloaded.failed_to_load(sample_paths[i]) ||
+                !create_sfz_zone(this, opcodes, sample_paths[i], channel))
+                dump_opcodes(this, opcodes);
+        }
     }
+    release_unused_samples(preloaded);
 
     return true;
 }
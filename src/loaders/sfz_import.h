@@ -0,0 +1,9 @@
+#pragma once
+#include <cstddef>
+
+class sampler;
+
+// What sampler::load_sfz does before it decodes any sample: tokenize the SFZ data and resolve
+// the opcodes of each region through its group and global. Returns how many regions name a
+// sample.
+size_t resolve_sfz_regions(sampler *s, const char *data, size_t datasize);
@@ -28,6 +28,8 @@ void multiselect::set_zone_parameter_float_internal(int offset, float value)
             *v = value;
         }
     }
+    // the offset may be one of the fields the zone index caches, see zone_hot
+    sobj->invalidate_zone_index();
 }
 
 void multiselect::set_zone_parameter_cstr_internal(int offset, char *value)
@@ -65,6 +67,7 @@ void multiselect::set_zone_parameter_int_internal(int offset, int value)
             *v = value;
         }
     }
+    sobj->invalidate_zone_index();
 }
 
 void multiselect::set_zone_parameter_char_internal(int offset, char value)
@@ -82,6 +85,7 @@ void multiselect::set_zone_parameter_char_internal(int offset, char value)
             *adr = value;
         }
     }
+    sobj->invalidate_zone_index();
 }
 
 void multiselect::move_selected_zones_to_part(int part)
@@ -96,6 +100,7 @@ void multiselect::move_selected_zones_to_part(int part)
             sobj->zones[*iter].part = part;
         }
     }
+    sobj->invalidate_zone_index();
 }
 void multiselect::move_selected_zones_to_layer(int layer)
 {
@@ -283,6 +288,7 @@ void multiselect::mute_zones(bool b)
     {
         sobj->zones[*iter].mute = b;
     }
+    sobj->invalidate_zone_index();
 }
 
 bool multiselect::zone_is_selected(int id)
@@ -0,0 +1,112 @@
+/*
+** Shortcircuit XT is Free and Open Source Software
+**
+** Shortcircuit is made available under the Gnu General Public License, v3.0
+** https://www.gnu.org/licenses/gpl-3.0.en.html; The authors of the code
+** reserve the right to re-license their contributions under the MIT license in the
+** future at the discretion of the project maintainers.
+**
+** Copyright 2004-2021 by various individuals as described by the git transaction log
+**
+** All source at: https://github.com/surge-synthesizer/surge.git
+**
+** Shortcircuit was a commercial product from 2004-2018, with copyright and ownership
+** in that period held by Claes Johanson at Vember Audio. Claes made Shortcircuit
+** open source in December 2020.
+*/
+
+#include "polyphase_resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace
+{
+constexpr int zero_crossings = 32;
+constexpr double kaiser_beta = 9.0; // about 90 dB of stopband
+constexpr double passband = 0.95;   // of the lower Nyquist frequency
+
+double bessel_i0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 64; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12)
+            break;
+    }
+    return sum;
+}
+} // namespace
+
+polyphase_resampler::polyphase_resampler(uint32_t from_rate, uint32_t to_rate)
+{
+    auto g = std::gcd((uint64_t)from_rate, (uint64_t)to_rate);
+    L = to_rate / g;
+    M = from_rate / g;
+    phases = (uint32_t)std::min<uint64_t>(L, max_phases);
+
+    // cutoff in cycles per input frame
+    double fc = 0.5 * passband * std::min(1.0, (double)to_rate / from_rate);
+    double half_width = zero_crossings / (2.0 * fc);
+    taps = 2 * (int)std::ceil(half_width);
+
+    coefficients.resize((size_t)phases * taps);
+    double i0_beta = bessel_i0(kaiser_beta);
+    for (uint32_t p = 0; p < phases; p++)
+    {
+        double frac = (double)p / phases;
+        float *row = &coefficients[(size_t)p * taps];
+        double sum = 0.0;
+        for (int k = 0; k < taps; k++)
+        {
+            double t = (k - taps / 2 + 1) - frac;
+            double h = 0.0;
+            if (fabs(t) < half_width)
+            {
+                double x = 2.0 * fc * t;
+                double sinc = (x == 0.0) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+                double w = t / half_width;
+                h = 2.0 * fc * sinc * bessel_i0(kaiser_beta * sqrt(1.0 - w * w)) / i0_beta;
+            }
+            row[k] = (float)h;
+            sum += h;
+        }
+        // unity gain at DC for every phase
+        for (int k = 0; k < taps; k++)
+            row[k] = (float)(row[k] / sum);
+    }
+}
+
+uint32_t polyphase_resampler::get_output_length(uint32_t input_length) const
+{
+    return (uint32_t)(((uint64_t)input_length * L + M - 1) / M);
+}
+
+uint32_t polyphase_resampler::map_position(uint32_t input_position) const
+{
+    return (uint32_t)(((uint64_t)input_position * L + M / 2) / M);
+}
+
+void polyphase_resampler::process(const float *in, uint32_t length, float *out) const
+{
+    const int before = taps / 2 - 1;
+    uint32_t n_out = get_output_length(length);
+    for (uint32_t n = 0; n < n_out; n++)
+    {
+        uint64_t num = (uint64_t)n * M;
+        int64_t i = (int64_t)(num / L);
+        uint32_t p = (uint32_t)((num % L) * phases / L);
+        const float *row = &coefficients[(size_t)p * taps];
+
+        int64_t first = i - before;
+        int k0 = (int)std::max<int64_t>(0, -first);
+        int k1 = (int)std::min<int64_t>(taps, (int64_t)length - first);
+        float acc = 0.f;
+        for (int k = k0; k < k1; k++)
+            acc += row[k] * in[first + k];
+        out[n] = acc;
+    }
+}
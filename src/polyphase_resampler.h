@@ -0,0 +1,51 @@
+/*
+** Shortcircuit XT is Free and Open Source Software
+**
+** Shortcircuit is made available under the Gnu General Public License, v3.0
+** https://www.gnu.org/licenses/gpl-3.0.en.html; The authors of the code
+** reserve the right to re-license their contributions under the MIT license in the
+** future at the discretion of the project maintainers.
+**
+** Copyright 2004-2021 by various individuals as described by the git transaction log
+**
+** All source at: https://github.com/surge-synthesizer/surge.git
+**
+** Shortcircuit was a commercial product from 2004-2018, with copyright and ownership
+** in that period held by Claes Johanson at Vember Audio. Claes made Shortcircuit
+** open source in December 2020.
+*/
+
+#ifndef SHORTCIRCUIT_POLYPHASE_RESAMPLER_H
+#define SHORTCIRCUIT_POLYPHASE_RESAMPLER_H
+
+#include <cstdint>
+#include <vector>
+
+/*
+ * Offline sample rate conversion with a Kaiser windowed sinc, 32 zero crossings a side, for
+ * resampling whole samples once rather than per voice. The output frame n lies n * M / L
+ * input frames in, with L / M the reduced rate ratio. Ratios reducing to L <= max_phases use
+ * the exact phase for each output frame, others the one of max_phases just below it.
+ * Downsampling narrows the passband to the new Nyquist frequency.
+ */
+class polyphase_resampler
+{
+  public:
+    polyphase_resampler(uint32_t from_rate, uint32_t to_rate);
+
+    static constexpr uint32_t max_phases = 4096;
+
+    uint32_t get_output_length(uint32_t input_length) const;
+    // maps an input frame position to the output, rounded
+    uint32_t map_position(uint32_t input_position) const;
+    // out holds get_output_length(length) frames, the input is zero beyond its length
+    void process(const float *in, uint32_t length, float *out) const;
+
+  private:
+    uint64_t L, M;
+    uint32_t phases;
+    int taps; // per phase, the first at input frame floor(position) - taps / 2 + 1
+    std::vector<float> coefficients; // phases rows of taps
+};
+
+#endif // SHORTCIRCUIT_POLYPHASE_RESAMPLER_H
@@ -8,8 +8,13 @@
 
 #include "sample.h"
 #include "configuration.h"
+#include "loaders/sample_cache.h"
 #include "resampling.h"
+#include <algorithm>
 #include <assert.h>
+#include <cmath>
+#include <cstring>
+#include <vector>
 #include <vt_dsp/endian.h>
 #if WINDOWS
 #include <windows.h>
@@ -30,11 +35,22 @@
 #include "util/scxtstring.h"
 #include "infrastructure/logfile.h"
 #include "infrastructure/file_map_view.h"
+#include "infrastructure/sample_arena.h"
+
+namespace
+{
+// sample and mip buffers, see infrastructure/sample_arena.h
+void *data_alloc(size_t bytes) { return scxt::SampleArena::get().allocate(bytes); }
+void *data_realloc(void *p, size_t bytes) { return scxt::SampleArena::get().reallocate(p, bytes); }
+void data_free(void *p) { scxt::SampleArena::get().release(p); }
+} // namespace
 
 sample::sample(configuration *conf)
 {
     refcount = 1;
     this->conf = conf;
+    if (conf)
+        storage = conf->get_sample_storage();
 
     // zero pointers
     SampleData[0] = 0;
@@ -44,61 +60,102 @@ sample::sample(configuration *conf)
     graintable = 0;
     Embedded = true;
     UseInt16 = false;
+    UseInt24 = false;
 
     clear_data();
+    sample_memory::get().add(this);
 }
 
 short *sample::GetSamplePtrI16(int Channel)
 {
-    if (!UseInt16)
+    if (!UseInt16 || !SampleData[Channel])
         return 0;
     return &((short *)SampleData[Channel])[FIRoffset];
 }
 float *sample::GetSamplePtrF32(int Channel)
 {
-    if (UseInt16)
+    if (UseInt16 || UseInt24 || !SampleData[Channel])
         return 0;
     return &((float *)SampleData[Channel])[FIRoffset];
 }
+uint8_t *sample::GetSamplePtrI24(int Channel)
+{
+    if (!UseInt24 || !SampleData[Channel])
+        return 0;
+    return (uint8_t *)SampleData[Channel] + 3 * FIRoffset;
+}
 
 bool sample::AllocateI16(int Channel, int Samples)
 {
     // int samplesizewithmargin = Samples + 2*FIRipol_N + block_size + FIRoffset;
-    int samplesizewithmargin = Samples + FIRipol_N;
+    size_t samplesizewithmargin = (size_t)Samples + FIRipol_N;
     if (SampleData[Channel])
-        free(SampleData[Channel]);
-    SampleData[Channel] = malloc(sizeof(short) * samplesizewithmargin);
+        data_free(SampleData[Channel]);
+    SampleData[Channel] = data_alloc(sizeof(short) * samplesizewithmargin);
     if (!SampleData[Channel])
         return false;
     UseInt16 = true;
+    UseInt24 = false;
 
     // clear pre/post zero area
     memset(SampleData[Channel], 0, FIRoffset * sizeof(short));
-    memset((char *)SampleData[Channel] + (Samples + FIRoffset) * sizeof(short), 0,
+    memset((char *)SampleData[Channel] + ((size_t)Samples + FIRoffset) * sizeof(short), 0,
            FIRoffset * sizeof(short));
+    update_resident_bytes();
 
     return true;
 }
 bool sample::AllocateF32(int Channel, int Samples)
 {
-    int samplesizewithmargin = Samples + FIRipol_N;
+    size_t samplesizewithmargin = (size_t)Samples + FIRipol_N;
     if (SampleData[Channel])
-        free(SampleData[Channel]);
-    SampleData[Channel] = malloc(sizeof(float) * samplesizewithmargin);
+        data_free(SampleData[Channel]);
+    SampleData[Channel] = data_alloc(sizeof(float) * samplesizewithmargin);
     if (!SampleData[Channel])
         return false;
     UseInt16 = false;
+    UseInt24 = false;
 
     // clear pre/post zero area
     memset(SampleData[Channel], 0, FIRoffset * sizeof(float));
-    memset((char *)SampleData[Channel] + (Samples + FIRoffset) * sizeof(float), 0,
+    memset((char *)SampleData[Channel] + ((size_t)Samples + FIRoffset) * sizeof(float), 0,
            FIRoffset * sizeof(float));
+    update_resident_bytes();
+
+    return true;
+}
+bool sample::AllocateI24(int Channel, int Samples)
+{
+    size_t bytes = channel_bytes(Samples, 3);
+    if (SampleData[Channel])
+        data_free(SampleData[Channel]);
+    SampleData[Channel] = data_alloc(bytes);
+    if (!SampleData[Channel])
+        return false;
+    UseInt16 = false;
+    UseInt24 = true;
+
+    // clear pre/post zero area
+    size_t data_end = ((size_t)Samples + FIRoffset) * 3;
+    memset(SampleData[Channel], 0, FIRoffset * 3);
+    memset((char *)SampleData[Channel] + data_end, 0, bytes - data_end);
+    update_resident_bytes();
 
     return true;
 }
 
 int sample::GetRefCount() { return refcount; }
-size_t sample::GetDataSize() { return sample_length * (UseInt16 ? 2 : 4) * channels; }
+size_t sample::GetDataSize()
+{
+    if (is_compressed())
+    {
+        size_t s = 0;
+        for (int c = 0; c < channels; c++)
+            s += compressed[c]->get_size();
+        return s;
+    }
+    return (size_t)sample_length * get_bytes_per_sample() * channels;
+}
 char *sample::GetName()
 {
     return name;
@@ -110,12 +167,25 @@ void sample::clear_data()
 {
     sample_loaded = false;
     grains_initialized = false;
+    saved_chunk.reset();
+
+    if (mCacheMap)
+    {
+        // the buffers belong to the mapped cache file
+        SampleData[0] = 0;
+        SampleData[1] = 0;
+        release_cache_map();
+    }
+
+    clear_mips();
+    compressed[0].reset();
+    compressed[1].reset();
 
     // free any allocated data
     if (SampleData[0])
-        free(SampleData[0]);
+        data_free(SampleData[0]);
     if (SampleData[1])
-        free(SampleData[1]);
+        data_free(SampleData[1]);
     if (meta.slice_start)
         delete meta.slice_start;
     if (meta.slice_end)
@@ -133,11 +203,168 @@ void sample::clear_data()
     memset(name, 0, 64);
     memset(&meta, 0, sizeof(meta));
     mFileName.clear();
+    resident_bytes = 0;
+    rate_converted = false;
+    pending_rate.reset();
 }
 
 sample::~sample()
 {
-    clear_data(); // this should free everything
+    sample_memory::get().remove(this); // before the data goes, it may be paging us out
+    clear_data();                      // this should free everything
+}
+
+void sample::release_cache_map()
+{
+    std::lock_guard<std::mutex> g(residency_mutex);
+    scxt::SampleArena::get().unlockRange(mCacheMap->data(), mCacheLocked);
+    mCacheLocked = 0;
+    mCacheMap.reset();
+    resident = true;
+    page_in_wanted = false;
+}
+
+void sample::prefault_head()
+{
+    size_t bytes = channel_bytes(std::min(sample_length, preload_frames), get_bytes_per_sample());
+    for (int c = 0; c < channels; c++)
+        scxt::SampleArena::get().prefaultRange(SampleData[c], bytes);
+    resident = false;
+}
+
+bool sample::can_page_out() const
+{
+    // a sample held on the heap is read again from its file, see reload
+    return resident && (sample_length > preload_frames) && SampleData[0] && !is_compressed() &&
+           !save_pins && (mCacheMap || (conf && !mFileName.empty()));
+}
+
+std::unique_ptr<sample> sample::reload() const
+{
+    // the same decode load() did, on a logger and configuration of our own as the worker
+    // threads of preload_samples do
+    scxt::log::StreamLogger logger(conf->mLogger.getCallback());
+    configuration reloadConf(logger);
+    reloadConf.set_relative_path(conf->get_relative_path());
+    auto fresh = std::make_unique<sample>(nullptr);
+    fresh->storage = storage;
+    fresh->analysis = analysis;
+    bool ok = fresh->decode(mFileName, &reloadConf);
+    if (ok && rate_converted && fresh->sample_rate != sample_rate)
+    {
+        rate_conversion rc;
+        ok = fresh->convert_rate(sample_rate, rc);
+        if (ok)
+            fresh->apply_rate_conversion(rc);
+    }
+    if (ok && fresh->get_bytes_per_sample() != get_bytes_per_sample())
+        ok = fresh->convert_storage(UseInt16 ? ss_int16 : ss_packed24);
+    // unless the file changed meanwhile
+    if (!ok || fresh->channels != channels || fresh->sample_length != sample_length ||
+        fresh->get_bytes_per_sample() != get_bytes_per_sample())
+    {
+        LOGERROR(logger) << "Could not read " << mFileName << " again, only the first "
+                         << preload_frames << " frames of it will play" << std::flush;
+        return nullptr;
+    }
+    return fresh;
+}
+
+void sample::page_in()
+{
+    // decoded outside the lock: the fresh sample registers with sample_memory, which holds
+    // its own lock while it pages samples out
+    std::unique_ptr<sample> fresh;
+    if (!is_resident() && !mCacheMap && !reload_failed)
+    {
+        fresh = reload();
+        reload_failed = !fresh;
+    }
+
+    std::lock_guard<std::mutex> g(residency_mutex);
+    page_in_wanted = false;
+    if (resident)
+        return;
+    auto &arena = scxt::SampleArena::get();
+    if (mCacheMap)
+    {
+        mCacheLocked = arena.prepareRange(mCacheMap->data(), mCacheMap->dataSize());
+    }
+    else
+    {
+        if (!fresh)
+            return;
+        // voices only read the head until resident is set, so the rest can be written now
+        size_t keep = channel_bytes(preload_frames, get_bytes_per_sample());
+        size_t all = channel_bytes(sample_length, get_bytes_per_sample());
+        for (int c = 0; c < channels; c++)
+        {
+            memcpy((char *)SampleData[c] + keep, (char *)fresh->SampleData[c] + keep,
+                   all - keep);
+            arena.relock(SampleData[c]);
+        }
+    }
+    if (!refill_mip_tails())
+        return;
+    resident.store(true, std::memory_order_release);
+    build_mips(); // those loaded on demand have none yet
+    update_resident_bytes();
+}
+
+size_t sample::page_out()
+{
+    std::lock_guard<std::mutex> g(residency_mutex);
+    if (!can_page_out())
+        return 0;
+    auto before = get_resident_bytes();
+    auto &arena = scxt::SampleArena::get();
+    int bps = get_bytes_per_sample();
+    // from here on voices keep to the head
+    resident = false;
+    if (mCacheMap)
+    {
+        arena.unlockRange(mCacheMap->data(), mCacheLocked);
+        mCacheLocked = 0;
+        arena.discardRange(mCacheMap->data(), mCacheMap->dataSize());
+        prefault_head();
+    }
+    else
+    {
+        for (int c = 0; c < channels; c++)
+            arena.discardTail(SampleData[c], channel_bytes(preload_frames, bps));
+    }
+    for (int l = 1; l <= get_mip_count(); l++)
+        for (int c = 0; c < channels; c++)
+            arena.discardTail(mips[l - 1].data[c], channel_bytes(preload_frames >> l, bps));
+    update_resident_bytes();
+    return before - get_resident_bytes();
+}
+
+void sample::update_resident_bytes()
+{
+    size_t bytes = 0;
+    if (is_compressed())
+        bytes = GetDataSize();
+    else if (SampleData[0])
+    {
+        int bps = get_bytes_per_sample();
+        uint32_t frames = resident ? sample_length : std::min(sample_length, preload_frames);
+        bytes = channel_bytes(frames, bps) * channels;
+        for (int l = 1; l <= max_mip_levels; l++)
+        {
+            auto &m = mips[l - 1];
+            uint32_t n = resident ? m.length : std::min(m.length, preload_frames >> l);
+            if (m.data[0])
+                bytes += channel_bytes(n, bps) * channels;
+        }
+    }
+    resident_bytes = bytes;
+}
+
+void sample::retire(sample *s)
+{
+    scxt::Reclaimer::get().retire(s,
+                                  [](scxt::Reclaimable *r) { delete static_cast<sample *>(r); });
 }
 
 bool sample::SetMeta(unsigned int Channels, unsigned int SampleRate, unsigned int SampleLength)
@@ -147,29 +374,123 @@ bool sample::SetMeta(unsigned int Channels, unsigned int SampleRate, unsigned in
 
     channels = Channels;
     sample_length = SampleLength;
+    source_length = SampleLength;
     sample_rate = SampleRate;
     InvSampleRate = 1.f / (float)SampleRate;
 
     return true;
 }
 
-bool sample::load(const fs::path &filename)
+bool sample::load(const fs::path &filename) { return load(filename, conf); }
+
+bool sample::load(const fs::path &filename, configuration *loadConf)
 {
-    assert(conf);
+    assert(loadConf);
     fs::path validFilename;
-    std::string extension;
     int sample_id;
 
     // extract elements of path
-    decode_path(filename, &validFilename, &extension, 0, 0, 0, &sample_id);
+    decode_path(filename, &validFilename, 0, 0, 0, 0, &sample_id);
     // resolve the path
-    validFilename = conf->resolve_path(validFilename);
+    validFilename = loadConf->resolve_path(validFilename);
+    storage = loadConf->get_sample_storage();
+    analysis = loadConf->get_sample_analysis();
+    on_demand = loadConf->get_load_on_demand();
+    if (on_demand && (loadConf->get_compress_samples() || !conf))
+    {
+        // compressed samples are small enough as they are, and without a configuration of its
+        // own the sample couldn't read its data back
+        LOGINFO(loadConf->mLogger) << "Loading " << validFilename << " in full, "
+                                   << (conf ? "it is compressed" : "it can't be read again")
+                                   << std::flush;
+        on_demand = false;
+    }
+
+    // a decoded copy from an earlier session saves parsing and converting the file again
+    sample_cache_key cacheKey;
+    fs::path cacheFile;
+    if (!loadConf->get_sample_cache_path().empty() &&
+        get_sample_cache_key(validFilename, sample_id, cacheKey))
+    {
+        cacheFile = get_sample_cache_file(loadConf->get_sample_cache_path(), cacheKey);
+        clear_data();
+        if (load_cached(cacheFile, cacheKey))
+        {
+            mFileName = filename;
+            auto st = mFileName.stem().u8string();
+            strncpy(name, st.c_str(), 64);
+            if (loadConf->get_compress_samples())
+                compress();
+            if (!prepare_rate_conversion(loadConf))
+                finish_load();
+            return true;
+        }
+    }
+
+    bool r = decode(filename, loadConf);
+    if (r && !cacheFile.empty() && save_cached(cacheFile, cacheKey) && on_demand &&
+        sample_length > preload_frames)
+    {
+        // from here on the cache file backs the sample, so only its head stays in memory
+        clear_data();
+        r = load_cached(cacheFile, cacheKey);
+        mFileName = filename;
+    }
+
+    auto st = mFileName.stem().u8string();
+    strncpy(name, st.c_str(), 64);
+
+    if (r)
+    {
+        if (loadConf->get_compress_samples())
+            compress();
+        if (!prepare_rate_conversion(loadConf))
+            finish_load();
+    }
+
+    return r;
+}
+
+bool sample::prepare_rate_conversion(configuration *loadConf)
+{
+    pending_rate.reset();
+    uint32_t rate = loadConf->get_sample_rate_target();
+    if (!rate || rate == sample_rate || is_compressed())
+        return false;
+    auto rc = std::make_unique<rate_conversion>();
+    if (!convert_rate(rate, *rc))
+    {
+        conversion_failed = rate;
+        LOGWARNING(loadConf->mLogger) << "Could not resample " << GetName() << " to " << rate
+                                      << " Hz" << std::flush;
+        return false;
+    }
+    pending_rate = std::move(rc);
+    return true;
+}
+
+void sample::finish_load()
+{
+    if (on_demand)
+        page_out(); // but for its head, until played
+    // now rather than when a voice first wants them, so notes play the same every time
+    if (resident)
+        build_mips();
+}
+
+bool sample::decode(const fs::path &filename, configuration *loadConf)
+{
+    fs::path validFilename;
+    std::string extension;
+    int sample_id;
+    decode_path(filename, &validFilename, &extension, 0, 0, 0, &sample_id);
+    validFilename = loadConf->resolve_path(validFilename);
 
     auto mapper = std::make_unique<scxt::FileMapView>(validFilename);
     if (!mapper->isMapped())
     {
-        LOGERROR(conf->mLogger) << "Unable to map view of file '" << validFilename << "'"
-                                << std::flush;
+        LOGERROR(loadConf->mLogger) << "Unable to map view of file '" << validFilename << "'"
+                                    << std::flush;
         return false;
     }
     auto data = mapper->data();
@@ -178,7 +499,8 @@ bool sample::load(const fs::path &filename)
     clear_data(); // clear to a more predictable state
 
     bool r = false;
-    if (extension.compare("wav") == 0)
+    if ((extension.compare("wav") == 0) || (extension.compare("w64") == 0) ||
+        (extension.compare("rf64") == 0))
     {
         r = parse_riff_wave(data, datasize);
     }
@@ -195,23 +517,75 @@ bool sample::load(const fs::path &filename)
         r = parse_aiff(data, datasize);
     }
 
-    if (r)
+    if (!r)
     {
-        assert(SampleData[0]);
-        if (channels == 2)
-            assert(SampleData[1]);
+        LOGERROR(loadConf->mLogger)
+            << "Error processing file " << validFilename.c_str() << std::flush;
+        return false;
+    }
 
-        mFileName = filename;
+    assert(SampleData[0]);
+    if (channels == 2)
+        assert(SampleData[1]);
+
+    mFileName = filename;
+    if (analysis & sa_fold_mono)
+        fold_mono();
+    if (analysis & sa_trim_silence)
+        trim_silence();
+    return true;
+}
+
+bool sample::compress()
+{
+    if (!UseInt16 || is_compressed() || !SampleData[0])
+        return false;
+
+    std::unique_ptr<compressed_channel> cc[2];
+    size_t packed = 0;
+    for (int c = 0; c < channels; c++)
+    {
+        cc[c] = std::make_unique<compressed_channel>();
+        cc[c]->encode(GetSamplePtrI16(c), sample_length);
+        packed += cc[c]->get_size();
     }
+    // below a 10% saving it isn't worth decoding on the fly
+    if (packed * 10 > GetDataSize() * 9)
+        return false;
+
+    clear_mips();
+    if (mCacheMap)
+        release_cache_map();
     else
+        for (auto d : SampleData)
+            data_free(d);
+    SampleData[0] = 0;
+    SampleData[1] = 0;
+    for (int c = 0; c < 2; c++)
+        compressed[c] = std::move(cc[c]);
+    update_resident_bytes();
+    return true;
+}
+
+bool sample::read_i16(int channel, short *dst) const
+{
+    if (!UseInt16 || channel >= channels)
+        return false;
+    if (!is_compressed())
     {
-        LOGERROR(conf->mLogger) << "Error processing file " << validFilename.c_str() << std::flush;
+        memcpy(dst, (short *)SampleData[channel] + FIRoffset, sample_length * sizeof(short));
+        return true;
     }
 
-    auto st = mFileName.stem().u8string();
-    strncpy(name, st.c_str(), 64);
-
-    return r;
+    auto cc = compressed[channel].get();
+    const uint32_t bf = compressed_channel::block_frames;
+    std::vector<short> block(bf);
+    for (uint32_t b = 0; b < cc->get_block_count(); b++)
+    {
+        cc->decode_block(b, block.data());
+        memcpy(dst + b * bf, block.data(), std::min(bf, sample_length - b * bf) * sizeof(short));
+    }
+    return true;
 }
 
 void sample::init_grains()
@@ -259,6 +633,225 @@ void sample::init_grains()
     }*/
 }
 
+//-------------------------------------------------------------------------------------------------
+// band-limited mip levels
+
+namespace
+{
+const float i24_scale = 1.f / 8388608.f;
+
+inline void pack_i24(uint8_t *d, int v)
+{
+    d[0] = (uint8_t)v;
+    d[1] = (uint8_t)(v >> 8);
+    d[2] = (uint8_t)(v >> 16);
+}
+inline int unpack_i24(const uint8_t *d)
+{
+    int v = (d[2] << 16) | (d[1] << 8) | d[0];
+    return v - ((v & 0x800000) << 1);
+}
+inline int round_i24(float v)
+{
+    float x = floorf(v * 8388608.f + 0.5f);
+    return (int)std::min(8388607.f, std::max(-8388608.f, x));
+}
+
+// zero phase half-band lowpass, so decimated positions line up with the source ones
+const int mip_filter_half = 31; // taps either side of the centre, the even ones are zero
+
+struct mip_halfband
+{
+    float h[mip_filter_half + 1]; // h[k] applies at +k and -k
+
+    mip_halfband()
+    {
+        double sum = 0.5;
+        h[0] = 0.5f;
+        for (int k = 1; k <= mip_filter_half; k++)
+        {
+            double hk = 0;
+            if (k & 1)
+            {
+                // sinc at half the sample rate under a Blackman-Harris window
+                const double pi = 3.14159265358979323846;
+                double x = (double)(k + mip_filter_half + 1) / (2 * mip_filter_half + 2);
+                double w = 0.35875 - 0.48829 * cos(2 * pi * x) + 0.14128 * cos(4 * pi * x) -
+                           0.01168 * cos(6 * pi * x);
+                hk = sin(0.5 * pi * k) / (pi * k) * w;
+            }
+            h[k] = (float)hk;
+            sum += 2 * hk;
+        }
+        for (auto &v : h)
+            v = (float)(v / sum);
+    }
+};
+
+template <typename T> T mip_output(float v) { return v; }
+template <> short mip_output<short>(float v)
+{
+    return (short)std::min(32767.f, std::max(-32768.f, floorf(v + 0.5f)));
+}
+
+// src and dst point past the FIRoffset margin, dst_length = (src_length + 1) / 2
+template <typename T> void mip_decimate(const T *src, uint32_t src_length, T *dst)
+{
+    static const mip_halfband f;
+    int64_t n = src_length;
+    uint32_t dst_length = (src_length + 1) >> 1;
+    for (uint32_t i = 0; i < dst_length; i++)
+    {
+        int64_t c = 2 * (int64_t)i;
+        float acc = f.h[0] * src[c];
+        if (c >= mip_filter_half && c + mip_filter_half < n)
+        {
+            for (int k = 1; k <= mip_filter_half; k += 2)
+                acc += f.h[k] * ((float)src[c - k] + (float)src[c + k]);
+        }
+        else
+        {
+            // outside the sample is silence
+            for (int k = 1; k <= mip_filter_half; k += 2)
+            {
+                if (c - k >= 0)
+                    acc += f.h[k] * src[c - k];
+                if (c + k < n)
+                    acc += f.h[k] * src[c + k];
+            }
+        }
+        dst[i] = mip_output<T>(acc);
+    }
+}
+
+template <typename T> void *mip_allocate(uint32_t length)
+{
+    auto d = (T *)data_alloc(sizeof(T) * ((size_t)length + FIRipol_N));
+    if (d)
+    {
+        memset(d, 0, FIRoffset * sizeof(T));
+        memset(d + (size_t)length + FIRoffset, 0, FIRoffset * sizeof(T));
+    }
+    return d;
+}
+void *mip_allocate_i24(uint32_t length)
+{
+    size_t bytes = sample::channel_bytes(length, 3);
+    auto d = (uint8_t *)data_alloc(bytes);
+    if (d)
+        memset(d, 0, bytes);
+    return d;
+}
+
+// packed levels are filtered in float
+void mip_decimate_i24(const uint8_t *src, uint32_t src_length, uint8_t *dst)
+{
+    std::vector<float> in(src_length), out((src_length + 1) >> 1);
+    for (uint32_t i = 0; i < src_length; i++)
+        in[i] = i24_scale * unpack_i24(src + 3 * i);
+    mip_decimate(in.data(), src_length, out.data());
+    for (uint32_t i = 0; i < out.size(); i++)
+        pack_i24(dst + 3 * i, round_i24(out[i]));
+}
+} // namespace
+
+void *sample::allocate_mip(uint32_t length) const
+{
+    if (UseInt24)
+        return mip_allocate_i24(length);
+    return UseInt16 ? mip_allocate<short>(length) : mip_allocate<float>(length);
+}
+
+void sample::decimate_mip(int level, int channel, void *dst) const
+{
+    uint32_t src_length = (level == 1) ? sample_length : mips[level - 2].length;
+    void *src = (level == 1) ? SampleData[channel] : mips[level - 2].data[channel];
+    if (UseInt24)
+        mip_decimate_i24((uint8_t *)src + 3 * FIRoffset, src_length,
+                         (uint8_t *)dst + 3 * FIRoffset);
+    else if (UseInt16)
+        mip_decimate((short *)src + FIRoffset, src_length, (short *)dst + FIRoffset);
+    else
+        mip_decimate((float *)src + FIRoffset, src_length, (float *)dst + FIRoffset);
+}
+
+void sample::build_mips()
+{
+    mips_wanted.store(false, std::memory_order_relaxed);
+    // paged out samples build theirs once paged in again
+    if (is_compressed() || !is_resident())
+        return;
+    int done = get_mip_count();
+    for (int l = done + 1; l <= max_mip_levels; l++)
+    {
+        uint32_t src_length = (l == 1) ? sample_length : mips[l - 2].length;
+        if (src_length < 2)
+            break;
+        auto &m = mips[l - 1];
+        m.length = (src_length + 1) >> 1;
+        for (int c = 0; c < channels; c++)
+        {
+            m.data[c] = allocate_mip(m.length);
+            if (!m.data[c])
+            {
+                for (auto &d : m.data)
+                {
+                    data_free(d);
+                    d = nullptr;
+                }
+                m.length = 0;
+                return;
+            }
+            decimate_mip(l, c, m.data[c]);
+        }
+        // publish each level as soon as it is usable
+        mip_count.store(l, std::memory_order_release);
+        update_resident_bytes();
+    }
+}
+
+bool sample::refill_mip_tails()
+{
+    // level by level, as each is decimated from the one above; the heads voices may be
+    // reading stay as they are
+    int bps = get_bytes_per_sample();
+    for (int l = 1; l <= get_mip_count(); l++)
+    {
+        auto &m = mips[l - 1];
+        size_t keep = channel_bytes(preload_frames >> l, bps);
+        size_t all = channel_bytes(m.length, bps);
+        if (keep >= all)
+            continue;
+        for (int c = 0; c < channels; c++)
+        {
+            auto d = allocate_mip(m.length);
+            if (!d)
+                return false;
+            decimate_mip(l, c, d);
+            memcpy((char *)m.data[c] + keep, (char *)d + keep, all - keep);
+            data_free(d);
+            scxt::SampleArena::get().relock(m.data[c]);
+        }
+    }
+    return true;
+}
+
+void sample::clear_mips()
+{
+    mip_count.store(0, std::memory_order_relaxed);
+    mips_wanted.store(false, std::memory_order_relaxed);
+    for (auto &m : mips)
+    {
+        for (auto &d : m.data)
+        {
+            data_free(d);
+            d = nullptr;
+        }
+        m.length = 0;
+    }
+    update_resident_bytes();
+}
+
 bool sample::get_filename(fs::path *out)
 {
     assert(out);
@@ -276,7 +869,7 @@ bool sample::load_data_ui8(int channel, void *data, unsigned int samplesize, uns
     AllocateI16(channel, samplesize);
     short *sampledata = GetSamplePtrI16(channel);
 
-    for (int i = 0; i < samplesize; i++)
+    for (size_t i = 0; i < samplesize; i++)
     {
         sampledata[i] = (((short)*((unsigned char *)data + i * stride)) - 128) << 8;
     }
@@ -288,7 +881,7 @@ bool sample::load_data_i8(int channel, void *data, unsigned int samplesize, unsi
     AllocateI16(channel, samplesize);
     short *sampledata = GetSamplePtrI16(channel);
 
-    for (int i = 0; i < samplesize; i++)
+    for (size_t i = 0; i < samplesize; i++)
     {
         sampledata[i] = ((short)*((char *)data + i * stride)) << 8;
     }
@@ -300,7 +893,7 @@ bool sample::load_data_i16(int channel, void *data, unsigned int samplesize, uns
     AllocateI16(channel, samplesize);
     short *sampledata = GetSamplePtrI16(channel);
 
-    for (int i = 0; i < samplesize; i++)
+    for (size_t i = 0; i < samplesize; i++)
     {
         sampledata[i] = vt_read_int16LE(*(short *)((char *)data + i * stride));
     }
@@ -312,90 +905,358 @@ bool sample::load_data_i16BE(int channel, void *data, unsigned int samplesize, u
     AllocateI16(channel, samplesize);
     short *sampledata = GetSamplePtrI16(channel);
 
-    for (int i = 0; i < samplesize; i++)
+    for (size_t i = 0; i < samplesize; i++)
     {
         sampledata[i] = vt_read_int16BE(*(short *)((char *)data + i * stride));
     }
     return true;
 }
-bool sample::load_data_i32(int channel, void *data, unsigned int samplesize, unsigned int stride)
+
+namespace
 {
-    AllocateF32(channel, samplesize);
-    float *sampledata = GetSamplePtrF32(channel);
+// triangular dither of +-1 lsb from a cheap LCG, the same on every load
+struct tpdf_dither
+{
+    uint32_t state{0x9e3779b9};
+    float next()
+    {
+        state = state * 1664525 + 1013904223;
+        float a = (state >> 8) * (1.f / 16777216.f);
+        state = state * 1664525 + 1013904223;
+        float b = (state >> 8) * (1.f / 16777216.f);
+        return a - b;
+    }
+};
+
+inline short dither_i16(float v, tpdf_dither &d)
+{
+    float x = floorf(v * 32768.f + d.next() + 0.5f);
+    return (short)std::min(32767.f, std::max(-32768.f, x));
+}
+} // namespace
 
-    for (int i = 0; i < samplesize; i++)
+template <typename F>
+bool sample::load_data_wide(int channel, unsigned int samplesize, bool integer, F get)
+{
+    if (storage == ss_int16)
     {
-        int x = vt_read_int32LE(*(int *)((char *)data + i * stride));
-        sampledata[i] = (4.6566128730772E-10f) * (float)x;
+        if (!AllocateI16(channel, samplesize))
+            return false;
+        short *sampledata = GetSamplePtrI16(channel);
+        tpdf_dither d;
+        for (size_t i = 0; i < samplesize; i++)
+            sampledata[i] = dither_i16(get(i), d);
+        return true;
+    }
+    if (storage == ss_packed24 && integer)
+    {
+        if (!AllocateI24(channel, samplesize))
+            return false;
+        uint8_t *sampledata = GetSamplePtrI24(channel);
+        for (size_t i = 0; i < samplesize; i++)
+            pack_i24(sampledata + 3 * i, round_i24(get(i)));
+        return true;
     }
+
+    if (!AllocateF32(channel, samplesize))
+        return false;
+    float *sampledata = GetSamplePtrF32(channel);
+    for (size_t i = 0; i < samplesize; i++)
+        sampledata[i] = get(i);
     return true;
 }
 
+bool sample::load_data_i32(int channel, void *data, unsigned int samplesize, unsigned int stride)
+{
+    return load_data_wide(channel, samplesize, true, [=](size_t i) {
+        int x = vt_read_int32LE(*(int *)((char *)data + i * stride));
+        return (4.6566128730772E-10f) * (float)x;
+    });
+}
+
 bool sample::load_data_i32BE(int channel, void *data, unsigned int samplesize, unsigned int stride)
 {
-    AllocateF32(channel, samplesize);
-    float *sampledata = GetSamplePtrF32(channel);
+    return load_data_wide(channel, samplesize, true, [=](size_t i) {
+        int x = vt_read_int32BE(*(int *)((char *)data + i * stride));
+        return (4.6566128730772E-10f) * (float)x;
+    });
+}
 
-    for (int i = 0; i < samplesize; i++)
+bool sample::load_data_i24(int channel, void *data, unsigned int samplesize, unsigned int stride)
+{
+    if (storage == ss_packed24)
     {
-        int x = vt_read_int32BE(*(int *)((char *)data + i * stride));
-        sampledata[i] = (4.6566128730772E-10f) * (float)x;
+        // already in the layout it is kept in
+        if (!AllocateI24(channel, samplesize))
+            return false;
+        uint8_t *sampledata = GetSamplePtrI24(channel);
+        for (size_t i = 0; i < samplesize; i++)
+            memcpy(sampledata + 3 * i, (unsigned char *)data + i * stride, 3);
+        return true;
     }
-    return true;
+    return load_data_wide(channel, samplesize, true, [=](size_t i) {
+        return i24_scale * unpack_i24((unsigned char *)data + i * stride);
+    });
 }
 
-bool sample::load_data_i24(int channel, void *data, unsigned int samplesize, unsigned int stride)
+bool sample::load_data_i24BE(int channel, void *data, unsigned int samplesize, unsigned int stride)
 {
-    AllocateF32(channel, samplesize);
-    float *sampledata = GetSamplePtrF32(channel);
+    return load_data_wide(channel, samplesize, true, [=](size_t i) {
+        unsigned char *cval = (unsigned char *)data + i * stride;
+        uint8_t le[3] = {cval[2], cval[1], cval[0]};
+        return i24_scale * unpack_i24(le);
+    });
+}
+
+bool sample::load_data_f32(int channel, void *data, unsigned int samplesize, unsigned int stride)
+{
+    return load_data_wide(channel, samplesize, false,
+                          [=](size_t i) { return (*(float *)((char *)data + i * stride)); });
+}
+
+bool sample::load_data_f64(int channel, void *data, unsigned int samplesize, unsigned int stride)
+{
+    return load_data_wide(channel, samplesize, false, [=](size_t i) {
+        return (float)(*(double *)((char *)data + i * stride));
+    });
+}
+
+bool sample::convert_storage(int to)
+{
+    if (!SampleData[0] || UseInt16 || (to == ss_packed24 && UseInt24) ||
+        (to != ss_packed24 && to != ss_int16))
+        return false;
 
-    for (int i = 0; i < samplesize; i++)
+    // convert into fresh buffers, so a failed allocation leaves the sample as it was
+    void *converted[2] = {nullptr, nullptr};
+    for (int c = 0; c < channels; c++)
     {
-        unsigned char *cval = (unsigned char *)data + i * stride;
-        int value = (cval[2] << 16) | (cval[1] << 8) | cval[0];
-        value -= (value & 0x800000) << 1;
-        sampledata[i] = 0.00000011920928955078f * float(value);
-        ;
+        converted[c] = data_alloc(channel_bytes(sample_length, (to == ss_int16) ? 2 : 3));
+        if (!converted[c])
+        {
+            data_free(converted[0]);
+            return false;
+        }
     }
+
+    tpdf_dither d;
+    for (int c = 0; c < channels; c++)
+    {
+        auto get = [this, c](size_t i) {
+            if (UseInt24)
+                return i24_scale * unpack_i24(GetSamplePtrI24(c) + 3 * i);
+            return GetSamplePtrF32(c)[i];
+        };
+        if (to == ss_int16)
+        {
+            auto dst = (short *)converted[c];
+            memset(dst, 0, channel_bytes(sample_length, 2));
+            for (size_t i = 0; i < sample_length; i++)
+                dst[FIRoffset + i] = dither_i16(get(i), d);
+        }
+        else
+        {
+            auto dst = (uint8_t *)converted[c];
+            memset(dst, 0, channel_bytes(sample_length, 3));
+            for (size_t i = 0; i < sample_length; i++)
+                pack_i24(dst + 3 * (FIRoffset + i), round_i24(get(i)));
+        }
+    }
+
+    clear_mips();
+    if (mCacheMap)
+        release_cache_map();
+    else
+        for (auto p : SampleData)
+            data_free(p);
+    SampleData[0] = converted[0];
+    SampleData[1] = converted[1];
+    saved_chunk.reset();
+    UseInt16 = (to == ss_int16);
+    UseInt24 = (to == ss_packed24);
+    update_resident_bytes();
+    build_mips();
     return true;
 }
 
-bool sample::load_data_i24BE(int channel, void *data, unsigned int samplesize, unsigned int stride)
+namespace
 {
-    AllocateF32(channel, samplesize);
-    float *sampledata = GetSamplePtrF32(channel);
+// sample i of a channel buffer at a full scale of 1, whatever it holds
+inline float read_sample(const void *channel, int bytes_per_sample, size_t i)
+{
+    switch (bytes_per_sample)
+    {
+    case 2:
+        return ((const short *)channel)[FIRoffset + i] * (1.f / 32768.f);
+    case 3:
+        return i24_scale * unpack_i24((const uint8_t *)channel + 3 * (FIRoffset + i));
+    default:
+        return ((const float *)channel)[FIRoffset + i];
+    }
+}
+} // namespace
 
-    for (int i = 0; i < samplesize; i++)
+bool sample::fold_mono()
+{
+    // mapped and compressed data aren't ours to rewrite
+    if (channels != 2 || !SampleData[1] || mCacheMap || is_compressed())
+        return false;
+
+    int bps = get_bytes_per_sample();
+    for (size_t i = 0; i < sample_length; i++)
+        if (fabs(read_sample(SampleData[0], bps, i) - read_sample(SampleData[1], bps, i)) >
+            analysis_floor)
+            return false;
+
+    // the channels differ by at most a 16 bit LSB, so the mean loses nothing audible
+    for (size_t i = 0; i < sample_length; i++)
     {
-        unsigned char *cval = (unsigned char *)data + i * stride;
-        int value = (cval[0] << 16) | (cval[1] << 8) | cval[2];
-        value -= (value & 0x800000) << 1;
-        sampledata[i] = 0.00000011920928955078f * float(value);
-        ;
+        size_t p = FIRoffset + i;
+        if (UseInt16)
+        {
+            auto d = (short *)SampleData[0];
+            d[p] = (short)((d[p] + ((short *)SampleData[1])[p]) >> 1);
+        }
+        else if (UseInt24)
+        {
+            auto d = (uint8_t *)SampleData[0];
+            int v = unpack_i24(d + 3 * p) + unpack_i24((uint8_t *)SampleData[1] + 3 * p);
+            pack_i24(d + 3 * p, v >> 1);
+        }
+        else
+        {
+            auto d = (float *)SampleData[0];
+            d[p] = 0.5f * (d[p] + ((float *)SampleData[1])[p]);
+        }
     }
+
+    clear_mips();
+    data_free(SampleData[1]);
+    SampleData[1] = 0;
+    channels = 1;
+    saved_chunk.reset();
+    update_resident_bytes();
     return true;
 }
 
-bool sample::load_data_f32(int channel, void *data, unsigned int samplesize, unsigned int stride)
+bool sample::trim_silence()
 {
-    AllocateF32(channel, samplesize);
-    float *sampledata = GetSamplePtrF32(channel);
+    if (!SampleData[0] || mCacheMap || is_compressed())
+        return false;
 
-    for (int i = 0; i < samplesize; i++)
+    int bps = get_bytes_per_sample();
+    uint32_t length = sample_length;
+    while (length > 1)
     {
-        sampledata[i] = (*(float *)((char *)data + i * stride));
+        bool silent = true;
+        for (int c = 0; c < channels && silent; c++)
+            silent = fabs(read_sample(SampleData[c], bps, length - 1)) < analysis_floor;
+        if (!silent)
+            break;
+        length--;
     }
+
+    // loops and slices may end in silence on purpose
+    if (meta.loop_present)
+        length = std::max(length, std::min(meta.loop_end, sample_length));
+    if (meta.slice_end)
+        for (int i = 0; i < meta.n_slices; i++)
+            length = std::max(length, std::min((uint32_t)std::max(meta.slice_end[i], 0),
+                                               sample_length));
+    if (length >= sample_length)
+        return false;
+
+    clear_mips();
+    size_t bytes = channel_bytes(length, bps);
+    size_t data_end = ((size_t)length + FIRoffset) * bps;
+    for (int c = 0; c < channels; c++)
+    {
+        // a failed shrink leaves the old, larger buffer, which is just as good
+        if (auto p = data_realloc(SampleData[c], bytes))
+            SampleData[c] = p;
+        memset((char *)SampleData[c] + data_end, 0, bytes - data_end);
+    }
+    sample_length = length;
+    saved_chunk.reset();
+    update_resident_bytes();
     return true;
 }
 
-bool sample::load_data_f64(int channel, void *data, unsigned int samplesize, unsigned int stride)
+sample::rate_conversion::~rate_conversion()
 {
-    AllocateF32(channel, samplesize);
-    float *sampledata = GetSamplePtrF32(channel);
+    for (auto d : data)
+        data_free(d);
+}
 
-    for (int i = 0; i < samplesize; i++)
+bool sample::convert_rate(uint32_t rate, rate_conversion &rc) const
+{
+    if (!SampleData[0] || is_compressed() || !rate || rate == sample_rate || !sample_rate)
+        return false;
+
+    auto resampler = std::make_unique<polyphase_resampler>(sample_rate, rate);
+    uint32_t length = resampler->get_output_length(sample_length);
+    int bps = get_bytes_per_sample();
+    std::vector<float> in(sample_length), out(length);
+    tpdf_dither d;
+    for (int c = 0; c < channels; c++)
     {
-        sampledata[i] = (float)(*(double *)((char *)data + i * stride));
+        size_t bytes = channel_bytes(length, bps);
+        rc.data[c] = data_alloc(bytes);
+        if (!rc.data[c])
+            return false; // rc frees what it has
+        memset(rc.data[c], 0, bytes);
+
+        for (size_t i = 0; i < sample_length; i++)
+            in[i] = read_sample(SampleData[c], bps, i);
+        resampler->process(in.data(), sample_length, out.data());
+
+        for (size_t i = 0; i < length; i++)
+        {
+            size_t p = FIRoffset + i;
+            if (UseInt16)
+                ((short *)rc.data[c])[p] = dither_i16(out[i], d);
+            else if (UseInt24)
+                pack_i24((uint8_t *)rc.data[c] + 3 * p, round_i24(out[i]));
+            else
+                ((float *)rc.data[c])[p] = out[i];
+        }
     }
+    rc.rate = rate;
+    rc.length = length;
+    rc.resampler = std::move(resampler);
     return true;
 }
+
+void sample::apply_rate_conversion(rate_conversion &rc)
+{
+    clear_mips();
+    if (mCacheMap)
+    {
+        // the old buffers belong to the mapped cache file
+        release_cache_map();
+        SampleData[0] = 0;
+        SampleData[1] = 0;
+    }
+    for (int c = 0; c < 2; c++)
+    {
+        void *d = SampleData[c];
+        SampleData[c] = rc.data[c];
+        rc.data[c] = d;
+    }
+
+    auto &r = *rc.resampler;
+    meta.loop_start = r.map_position(meta.loop_start);
+    meta.loop_end = r.map_position(meta.loop_end);
+    if (meta.slice_start && meta.slice_end)
+        for (int i = 0; i < meta.n_slices; i++)
+        {
+            meta.slice_start[i] = r.map_position(std::max(meta.slice_start[i], 0));
+            meta.slice_end[i] = r.map_position(std::max(meta.slice_end[i], 0));
+        }
+    source_length = r.map_position(source_length);
+    sample_rate = rc.rate;
+    sample_length = rc.length;
+    rate_converted = true;
+    saved_chunk.reset();
+    update_resident_bytes();
+}
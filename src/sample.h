@@ -8,12 +8,40 @@
 #pragma once
 
 #include "globals.h"
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include "filesystem/import.h"
+#include "infrastructure/file_map_view.h"
+#include "infrastructure/reclaimer.h"
+#include "resampling.h"
+#include "sample_codec.h"
+#include "sample_memory.h"
+#include "polyphase_resampler.h"
 
 class configuration;
+struct sample_cache_key;
 
-class alignas(16) sample
+// how samples wider than 16 bits are held, see configuration::set_sample_storage
+enum sample_storage
+{
+    ss_native = 0, // 8 and 16 bit sources as int16, everything else as float
+    ss_packed24,   // as native, but 24 and 32 bit integer sources packed into 3 bytes
+    ss_int16,      // everything as int16, dithered
+    n_sample_storage
+};
+
+// analysis run on newly decoded samples, see configuration::set_sample_analysis
+enum sample_analysis
+{
+    sa_fold_mono = 1 << 0,    // store stereo samples with (nearly) equal channels as mono
+    sa_trim_silence = 1 << 1, // drop trailing silence, see sample::trim_silence
+};
+
+class alignas(16) sample : public scxt::Reclaimable
 {
   public:
     /// constructor
@@ -21,11 +49,14 @@ class alignas(16) sample
     /// deconstructor
     virtual ~sample();
     bool load(const fs::path &path);
+    // load using another configuration (and thus logger), eg. from a loader thread
+    bool load(const fs::path &path, configuration *loadConf);
     bool get_filename(fs::path *out);
     bool compare_filename(const char *path);
     bool parse_riff_wave(void *data, size_t filesize, bool skip_riffchunk = false);
     short *GetSamplePtrI16(int Channel);
     float *GetSamplePtrF32(int Channel);
+    uint8_t *GetSamplePtrI24(int Channel);
     int GetRefCount();
     size_t GetDataSize();
     char *GetName();
@@ -34,6 +65,11 @@ class alignas(16) sample
     bool parse_aiff(void *data, size_t filesize);
     bool parse_sf2_sample(void *data, size_t filesize, unsigned int sampleid);
     bool parse_dls_sample(void *data, size_t filesize, unsigned int sampleid);
+    // decoded sample cache, see loaders/sample_cache.h
+    bool load_cached(const fs::path &cachefile, const sample_cache_key &key);
+    // maps and parses the file and runs the analysis, what load() does without the cache
+    bool decode(const fs::path &filename, configuration *loadConf);
+    bool save_cached(const fs::path &cachefile, const sample_cache_key &key) const;
     // bool load_recycle(const fs::path &filename);
     configuration *conf;
 
@@ -44,9 +80,11 @@ class alignas(16) sample
     // public data
     void *__restrict SampleData[2];
     bool UseInt16;
+    bool UseInt24; // packed little endian, each channel channel_bytes(length, 3) long
     uint8_t channels;
     bool Embedded; // if true, sample data will be stored inside the patch/multi
     uint32_t sample_length;
+    uint32_t source_length{0}; // as decoded, before trim_silence
     uint32_t sample_rate;
     float InvSampleRate;
     uint32_t *graintable;
@@ -55,12 +93,155 @@ class alignas(16) sample
     void init_grains();
     char name[64];
 
+    /*
+     * Band-limited copies of the sample at 1/2, 1/4, ... of its rate, so voices playing far
+     * above the root render at 1x rather than oversampling. Level l (1 based) holds
+     * get_mip_length(l) frames laid out like SampleData, with positions scaled by 2^-l.
+     * load() and convert_storage() build them, except for samples loaded on demand; voices
+     * finding none ask for them to be built off the audio thread (request_mips).
+     * Levels below get_mip_count() are complete and never change until the sample is cleared.
+     */
+    static constexpr int max_mip_levels = 5;
+    int get_mip_count() const { return mip_count.load(std::memory_order_acquire); }
+    void *get_mip_data(int level, int channel) const { return mips[level - 1].data[channel]; }
+    uint32_t get_mip_length(int level) const { return mips[level - 1].length; }
+    void request_mips() { mips_wanted.store(true, std::memory_order_relaxed); }
+    bool mips_requested() const { return mips_wanted.load(std::memory_order_relaxed); }
+    // decimates all levels, call with a reference held and not from the audio thread
+    void build_mips();
+
+    /*
+     * Compressed 16 bit samples (see sample_codec.h) keep their data in compressed_channels
+     * and have no SampleData; voices decode what they play through a compressed_window.
+     * Float samples stay as they are, and compressed ones get no mip levels.
+     */
+    bool compress(); // false if the sample can't be or isn't worth compressing
+    bool is_compressed() const { return (bool)compressed[0]; }
+    const compressed_channel *get_compressed(int channel) const
+    {
+        return compressed[channel].get();
+    }
+    // copies sample_length frames of a 16 bit channel to dst however they are held
+    bool read_i16(int channel, short *dst) const;
+
+    int get_bytes_per_sample() const { return UseInt16 ? 2 : (UseInt24 ? 3 : 4); }
+    // the size of a channel buffer including the FIRoffset margins
+    static size_t channel_bytes(uint32_t length, int bytes_per_sample)
+    {
+        // the packed 24 bit generator reads each sample as 4 bytes
+        return ((size_t)length + FIRipol_N) * bytes_per_sample + (bytes_per_sample == 3);
+    }
+    /*
+     * Narrows a loaded sample to ss_packed24 or ss_int16 storage. Nothing may be playing it
+     * or building its mips meanwhile, see sampler::set_sample_storage. False if the sample
+     * is already as narrow as that.
+     */
+    bool convert_storage(int storage);
+
+    /*
+     * Resamples the data to another rate, eg. the engine's, so voices at the root key step
+     * through it a frame at a time. convert_rate does the work into rc and only reads the
+     * sample, so voices may go on playing it meanwhile. apply_rate_conversion switches over
+     * with nothing playing it and its mips not being built, see sampler::convert_sample_rate.
+     * The positions in meta and source_length scale along, those of zones are for the caller
+     * (rc.resampler->map_position). Compressed samples aren't converted.
+     *
+     * load() converts to its configuration's sample rate target (set_sample_rate_target) into
+     * pending_rate but leaves switching over to the sampler, as importers give zones positions
+     * for the data as decoded: it maps them once the load is done, applies the conversion and
+     * calls finish_load (sampler::apply_load_rate_conversions). Voices don't start on the
+     * sample meanwhile.
+     */
+    struct rate_conversion
+    {
+        void *data[2]{nullptr, nullptr}; // the new buffers, after apply the old ones
+        uint32_t rate{0}, length{0};
+        std::unique_ptr<polyphase_resampler> resampler;
+        ~rate_conversion();
+    };
+    bool convert_rate(uint32_t rate, rate_conversion &rc) const;
+    void apply_rate_conversion(rate_conversion &rc);
+    bool rate_converted{false};
+    uint32_t conversion_failed{0}; // the rate convert_rate last failed for
+    std::unique_ptr<rate_conversion> pending_rate;
+    bool prepare_rate_conversion(configuration *loadConf); // true if pending_rate was set
+    void finish_load(); // what load() does after decoding, pages out and builds the mips
+
+    /*
+     * Optional analysis of a freshly decoded sample (sample_analysis, which load() runs).
+     * fold_mono averages stereo channels which never differ by more than analysis_floor
+     * into one, trim_silence drops the trailing frames below it but keeps loop and slice
+     * points. Zones are set up against source_length and voices clamp to sample_length, so
+     * positions in the trimmed tail stay valid and play as silence.
+     */
+    static constexpr float analysis_floor = 1.f / 32768.f; // one 16 bit LSB, about -90 dBFS
+    bool fold_mono();    // false if the sample isn't or can't be folded
+    bool trim_silence(); // false if there is nothing to trim
+
+    /*
+     * Loading on demand (configuration::set_load_on_demand). Once decoded, a sample keeps only
+     * the first preload_frames of each channel (and the matching heads of its mip levels) in
+     * memory, the rest once a voice plays it: note_played flags it and the sampler's sample
+     * worker thread calls page_in. A sample backed by a mapped cache file pages the rest in
+     * from there, one held on the heap decodes its file again. Until then voices play only
+     * the head, get_available_frames. page_out goes back to just the head, eg. for samples
+     * never played or, from sample_memory, those played least recently. Compressed samples,
+     * and those not loaded from a file, are always resident.
+     *
+     * note_rendered is called for every block a voice renders. sample_memory doesn't page out
+     * a sample rendered within its playing_grace_ms, and one paged out meanwhile asks to be
+     * paged in again.
+     */
+    static constexpr uint32_t preload_frames = 32768;
+    void note_played()
+    {
+        last_played.store(sample_memory::now(), std::memory_order_relaxed);
+        if (!resident.load(std::memory_order_relaxed))
+            page_in_wanted.store(true, std::memory_order_relaxed);
+    }
+    void note_rendered(uint32_t now)
+    {
+        last_rendered.store(now, std::memory_order_relaxed);
+        if (!resident.load(std::memory_order_relaxed))
+            page_in_wanted.store(true, std::memory_order_relaxed);
+    }
+    bool is_playing(uint32_t now) const
+    {
+        auto t = last_rendered.load(std::memory_order_relaxed);
+        return t && (now - t < sample_memory::playing_grace_ms);
+    }
+    bool was_played() const { return get_last_played() != 0; }
+    uint32_t get_last_played() const { return last_played.load(std::memory_order_relaxed); }
+    bool is_resident() const { return resident.load(std::memory_order_relaxed); }
+    // the frames of a channel, or of a mip level, voices may read right now
+    uint32_t get_available_frames(int level = 0) const
+    {
+        uint32_t length = level ? get_mip_length(level) : sample_length;
+        if (resident.load(std::memory_order_acquire))
+            return length;
+        return std::min(length, preload_frames >> level);
+    }
+    bool page_in_requested() const { return page_in_wanted.load(std::memory_order_relaxed); }
+    // call with a reference held and not from the audio thread
+    void page_in();
+    size_t page_out(); // returns the bytes no longer kept resident
+    // data and mips held in memory, the head only while paged out
+    size_t get_resident_bytes() const { return resident_bytes.load(std::memory_order_relaxed); }
+
+    // the chunk the last state save embedded this sample as, dropped when the data changes
+    std::shared_ptr<const std::vector<char>> saved_chunk;
+    // saves writing the data out, which mustn't change or be paged out meanwhile
+    std::atomic<int> save_pins{0};
+
     void remember() { refcount++; }
     bool forget()
     {
         refcount--;
         return (!refcount);
     }
+    // for samples whose refcount reached zero once unlinked: destroys them later, off the
+    // audio thread and outside cs_patch
+    static void retire(sample *s);
 
     // meta data
     struct
@@ -82,6 +263,7 @@ class alignas(16) sample
 
     bool AllocateI16(int Channel, int Samples);
     bool AllocateF32(int Channel, int Samples);
+    bool AllocateI24(int Channel, int Samples);
 
     bool SetMeta(unsigned int channels, unsigned int SampleRate, unsigned int SampleLength);
     bool load_data_ui8(int channel, void *data, unsigned int samplesize, unsigned int stride);
@@ -94,7 +276,39 @@ class alignas(16) sample
     bool load_data_i32BE(int channel, void *data, unsigned int samplesize, unsigned int stride);
     bool load_data_f32(int channel, void *data, unsigned int samplesize, unsigned int stride);
     bool load_data_f64(int channel, void *data, unsigned int samplesize, unsigned int stride);
+    // stores samples wider than 16 bits, get(i) returns sample i at a full scale of 1
+    template <typename F>
+    bool load_data_wide(int channel, unsigned int samplesize, bool integer, F get);
+    void clear_mips();
+    void *allocate_mip(uint32_t length) const;
+    void decimate_mip(int level, int channel, void *dst) const; // from the level above
+    bool refill_mip_tails(); // the parts page_out dropped
+    void update_resident_bytes(); // not while another thread may page the sample in or out
+    bool can_page_out() const;
+    std::unique_ptr<sample> reload() const; // decodes the file again, as load() did
+
     bool sample_loaded;
+    int storage{ss_native}; // sample_storage the loaders use
+    int analysis{0};        // sample_analysis load() runs
     fs::path mFileName;
+    struct mip_level
+    {
+        void *data[2]{nullptr, nullptr};
+        uint32_t length{0};
+    } mips[max_mip_levels];
+    std::atomic<int> mip_count{0};
+    std::atomic<bool> mips_wanted{false};
+    std::unique_ptr<scxt::FileMapView> mCacheMap; // owns SampleData when loaded from the cache
+    size_t mCacheLocked{0};                       // bytes of it locked by the sample arena
+    void release_cache_map();
+    void prefault_head();
+    bool on_demand{false}; // load_cached leaves the sample paged out but for its head
+    bool reload_failed{false};
+    std::atomic<bool> resident{true}, page_in_wanted{false};
+    std::atomic<uint32_t> last_played{0}; // sample_memory::now(), 0 if never played
+    std::atomic<uint32_t> last_rendered{0};
+    std::atomic<size_t> resident_bytes{0};
+    std::mutex residency_mutex; // page_in and page_out may come from several threads
+    std::unique_ptr<compressed_channel> compressed[2];
     uint32 refcount;
 };
\ No newline at end of file
@@ -0,0 +1,304 @@
+/*
+** Shortcircuit XT is Free and Open Source Software
+**
+** Shortcircuit is made available under the Gnu General Public License, v3.0
+** https://www.gnu.org/licenses/gpl-3.0.en.html; The authors of the code
+** reserve the right to re-license their contributions under the MIT license in the
+** future at the discretion of the project maintainers.
+**
+** Copyright 2004-2021 by various individuals as described by the git transaction log
+**
+** All source at: https://github.com/surge-synthesizer/surge.git
+**
+** Shortcircuit was a commercial product from 2004-2018, with copyright and ownership
+** in that period held by Claes Johanson at Vember Audio. Claes made Shortcircuit
+** open source in December 2020.
+*/
+
+#include "sample_codec.h"
+#include "resampling.h"
+#include "sample.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+/*
+ * Block layout, starting on a byte boundary:
+ * - a header byte: predictor order in bits 0-1, Rice parameter in bits 2-6, bit 7 verbatim
+ * - order warm up samples, 16 bits each
+ * - the zigzagged residuals, Rice coded: the quotient in unary (ones closed by a zero) then
+ *   the low bits. A quotient of rice_escape or more is written as rice_escape ones followed
+ *   by the residual in escape_bits
+ * Verbatim blocks hold every sample in 16 bits instead.
+ */
+const int max_order = 3;
+const int max_rice = 20;
+const uint32_t rice_escape = 24;
+const int escape_bits = 20; // an order 3 residual of 16 bit data fits in 19 bits zigzagged
+
+int32_t predict(const int32_t *x, int i, int order)
+{
+    switch (order)
+    {
+    case 1:
+        return x[i - 1];
+    case 2:
+        return 2 * x[i - 1] - x[i - 2];
+    case 3:
+        return 3 * x[i - 1] - 3 * x[i - 2] + x[i - 3];
+    }
+    return 0;
+}
+
+inline uint32_t zigzag(int32_t r) { return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31); }
+inline int32_t unzigzag(uint32_t u) { return (int32_t)(u >> 1) ^ -(int32_t)(u & 1); }
+
+uint64_t rice_cost(const uint32_t *u, int n, int k)
+{
+    uint64_t c = 0;
+    for (int i = 0; i < n; i++)
+    {
+        uint32_t q = u[i] >> k;
+        c += (q >= rice_escape) ? rice_escape + escape_bits : q + 1 + k;
+    }
+    return c;
+}
+
+struct bit_writer
+{
+    std::vector<uint8_t> &out;
+    uint64_t acc{0};
+    int n{0};
+
+    explicit bit_writer(std::vector<uint8_t> &o) : out(o) {}
+    void put(uint32_t v, int bits) // bits <= 32
+    {
+        acc = (acc << bits) | (v & ((1ULL << bits) - 1));
+        n += bits;
+        while (n >= 8)
+        {
+            n -= 8;
+            out.push_back((uint8_t)(acc >> n));
+        }
+    }
+    void flush()
+    {
+        if (n)
+            put(0, 8 - n);
+    }
+};
+
+struct bit_reader
+{
+    const uint8_t *p;
+    uint64_t cache{0}; // left aligned
+    int avail{0};
+
+    explicit bit_reader(const uint8_t *d) : p(d) {}
+    void refill()
+    {
+        while (avail <= 56)
+        {
+            cache |= (uint64_t)*p++ << (56 - avail);
+            avail += 8;
+        }
+    }
+    uint32_t get(int bits) // bits <= 32
+    {
+        if (!bits)
+            return 0;
+        refill();
+        uint32_t v = (uint32_t)(cache >> (64 - bits));
+        cache <<= bits;
+        avail -= bits;
+        return v;
+    }
+    uint32_t unary()
+    {
+        uint32_t q = 0;
+        refill();
+        while (cache >> 63)
+        {
+            cache <<= 1;
+            avail--;
+            if (++q == rice_escape)
+                return q;
+        }
+        cache <<= 1;
+        avail--;
+        return q;
+    }
+};
+} // namespace
+
+void compressed_channel::encode(const short *data, uint32_t length)
+{
+    frames = length;
+    bits.clear();
+    offsets.clear();
+
+    int32_t x[block_frames];
+    uint32_t u[max_order + 1][block_frames];
+    for (uint32_t b = 0; b < get_block_count(); b++)
+    {
+        int n = (int)std::min(block_frames, frames - b * block_frames);
+        for (int i = 0; i < n; i++)
+            x[i] = data[b * block_frames + i];
+
+        int order = 0;
+        uint64_t best = UINT64_MAX;
+        for (int o = 0; o <= max_order && o < n; o++)
+        {
+            uint64_t sum = 0;
+            for (int i = o; i < n; i++)
+            {
+                u[o][i] = zigzag(x[i] - predict(x, i, o));
+                sum += u[o][i];
+            }
+            if (sum < best)
+            {
+                best = sum;
+                order = o;
+            }
+        }
+
+        // start from the mean residual and walk downhill, outliers skew the mean upwards
+        const uint32_t *res = u[order] + order;
+        int nres = n - order;
+        uint64_t mean = nres ? best / nres : 0;
+        int k = 0;
+        while (k < max_rice && (2ULL << k) <= mean)
+            k++;
+        uint64_t cost = rice_cost(res, nres, k);
+        for (int step : {-1, 1})
+        {
+            bool moved = false;
+            for (int kk = k + step; kk >= 0 && kk <= max_rice; kk += step)
+            {
+                auto c = rice_cost(res, nres, kk);
+                if (c >= cost)
+                    break;
+                cost = c;
+                k = kk;
+                moved = true;
+            }
+            if (moved)
+                break;
+        }
+
+        offsets.push_back((uint32_t)bits.size());
+        bit_writer w(bits);
+        if (order * 16 + cost >= (uint64_t)n * 16)
+        {
+            w.put(0x80, 8);
+            for (int i = 0; i < n; i++)
+                w.put((uint16_t)x[i], 16);
+        }
+        else
+        {
+            w.put((uint32_t)(order | (k << 2)), 8);
+            for (int i = 0; i < order; i++)
+                w.put((uint16_t)x[i], 16);
+            for (int i = 0; i < nres; i++)
+            {
+                uint32_t q = res[i] >> k;
+                if (q >= rice_escape)
+                {
+                    w.put((1u << rice_escape) - 1, rice_escape);
+                    w.put(res[i], escape_bits);
+                }
+                else
+                {
+                    w.put(((1u << q) - 1) << 1, q + 1);
+                    w.put(res[i] & ((1u << k) - 1), k);
+                }
+            }
+        }
+        w.flush();
+    }
+    // the reader refills 8 bytes at a time
+    bits.resize(bits.size() + 8, 0);
+    bits.shrink_to_fit();
+    offsets.shrink_to_fit();
+}
+
+void compressed_channel::decode_block(uint32_t b, short *dst) const
+{
+    int n = 0;
+    if (b < get_block_count())
+    {
+        n = (int)std::min(block_frames, frames - b * block_frames);
+        bit_reader r(bits.data() + offsets[b]);
+        uint32_t header = r.get(8);
+        if (header & 0x80)
+        {
+            for (int i = 0; i < n; i++)
+                dst[i] = (short)r.get(16);
+        }
+        else
+        {
+            int order = header & 3;
+            int k = (header >> 2) & 31;
+            int32_t x[block_frames];
+            for (int i = 0; i < order && i < n; i++)
+                x[i] = (short)r.get(16);
+            for (int i = order; i < n; i++)
+            {
+                uint32_t q = r.unary();
+                uint32_t v = (q == rice_escape) ? r.get(escape_bits) : ((q << k) | r.get(k));
+                x[i] = unzigzag(v) + predict(x, i, order);
+            }
+            for (int i = 0; i < n; i++)
+                dst[i] = (short)x[i];
+        }
+    }
+    if (n < (int)block_frames)
+        memset(dst + n, 0, (block_frames - n) * sizeof(short));
+}
+
+void compressed_window::map(const sample *s, int from, int to, void *data[2])
+{
+    const int64_t bf = compressed_channel::block_frames;
+    auto floor_block = [bf](int64_t f) { return (f >= 0) ? f / bf : -((bf - 1 - f) / bf); };
+    int64_t b0 = floor_block((int64_t)from - FIRoffset);
+    int64_t b1 = floor_block((int64_t)to - FIRoffset);
+
+    if (!valid || b0 < first_block || b1 >= first_block + window_blocks)
+    {
+        // keep the window ahead of the direction of travel
+        int64_t nf = (valid && b0 < first_block) ? b1 - (window_blocks - 1) : b0;
+        int64_t shift = nf - first_block;
+        const size_t bytes = compressed_channel::block_frames * sizeof(short);
+        for (int c = 0; c < s->channels; c++)
+        {
+            auto cc = s->get_compressed(c);
+            for (int j = 0; j < window_blocks; j++)
+            {
+                // walk against the shift so reused blocks are moved before being overwritten
+                int i = (shift < 0) ? window_blocks - 1 - j : j;
+                int64_t blk = nf + i;
+                short *dst = buffer[c] + i * bf;
+                if (valid && blk >= first_block && blk < first_block + window_blocks)
+                {
+                    if (shift)
+                        memmove(dst, buffer[c] + (blk - first_block) * bf, bytes);
+                }
+                else if (blk < 0 || !cc)
+                    memset(dst, 0, bytes);
+                else
+                    cc->decode_block((uint32_t)std::min<int64_t>(blk, UINT32_MAX), dst);
+            }
+        }
+        first_block = nf;
+        valid = true;
+    }
+
+    // data[c][p] has to land on buffer[c][p - FIRoffset - first_block * bf], with p only
+    // ever inside the window
+    auto base = (first_block * bf + FIRoffset) * (int64_t)sizeof(short);
+    for (int c = 0; c < 2; c++)
+        data[c] = (c < s->channels) ? (void *)((intptr_t)buffer[c] - (intptr_t)base) : nullptr;
+}
@@ -0,0 +1,79 @@
+/*
+** Shortcircuit XT is Free and Open Source Software
+**
+** Shortcircuit is made available under the Gnu General Public License, v3.0
+** https://www.gnu.org/licenses/gpl-3.0.en.html; The authors of the code
+** reserve the right to re-license their contributions under the MIT license in the
+** future at the discretion of the project maintainers.
+**
+** Copyright 2004-2021 by various individuals as described by the git transaction log
+**
+** All source at: https://github.com/surge-synthesizer/surge.git
+**
+** Shortcircuit was a commercial product from 2004-2018, with copyright and ownership
+** in that period held by Claes Johanson at Vember Audio. Claes made Shortcircuit
+** open source in December 2020.
+*/
+
+#ifndef SHORTCIRCUIT_SAMPLE_CODEC_H
+#define SHORTCIRCUIT_SAMPLE_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class sample;
+
+/*
+ * Lossless in-memory compression for 16 bit sample data. A channel is cut into blocks of
+ * block_frames which are coded independently, so any block can be decoded on its own: each
+ * picks the fixed polynomial predictor (order 0-3, as in FLAC's fixed subframes) which leaves
+ * the smallest residuals and Rice codes those with a per block parameter. Blocks which don't
+ * shrink are stored verbatim.
+ */
+class compressed_channel
+{
+  public:
+    static constexpr uint32_t block_frames = 2048;
+
+    void encode(const short *data, uint32_t frames);
+    uint32_t get_frames() const { return frames; }
+    uint32_t get_block_count() const { return (frames + block_frames - 1) / block_frames; }
+    // fills dst (block_frames long) with block b, frames past the end of the data are zero
+    void decode_block(uint32_t b, short *dst) const;
+    size_t get_size() const { return bits.size() + offsets.size() * sizeof(uint32_t); }
+
+  private:
+    std::vector<uint8_t> bits;
+    std::vector<uint32_t> offsets; // byte offset of each block in bits
+    uint32_t frames{0};
+};
+
+/*
+ * A voice's view of a compressed sample: window_blocks consecutive decoded blocks per
+ * channel, which the generator reads through a pointer standing in for sample::SampleData.
+ * Moving the window along reuses the blocks it still covers, so a voice playing forward
+ * decodes each block once.
+ */
+class compressed_window
+{
+  public:
+    static constexpr int window_blocks = 3;
+    // the longest run of padded positions map() can cover
+    static constexpr int max_span = (window_blocks - 1) * compressed_channel::block_frames + 1;
+
+    void reset() { valid = false; }
+    /*
+     * Makes padded positions from..to (inclusive, indexed like sample::SampleData) readable
+     * and sets data[c] so data[c][p] is position p. to - from must be below max_span. The
+     * pointers are only meaningful for positions within the range.
+     */
+    void map(const sample *s, int from, int to, void *data[2]);
+
+  private:
+    short buffer[2][window_blocks * compressed_channel::block_frames];
+    int64_t first_block{0}; // of the window, in frames of the unpadded data
+    bool valid{false};
+};
+
+#endif // SHORTCIRCUIT_SAMPLE_CODEC_H
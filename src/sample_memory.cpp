@@ -0,0 +1,95 @@
+/*
+** Shortcircuit XT is Free and Open Source Software
+**
+** Shortcircuit is made available under the Gnu General Public License, v3.0
+** https://www.gnu.org/licenses/gpl-3.0.en.html; The authors of the code
+** reserve the right to re-license their contributions under the MIT license in the
+** future at the discretion of the project maintainers.
+**
+** Copyright 2004-2021 by various individuals as described by the git transaction log
+**
+** All source at: https://github.com/surge-synthesizer/surge.git
+**
+** Shortcircuit was a commercial product from 2004-2018, with copyright and ownership
+** in that period held by Claes Johanson at Vember Audio. Claes made Shortcircuit
+** open source in December 2020.
+*/
+
+#include "sample_memory.h"
+#include "sample.h"
+
+#include <algorithm>
+#include <chrono>
+
+sample_memory &sample_memory::get()
+{
+    static sample_memory m;
+    return m;
+}
+
+uint32_t sample_memory::now()
+{
+    static const auto start = std::chrono::steady_clock::now();
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+    return (uint32_t)ms + 1;
+}
+
+void sample_memory::add(sample *s)
+{
+    std::lock_guard<std::mutex> g(mutex);
+    samples.push_back(s);
+}
+
+void sample_memory::remove(sample *s)
+{
+    std::lock_guard<std::mutex> g(mutex);
+    auto i = std::find(samples.begin(), samples.end(), s);
+    if (i != samples.end())
+    {
+        *i = samples.back();
+        samples.pop_back();
+    }
+}
+
+size_t sample_memory::update()
+{
+    std::lock_guard<std::mutex> g(mutex);
+    size_t total = 0;
+    for (auto s : samples)
+        total += s->get_resident_bytes();
+    usage = total;
+
+    size_t limit = budget;
+    if (!limit || total <= limit)
+        return 0;
+
+    std::vector<sample *> lru;
+    auto t = now();
+    for (auto s : samples)
+        if (s->is_resident() && s->get_resident_bytes() && !s->is_playing(t))
+            lru.push_back(s);
+    // never played (0) goes first
+    std::sort(lru.begin(), lru.end(),
+              [](auto a, auto b) { return a->get_last_played() < b->get_last_played(); });
+
+    size_t evicted = 0;
+    for (auto s : lru)
+    {
+        if (total <= limit)
+            break;
+        auto before = s->get_resident_bytes();
+        if (!s->page_out())
+            continue; // compressed, not loaded from a file or pinned by a save
+        auto after = s->get_resident_bytes();
+        if (after < before)
+        {
+            total -= before - after;
+            evicted += before - after;
+        }
+        evictions++;
+    }
+    usage = total;
+    return evicted;
+}
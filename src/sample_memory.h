@@ -0,0 +1,78 @@
+/*
+** Shortcircuit XT is Free and Open Source Software
+**
+** Shortcircuit is made available under the Gnu General Public License, v3.0
+** https://www.gnu.org/licenses/gpl-3.0.en.html; The authors of the code
+** reserve the right to re-license their contributions under the MIT license in the
+** future at the discretion of the project maintainers.
+**
+** Copyright 2004-2021 by various individuals as described by the git transaction log
+**
+** All source at: https://github.com/surge-synthesizer/surge.git
+**
+** Shortcircuit was a commercial product from 2004-2018, with copyright and ownership
+** in that period held by Claes Johanson at Vember Audio. Claes made Shortcircuit
+** open source in December 2020.
+*/
+
+#ifndef SHORTCIRCUIT_SAMPLE_MEMORY_H
+#define SHORTCIRCUIT_SAMPLE_MEMORY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+class sample;
+
+/*
+ * Accounting of the memory held by samples across all parts and all sampler instances in the
+ * process, with an optional budget. Every sample registers itself for its lifetime and keeps
+ * its resident byte count and the time it was last played up to date.
+ *
+ * update() recounts, and while over budget pages out the least recently played samples which
+ * can be, keeping their preload heads (see sample::page_out): those backed by the cache read
+ * the rest back from there, those held on the heap decode their file again. Samples a voice
+ * rendered within the last playing_grace_ms are still playing and stay. Compressed samples
+ * and those not loaded from a file always count but are never evicted, so the budget can go
+ * unmet, which over_budget tells. Each sampler's sample worker calls update periodically;
+ * the getters are atomic and fine on the audio thread.
+ */
+class sample_memory
+{
+  public:
+    static sample_memory &get();
+
+    void set_budget(size_t bytes) { budget = bytes; } // 0 for no limit
+    size_t get_budget() const { return budget; }
+    size_t get_usage() const { return usage; }
+    uint64_t get_evictions() const { return evictions; }
+    // as of the last update, with nothing left that could be paged out
+    bool over_budget() const
+    {
+        size_t b = budget;
+        return b && usage > b;
+    }
+
+    // milliseconds since start up, never 0, for sample::note_played and note_rendered
+    static uint32_t now();
+    // well above the time between blocks, so a stalled audio thread doesn't lose its samples
+    static constexpr uint32_t playing_grace_ms = 250;
+
+    // returns the bytes evicted
+    size_t update();
+
+  private:
+    friend class sample;
+    sample_memory() = default;
+    void add(sample *s);
+    void remove(sample *s);
+
+    std::mutex mutex; // guards samples, held while one is paged out
+    std::vector<sample *> samples;
+    std::atomic<size_t> budget{0}, usage{0};
+    std::atomic<uint64_t> evictions{0};
+};
+
+#endif // SHORTCIRCUIT_SAMPLE_MEMORY_H
@@ -12,8 +12,11 @@
 #include "globals.h"
 #include "synthesis/mathtables.h"
 #include "sample.h"
+#include "sample_memory.h"
+#include "loaders/sample_cache.h"
 #include "sampler_voice.h"
 #include "infrastructure/logfile.h"
+#include "infrastructure/sample_arena.h"
 #include "configuration.h"
 #include "interaction_parameters.h"
 #include "synthesis/morphEQ.h"
@@ -27,6 +30,11 @@
 using std::list;
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <set>
+#include <thread>
 using std::max;
 using std::min;
 
@@ -44,21 +52,28 @@ void sampler::set_samplerate(float sr)
     VUidx = 0;
     VUrate = (int)(sr / ((float)block_size * 30.f));
     init_tables(sr, block_size);
+    if (convertSampleRate)
+        set_convert_sample_rate(true);
+}
+
+void sampler::set_convert_sample_rate(bool convert)
+{
+    convertSampleRate = convert;
+    sampleRateTarget = convert ? (uint32_t)samplerate : 0;
+    conf->set_sample_rate_target(sampleRateTarget);
 }
 
 //-------------------------------------------------------------------------------------------------
 
 sampler::sampler(EditorClass *editor, int NumOutputs, WrapperClass *effect,
                  scxt::log::LoggingCallback *cb)
-    : mLogger(cb), mNumOutputs(NumOutputs), actionBuffer(0x4000)
+    : mLogger(cb), mRTLogger(cb), mNumOutputs(NumOutputs), actionBuffer(0x4000)
 {
     LOGINFO(mLogger) << "scxt engine " << scxt::build::FullVersionStr << std::flush;
     conf = new configuration(mLogger);
     memset(externalControllers, 0, sizeof(external_controller) * n_custom_controllers);
 
-#if WINDOWS
     holdengine = false;
-#endif
 
     mpPreview = std::make_unique<sampler::Preview>(&time_data, this);
 
@@ -111,6 +126,7 @@ sampler::sampler(EditorClass *editor, int NumOutputs, WrapperClass *effect,
         partv[c].mm->assign(conf, 0, &parts[c], 0, &controllers[n_controllers * c], automation,
                             &time_data);
     }
+    restart_random();
 
     for (int i = 0; i < 16; i++)
     {
@@ -162,6 +178,60 @@ sampler::sampler(EditorClass *editor, int NumOutputs, WrapperClass *effect,
         100.0;
     mAutoPreview =
         defaultsProvider->getUserDefaultValue(scxt::defaults::DefaultKeys::previewAuto, false);
+    if (defaultsProvider->getUserDefaultValue(scxt::defaults::DefaultKeys::sampleCache, false))
+    {
+        conf->set_sample_cache_path(userDocumentDirectory / "Cache" / "Samples");
+        int cache_mb = defaultsProvider->getUserDefaultValue(
+            scxt::defaults::DefaultKeys::sampleCacheBudget, 4096);
+        sampleCacheBudget = (uint64_t)std::max(cache_mb, 0) << 20;
+    }
+    conf->set_compress_samples(
+        defaultsProvider->getUserDefaultValue(scxt::defaults::DefaultKeys::compressSamples, false));
+    conf->set_sample_storage(defaultsProvider->getUserDefaultValue(
+        scxt::defaults::DefaultKeys::sampleStorage, (int)ss_native));
+    int analysis = 0;
+    if (defaultsProvider->getUserDefaultValue(scxt::defaults::DefaultKeys::foldMonoSamples, false))
+        analysis |= sa_fold_mono;
+    if (defaultsProvider->getUserDefaultValue(scxt::defaults::DefaultKeys::trimSampleSilence,
+                                              false))
+        analysis |= sa_trim_silence;
+    conf->set_sample_analysis(analysis);
+    conf->set_load_on_demand(defaultsProvider->getUserDefaultValue(
+        scxt::defaults::DefaultKeys::loadSamplesOnDemand, false));
+    if (conf->get_load_on_demand() && conf->get_compress_samples())
+    {
+        LOGWARNING(mLogger) << "Samples are compressed, so they are loaded in full rather than on "
+                               "demand"
+                            << std::flush;
+        conf->set_load_on_demand(false);
+    }
+    set_convert_sample_rate(defaultsProvider->getUserDefaultValue(
+        scxt::defaults::DefaultKeys::convertSampleRate, false));
+    scxt::SampleArena::Config arena;
+    int lock_mb =
+        defaultsProvider->getUserDefaultValue(scxt::defaults::DefaultKeys::sampleLockBudget, 0);
+    arena.lockBudget = (size_t)std::max(lock_mb, 0) << 20;
+    arena.prefault =
+        defaultsProvider->getUserDefaultValue(scxt::defaults::DefaultKeys::samplePrefault, true);
+    arena.hugePages = (scxt::SampleArena::HugePages)limit_range(
+        defaultsProvider->getUserDefaultValue(scxt::defaults::DefaultKeys::sampleHugePages,
+                                              (int)scxt::SampleArena::hugePagesTransparent),
+        (int)scxt::SampleArena::hugePagesOff, (int)scxt::SampleArena::hugePagesExplicit);
+    scxt::SampleArena::get().configure(arena);
+    // shared by every instance in the process, the last one constructed sets it
+    int budget_mb =
+        defaultsProvider->getUserDefaultValue(scxt::defaults::DefaultKeys::sampleMemoryBudget, 0);
+    sample_memory::get().set_budget((size_t)std::max(budget_mb, 0) << 20);
+    set_control_interval(
+        defaultsProvider->getUserDefaultValue(scxt::defaults::DefaultKeys::controlInterval, 1));
+    shedder.set_max_stage(defaultsProvider->getUserDefaultValue(
+        scxt::defaults::DefaultKeys::loadShedMaxStage, (int)load_shedder::ls_skip_filter2));
+    auto silence_ms = defaultsProvider->getUserDefaultValue(
+        scxt::defaults::DefaultKeys::voiceSilenceTimeout, 100);
+    set_voice_silence_timeout(silence_ms * 0.001f);
+
+    sampleWorker = std::thread([this]() { sample_worker_loop(); });
+    reclaimParticipant = scxt::Reclaimer::get().registerParticipant();
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -182,6 +252,13 @@ void sampler::multi_init()
 
 sampler::~sampler(void)
 {
+    {
+        std::lock_guard<std::mutex> g(sampleWorkerMutex);
+        sampleWorkerStop = true;
+    }
+    sampleWorkerCV.notify_all();
+    sampleWorker.join();
+
     free_all();
     int i;
     for (i = 0; i < max_voices; i++)
@@ -211,6 +288,64 @@ sampler::~sampler(void)
                                                  (int)(round(mPreviewLevel * 100.0)));
         defaultsProvider->updateUserDefaultValue(scxt::defaults::previewAuto, mAutoPreview);
     }
+
+    // samples and filters freed above may still be waiting in the reclaimer
+    scxt::Reclaimer::get().unregisterParticipant(reclaimParticipant);
+}
+
+void sampler::set_control_interval(int blocks)
+{
+    control_interval = limit_range(blocks, 1, max_control_interval);
+    // voices pick this up at their next control update
+    for (int i = 0; i < max_voices; i++)
+        voices[i]->control_interval = control_interval;
+}
+
+void sampler::set_voice_silence_timeout(float seconds)
+{
+    // voices pick this up at their next note on
+    for (int i = 0; i < max_voices; i++)
+        voices[i]->silence_timeout = std::max(seconds, 0.f);
+}
+
+bool sampler::set_sample_storage(int sample_id, int storage)
+{
+    std::lock_guard<std::mutex> d(sampleDataMutex);
+    std::lock_guard g(cs_patch);
+    // a state save may be writing the data out
+    if (sample_id < 0 || sample_id >= (int)max_samples || !samples[sample_id] ||
+        samples[sample_id]->save_pins)
+        return false;
+    for (int z = 0; z < max_zones; z++)
+        if (zone_exists[z] && (zones[z].sample_id == sample_id))
+            kill_notes(z);
+    samples[sample_id]->page_in(); // the conversion reads all of it
+    return samples[sample_id]->convert_storage(storage);
+}
+
+void sampler::set_random_seed(uint64_t seed)
+{
+    random_seed = seed;
+    restart_random();
+}
+
+void sampler::restart_random()
+{
+    // parts and effects take streams from the top, notes count up from 0
+    notes_started = 0;
+    for (int p = 0; p < n_sampler_parts; p++)
+    {
+        partv[p].rng.seed(random_seed, ~(uint64_t)p);
+        partv[p].mm->seed_random(partv[p].rng.next());
+    }
+    multiv.rng.seed(random_seed, ~(uint64_t)n_sampler_parts);
+}
+
+void sampler::set_realtime(bool rt)
+{
+    if (rt != realtime)
+        shedder.reset();
+    realtime = rt;
 }
 
 bool sampler::zone_exist(int id)
@@ -427,6 +562,35 @@ void sampler::update_zone_switches(int z)
         (mm.is_source_used(ss_LFO3) & ve_LFO3) | (mm.is_source_used(ss_EG2) & ve_EG2);
 }
 
+void sampler::compile_zone_index()
+{
+    // cleared first, so an edit which races the compile marks it again
+    zone_index_dirty = false;
+    zone_index_count = 0;
+    for (int z = 0; z < max_zones; z++)
+    {
+        auto &h = zone_index[z];
+        h.flags = 0;
+        if (!zone_exists[z])
+            continue;
+
+        const auto &zn = zones[z];
+        h.flags = zhf_exists;
+        if (zn.mute)
+            h.flags |= zhf_mute;
+        if (zn.playmode == pm_forward_release)
+            h.flags |= zhf_release;
+        if (zn.ignore_part_polymode)
+            h.flags |= zhf_ignore_polymode;
+        h.part = zn.part;
+        h.key_low = zn.key_low - zn.key_low_fade;
+        h.key_high = zn.key_high + zn.key_high_fade;
+        for (int a = 0; a < 3; a++)
+            h.aux_output[a] = zn.aux[a].output;
+        zone_index_count = z + 1;
+    }
+}
+
 //-------------------------------------------------------------------------------------------------
 
 bool sampler::clone_zone(int zone_id, int *new_z, bool same_key)
@@ -449,6 +613,7 @@ bool sampler::clone_zone(int zone_id, int *new_z, bool same_key)
         samples[s]->remember();
 
     zone_exists[i] = true;
+    invalidate_zone_index();
 
     if (!same_key)
     {
@@ -487,6 +652,7 @@ bool sampler::slice_to_zone(int zone_id, int slice)
             zones[nz].key_root = zones[zone_id].key_root + slice;
             zones[nz].key_high = zones[nz].key_root;
             zones[nz].key_low = zones[nz].key_root;
+            invalidate_zone_index();
 
             return true;
         }
@@ -506,6 +672,7 @@ bool sampler::slices_to_zones(int zone_id)
             this->slice_to_zone(zone_id, i);
         }
         zones[zone_id].mute = true;
+        invalidate_zone_index();
 
         return true;
     }
@@ -559,7 +726,8 @@ bool sampler::get_sample_id(const fs::path &filename, int *s_id)
     int s;
     for (s = 0; s < max_samples; s++)
     {
-        if (samples[s])
+        // positions in the file are for the data as decoded
+        if (samples[s] && !samples[s]->rate_converted)
         {
             if (samples[s]->compare_filename(fnstr.c_str()))
             {
@@ -574,7 +742,11 @@ bool sampler::get_sample_id(const fs::path &filename, int *s_id)
 
 //-------------------------------------------------------------------------------------------------
 
-void sampler::InitZone(int i) { SInitZone(&zones[i]); }
+void sampler::InitZone(int i)
+{
+    SInitZone(&zones[i]);
+    invalidate_zone_index();
+}
 
 //-------------------------------------------------------------------------------------------------
 
@@ -669,6 +841,8 @@ void sampler::SInitZone(sample_zone *pZone)
 
 bool sampler::add_zone(const fs::path &filename, int *new_z, char part, bool use_root_key)
 {
+    load_in_progress loading{this};
+
     // find free zone and create zone object
     int i = GetFreeZoneId();
     if (i < 0)
@@ -720,10 +894,10 @@ bool sampler::add_zone(const fs::path &filename, int *new_z, char part, bool use
 
     if (s >= 0)
     {
-        zones[i].sample_stop = samples[s]->sample_length;
-        zones[i].loop_end = samples[s]->sample_length;
+        zones[i].sample_stop = samples[s]->source_length;
+        zones[i].loop_end = samples[s]->source_length;
 
-        zones[i].hp[0].end_sample = samples[s]->sample_length;
+        zones[i].hp[0].end_sample = samples[s]->source_length;
         zones[i].pitchcorrection = samples[s]->meta.detune;
 
         /*if(samples[s]->inst_present)
@@ -784,6 +958,7 @@ bool sampler::add_zone(const fs::path &filename, int *new_z, char part, bool use
     if (new_z)
         *new_z = i;
     zone_exists[i] = true;
+    invalidate_zone_index();
     update_zone_switches(i);
     return true;
 }
@@ -794,6 +969,7 @@ bool sampler::replace_zone(int z, const fs::path &fileName)
 {
     // ATTENTION !!! if sample refcount> 1 then the sampling should only be changed for the current
     // zone !! kill all notes for the given zone
+    load_in_progress loading{this};
     kill_notes(z);
     int s_old = zones[z].sample_id;
 
@@ -817,13 +993,13 @@ bool sampler::replace_zone(int z, const fs::path &fileName)
     std::lock_guard lockUntilEnd(cs_patch);
     if ((s_old >= 0) && samples[s_old]->forget())
     {
-        delete samples[s_old];
+        sample::retire(samples[s_old]);
         samples[s_old] = 0;
     }
 
     zones[z].sample_id = s;
     zones[z].sample_start = 0;
-    zones[z].sample_stop = samples[s]->sample_length;
+    zones[z].sample_stop = samples[s]->source_length;
     zones[z].hp[0].start_sample = 0;
 
     if (samples[s]->meta.n_slices > 1)
@@ -882,6 +1058,7 @@ bool sampler::replace_zone(int z, const fs::path &fileName)
     std::string nameOnly;
     decode_path(fileName, nullptr, nullptr, &nameOnly);
     strncpy_0term(zones[z].name, nameOnly.c_str(), 32);
+    invalidate_zone_index(); // the playmode may have changed
     update_zone_switches(z);
     return true;
 }
@@ -893,9 +1070,10 @@ bool sampler::free_zone(uint32_t zoneid)
     std::lock_guard g(cs_patch);
     kill_notes(zoneid);
     zone_exists[zoneid] = false;
+    invalidate_zone_index();
     if ((zones[zoneid].sample_id >= 0) && samples[zones[zoneid].sample_id]->forget())
     {
-        delete samples[zones[zoneid].sample_id];
+        sample::retire(samples[zones[zoneid].sample_id]);
         samples[zones[zoneid].sample_id] = 0;
     }
     return true;
@@ -935,6 +1113,331 @@ void sampler::free_all()
 
 //-------------------------------------------------------------------------------------------------
 
+sampler::preloaded_samples sampler::preload_samples(const std::vector<fs::path> &filenames)
+{
+    // only decode each sample once, and skip those which are already resident
+    std::vector<fs::path> todo;
+    std::set<fs::path> seen;
+    for (auto &f : filenames)
+    {
+        if (f.empty() || !seen.insert(f).second)
+            continue;
+        int s;
+        if (!get_sample_id(f, &s))
+            todo.push_back(f);
+    }
+    if (todo.empty())
+        return {};
+
+    // the worker threads only touch their own sample objects, logger and configuration, the
+    // sampler state isn't changed until everything is decoded
+    std::vector<std::unique_ptr<sample>> decoded(todo.size());
+    std::atomic<size_t> next{0};
+    auto relative = conf->get_relative_path();
+    auto cachePath = conf->get_sample_cache_path();
+    auto compressSamples = conf->get_compress_samples();
+    auto sampleStorage = conf->get_sample_storage();
+    auto sampleAnalysis = conf->get_sample_analysis();
+    auto loadOnDemand = conf->get_load_on_demand();
+    auto rateTarget = conf->get_sample_rate_target();
+    auto logCB = mLogger.getCallback();
+    auto worker = [&]() {
+        scxt::log::StreamLogger workerLogger(logCB);
+        configuration workerConf(workerLogger);
+        workerConf.set_relative_path(relative);
+        workerConf.set_sample_cache_path(cachePath);
+        workerConf.set_compress_samples(compressSamples);
+        workerConf.set_sample_storage(sampleStorage);
+        workerConf.set_sample_analysis(sampleAnalysis);
+        workerConf.set_load_on_demand(loadOnDemand);
+        workerConf.set_sample_rate_target(rateTarget);
+
+        size_t i;
+        while ((i = next++) < todo.size())
+        {
+            auto smp = std::make_unique<sample>(conf);
+            if (smp->load(todo[i], &workerConf))
+                decoded[i] = std::move(smp);
+        }
+    };
+
+    size_t n_threads = std::max(1u, std::thread::hardware_concurrency());
+    n_threads = std::min(n_threads, todo.size());
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < n_threads; t++)
+        pool.emplace_back(worker);
+    worker();
+    for (auto &t : pool)
+        t.join();
+
+    // commit the whole batch in one go
+    preloaded_samples res;
+    std::lock_guard g(cs_patch);
+    size_t dropped = 0;
+    for (size_t i = 0; i < todo.size(); i++)
+    {
+        if (!decoded[i])
+        {
+            res.failed.insert(todo[i]); // the worker has logged why
+            continue;
+        }
+        int s = dropped ? -1 : GetFreeSampleId();
+        if (s < 0)
+        {
+            // no slot left, the decoded sample goes with decoded
+            res.failed.insert(todo[i]);
+            dropped++;
+            continue;
+        }
+        // keeps the refcount of 1 a new sample starts with, so a purge can't retire it before
+        // its zones remember it
+        samples[s] = decoded[i].release();
+        res.sample_ids.push_back(s);
+    }
+    if (dropped)
+        LOGERROR(mLogger) << "Reached the limit of " << max_samples << " samples, " << dropped
+                          << " more could not be loaded" << std::flush;
+    return res;
+}
+
+void sampler::release_unused_samples(const preloaded_samples &batch)
+{
+    std::lock_guard g(cs_patch);
+    for (auto s : batch.sample_ids)
+    {
+        if (samples[s] && samples[s]->forget())
+        {
+            sample::retire(samples[s]);
+            samples[s] = 0;
+        }
+    }
+}
+
+void sampler::sample_worker_loop()
+{
+    // keep the disk cache in bounds, out of the way of the constructor and the audio thread
+    auto cacheDir = conf->get_sample_cache_path();
+    if (!cacheDir.empty())
+    {
+        auto bytes = prune_sample_cache(cacheDir, sampleCacheBudget);
+        if (bytes)
+            RTLOGINFO(mRTLogger, "Pruned {} MB from the sample cache", bytes >> 20);
+    }
+
+    // voices only flag the samples they want, so poll for them
+    std::unique_lock<std::mutex> lk(sampleWorkerMutex);
+    while (!sampleWorkerCV.wait_for(lk, std::chrono::milliseconds(50),
+                                    [this]() { return sampleWorkerStop; }))
+    {
+        lk.unlock();
+        serve_sample_requests();
+        auto &memory = sample_memory::get();
+        memory.update();
+        // once each time the budget goes unmet rather than every poll
+        bool over = memory.over_budget();
+        if (over && !memoryOverBudget)
+            RTLOGWARNING(mRTLogger,
+                         "Samples hold {} MB, over the {} MB budget, and none can be paged out",
+                         memory.get_usage() >> 20, memory.get_budget() >> 20);
+        memoryOverBudget = over;
+        if (purgeRequested.exchange(false))
+        {
+            auto bytes = purge_unused_samples();
+            RTLOGINFO(mRTLogger, "Purged {} MB of unplayed samples", bytes >> 20);
+        }
+        lk.lock();
+    }
+}
+
+void sampler::serve_sample_requests()
+{
+    for (;;)
+    {
+        int s = -1;
+        sample *smp = nullptr;
+        uint32_t rate = 0;
+        {
+            std::lock_guard g(cs_patch);
+            for (int i = 0; i < (int)max_samples; i++)
+            {
+                if (samples[i] && wants_rate_conversion(i))
+                    rate = sampleRateTarget;
+                if (samples[i] && (rate || samples[i]->mips_requested() ||
+                                   samples[i]->page_in_requested()))
+                {
+                    s = i;
+                    smp = samples[i];
+                    smp->remember(); // keeps it alive if its zones go away meanwhile
+                    break;
+                }
+            }
+        }
+        if (!smp)
+            return;
+
+        if (rate)
+            convert_sample_rate(s, smp, rate);
+        {
+            std::lock_guard<std::mutex> d(sampleDataMutex);
+            if (smp->page_in_requested())
+                smp->page_in();
+            if (smp->mips_requested())
+                smp->build_mips();
+        }
+
+        std::lock_guard g(cs_patch);
+        if (smp->forget())
+        {
+            sample::retire(smp);
+            samples[s] = nullptr;
+        }
+        std::lock_guard<std::mutex> lk(sampleWorkerMutex);
+        if (sampleWorkerStop)
+            return;
+    }
+}
+
+bool sampler::wants_rate_conversion(int sample_id)
+{
+    auto s = samples[sample_id];
+    uint32_t rate = sampleRateTarget;
+    if (!rate || s->sample_rate == rate || s->is_compressed() || s->conversion_failed == rate ||
+        s->pending_rate || loadsInProgress)
+        return false;
+    // samples parked by preload_samples wait for their zones
+    for (int z = 0; z < max_zones; z++)
+        if (zone_exists[z] && (zones[z].sample_id == sample_id))
+            return true;
+    return false;
+}
+
+void sampler::convert_sample_rate(int sample_id, sample *s, uint32_t rate)
+{
+    // the work happens outside cs_patch, voices go on playing the data as it was meanwhile
+    std::lock_guard<std::mutex> d(sampleDataMutex);
+    s->page_in(); // the conversion reads all of it
+    sample::rate_conversion rc;
+    if (!s->convert_rate(rate, rc))
+    {
+        s->conversion_failed = rate;
+        RTLOGWARNING(mRTLogger, "Could not resample {} to {} Hz", s->GetName(), rate);
+        return;
+    }
+
+    // rather than cut the voices playing it, fade them out and switch over once they are
+    // gone. Those still playing after rate_switch_wait_ms, eg. as nothing renders them, stop
+    auto start = std::chrono::steady_clock::now();
+    for (;;)
+    {
+        {
+            std::lock_guard g(cs_patch);
+            // a state save may be writing the data out, or a load began, try again later
+            if (s->save_pins || loadsInProgress)
+                return;
+            bool timedOut = std::chrono::steady_clock::now() - start >
+                            std::chrono::milliseconds(rate_switch_wait_ms);
+            if (!release_sample_voices(sample_id) || timedOut)
+            {
+                for (int z = 0; z < max_zones; z++)
+                    if (zone_exists[z] && (zones[z].sample_id == sample_id))
+                        kill_notes(z);
+                map_zone_positions(sample_id, *rc.resampler);
+                s->apply_rate_conversion(rc);
+                break;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    s->build_mips();
+}
+
+void sampler::apply_load_rate_conversions()
+{
+    for (int i = 0; i < (int)max_samples; i++)
+    {
+        sample *smp = nullptr;
+        std::unique_ptr<sample::rate_conversion> rc;
+        {
+            std::lock_guard g(cs_patch);
+            // nothing plays these yet (see PlayNote), so no voice reads the old data
+            if (!samples[i] || !samples[i]->pending_rate)
+                continue;
+            smp = samples[i];
+            smp->remember();
+            map_zone_positions(i, *smp->pending_rate->resampler);
+            smp->apply_rate_conversion(*smp->pending_rate);
+        }
+
+        {
+            std::lock_guard<std::mutex> d(sampleDataMutex);
+            smp->finish_load();
+        }
+
+        std::lock_guard g(cs_patch);
+        rc = std::move(smp->pending_rate); // the old buffers, freed outside cs_patch
+        if (smp->forget())
+        {
+            sample::retire(smp);
+            samples[i] = nullptr;
+        }
+    }
+}
+
+void sampler::map_zone_positions(int sample_id, const polyphase_resampler &r)
+{
+    auto map = [&r](unsigned int &p) { p = r.map_position(p); };
+    for (int z = 0; z < max_zones; z++)
+    {
+        if (!zone_exists[z] || (zones[z].sample_id != sample_id))
+            continue;
+        auto &zone = zones[z];
+        map(zone.sample_start);
+        map(zone.sample_stop);
+        map(zone.loop_start);
+        map(zone.loop_end);
+        map(zone.loop_crossfade_length);
+        for (auto &hp : zone.hp)
+        {
+            map(hp.start_sample);
+            map(hp.end_sample);
+        }
+    }
+}
+
+size_t sampler::purge_unused_samples()
+{
+    size_t bytes = 0;
+    for (int i = 0; i < (int)max_samples; i++)
+    {
+        sample *smp = nullptr;
+        {
+            std::lock_guard g(cs_patch);
+            if (samples[i] && !samples[i]->was_played())
+            {
+                smp = samples[i];
+                smp->remember();
+            }
+        }
+        if (!smp)
+            continue;
+
+        {
+            std::lock_guard<std::mutex> d(sampleDataMutex);
+            bytes += smp->page_out();
+        }
+
+        std::lock_guard g(cs_patch);
+        if (smp->forget())
+        {
+            sample::retire(smp);
+            samples[i] = nullptr;
+        }
+    }
+    return bytes;
+}
+
+//-------------------------------------------------------------------------------------------------
+
 int sampler::GetFreeSampleId()
 {
     int i;
@@ -1122,10 +1625,13 @@ void sampler::Preview::Start(const fs::path &Filename)
     // auto ppath = string_to_path(Filename);
     auto ppath = Filename;
 
-    if (mpSample->load(ppath))
+    // previews play the file as it is, there are no zones to map to another rate
+    configuration previewConf(*mpParent->conf);
+    previewConf.set_sample_rate_target(0);
+    if (mpSample->load(ppath, &previewConf))
     {
         mZone.sample_start = 0;
-        mZone.sample_stop = mpSample->sample_length;
+        mZone.sample_stop = mpSample->source_length;
         mZone.key_root = 60;
         mZone.playmode = pm_forward_shot;
         mZone.aux[0].level = mpParent->mPreviewLevel;
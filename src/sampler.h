@@ -13,9 +13,16 @@ class sampler;
 #include "multiselect.h"
 #include "sampler_state.h"
 #include "infrastructure/logfile.h"
+#include "infrastructure/rt_logger.h"
+#include "infrastructure/reclaimer.h"
 #include "browser/ContentBrowser.h"
+#include "load_shedder.h"
+#include "util/prng.h"
 #include <list>
+#include <memory>
 #include <string>
+#include <atomic>
+#include <condition_variable>
 #include <thread>
 #include <mutex>
 #include <vector>
@@ -38,6 +45,7 @@ typedef int WrapperClass;
 class modmatrix;
 class TiXmlElement;
 class configuration;
+class polyphase_resampler;
 
 struct voicestate
 {
@@ -46,6 +54,28 @@ struct voicestate
     uint32 zone_id;
 };
 
+/*
+ * The sample_zone fields PlayNote tests for every zone and process_audio reads for every voice,
+ * packed so neither strides through whole zones (which carry the hitpoints, names and so on).
+ * zones[] stays the source of truth; the sampler and multiselect methods which edit it call
+ * invalidate_zone_index(), as must code writing to zones[] directly, and the index is
+ * recompiled before the next note or block.
+ */
+struct zone_hot
+{
+    int16_t key_low, key_high; // including the fades
+    uint8_t flags, part;
+    int8_t aux_output[3];
+};
+
+enum zone_hot_flags
+{
+    zhf_exists = 1 << 0,
+    zhf_mute = 1 << 1,
+    zhf_release = 1 << 2, // pm_forward_release
+    zhf_ignore_polymode = 1 << 3,
+};
+
 static constexpr int n_custom_controllers = 16;
 
 enum external_controller_type
@@ -77,18 +107,23 @@ class sampler
     struct alignas(16) partvoice
     {
         lipol_ps fmix1, fmix2, ampL, ampR, pfg, aux1L, aux1R, aux2L, aux2R;
+        lipol_span<9> ramps{&fmix1, &fmix2, &ampL, &ampR, &pfg, &aux1L, &aux1R, &aux2L, &aux2R};
         filter *pFilter[2];
         int last_ft[2];
         modmatrix *mm;
+        prng rng;
     } partv[n_sampler_parts];
     struct alignas(16) multivoice
     {
         lipol_ps pregain, postgain;
         filter *pFilter[n_sampler_effects];
         int last_ft[n_sampler_effects];
+        prng rng;
     } multiv;
     float *output_ptr[max_outputs << 1];
     scxt::log::StreamLogger mLogger;
+    // for the audio thread and the sample worker
+    scxt::log::RealtimeLogger mRTLogger;
 
     // Public Interface
 
@@ -123,6 +158,7 @@ class sampler
     void release_zone(int zone_id);
     void voice_off(uint32 voice_id);
     void kill_notes(uint32 zone_id);
+    bool release_sample_voices(int sample_id); // fades them out, true while any are left
     float *get_output_pointer(int id, int channel, int part); // internal
     bool get_key_name(char *str, int channel, int key);
     void process_audio();
@@ -140,6 +176,52 @@ class sampler
 
     int get_headroom() { return headroom; };
     void set_samplerate(float sr);
+    // run the voice and part control paths (envelopes, LFOs, mod matrix, pitch, controller
+    // smoothing) every n audio blocks, with the interpolators ramping across the interval
+    static constexpr int max_control_interval = 8;
+    void set_control_interval(int blocks);
+    int get_control_interval() const { return control_interval; }
+    // how far to go shedding load when rendering falls behind real time (see load_shedder),
+    // and whether it should at all; offline renders can take as long as they need
+    void set_max_load_shed_stage(int stage) { shedder.set_max_stage(stage); }
+    int get_load_shed_stage() const { return shedder.get_stage(); }
+    void set_realtime(bool rt);
+    // end released voices once they have been silent (below -120 dBFS) for this long, 0 keeps
+    // them until their envelope and filter tails have run out
+    void set_voice_silence_timeout(float seconds);
+    // voices, parts and effects draw their random numbers from streams derived from this seed
+    // and, for voices, the number of notes started since. restart_random() begins them again,
+    // so rendering the same events twice gives the same output
+    void set_random_seed(uint64_t seed);
+    uint64_t get_random_seed() const { return random_seed; }
+    void restart_random();
+    // narrow a loaded sample to ss_packed24 or ss_int16 storage (see sample.h), stopping the
+    // voices playing it. False while a state save writes the sample out. New loads use
+    // configuration::set_sample_storage
+    bool set_sample_storage(int sample_id, int storage);
+    /*
+     * Resample every sample zones play to the engine rate. Samples are converted as they load,
+     * on the loading threads (see sample::pending_rate), and switched over with their zones'
+     * positions rescaled to match when the last load in progress ends, before anything plays
+     * them. Those loaded before, eg. following a set_samplerate change, are converted on the
+     * sample worker thread: the voices playing one fade out and it switches over once they
+     * are gone (convert_sample_rate).
+     */
+    void set_convert_sample_rate(bool convert);
+    bool get_convert_sample_rate() const { return convertSampleRate; }
+    // held by whatever loads samples and sets up their zones, see set_convert_sample_rate
+    struct load_in_progress
+    {
+        sampler *s;
+        explicit load_in_progress(sampler *s) : s(s) { s->loadsInProgress++; }
+        ~load_in_progress()
+        {
+            if (--s->loadsInProgress == 0)
+                s->apply_load_rate_conversions();
+        }
+    };
+    std::atomic<int> loadsInProgress{0};
+    void apply_load_rate_conversions();
     bool zone_exist(int id);
     bool verify_zone_validity(int zone_id);
 
@@ -199,12 +281,41 @@ class sampler
     bool replace_zone(int z, const fs::path &filename);
     bool free_zone(uint32 zoneid);
     void update_zone_switches(int zone);
+    void invalidate_zone_index() { zone_index_dirty = true; }
+    void compile_zone_index();
     bool get_sample_id(const fs::path &filename, int *s_id);
     int find_next_free_key(int part);
     int GetFreeSampleId();
+    // decode a batch of samples concurrently and park them in free slots so the add_zone calls
+    // of a multi-sample import find them already loaded. Parked samples hold a pin (a refcount
+    // of 1) until the batch is handed to release_unused_samples once the zones have been
+    // created. Importers skip the regions of failed samples rather than have add_zone decode
+    // them again with cs_patch held.
+    struct preloaded_samples
+    {
+        std::vector<int> sample_ids;
+        std::set<fs::path> failed;
+        bool failed_to_load(const fs::path &p) const { return failed.count(p) != 0; }
+    };
+    preloaded_samples preload_samples(const std::vector<fs::path> &filenames);
+    void release_unused_samples(const preloaded_samples &batch);
+    // builds the band-limited levels voices ask for when playing far above the root and pages
+    // in samples loaded on demand, on its own thread so neither the audio nor the editor
+    // thread waits for them
+    void sample_worker_loop();
+    void serve_sample_requests();
+    bool wants_rate_conversion(int sample_id); // call with cs_patch held
+    void convert_sample_rate(int sample_id, sample *s, uint32_t rate);
+    static constexpr int rate_switch_wait_ms = 500; // then voices still playing are stopped
+    void map_zone_positions(int sample_id, const polyphase_resampler &r);
+    // drops all but the preload head of the samples no voice has played yet
+    // (see sample::page_out), returning the bytes released. Not for the audio thread, which
+    // asks the sample worker with purgeRequested instead.
+    size_t purge_unused_samples();
     int GetFreeZoneId();
     int GetFreeVoiceId(int group_id = 0); // get a free voice id. kills an old voice if necessary
     int softkill_oldest_note(int group_id = 0);
+    int softkill_quietest_released_note();
     void update_highest_voice_id();
 
     int get_zone_poly(int zone);
@@ -336,12 +447,24 @@ class sampler
     // surge needed this so presume SC3 will too one day. For now make it a noop
     void resetStateFromTimeData() {}
 
-    int VUrate, VUidx, lastSentPolyphony{-1};
+    int VUrate, VUidx, lastSentPolyphony{-1}, lastSentShedStage{-1};
+    int lastSentSampleMemory{-1}, lastSentSampleBudget{-1}; // MB
     float automation[n_automation_parameters];
 
     // AudioEffectX	*effect;
     multiselect *selected;
     std::recursive_mutex cs_patch, cs_gui, cs_engine;
+    std::thread sampleWorker;
+    std::mutex sampleWorkerMutex;
+    std::mutex sampleDataMutex; // held while a loaded sample's data is rebuilt
+    std::condition_variable sampleWorkerCV;
+    bool sampleWorkerStop{false};
+    std::atomic<bool> purgeRequested{false};
+    bool memoryOverBudget{false}; // as the sample worker last warned
+    uint64_t sampleCacheBudget{0}; // bytes, the sample worker prunes the disk cache to it
+    bool convertSampleRate{false};
+    std::atomic<uint32_t> sampleRateTarget{0}; // 0 while samples keep their own rates
+    int reclaimParticipant{-1}; // the audio thread's slot, see scxt::Reclaimer
     configuration *conf;
     external_controller externalControllers[n_custom_controllers];
 
@@ -356,7 +479,15 @@ class sampler
     bool volatile AudioHalted; // don't care to wait for the process thread
   protected:
     bool zone_exists[max_zones];
+    zone_hot zone_index[max_zones];
+    int zone_index_count{0}; // one past the highest existing zone
+    std::atomic<bool> zone_index_dirty{true};
     bool holdengine;
+    int control_interval{1};
+    load_shedder shedder;
+    bool realtime{true};
+    int part_control_blocks{1}, part_control_countdown{0};
+    uint64_t random_seed{0}, notes_started{0};
     sampler_voice *voices[max_voices];
     voicestate voice_state[max_voices];
     double headroom_linear;
@@ -370,4 +501,8 @@ class sampler
     int highest_voice_id, highest_group_id;
 
     void *chunkDataPtr, *dbSampleListDataPtr;
+    // chunks of earlier SaveAllAsRIFF calls, see sampler_fileio_riff.cpp
+    struct riff_save_cache;
+    std::shared_ptr<riff_save_cache> riffSaveCache;
+    std::mutex riffSaveMutex; // one save at a time, guards riffSaveCache and chunkDataPtr
 };
@@ -19,7 +19,9 @@
 
 #include "sampler.h"
 #include "sample.h"
+#include "sample_memory.h"
 #include "synthesis/filter.h"
+#include "infrastructure/sample_arena.h"
 
 struct indenter
 {
@@ -65,11 +67,15 @@ std::string sampler::generateInternalStateView() const
             oss << pfx << "id: " << i << "\n";
             SHOWT(channels, s, int);
             SHOW(sample_length, s);
+            SHOW(source_length, s);
             SHOW(sample_rate, s);
             SHOW(grains_initialized, s);
             if (s->grains_initialized)
                 SHOW(num_grains, s);
             SHOW(name, s);
+            oss << pfx << "resident: " << s->is_resident() << "\n";
+            oss << pfx << "last_played: " << s->get_last_played() << "\n";
+            oss << pfx << "resident_bytes: " << s->get_resident_bytes() << "\n";
 
             fs::path p;
             s->get_filename(&p);
@@ -109,6 +115,28 @@ std::string sampler::generateInternalStateView() const
         }
     }
 
+    oss << pfx << "sample_arena:\n";
+    {
+        auto g2 = pfx.up();
+        auto st = scxt::SampleArena::get().getStats();
+        SHOWV(allocatedBytes, st);
+        SHOWV(mappedBytes, st);
+        SHOWV(hugePageBytes, st);
+        SHOWV(lockedBytes, st);
+        SHOWV(lockBudget, st);
+        SHOWV(lockFailures, st);
+        SHOWV(audioMinorFaults, st);
+        SHOWV(audioMajorFaults, st);
+    }
+    oss << pfx << "sample_memory:\n";
+    {
+        auto g2 = pfx.up();
+        auto &m = sample_memory::get();
+        oss << pfx << "usage: " << m.get_usage() << "\n";
+        oss << pfx << "budget: " << m.get_budget() << "\n";
+        oss << pfx << "evictions: " << m.get_evictions() << "\n";
+    }
+
     oss << pfx << "zones:\n";
     for (auto i = 0; i < max_zones; ++i)
     {
@@ -1,5 +1,6 @@
 
 #include "sampler.h"
+#include "sample.h"
 #include "interaction_parameters.h"
 #include "sampler_voice.h"
 #include "util/tools.h"
@@ -23,6 +24,20 @@ void sampler::kill_notes(uint32 zone_id)
     }
 }
 
+bool sampler::release_sample_voices(int sample_id)
+{
+    bool playing = false;
+    for (int i = 0; i < max_voices; i++)
+    {
+        if (voice_state[i].active && (zones[voice_state[i].zone_id].sample_id == sample_id))
+        {
+            voices[i]->uberrelease();
+            playing = true;
+        }
+    }
+    return playing;
+}
+
 void sampler::AllNotesOff()
 {
     int i;
@@ -80,6 +95,29 @@ int sampler::softkill_oldest_note(int group_id)
     return oldest_id;
 }
 
+int sampler::softkill_quietest_released_note()
+{
+    int quietest_id = -1;
+    float quietest = 0.f;
+
+    for (int i = 0; i < max_voices; i++)
+    {
+        if (voice_state[i].active && !voices[i]->is_uberrelease && !voices[i]->gate)
+        {
+            float level = fabs(voices[i]->vca.get_target());
+            if ((quietest_id < 0) || (level < quietest))
+            {
+                quietest = level;
+                quietest_id = i;
+            }
+        }
+    }
+    if (quietest_id >= 0)
+        voices[quietest_id]->uberrelease();
+
+    return quietest_id;
+}
+
 int sampler::GetFreeVoiceId(int group_id)
 {
     int i, v = 0, vg = 0;
@@ -159,7 +197,7 @@ void sampler::play_zone(int z)
     if (!zone_exists[z])
         return;
 
-    if (zones[z].sample_id < 0)
+    if ((zones[z].sample_id < 0) || samples[zones[z].sample_id]->pending_rate)
         return;
 
     if (sample_replace_filename[0] && (selected->zone_is_active(z)))
@@ -172,6 +210,10 @@ void sampler::play_zone(int z)
     int resultchannel = zones[z].part;
     int ch = parts[zones[z].part].MIDIchannel;
     update_zone_switches(z);
+    voices[v]->shed_stage = shedder.get_stage();
+    voices[v]->rng.seed(random_seed, notes_started++);
+    if (!realtime)
+        samples[zones[z].sample_id]->page_in(); // see PlayNote
     voices[v]->play(samples[zones[z].sample_id], &zones[z], &parts[zones[z].part & 0xf],
                     zones[z].key_root, 100, 0, &controllers[n_controllers * ch], automation, 1.f);
     voice_state[v].active = true;
@@ -203,6 +245,9 @@ bool sampler::PlayNote(char channel, char key, char velocity, bool is_release, c
     else
         track_key_triggered(channel, key, velocity);
 
+    if (zone_index_dirty)
+        compile_zone_index();
+
     bool require_ignore = false;
     if (!is_release) // look for legato notes
     {
@@ -211,7 +256,7 @@ bool sampler::PlayNote(char channel, char key, char velocity, bool is_release, c
             if (voice_state[tv].active &&
                 (parts[voice_state[tv].part].polymode == polymode_legato) &&
                 (parts[voice_state[tv].part].MIDIchannel == channel) &&
-                !zones[voice_state[tv].zone_id].ignore_part_polymode)
+                !(zone_index[voice_state[tv].zone_id].flags & zhf_ignore_polymode))
             {
                 if (voices[tv]->gate)
                 {
@@ -228,34 +273,29 @@ bool sampler::PlayNote(char channel, char key, char velocity, bool is_release, c
     }
 
     // find matching zone
-    for (int z = 0; z < max_zones; z++)
+    for (int z = 0; z < zone_index_count; z++)
     {
+        const zone_hot &h = zone_index[z];
         int p = 0, v = 0, n_split = 0, zkey = 0;
         float crossfade_amp = 1.f;
 
-        if (!zone_exists[z])
+        if ((h.flags & (zhf_exists | zhf_mute)) != zhf_exists)
             goto skipzone;
-        if (zones[z].mute)
+        if (require_ignore && !(h.flags & zhf_ignore_polymode))
             goto skipzone;
-        if (require_ignore && !zones[z].ignore_part_polymode)
+        if (is_release != !!(h.flags & zhf_release))
             goto skipzone;
-        if (is_release && (zones[z].playmode != pm_forward_release))
-            goto skipzone;
-        if (!is_release && (zones[z].playmode == pm_forward_release))
-            goto skipzone;
-        if (channel != parts[zones[z].part & 0xf].MIDIchannel)
+        if (channel != parts[h.part & 0xf].MIDIchannel)
             goto skipzone;
         if ((sample_replace_filename[0] != 0) && (selected->zone_is_active(z)))
             goto skipzone;
         if (selected->get_solo() && !selected->zone_is_selected(z))
             goto skipzone;
 
-        p = zones[z].part & 0xf;
+        p = h.part & 0xf;
         zkey = key + parts[p].transpose - parts[p].formant; // key used for range check
 
-        if (zkey < (zones[z].key_low - zones[z].key_low_fade))
-            goto skipzone;
-        if (zkey > (zones[z].key_high + zones[z].key_high_fade))
+        if ((zkey < h.key_low) || (zkey > h.key_high))
             goto skipzone;
         if (!partv[p].mm->check_NC(&zones[z]))
             goto skipzone;
@@ -342,13 +382,13 @@ bool sampler::PlayNote(char channel, char key, char velocity, bool is_release, c
         // if mono, release other voices
         // bool do_play = true;
 
-        if (!zones[z].ignore_part_polymode && (parts[p].polymode == polymode_mono))
+        if (!(h.flags & zhf_ignore_polymode) && (parts[p].polymode == polymode_mono))
         {
             int tv;
             for (tv = 0; tv < max_voices; tv++)
             {
                 if (voice_state[tv].active && (voice_state[tv].part == p) &&
-                    !zones[voice_state[tv].zone_id].ignore_part_polymode)
+                    !(zone_index[voice_state[tv].zone_id].flags & zhf_ignore_polymode))
                     voices[tv]->uberrelease();
             }
         }
@@ -372,9 +412,19 @@ bool sampler::PlayNote(char channel, char key, char velocity, bool is_release, c
         if (parts[zones[z].part & 0xf].vs_xf_equality)
             crossfade_amp = sqrt(crossfade_amp);
 
-        if ((zones[z].sample_id >= 0) && samples[zones[z].sample_id])
+        // samples still being switched to the engine rate don't play until their zones have
+        // been mapped, see apply_load_rate_conversions
+        if ((zones[z].sample_id >= 0) && samples[zones[z].sample_id] &&
+            !samples[zones[z].sample_id]->pending_rate)
         {
             update_zone_switches(z);
+            voices[v]->shed_stage = shedder.get_stage();
+            voices[v]->rng.seed(random_seed, notes_started++);
+            // rendering offline nothing waits on this thread, so rather than play just the
+            // head of a sample loaded on demand, as voices do until the sample worker gets
+            // to it, read the rest in now
+            if (!realtime)
+                samples[zones[z].sample_id]->page_in();
             voices[v]->play(samples[zones[z].sample_id], &zones[z], &parts[p], key, velocity,
                             detune, &controllers[n_controllers * channel], automation,
                             crossfade_amp);
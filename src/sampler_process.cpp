@@ -2,11 +2,15 @@
 #include "configuration.h"
 #include "synthesis/mathtables.h"
 #include "sampler_voice.h"
+#include "sample.h"
+#include "sample_memory.h"
 #include "synthesis/filter.h"
 #include "synthesis/modmatrix.h"
 #include <vt_dsp/basic_dsp.h>
 #include "interaction_parameters.h"
 #include "util/tools.h"
+#include "infrastructure/ticks.h"
+#include "infrastructure/sample_arena.h"
 
 using std::max;
 using std::min;
@@ -36,7 +40,10 @@ void sampler::part_check_filtertypes(int p, int f)
             parts[p].Filter[f].ip, 0, true);
 
         if (partv[p].pFilter[f])
+        {
+            partv[p].pFilter[f]->seed_random(partv[p].rng.next());
             partv[p].pFilter[f]->init();
+        }
         partv[p].last_ft[f] = parts[p].Filter[f].type;
     }
 }
@@ -52,7 +59,10 @@ void sampler::process_global_effects()
             multiv.pFilter[f] =
                 spawn_filter(multi.Filter[f].type, multi.Filter[f].p, multi.Filter[f].ip, 0, true);
             if (multiv.pFilter[f])
+            {
+                multiv.pFilter[f]->seed_random(multiv.rng.next());
                 multiv.pFilter[f]->init();
+            }
             multiv.last_ft[f] = multi.Filter[f].type;
         }
 
@@ -93,43 +103,52 @@ void sampler::process_part(int p)
 
     _MM_ALIGN16 float tempbuf[2][block_size], postfader_buf[2][block_size];
 
-    // smooth controllers
-
-    for (unsigned int i = 0; i < n_controllers; i++)
+    // control path, see set_control_interval
+    if (part_control_countdown == part_control_blocks)
     {
-        float b =
-            fabs(controllers_target[p * n_controllers + i] - controllers[p * n_controllers + i]);
-        float a = 0.1 * b;
-        controllers[p * n_controllers + i] = (1 - a) * controllers[p * n_controllers + i] +
-                                             a * controllers_target[p * n_controllers + i];
+        // smooth controllers
+
+        for (unsigned int i = 0; i < n_controllers; i++)
+        {
+            float b = fabs(controllers_target[p * n_controllers + i] -
+                           controllers[p * n_controllers + i]);
+            float a = min<float>(0.1 * b * part_control_blocks, 1.f);
+            controllers[p * n_controllers + i] = (1 - a) * controllers[p * n_controllers + i] +
+                                                 a * controllers_target[p * n_controllers + i];
+        }
+        for (unsigned int i = 0; i < n_custom_controllers; i++)
+        {
+            float b = fabs(parts[p].userparameter[i] - parts[p].userparameter_smoothed[i]);
+            float a = min<float>(0.1 * b * part_control_blocks, 1.f);
+            parts[p].userparameter_smoothed[i] =
+                (1 - a) * parts[p].userparameter_smoothed[i] + a * parts[p].userparameter[i];
+        }
+
+        partv[p].mm->process_part();
+
+        // update interpolators
+        float amp = db_to_linear(partv[p].mm->get_destination_value(md_part_amplitude));
+        float pan = partv[p].mm->get_destination_value(md_part_pan);
+        partv[p].ampL.set_target_smoothed(megapanL(pan) * amp);
+        partv[p].ampR.set_target_smoothed(megapanR(pan) * amp);
+        amp = db_to_linear(partv[p].mm->get_destination_value(md_part_aux_level));
+        pan = partv[p].mm->get_destination_value(md_part_aux_balance);
+        partv[p].aux1R.set_target_smoothed(megapanR(pan) * amp);
+        amp = db_to_linear(partv[p].mm->get_destination_value(md_part_aux2_level));
+        pan = partv[p].mm->get_destination_value(md_part_aux2_balance);
+        partv[p].aux2L.set_target_smoothed(megapanL(pan) * amp);
+        partv[p].aux2R.set_target_smoothed(megapanR(pan) * amp);
+        partv[p].pfg.set_target(
+            db_to_linear(partv[p].mm->get_destination_value(md_part_prefilter_gain)));
+        partv[p].fmix1.set_target_smoothed(partv[p].mm->get_destination_value(md_part_filter1mix));
+        partv[p].fmix2.set_target_smoothed(partv[p].mm->get_destination_value(md_part_filter2mix));
+        partv[p].ramps.begin(part_control_blocks);
     }
-    for (unsigned int i = 0; i < n_custom_controllers; i++)
+    else
     {
-        float b = fabs(parts[p].userparameter[i] - parts[p].userparameter_smoothed[i]);
-        float a = 0.1 * b;
-        parts[p].userparameter_smoothed[i] =
-            (1 - a) * parts[p].userparameter_smoothed[i] + a * parts[p].userparameter[i];
+        partv[p].ramps.advance();
     }
 
-    partv[p].mm->process_part();
-
-    // update interpolators
-    float amp = db_to_linear(partv[p].mm->get_destination_value(md_part_amplitude));
-    float pan = partv[p].mm->get_destination_value(md_part_pan);
-    partv[p].ampL.set_target_smoothed(megapanL(pan) * amp);
-    partv[p].ampR.set_target_smoothed(megapanR(pan) * amp);
-    amp = db_to_linear(partv[p].mm->get_destination_value(md_part_aux_level));
-    pan = partv[p].mm->get_destination_value(md_part_aux_balance);
-    partv[p].aux1R.set_target_smoothed(megapanR(pan) * amp);
-    amp = db_to_linear(partv[p].mm->get_destination_value(md_part_aux2_level));
-    pan = partv[p].mm->get_destination_value(md_part_aux2_balance);
-    partv[p].aux2L.set_target_smoothed(megapanL(pan) * amp);
-    partv[p].aux2R.set_target_smoothed(megapanR(pan) * amp);
-    partv[p].pfg.set_target(
-        db_to_linear(partv[p].mm->get_destination_value(md_part_prefilter_gain)));
-    partv[p].fmix1.set_target_smoothed(partv[p].mm->get_destination_value(md_part_filter1mix));
-    partv[p].fmix2.set_target_smoothed(partv[p].mm->get_destination_value(md_part_filter2mix));
-
     // process filters
     part_check_filtertypes(p, 0);
     part_check_filtertypes(p, 1);
@@ -191,6 +210,18 @@ void sampler::process_audio()
             clear_block(output[op], block_size_quad << 1);
         return;
     }
+    // nothing unlinked from here on is freed before the block is done with it
+    scxt::Reclaimer::Block reclaimBlock(reclaimParticipant);
+
+    scxt::Time::Timestamp render_start;
+    uint64_t minflt_start = 0, majflt_start = 0;
+    bool count_faults = false;
+    if (realtime)
+    {
+        scxt::Time::getCurrentTimestamp(&render_start);
+        count_faults = scxt::SampleArena::getThreadFaults(minflt_start, majflt_start);
+    }
+
     processWrapperEvents();
 
     /*if (sample_replace_filename[0])
@@ -218,24 +249,26 @@ void sampler::process_audio()
     {
         std::lock_guard g(cs_patch);
 
+        if (zone_index_dirty)
+            compile_zone_index();
+
+        // while still behind, make room one released voice per block
+        if ((shedder.get_stage() >= load_shedder::ls_steal_released) && shedder.is_overloaded())
+            softkill_quietest_released_note();
+
         // render voices
+        auto now = sample_memory::now();
         for (unsigned int v = 0; v < highest_voice_id; v++)
         {
             if (voice_state[v].active) // is bottleneck at idle (?)
             {
+                const auto &h = zone_index[voice_state[v].zone_id];
                 float *outbuf[3][2];
-                outbuf[0][0] =
-                    get_output_pointer(voices[v]->zone->aux[0].output, 0, voices[v]->zone->part);
-                outbuf[0][1] =
-                    get_output_pointer(voices[v]->zone->aux[0].output, 1, voices[v]->zone->part);
-                outbuf[1][0] =
-                    get_output_pointer(voices[v]->zone->aux[1].output, 0, voices[v]->zone->part);
-                outbuf[1][1] =
-                    get_output_pointer(voices[v]->zone->aux[1].output, 1, voices[v]->zone->part);
-                outbuf[2][0] =
-                    get_output_pointer(voices[v]->zone->aux[2].output, 0, voices[v]->zone->part);
-                outbuf[2][1] =
-                    get_output_pointer(voices[v]->zone->aux[2].output, 1, voices[v]->zone->part);
+                for (int a = 0; a < 3; a++)
+                {
+                    outbuf[a][0] = get_output_pointer(h.aux_output[a], 0, h.part);
+                    outbuf[a][1] = get_output_pointer(h.aux_output[a], 1, h.part);
+                }
 
                 voice_state[v].active =
                     voices[v]->process_block(outbuf[0][0], outbuf[0][1], outbuf[1][0], outbuf[1][1],
@@ -246,14 +279,22 @@ void sampler::process_audio()
                     polyphony--;
                     holdbuffer.remove(v);
                 }
+                else
+                    voices[v]->wave->note_rendered(now);
             }
         }
 
         // process parts
+        if (part_control_countdown <= 0)
+        {
+            part_control_blocks = control_interval;
+            part_control_countdown = part_control_blocks;
+        }
         for (int p = 0; p < n_sampler_parts; p++)
         {
             process_part(p);
         }
+        part_control_countdown--;
 
         process_global_effects();
 
@@ -270,6 +311,18 @@ void sampler::process_audio()
         }
     }
 
+    if (realtime)
+    {
+        scxt::Time::Timestamp render_end, elapsed;
+        scxt::Time::getCurrentTimestamp(&render_end);
+        scxt::Time::getTimestampDiff(&render_end, &render_start, &elapsed);
+        shedder.update(elapsed * 1e-6f, block_size * samplerate_inv);
+
+        uint64_t minflt, majflt;
+        if (count_faults && scxt::SampleArena::getThreadFaults(minflt, majflt))
+            scxt::SampleArena::get().addAudioFaults(minflt - minflt_start, majflt - majflt_start);
+    }
+
     processVUsAndPolyphonyUpdates();
     // post amplitude
     /*
@@ -317,15 +370,34 @@ void sampler::processVUsAndPolyphonyUpdates()
         }
         postEventsToWrapper(ad);
 
-        if (polyphony != lastSentPolyphony)
+        int shed_stage = shedder.get_stage();
+        if ((polyphony != lastSentPolyphony) || (shed_stage != lastSentShedStage))
         {
             actiondata ad;
             ad.actiontype = vga_intval;
             ad.id = ip_polyphony;
             ad.subid = -1;
             ad.data.i[0] = polyphony;
+            ad.data.i[1] = shed_stage;
             postEventsToWrapper(ad);
             lastSentPolyphony = polyphony;
+            lastSentShedStage = shed_stage;
+        }
+
+        // process wide, so every instance shows the same figures
+        int memory_mb = (int)(sample_memory::get().get_usage() >> 20);
+        int budget_mb = (int)(sample_memory::get().get_budget() >> 20);
+        if ((memory_mb != lastSentSampleMemory) || (budget_mb != lastSentSampleBudget))
+        {
+            actiondata ad;
+            ad.actiontype = vga_intval;
+            ad.id = ip_sample_memory;
+            ad.subid = -1;
+            ad.data.i[0] = memory_mb;
+            ad.data.i[1] = budget_mb; // 0 for no limit
+            postEventsToWrapper(ad);
+            lastSentSampleMemory = memory_mb;
+            lastSentSampleBudget = budget_mb;
         }
     }
 }
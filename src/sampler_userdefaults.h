@@ -16,6 +16,21 @@ enum DefaultKeys
     zoomLevel,
     previewAuto,
     previewLevel,
+    sampleCache,
+    controlInterval,
+    loadShedMaxStage,
+    voiceSilenceTimeout,
+    compressSamples,
+    sampleStorage,
+    foldMonoSamples,
+    trimSampleSilence,
+    sampleLockBudget,
+    samplePrefault,
+    sampleHugePages,
+    loadSamplesOnDemand,
+    sampleMemoryBudget,
+    convertSampleRate,
+    sampleCacheBudget,
     nKeys
 };
 inline std::string defaultKeyToString(DefaultKeys k)
@@ -28,6 +43,36 @@ inline std::string defaultKeyToString(DefaultKeys k)
         return "previewAuto";
     case previewLevel:
         return "previewLevel";
+    case sampleCache:
+        return "sampleCache";
+    case controlInterval:
+        return "controlInterval";
+    case loadShedMaxStage:
+        return "loadShedMaxStage";
+    case voiceSilenceTimeout:
+        return "voiceSilenceTimeout";
+    case compressSamples:
+        return "compressSamples";
+    case sampleStorage:
+        return "sampleStorage";
+    case foldMonoSamples:
+        return "foldMonoSamples";
+    case trimSampleSilence:
+        return "trimSampleSilence";
+    case sampleLockBudget:
+        return "sampleLockBudget";
+    case samplePrefault:
+        return "samplePrefault";
+    case sampleHugePages:
+        return "sampleHugePages";
+    case loadSamplesOnDemand:
+        return "loadSamplesOnDemand";
+    case sampleMemoryBudget:
+        return "sampleMemoryBudget";
+    case convertSampleRate:
+        return "convertSampleRate";
+    case sampleCacheBudget:
+        return "sampleCacheBudget";
     case nKeys:
         return "nKeys";
     default:
@@ -16,6 +16,7 @@
 #include "generator.h"
 #include "synthesis/mathtables.h"
 #include "sample.h"
+#include "sample_codec.h"
 #include "sampler_state.h"
 #include "synthesis/filter.h"
 
@@ -39,9 +40,20 @@ sampler_voice::sampler_voice(uint32 voice_id, timedata *td)
 {
     halfrate = (halfrate_stereo *)_mm_malloc(sizeof(halfrate_stereo), 16);
     new (halfrate) halfrate_stereo(4, false);
+    window = new compressed_window();
+    generator_mode = GSM_Normal;
 
     voice_filter[0] = nullptr;
     voice_filter[1] = nullptr;
+    mip_level = 0;
+    shed_stage = load_shedder::ls_none;
+    silence_timeout = 0.f;
+    silent_blocks = 0;
+    silence_hold_blocks = 0;
+    control_interval = 1;
+    control_blocks = 1;
+    control_countdown = 0;
+    eg_playing = false;
 
     this->voice_id = voice_id;
     this->td = td;
@@ -118,6 +130,7 @@ sampler_voice::~sampler_voice()
 
     halfrate->~halfrate_stereo();
     _mm_free(halfrate);
+    delete window;
 }
 
 void sampler_voice::play(sample *wave, sample_zone *zone, sample_part *part, uint32 key,
@@ -127,6 +140,7 @@ void sampler_voice::play(sample *wave, sample_zone *zone, sample_part *part, uin
     this->zone = zone;
     this->part = part;
     this->wave = wave;
+    wave->note_played();
 
     this->key = key;
     this->detune = detune;
@@ -166,8 +180,8 @@ void sampler_voice::play(sample *wave, sample_zone *zone, sample_part *part, uin
     slice_env = 0;
     time60 = 0;
     loop_pos = 0;
-    random = (float)rand() / (float)RAND_MAX;
-    randombp = ((float)rand() / (float)RAND_MAX) * 2.f - 1.f;
+    random = rng.uni();
+    randombp = rng.bi();
     envelope_follower = 0;
     grain_id = 0;
 
@@ -177,7 +191,8 @@ void sampler_voice::play(sample *wave, sample_zone *zone, sample_part *part, uin
     GDIO.SampleDataL = wave->SampleData[0];
     GDIO.SampleDataR = wave->SampleData[1];
     assert(wave);
-    assert(GDIO.SampleDataL);
+    assert(GDIO.SampleDataL || wave->is_compressed());
+    window->reset();
     GDIO.VoicePtr = this;
     GDIO.WaveSize = wave->sample_length;
 
@@ -186,9 +201,11 @@ void sampler_voice::play(sample *wave, sample_zone *zone, sample_part *part, uin
     halfrate->reset();
 
     mm.assign(nullptr, zone, part, this, ctrl, autom, td);
+    mm.seed_random(rng.next());
     mm.process();
 
     first_run = true;
+    control_countdown = 0;
 
     AEG.Assign(mm.get_destination_ptr(md_AEG_a), mm.get_destination_ptr(md_AEG_h),
                mm.get_destination_ptr(md_AEG_d), mm.get_destination_ptr(md_AEG_s),
@@ -198,9 +215,9 @@ void sampler_voice::play(sample *wave, sample_zone *zone, sample_part *part, uin
                mm.get_destination_ptr(md_EG2_d), mm.get_destination_ptr(md_EG2_s),
                mm.get_destination_ptr(md_EG2_r), zone->EG2.shape);
 
-    stepLFO[0].assign(&zone->LFO[0], mm.get_destination_ptr(md_LFO1_rate), td);
-    stepLFO[1].assign(&zone->LFO[1], mm.get_destination_ptr(md_LFO2_rate), td);
-    stepLFO[2].assign(&zone->LFO[2], mm.get_destination_ptr(md_LFO3_rate), td);
+    stepLFO[0].assign(&zone->LFO[0], mm.get_destination_ptr(md_LFO1_rate), td, rng);
+    stepLFO[1].assign(&zone->LFO[1], mm.get_destination_ptr(md_LFO2_rate), td, rng);
+    stepLFO[2].assign(&zone->LFO[2], mm.get_destination_ptr(md_LFO3_rate), td, rng);
 
     AEG.Attack();
     EG2.Attack();
@@ -232,21 +249,26 @@ void sampler_voice::play(sample *wave, sample_zone *zone, sample_part *part, uin
         RingOut = min(RingOut, 5000);
     }
 
+    silent_blocks = 0;
+    silence_hold_blocks = (int)(silence_timeout * samplerate * inv_block_size);
+
+    // zones refer to the sample as decoded, a trimmed tail plays as silence
+    int stop = std::min((int)zone->sample_stop, (int)wave->sample_length);
     GD.SamplePos = (int)mm.get_destination_value(md_sample_start);
-    GD.SamplePos = limit_range(GD.SamplePos, 0, (int)zone->sample_stop);
+    GD.SamplePos = limit_range(GD.SamplePos, 0, stop);
 
     last_loopstart = mm.get_destination_value(md_loop_start);
     last_loopend =
         mm.get_destination_value(md_loop_length) + mm.get_destination_value(md_loop_start);
     GD.SampleSubPos = 0;
-    GD.LowerBound = zone->sample_start;
-    GD.UpperBound = zone->sample_stop;
+    GD.LowerBound = std::min((int)zone->sample_start, stop);
+    GD.UpperBound = stop;
     GD.Direction = 1;
     GD.IsFinished = 0;
 
     if (zone->reverse)
     {
-        GD.SamplePos = zone->sample_stop;
+        GD.SamplePos = stop;
         GD.Direction = -1;
     }
 
@@ -266,8 +288,8 @@ void sampler_voice::play(sample *wave, sample_zone *zone, sample_part *part, uin
         {
             slice_env = zone->hp[sp].env;
 
-            GD.LowerBound = zone->hp[sp].start_sample;
-            GD.UpperBound = zone->hp[sp].end_sample;
+            GD.LowerBound = std::min((int)zone->hp[sp].start_sample, stop);
+            GD.UpperBound = std::min((int)zone->hp[sp].end_sample, stop);
 
             GD.SamplePos = zone->reverse ? GD.UpperBound : GD.LowerBound;
             // slice_end = &zone->hp[sp].end_sample;
@@ -281,12 +303,30 @@ void sampler_voice::play(sample *wave, sample_zone *zone, sample_part *part, uin
         ((playmode == pm_forward_loop) || ((playmode == pm_forward_loop_until_release) && gate) ||
          (playmode == pm_forward_loop_bidirectional));
 
-    // determine whether to use oversampling
+    // determine whether to play a decimated copy of the sample, or to oversample
     CalcRatio();
     if (GD.Ratio < 0)
-        GD.SamplePos = zone->sample_stop;
+        GD.SamplePos = stop;
+    mip_level = 0;
+    for (int r = abs(GD.Ratio); (r > 18000000) && (mip_level < sample::max_mip_levels); r >>= 1)
+        mip_level++;
+    if (mip_level > wave->get_mip_count())
+    {
+        // not built yet, eg. for a sample loaded on demand: oversample until they are
+        wave->request_mips();
+        mip_level = wave->get_mip_count();
+    }
+    if (mip_level)
+    {
+        GDIO.SampleDataL = wave->get_mip_data(mip_level, 0);
+        GDIO.SampleDataR = wave->get_mip_data(mip_level, 1);
+        GDIO.WaveSize = wave->get_mip_length(mip_level);
+        GD.SamplePos >>= mip_level;
+        GD.LowerBound >>= mip_level;
+        GD.UpperBound >>= mip_level;
+    }
     // use_oversampling = resample_ratio > 16777216;
-    use_oversampling = abs(GD.Ratio) > 18000000;
+    use_oversampling = (abs(GD.Ratio) >> mip_level) > 18000000;
     use_stereo = (wave->channels == 2);
 
     GD.BlockSize = use_oversampling ? (block_size * 2) : block_size;
@@ -325,11 +365,103 @@ void sampler_voice::play(sample *wave, sample_zone *zone, sample_part *part, uin
         break;
     }
 
-    Generator = GetFPtrGeneratorSample(use_stereo, !wave->UseInt16, gmode);
+    generator_mode = gmode;
+    int format = wave->UseInt16 ? GSF_Int16 : (wave->UseInt24 ? GSF_Int24 : GSF_Float);
+    Generator = GetFPtrGeneratorSample(use_stereo, format, gmode,
+                                       shed_stage >= load_shedder::ls_reduce_quality);
 
     assert(Generator);
 }
 
+void sampler_voice::generate_compressed()
+{
+    /*
+     * The generator is run over stretches in which the read position moves steadily, without
+     * a loop wrap or clamp, so each reads one contiguous span of positions which the window
+     * maps for it. Only a loop wrap needs a stretch of its own, usually one sample long.
+     */
+    const int bs = GD.BlockSize;
+    const int ratio = abs(GD.Ratio);
+    float *outL = GDIO.OutputL, *outR = GDIO.OutputR;
+
+    for (int done = 0; done < bs;)
+    {
+        // the positions the generator can move between without jumping
+        int lo = 0, hi = GDIO.WaveSize;
+        switch (generator_mode)
+        {
+        case GSM_Normal:
+        case GSM_Shot:
+            lo = GD.LowerBound;
+            hi = GD.UpperBound;
+            break;
+        case GSM_Loop:
+            hi = Min(GD.UpperBound, GDIO.WaveSize);
+            break;
+        case GSM_LoopUntilRelease:
+            if (GD.Gated)
+                hi = Min(GD.UpperBound, GDIO.WaveSize);
+            else
+            {
+                lo = GD.SampleStart;
+                hi = GD.SampleStop;
+            }
+            break;
+        }
+
+        const int dir = GD.Direction * Sign(GD.Ratio);
+        const bool bidirectional = (generator_mode == GSM_Bidirectional);
+        int pos = GD.SamplePos;
+        int64_t room = bidirectional ? Min(hi - pos, pos - lo) : (dir > 0 ? hi - pos : pos - lo);
+        if (pos < lo || pos > hi)
+            room = 0; // about to be clamped or wrapped back in
+        room = std::min<int64_t>(room, (compressed_window::max_span - FIRipol_N - 2) >> 1);
+
+        int n = bs - done;
+        if (ratio)
+        {
+            int64_t steps = (room > 0) ? ((room << 24) - 1) / ratio : 0;
+            n = (int)std::min<int64_t>(n, steps + 1);
+        }
+        int reach = (int)(((int64_t)(n - 1) * ratio + (1 << 24)) >> 24);
+        int from = (bidirectional || dir < 0) ? pos - reach : pos;
+        int to = (bidirectional || dir > 0) ? pos + reach : pos;
+
+        void *data[2];
+        window->map(wave, from, to + FIRipol_N - 1, data);
+        GDIO.SampleDataL = data[0];
+        GDIO.SampleDataR = data[1];
+        GDIO.OutputL = outL + done;
+        GDIO.OutputR = outR + done;
+        GD.BlockSize = n;
+        Generator(&GD, &GDIO);
+        done += n;
+    }
+
+    GD.BlockSize = bs;
+    GDIO.OutputL = outL;
+    GDIO.OutputR = outR;
+}
+
+bool sampler_voice::outruns_head() const
+{
+    // compressed samples are always resident
+    if (wave->is_compressed())
+        return false;
+    int avail = (int)wave->get_available_frames(mip_level);
+    if (avail >= GDIO.WaveSize)
+        return false;
+
+    // the furthest position the block can read from, see generate_compressed
+    int reach = (int)(((int64_t)GD.BlockSize * abs(GD.Ratio)) >> 24) + 1;
+    int dir = GD.Direction * Sign(GD.Ratio);
+    int top = GD.SamplePos + ((dir > 0) ? reach : 1);
+    // a loop played backwards wraps around to its upper bound
+    if ((dir < 0) && looping_active && (GD.SamplePos - reach <= GD.LowerBound))
+        top = Max(top, GD.UpperBound + 1);
+    return top >= avail;
+}
+
 void sampler_voice::change_key(int key, int vel, int detune)
 {
     if (portaphase > 1)
@@ -345,6 +477,7 @@ void sampler_voice::change_key(int key, int vel, int detune)
     zone->last_note = key;
     portaphase = 0;
     portamento_active = true;
+    control_countdown = 0;
 }
 
 void sampler_voice::release(uint32 velocity)
@@ -364,6 +497,7 @@ void sampler_voice::release(uint32 velocity)
 
         gate = false;
         fgate = 0.0f;
+        control_countdown = 0;
     }
 }
 
@@ -373,6 +507,7 @@ void sampler_voice::uberrelease()
     gate = false;
     fgate = 0.0f;
     is_uberrelease = true;
+    control_countdown = 0;
 }
 
 inline int sampler_voice::get_filter_type(int id) const { return zone->Filter[id].type; }
@@ -386,7 +521,10 @@ void sampler_voice::check_filtertypes()
         voice_filter[0] = spawn_filter(get_filter_type(0), mm.get_destination_ptr(md_filter1prm0),
                                        zone->Filter[0].ip, nullptr, true);
         if (voice_filter[0])
+        {
+            voice_filter[0]->seed_random(rng.next());
             voice_filter[0]->init();
+        }
         last_ft[0] = get_filter_type(0);
     }
     if (last_ft[1] != get_filter_type(1))
@@ -395,7 +533,10 @@ void sampler_voice::check_filtertypes()
         voice_filter[1] = spawn_filter(get_filter_type(1), mm.get_destination_ptr(md_filter2prm0),
                                        zone->Filter[1].ip, nullptr, true);
         if (voice_filter[1])
+        {
+            voice_filter[1]->seed_random(rng.next());
             voice_filter[1]->init();
+        }
         last_ft[1] = get_filter_type(1);
     }
 }
@@ -403,7 +544,7 @@ void sampler_voice::check_filtertypes()
 void sampler_voice::update_lag_gen(int id)
 {
     // lag generators
-    const float integratorconst = samplerate_inv * block_size;
+    const float integratorconst = samplerate_inv * block_size * control_blocks;
     if (zone->lag_generator[id] != 0)
     {
         float x = pi1 * note_to_pitch(-12 * zone->lag_generator[id]) * integratorconst;
@@ -420,7 +561,8 @@ void sampler_voice::update_portamento()
     float ratemult = 1.f;
     if (part->portamento_mode)
         ratemult = 12.f / (0.00001f + fabs(((float)key + 0.01f * detune) - portasrc_key));
-    portaphase += block_size * note_to_pitch(-12.f * part->portamento) * samplerate_inv * ratemult;
+    portaphase += block_size * control_blocks * note_to_pitch(-12.f * part->portamento) *
+                  samplerate_inv * ratemult;
     if (portaphase < 1.f)
     {
         fkey = (1.f - portaphase) * portasrc_key + (float)portaphase * (key + 0.01f * detune);
@@ -453,7 +595,9 @@ void sampler_voice::CalcRatio()
     // loop_pos = limit_range((sample_pos -
     // mm.get_destination_value_int(md_loop_start))/(float)mm.get_destination_value_int(md_loop_length),0,1);
 
-    GD.Ratio = Float2Int((float)((wave->sample_rate * samplerate_inv) * 16777216.f *
+    // divide rather than scale by samplerate_inv so a sample at the engine rate (see
+    // sampler::set_convert_sample_rate) plays at exactly unity
+    GD.Ratio = Float2Int((float)((wave->sample_rate / samplerate) * 16777216.f *
                                  note_to_pitch(fpitch + kt - zone->pitchcorrection) *
                                  mm.get_destination_value(md_rate)));
     fpitch += fkey - 69.f; // relative to A3 (440hz)
@@ -476,85 +620,107 @@ bool sampler_voice::process_block(float *p_L, float *p_R, float *p_aux1L, float
 
     perfslot(1);
 
-    // process envelopes & stepLFO's
-    bool continue_playing = AEG.Process(block_size);
-
-    if (VE & ve_EG2)
-        EG2.Process(block_size);
-    perfslot(2);
-    if (VE & ve_LFO1)
-        stepLFO[0].process(block_size);
-    if (VE & ve_LFO2)
-        stepLFO[1].process(block_size);
-    if (VE & ve_LFO3)
-        stepLFO[2].process(block_size);
-
-    perfslot(3);
-    mm.process();
-    perfslot(4);
-
-    if (first_run)
+    // control path, the targets it sets are reached at the end of control_blocks blocks
+    if (control_countdown <= 0)
     {
-        pfg.set_target_instantize(db_to_linear(mm.get_destination_value(md_prefilter_gain)));
-        float amp = crossfade_amp * db_to_linear((1 - fvelocity) * zone->velsense) * AEG.output;
-        vca.set_target_instantize(amp);
-        amp = db_to_linear(mm.get_destination_value(md_amplitude));
-        float pan = mm.get_destination_value(md_pan);
-        faderL.set_target_instantize(megapanL(pan) * amp);
-        faderR.set_target_instantize(megapanR(pan) * amp);
-
-        amp = db_to_linear(mm.get_destination_value(md_aux_level));
-        pan = mm.get_destination_value(md_aux_balance);
-        aux1L.set_target_instantize(megapanL(pan) * amp);
-        aux1R.set_target_instantize(megapanR(pan) * amp);
-        amp = db_to_linear(mm.get_destination_value(md_aux2_level));
-        pan = mm.get_destination_value(md_aux2_balance);
-        aux2L.set_target_instantize(megapanL(pan) * amp);
-        aux2R.set_target_instantize(megapanR(pan) * amp);
-        fmix1.set_target_instantize(limit_range(mm.get_destination_value(md_filter1mix), 0.f, 1.f));
-        fmix2.set_target_instantize(limit_range(mm.get_destination_value(md_filter2mix), 0.f, 1.f));
-    }
-    else
-    {
-        pfg.set_target(db_to_linear(mm.get_destination_value(md_prefilter_gain)));
-        float amp = crossfade_amp * db_to_linear((1 - fvelocity) * zone->velsense) * AEG.output;
-        vca.set_target(amp);
-        amp = db_to_linear(mm.get_destination_value(md_amplitude));
-        float pan = mm.get_destination_value(md_pan);
-        // faderL.set_target_smoothed(sqrt(0.5 - 0.5*pan) * amp);
-        // faderR.set_target_smoothed(sqrt(0.5 + 0.5*pan) * amp);
-        // megapanning test [-200% to 200%]
-        faderL.set_target_smoothed(megapanL(pan) * amp);
-        faderR.set_target_smoothed(megapanR(pan) * amp);
-        // aux.set_target(db_to_linear(mm.get_destination_value(md_aux_level)));
-        if (zone->aux[2].outmode)
+        // the first block after a note on runs on its own so the attack starts in time
+        control_blocks = first_run ? 1 : control_interval;
+        control_countdown = control_blocks;
+        const int control_samples = block_size * control_blocks;
+
+        // process envelopes & stepLFO's
+        eg_playing = AEG.Process(control_samples);
+
+        if (VE & ve_EG2)
+            EG2.Process(control_samples);
+        perfslot(2);
+        if (VE & ve_LFO1)
+            stepLFO[0].process(control_samples);
+        if (VE & ve_LFO2)
+            stepLFO[1].process(control_samples);
+        if (VE & ve_LFO3)
+            stepLFO[2].process(control_samples);
+
+        perfslot(3);
+        mm.process();
+        perfslot(4);
+
+        if (first_run)
         {
+            pfg.set_target_instantize(db_to_linear(mm.get_destination_value(md_prefilter_gain)));
+            float amp =
+                crossfade_amp * db_to_linear((1 - fvelocity) * zone->velsense) * AEG.output;
+            vca.set_target_instantize(amp);
+            amp = db_to_linear(mm.get_destination_value(md_amplitude));
+            float pan = mm.get_destination_value(md_pan);
+            faderL.set_target_instantize(megapanL(pan) * amp);
+            faderR.set_target_instantize(megapanR(pan) * amp);
+
             amp = db_to_linear(mm.get_destination_value(md_aux_level));
             pan = mm.get_destination_value(md_aux_balance);
-            aux1L.set_target_smoothed(megapanL(pan) * amp);
-            aux1R.set_target_smoothed(megapanR(pan) * amp);
-        }
-        if (zone->aux[2].outmode)
-        {
+            aux1L.set_target_instantize(megapanL(pan) * amp);
+            aux1R.set_target_instantize(megapanR(pan) * amp);
             amp = db_to_linear(mm.get_destination_value(md_aux2_level));
             pan = mm.get_destination_value(md_aux2_balance);
-            aux2L.set_target_smoothed(megapanL(pan) * amp);
-            aux2R.set_target_smoothed(megapanR(pan) * amp);
+            aux2L.set_target_instantize(megapanL(pan) * amp);
+            aux2R.set_target_instantize(megapanR(pan) * amp);
+            fmix1.set_target_instantize(
+                limit_range(mm.get_destination_value(md_filter1mix), 0.f, 1.f));
+            fmix2.set_target_instantize(
+                limit_range(mm.get_destination_value(md_filter2mix), 0.f, 1.f));
         }
-        fmix1.set_target_smoothed(limit_range(mm.get_destination_value(md_filter1mix), 0.f, 1.f));
-        fmix2.set_target_smoothed(limit_range(mm.get_destination_value(md_filter2mix), 0.f, 1.f));
-    }
+        else
+        {
+            pfg.set_target(db_to_linear(mm.get_destination_value(md_prefilter_gain)));
+            float amp =
+                crossfade_amp * db_to_linear((1 - fvelocity) * zone->velsense) * AEG.output;
+            vca.set_target(amp);
+            amp = db_to_linear(mm.get_destination_value(md_amplitude));
+            float pan = mm.get_destination_value(md_pan);
+            // faderL.set_target_smoothed(sqrt(0.5 - 0.5*pan) * amp);
+            // faderR.set_target_smoothed(sqrt(0.5 + 0.5*pan) * amp);
+            // megapanning test [-200% to 200%]
+            faderL.set_target_smoothed(megapanL(pan) * amp);
+            faderR.set_target_smoothed(megapanR(pan) * amp);
+            // aux.set_target(db_to_linear(mm.get_destination_value(md_aux_level)));
+            if (zone->aux[2].outmode)
+            {
+                amp = db_to_linear(mm.get_destination_value(md_aux_level));
+                pan = mm.get_destination_value(md_aux_balance);
+                aux1L.set_target_smoothed(megapanL(pan) * amp);
+                aux1R.set_target_smoothed(megapanR(pan) * amp);
+            }
+            if (zone->aux[2].outmode)
+            {
+                amp = db_to_linear(mm.get_destination_value(md_aux2_level));
+                pan = mm.get_destination_value(md_aux2_balance);
+                aux2L.set_target_smoothed(megapanL(pan) * amp);
+                aux2R.set_target_smoothed(megapanR(pan) * amp);
+            }
+            fmix1.set_target_smoothed(
+                limit_range(mm.get_destination_value(md_filter1mix), 0.f, 1.f));
+            fmix2.set_target_smoothed(
+                limit_range(mm.get_destination_value(md_filter2mix), 0.f, 1.f));
+        }
+        ramps.begin(control_blocks);
 
-    perfslot(5);
+        perfslot(5);
 
-    if (portamento_active)
-        update_portamento();
-    CalcRatio();
-    if (use_oversampling)
-        GD.Ratio = GD.Ratio >> 1;
+        if (portamento_active)
+            update_portamento();
+        CalcRatio();
+        GD.Ratio = GD.Ratio >> (mip_level + (use_oversampling ? 1 : 0));
 
-    update_lag_gen(0);
-    update_lag_gen(1);
+        update_lag_gen(0);
+        update_lag_gen(1);
+    }
+    else
+    {
+        ramps.advance();
+    }
+    control_countdown--;
+    // once the envelope has finished, play out the rest of the interval it ramped over
+    bool continue_playing = eg_playing || (control_countdown > 0);
 
     int bs = GD.BlockSize;
 
@@ -568,15 +734,25 @@ bool sampler_voice::process_block(float *p_L, float *p_R, float *p_aux1L, float
         int ll = mm.get_destination_value_int(md_loop_length);
         int ls = limit_range(mm.get_destination_value_int(md_loop_start), 0, end);
         int le = limit_range(ls + ll, 0, end);
-        GD.LowerBound = Min(ls, le);
-        GD.UpperBound = Max(ls, le);
+        GD.LowerBound = Min(ls, le) >> mip_level;
+        GD.UpperBound = Max(ls, le) >> mip_level;
     }
 
-    GD.SampleStart = zone->sample_start;
-    GD.SampleStop = zone->sample_stop;
+    auto stop = std::min(zone->sample_stop, wave->sample_length);
+    GD.SampleStart = std::min(zone->sample_start, stop) >> mip_level;
+    GD.SampleStop = stop >> mip_level;
     GD.Gated = gate;
     GD.InvertedBounds = 1.f / std::max(1, GD.UpperBound - GD.LowerBound);
-    Generator(&GD, &GDIO);
+    if (outruns_head())
+    {
+        // hold here, silent, until the sample worker has paged the rest in
+        memset(output[0], 0, GD.BlockSize * sizeof(float));
+        memset(output[1], 0, GD.BlockSize * sizeof(float));
+    }
+    else if (wave->is_compressed())
+        generate_compressed();
+    else
+        Generator(&GD, &GDIO);
 
     loop_gate = GD.IsInLoop;
     loop_pos = GD.PositionWithinLoop;
@@ -637,7 +813,8 @@ bool sampler_voice::process_block(float *p_L, float *p_R, float *p_aux1L, float
             fmix1.fade_2_blocks_to(output[0], tempbuf[0], output[1], tempbuf[1], output[0],
                                    output[1], block_size_quad);
         }
-        if ((voice_filter[1]) && (!zone->Filter[1].bypass))
+        if ((voice_filter[1]) && (!zone->Filter[1].bypass) &&
+            (shed_stage < load_shedder::ls_skip_filter2))
         {
             voice_filter[1]->process_stereo(output[0], output[1], tempbuf[0], tempbuf[1], fpitch);
             filter_modout[1] = voice_filter[1]->modulation_output;
@@ -653,7 +830,8 @@ bool sampler_voice::process_block(float *p_L, float *p_R, float *p_aux1L, float
             filter_modout[0] = voice_filter[0]->modulation_output;
             fmix1.fade_block_to(output[0], tempbuf[0], output[0], block_size_quad);
         }
-        if ((voice_filter[1]) && (!zone->Filter[1].bypass))
+        if ((voice_filter[1]) && (!zone->Filter[1].bypass) &&
+            (shed_stage < load_shedder::ls_skip_filter2))
         {
             voice_filter[1]->process(output[0], tempbuf[0], fpitch);
             filter_modout[1] = voice_filter[1]->modulation_output;
@@ -666,6 +844,23 @@ bool sampler_voice::process_block(float *p_L, float *p_R, float *p_aux1L, float
 
     const unsigned int bufof = block_size;
     vca.multiply_2_blocks(output[0], output[1], block_size_quad);
+
+    // once released, stop when the post filter/envelope output has died away rather than
+    // waiting out the envelope and the filters' worst case tails. a quiet passage of the sample
+    // only counts once nothing more can come of it: the AEG has decayed or the sample has ended
+    if (!gate && silence_hold_blocks > 0)
+    {
+        bool can_end = GD.IsFinished || (AEG.output < silence_threshold);
+        if (can_end && get_absmax_2(output[0], output[1], block_size_quad) < silence_threshold)
+        {
+            if (++silent_blocks >= silence_hold_blocks)
+                continue_playing = false;
+        }
+        else
+        {
+            silent_blocks = 0;
+        }
+    }
     faderL.multiply_block_to(output[0], postfader_buf[0], block_size_quad);
     faderR.multiply_block_to(output[1], postfader_buf[1], block_size_quad);
     accumulate_block(postfader_buf[0], p_L, block_size_quad);
@@ -14,6 +14,7 @@
 #include "synthesis/envelope.h"
 #include "synthesis/modmatrix.h"
 #include "synthesis/steplfo.h"
+#include "util/prng.h"
 
 #include <vt_dsp/lipol.h>
 
@@ -21,6 +22,7 @@ class sampler_voice;
 class filter;
 class sample;
 class halfrate_stereo;
+class compressed_window;
 
 struct sample_zone;
 struct sample_part;
@@ -32,6 +34,8 @@ class alignas(16) sampler_voice
   public:
     float output alignas(16)[2][block_size * 2];
     lipol_ps vca, faderL, faderR, pfg, aux1L, aux1R, aux2L, aux2R, fmix1, fmix2;
+    lipol_span<10> ramps{&vca,   &faderL, &faderR, &pfg,   &aux1L,
+                         &aux1R, &aux2L,  &aux2R,  &fmix1, &fmix2};
 
     sampler_voice(uint32 voice_id, timedata *);
     virtual ~sampler_voice();
@@ -64,6 +68,12 @@ class alignas(16) sampler_voice
     GeneratorState GD;
     GeneratorIO GDIO;
     GeneratorFPtr Generator;
+    int generator_mode; // GeneratorSampleModes
+    // compressed samples are played from decoded blocks, see sample::is_compressed
+    compressed_window *window;
+    void generate_compressed();
+    // whether the block would read past what a sample loaded on demand has in memory yet
+    bool outruns_head() const;
     // uint32 sample_pos;
     // uint32 sample_subpos;
     // int32 resample_ratio;
@@ -90,6 +100,10 @@ class alignas(16) sampler_voice
 
     float envelope_follower, fpitch;
     float lag[2];
+    // the control path runs every control_interval blocks (see sampler::set_control_interval),
+    // control_blocks is the interval the current targets span
+    int control_interval, control_blocks, control_countdown;
+    bool eg_playing;
 
     inline int get_filter_type(int id) const;
     // void filter_ctrldata(int);
@@ -100,6 +114,12 @@ class alignas(16) sampler_voice
     int playmode;
     uint32 grain_id;
     int32_t RingOut; // when sample playback is finished, this will be decremented until zero
+    // a released voice ends early once its output, and its AEG unless the sample has run out,
+    // have stayed below silence_threshold for silence_timeout seconds (0 disables, see
+    // sampler::set_voice_silence_timeout)
+    static constexpr float silence_threshold = 1e-6f; // -120 dBFS
+    float silence_timeout;
+    int silent_blocks, silence_hold_blocks;
     // template<bool stereo, bool oversampling, bool xfadeloop, int architecture>
     // __declspec(noalias) bool process_t(float *L, float *R, float *aux1L, float *aux1R, float
     // *aux2L, float *aux2R);
@@ -108,5 +128,8 @@ class alignas(16) sampler_voice
     inline void update_lag_gen(int);
     inline void update_portamento();
     bool use_oversampling, use_stereo, use_xfade;
+    int mip_level; // 0 plays the sample itself, see sample::get_mip_data
+    int shed_stage; // load_shedder stage the voice was started in, set before play()
+    prng rng;       // seeded for each note before play(), see sampler::set_random_seed
     bool looping_active, portamento_active;
 };
\ No newline at end of file
@@ -80,12 +80,21 @@ void sampler::postEventsToWrapper(const actiondata &ad, bool ErrorIfClosed)
 void sampler::processWrapperEvents()
 {
     // ingoing
+    if (!actionBuffer.peek())
+        return;
+    // edits go in as a whole, so a state save never sees half of one. Saves asked for here are
+    // written once the patch is released again, SaveAllAsRIFF takes it itself
+    std::unique_lock g(cs_patch);
+    std::vector<std::pair<fs::path, int>> saves;
     actiondata ad;
     while (actionBuffer.try_dequeue(ad))
     {
+        // most actions edit zones one way or another
+        invalidate_zone_index();
+
         if (!std::holds_alternative<VAction>(ad.actiontype))
         {
-            LOGDEBUG(mLogger) << "Surprise! It's not an action" << std::flush;
+            RTLOGDEBUG(mRTLogger, "Surprise! It's not an action");
             continue;
         }
 
@@ -148,14 +157,14 @@ void sampler::processWrapperEvents()
                 {
                     if (!load_file(f.p, nullptr, &nz, nullptr, editorpart & 0xF, 0, true))
                     {
-                        LOGDEBUG(mLogger) << "Did a loadFile for multi. What to do here?";
+                        RTLOGDEBUG(mRTLogger, "Did a loadFile for multi. What to do here?");
                     }
                 }
                 else
                 {
                     if (add_zone(f.p, &nz, editorpart & 0xf, false))
                     {
-                        LOGDEBUG(mLogger) << "Added zone; do rest of mapping from below";
+                        RTLOGDEBUG(mRTLogger, "Added zone; do rest of mapping from below");
                     }
                 }
             }
@@ -214,13 +223,19 @@ void sampler::processWrapperEvents()
         case vga_save_patch:
         {
             // save_part_as_xml(editorpart,editor->savepart_fname.c_str());
-            SaveAllAsRIFF(0, editorProxy.savepart_path.get(), editorpart);
+            saves.emplace_back(editorProxy.savepart_path.get(), editorpart);
         }
         break;
         case vga_save_multi:
         {
             // save_all_as_xml(0,editor->savepart_fname.c_str());
-            SaveAllAsRIFF(0, editorProxy.savepart_path.get());
+            saves.emplace_back(editorProxy.savepart_path.get(), -1);
+        }
+        break;
+        case vga_purge_samples:
+        {
+            // paging out is slow, the sample worker does it
+            purgeRequested = true;
         }
         break;
         case vga_browser_preview_start:
@@ -235,7 +250,7 @@ void sampler::processWrapperEvents()
                 mpPreview->Start(mpPreview->mFilename);
             }
 #else
-            LOGDEBUG(mLogger) << "Failed to vga_browser_preview_start" << std::flush;
+            RTLOGDEBUG(mRTLogger, "Failed to vga_browser_preview_start");
 #endif
         }
         break;
@@ -480,7 +495,8 @@ void sampler::processWrapperEvents()
                     if (zone_exist(z))
                     {
                         int e = max(0, min(3, ad.subid));
-                        load_lfo_preset(ad.data.i[0], &zones[z].LFO[e]);
+                        load_lfo_preset(ad.data.i[0], &zones[z].LFO[e],
+                                        &partv[zones[z].part & 0xf].rng);
                         selected->copy_lfo_waveform_to_selected_zones(&zones[z].LFO[e], e);
                     }
                     post_zonedata();
@@ -730,6 +746,10 @@ void sampler::processWrapperEvents()
         break;
         };
     }
+    g.unlock();
+
+    for (auto &s : saves)
+        SaveAllAsRIFF(0, s.first, s.second);
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -749,7 +769,7 @@ void sampler::set_editorpart(int p, int layer)
 
 void sampler::post_kgvdata()
 {
-    LOGDEBUG(mLogger) << __func__ << std::flush;
+    RTLOGDEBUG(mRTLogger, __func__);
 
     actiondata ad;
     // clear list/kgv
@@ -799,7 +819,7 @@ void sampler::post_kgvdata()
 
 void sampler::post_zonedata()
 {
-    LOGDEBUG(mLogger) << __func__ << std::flush;
+    RTLOGDEBUG(mRTLogger, __func__);
 
     post_kgvdata();
     actiondata ad;
@@ -889,7 +909,8 @@ void sampler::post_zonedata()
                 snprintf(ad.data.str, actiondata_maxstring,
                          "\t%.3f MB\t\t%i sm\t\t%.1fkHz %s %iCh\t\tRef: %i\t",
                          sptr->GetDataSize() / (1024.f * 1024.f), sptr->sample_length,
-                         sptr->sample_rate * 0.001f, sptr->UseInt16 ? "16i" : "32f", sptr->channels,
+                         sptr->sample_rate * 0.001f,
+                         sptr->UseInt16 ? "16i" : (sptr->UseInt24 ? "24i" : "32f"), sptr->channels,
                          sptr->GetRefCount());
                 ad.id = ip_sample_metadata;
                 ad.subid = -1;
@@ -1089,7 +1110,7 @@ void sampler::post_zonedata()
 void sampler::post_control_range(actiondata ad, int id_start, int id_end, int subid_start,
                                  int subid_end)
 {
-    LOGDEBUG(mLogger) << __func__ << std::flush;
+    RTLOGDEBUG(mRTLogger, __func__);
 
     if (subid_start == -1)
         subid_end = -1;
@@ -1109,7 +1130,7 @@ void sampler::post_control_range(actiondata ad, int id_start, int id_end, int su
 
 void sampler::post_data_from_structure(char *pointr, int id_start, int id_end)
 {
-    LOGDEBUG(mLogger) << __func__ << std::flush;
+    RTLOGDEBUG(mRTLogger, __func__);
 
     for (int i = id_start; i <= id_end; i++)
     {
@@ -1158,7 +1179,7 @@ void sampler::post_data_from_structure(char *pointr, int id_start, int id_end)
 
 void sampler::post_zone_filterdata(int z, int i, bool send_data)
 {
-    LOGDEBUG(mLogger) << __func__ << std::flush;
+    RTLOGDEBUG(mRTLogger, __func__);
 
     if (z < 0)
         return;
@@ -1238,7 +1259,7 @@ void sampler::post_zone_filterdata(int z, int i, bool send_data)
 
 void sampler::post_part_filterdata(int p, int i, bool send_data)
 {
-    LOGDEBUG(mLogger) << __func__ << std::flush;
+    RTLOGDEBUG(mRTLogger, __func__);
 
     filter *tf = spawn_filter(parts[p].Filter[i].type, parts[p].Filter[i].p, parts[p].Filter[i].ip,
                               0, false);
@@ -1306,7 +1327,7 @@ void sampler::post_part_filterdata(int p, int i, bool send_data)
 
 void sampler::post_multi_filterdata(int i, bool send_data)
 {
-    LOGDEBUG(mLogger) << __func__ << std::flush;
+    RTLOGDEBUG(mRTLogger, __func__);
 
     filter *tf =
         spawn_filter(multi.Filter[i].type, multi.Filter[i].p, multi.Filter[i].ip, 0, false);
@@ -1419,7 +1440,7 @@ void sampler::relay_data_to_structure(actiondata ad, char *pt)
 
 void sampler::post_initdata_mm(int zone)
 {
-    LOGDEBUG(mLogger) << __func__ << std::flush;
+    RTLOGDEBUG(mRTLogger, __func__);
 
     if (!zone_exist(zone))
         return;
@@ -1472,7 +1493,7 @@ void sampler::post_initdata_mm(int zone)
 
 void sampler::post_initdata_mm_part()
 {
-    LOGDEBUG(mLogger) << __func__ << std::flush;
+    RTLOGDEBUG(mRTLogger, __func__);
 
     // part matrix
     actiondata ad;
@@ -1551,7 +1572,7 @@ void sampler::post_initdata()
         }
     }
 
-    LOGDEBUG(mLogger) << __func__ << std::flush;
+    RTLOGDEBUG(mRTLogger, __func__);
 
     // fill various option-menus etc etc
 
@@ -1759,7 +1780,7 @@ string datamode_from_cmode(int cmode)
 
 void sampler::post_samplelist()
 {
-    LOGDEBUG(mLogger) << __func__ << std::flush;
+    RTLOGDEBUG(mRTLogger, __func__);
 
     int n_samples = 0;
     int j = 0;
@@ -1,4 +1,5 @@
 #include "biquadunit.h"
+#include "coefficient_cache.h"
 #include "globals.h"
 #include "util/unitconversion.h"
 #include <algorithm>
@@ -34,163 +35,146 @@ void biquadunit::coeff_copy(biquadunit *bq)
 
 const double pi1_with_margin = M_PI * 0.999;
 
-void biquadunit::coeff_LP(double omega, double Q)
+/*
+ * The designs behind the coeff_ functions, run through coefficient_cache. Each takes the
+ * parameters of the coeff_ function it is named after and gives a1, a2, b0, b1 and b2
+ * normalized to a0 = 1.
+ */
+namespace
+{
+void normalized(double *c, double a0, double a1, double a2, double b0, double b1, double b2)
 {
-    if (omega > pi1_with_margin)
-        omega = pi1_with_margin;
+    double a0inv = 1 / a0;
 
-    {
-        double cosi = cos(omega), sinu = sin(omega), alpha = sinu / (2 * Q), b0 = (1 - cosi) * 0.5,
-               b1 = 1 - cosi, b2 = (1 - cosi) * 0.5, a0 = 1 + alpha, a1 = -2 * cosi, a2 = 1 - alpha;
+    c[0] = a1 * a0inv;
+    c[1] = a2 * a0inv;
+    c[2] = b0 * a0inv;
+    c[3] = b1 * a0inv;
+    c[4] = b2 * a0inv;
+}
 
-        set_coef(a0, a1, a2, b0, b1, b2);
-    }
+void design_LP(const double *p, double *c)
+{
+    double omega = std::min(p[0], pi1_with_margin), Q = p[1];
+
+    double cosi = cos(omega), sinu = sin(omega), alpha = sinu / (2 * Q), b0 = (1 - cosi) * 0.5,
+           b1 = 1 - cosi, b2 = (1 - cosi) * 0.5, a0 = 1 + alpha, a1 = -2 * cosi, a2 = 1 - alpha;
+
+    normalized(c, a0, a1, a2, b0, b1, b2);
 }
 
-void biquadunit::coeff_LP2B(double omega, double Q)
+void design_LP2B(const double *p, double *c)
 {
-    if (omega > pi1_with_margin)
-        omega = pi1_with_margin;
+    double omega = std::min(p[0], pi1_with_margin), Q = p[1];
 
-    {
-        double w_sq = omega * omega;
-        double den = (w_sq * w_sq) + (pi1 * pi1 * pi1 * pi1) + w_sq * (pi1 * pi1) * (1 / Q - 2);
-        double G1 = std::min(1.0, sqrt((w_sq * w_sq) / den) * 0.5);
-
-        double cosi = cos(omega), sinu = sin(omega),
-               // alpha = sinu*sinh((log(2.0)/2.0) * (BW) * omega / sinu),
-            alpha = sinu / (2 * Q),
-               // G1 = 0.05, //powf(2,-log(pi1/omega)/log(2.0)),
-               // set aa to 6 db
-
-            A = 2 * sqrt(G1) * sqrt(2 - G1), b0 = (1 - cosi + G1 * (1 + cosi) + A * sinu) * 0.5,
-               b1 = (1 - cosi - G1 * (1 + cosi)),
-               b2 = (1 - cosi + G1 * (1 + cosi) - A * sinu) * 0.5, a0 = (1 + alpha), a1 = -2 * cosi,
-               a2 = 1 - alpha;
-
-        set_coef(a0, a1, a2, b0, b1, b2);
-    }
+    double w_sq = omega * omega;
+    double den = (w_sq * w_sq) + (pi1 * pi1 * pi1 * pi1) + w_sq * (pi1 * pi1) * (1 / Q - 2);
+    double G1 = std::min(1.0, sqrt((w_sq * w_sq) / den) * 0.5);
+
+    double cosi = cos(omega), sinu = sin(omega),
+           // alpha = sinu*sinh((log(2.0)/2.0) * (BW) * omega / sinu),
+        alpha = sinu / (2 * Q),
+           // G1 = 0.05, //powf(2,-log(pi1/omega)/log(2.0)),
+           // set aa to 6 db
+
+        A = 2 * sqrt(G1) * sqrt(2 - G1), b0 = (1 - cosi + G1 * (1 + cosi) + A * sinu) * 0.5,
+           b1 = (1 - cosi - G1 * (1 + cosi)), b2 = (1 - cosi + G1 * (1 + cosi) - A * sinu) * 0.5,
+           a0 = (1 + alpha), a1 = -2 * cosi, a2 = 1 - alpha;
+
+    normalized(c, a0, a1, a2, b0, b1, b2);
 }
 
-void biquadunit::coeff_HP(double omega, double Q)
+void design_HP(const double *p, double *c)
 {
-    if (omega > pi1_with_margin)
-        omega = pi1_with_margin;
+    double omega = std::min(p[0], pi1_with_margin), Q = p[1];
 
-    {
-        double cosi = cos(omega), sinu = sin(omega), alpha = sinu / (2 * Q), b0 = (1 + cosi) * 0.5,
-               b1 = -(1 + cosi), b2 = (1 + cosi) * 0.5, a0 = 1 + alpha, a1 = -2 * cosi,
-               a2 = 1 - alpha;
+    double cosi = cos(omega), sinu = sin(omega), alpha = sinu / (2 * Q), b0 = (1 + cosi) * 0.5,
+           b1 = -(1 + cosi), b2 = (1 + cosi) * 0.5, a0 = 1 + alpha, a1 = -2 * cosi, a2 = 1 - alpha;
 
-        set_coef(a0, a1, a2, b0, b1, b2);
-    }
+    normalized(c, a0, a1, a2, b0, b1, b2);
 }
 
-void biquadunit::coeff_BP2AQ(double omega, double Q)
+void design_BP2AQ(const double *p, double *c)
 {
-    if (omega > pi1_with_margin)
-        omega = pi1_with_margin;
+    double omega = std::min(p[0], pi1_with_margin), Q = p[1];
 
-    {
-        double cosi = cos(omega), sinu = sin(omega), alpha = sinu / (2 * Q), b0 = alpha,
-               b2 = -alpha, a0 = 1 + alpha, a1 = -2 * cosi, a2 = 1 - alpha;
+    double cosi = cos(omega), sinu = sin(omega), alpha = sinu / (2 * Q), b0 = alpha, b2 = -alpha,
+           a0 = 1 + alpha, a1 = -2 * cosi, a2 = 1 - alpha;
 
-        set_coef(a0, a1, a2, b0, 0, b2);
-    }
+    normalized(c, a0, a1, a2, b0, 0, b2);
 }
 
-void biquadunit::coeff_BP2A(double omega, double BW)
+void design_BP2A(const double *p, double *c)
 {
-    if (omega > pi1_with_margin)
-        omega = pi1_with_margin;
+    double omega = std::min(p[0], pi1_with_margin), BW = p[1];
+
     double cosi = cos(omega), sinu = sin(omega), q = 1 / (0.02 + 30 * BW * BW),
            alpha = sinu / (2 * q), b0 = alpha, b2 = -alpha, a0 = 1 + alpha, a1 = -2 * cosi,
            a2 = 1 - alpha;
 
-    set_coef(a0, a1, a2, b0, 0, b2);
+    normalized(c, a0, a1, a2, b0, 0, b2);
 }
 
-void biquadunit::coeff_PKA(double omega, double QQ)
+void design_PKA(const double *p, double *c)
 {
-    if (omega > pi1_with_margin)
-        omega = pi1_with_margin;
+    double omega = std::min(p[0], pi1_with_margin), QQ = p[1];
 
     double cosi = cos(omega), sinu = sin(omega), reso = limit_range(QQ, 0.0, 1.0),
            q = 0.1 + 10 * reso * reso, alpha = sinu / (2 * q), b0 = q * alpha, b2 = -q * alpha,
            a0 = 1 + alpha, a1 = -2 * cosi, a2 = 1 - alpha;
 
-    set_coef(a0, a1, a2, b0, 0, b2);
+    normalized(c, a0, a1, a2, b0, 0, b2);
 }
 
-void biquadunit::coeff_NOTCHQ(double omega, double Q)
+void design_NOTCHQ(const double *p, double *c)
 {
-    if (omega > pi1_with_margin)
-        omega = pi1_with_margin;
+    double omega = std::min(p[0], pi1_with_margin), Q = p[1];
 
-    {
-        double cosi = cos(omega), sinu = sin(omega), alpha = sinu / (2 * Q), b0 = 1, b1 = -2 * cosi,
-               b2 = 1, a0 = 1 + alpha, a1 = -2 * cosi, a2 = 1 - alpha;
+    double cosi = cos(omega), sinu = sin(omega), alpha = sinu / (2 * Q), b0 = 1, b1 = -2 * cosi,
+           b2 = 1, a0 = 1 + alpha, a1 = -2 * cosi, a2 = 1 - alpha;
 
-        set_coef(a0, a1, a2, b0, b1, b2);
-    }
+    normalized(c, a0, a1, a2, b0, b1, b2);
 }
 
-void biquadunit::coeff_NOTCH(double omega, double BW)
+void design_NOTCH(const double *p, double *c)
 {
-
     //	TODO replace orfanidis with regular (bugs in this case)
     // assert(0);
     // coeff_orfanidisEQ(omega, q, 0, M_SQRT1_2, 1);
-    if (omega > pi1_with_margin)
-        omega = pi1_with_margin;
+    double omega = std::min(p[0], pi1_with_margin), BW = p[1];
 
-    {
-        double cosi = cos(omega), sinu = sin(omega), reso = limit_range(BW, 0.0, 1.0),
-               // q = 10*reso*reso*reso,
-            q = 1 / (0.02 + 30 * reso * reso), alpha = sinu / (2 * q), b0 = 1, b1 = -2 * cosi,
-               b2 = 1, a0 = 1 + alpha, a1 = -2 * cosi, a2 = 1 - alpha;
+    double cosi = cos(omega), sinu = sin(omega), reso = limit_range(BW, 0.0, 1.0),
+           // q = 10*reso*reso*reso,
+        q = 1 / (0.02 + 30 * reso * reso), alpha = sinu / (2 * q), b0 = 1, b1 = -2 * cosi, b2 = 1,
+           a0 = 1 + alpha, a1 = -2 * cosi, a2 = 1 - alpha;
 
-        set_coef(a0, a1, a2, b0, b1, b2);
-    }
+    normalized(c, a0, a1, a2, b0, b1, b2);
 }
 
-void biquadunit::coeff_LP_with_BW(double omega, double BW) { coeff_LP(omega, 1 / BW); }
-
-void biquadunit::coeff_HP_with_BW(double omega, double BW) { coeff_HP(omega, 1 / BW); }
-
-void biquadunit::coeff_LPHPmorph(double omega, double Q, double morph)
+void design_LPHPmorph(const double *p, double *c)
 {
-    if (omega > pi1_with_margin)
-        omega = pi1_with_margin;
-
-    double HP = limit_range(morph, 0.0, 1.0), LP = 1 - HP, BP = LP * HP;
-    HP *= HP;
-    LP *= LP;
+    double omega = std::min(p[0], pi1_with_margin), Q = p[1];
 
     double cosi = cos(omega), sinu = sin(omega), alpha = sinu / (2 * Q), b0 = alpha, b1 = 0,
            b2 = -alpha, a0 = 1 + alpha, a1 = -2 * cosi, a2 = 1 - alpha;
 
-    set_coef(a0, a1, a2, b0, b1, b2);
+    normalized(c, a0, a1, a2, b0, b1, b2);
 }
 
-void biquadunit::coeff_APF(double omega, double Q)
+void design_APF(const double *p, double *c)
 {
-    if (omega > pi1_with_margin)
-        omega = pi1_with_margin;
+    double omega = std::min(p[0], pi1_with_margin), Q = p[1];
 
     double cosi = cos(omega), sinu = sin(omega), alpha = sinu / (2 * Q), b0 = (1 - alpha),
            b1 = -2 * cosi, b2 = (1 + alpha), a0 = (1 + alpha), a1 = -2 * cosi, a2 = (1 - alpha);
 
-    set_coef(a0, a1, a2, b0, b1, b2);
+    normalized(c, a0, a1, a2, b0, b1, b2);
 }
 
-void biquadunit::coeff_peakEQ(double omega, double BW, double gain)
+void design_orfanidisEQ(const double *p, double *c)
 {
-    coeff_orfanidisEQ(omega, BW, dB_to_linear(gain), dB_to_linear(gain * 0.5), 1);
-}
+    double omega = p[0], BW = p[1], G = p[2], GB = p[3], G0 = p[4];
 
-void biquadunit::coeff_orfanidisEQ(double omega, double BW, double G, double GB, double G0)
-{
     double limit = 0.95;
     double w0 = omega; // min(pi1-0.000001,omega);
     BW = std::max(minBW, BW);
@@ -238,14 +222,106 @@ void biquadunit::coeff_orfanidisEQ(double omega, double BW, double G, double GB,
         // if (c) sprintf(c,"G0: %f G: %f GB: %f G1: %f
         // ",linear_to_dB(G0),linear_to_dB(G),linear_to_dB(GB),linear_to_dB(G1));
 
-        set_coef(a0, a1, a2, b0, b1, b2);
+        normalized(c, a0, a1, a2, b0, b1, b2);
     }
     else
     {
-        set_coef(1, 0, 0, 1, 0, 0);
+        normalized(c, 1, 0, 0, 1, 0, 0);
     }
 }
 
+void design_peakEQ(const double *p, double *c)
+{
+    double gain = p[2];
+    double q[] = {p[0], p[1], dB_to_linear(gain), dB_to_linear(gain * 0.5), 1};
+    design_orfanidisEQ(q, c);
+}
+} // namespace
+
+void biquadunit::design(coefficient_cache::design_fn fn, double *params, int n_params)
+{
+    double c[coefficient_cache::max_coefficients];
+    coefficient_cache::get().design(fn, params, n_params, c);
+    set_coef(1, c[0], c[1], c[2], c[3], c[4]);
+}
+
+void biquadunit::coeff_LP(double omega, double Q)
+{
+    double p[] = {omega, Q};
+    design(design_LP, p, 2);
+}
+
+void biquadunit::coeff_LP2B(double omega, double Q)
+{
+    double p[] = {omega, Q};
+    design(design_LP2B, p, 2);
+}
+
+void biquadunit::coeff_HP(double omega, double Q)
+{
+    double p[] = {omega, Q};
+    design(design_HP, p, 2);
+}
+
+void biquadunit::coeff_BP2AQ(double omega, double Q)
+{
+    double p[] = {omega, Q};
+    design(design_BP2AQ, p, 2);
+}
+
+void biquadunit::coeff_BP2A(double omega, double BW)
+{
+    double p[] = {omega, BW};
+    design(design_BP2A, p, 2);
+}
+
+void biquadunit::coeff_PKA(double omega, double QQ)
+{
+    double p[] = {omega, QQ};
+    design(design_PKA, p, 2);
+}
+
+void biquadunit::coeff_NOTCHQ(double omega, double Q)
+{
+    double p[] = {omega, Q};
+    design(design_NOTCHQ, p, 2);
+}
+
+void biquadunit::coeff_NOTCH(double omega, double BW)
+{
+    double p[] = {omega, BW};
+    design(design_NOTCH, p, 2);
+}
+
+void biquadunit::coeff_LP_with_BW(double omega, double BW) { coeff_LP(omega, 1 / BW); }
+
+void biquadunit::coeff_HP_with_BW(double omega, double BW) { coeff_HP(omega, 1 / BW); }
+
+void biquadunit::coeff_LPHPmorph(double omega, double Q, double morph)
+{
+    // morph doesn't reach the coefficients (yet)
+    double p[] = {omega, Q};
+    design(design_LPHPmorph, p, 2);
+}
+
+void biquadunit::coeff_APF(double omega, double Q)
+{
+    double p[] = {omega, Q};
+    design(design_APF, p, 2);
+}
+
+void biquadunit::coeff_peakEQ(double omega, double BW, double gain)
+{
+    double p[] = {omega, BW, gain};
+    design(design_peakEQ, p, 3);
+}
+
+void biquadunit::coeff_orfanidisEQ(double omega, double BW, double G, double GB, double G0)
+{
+    double p[] = {omega, BW, G, GB, G0};
+    design(design_orfanidisEQ, p, 5);
+}
+
 void biquadunit::coeff_same_as_last_time()
 {
     // if you were to change the ipol then set dv = 0 here
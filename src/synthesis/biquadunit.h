@@ -1,5 +1,6 @@
 #pragma once
 
+#include "coefficient_cache.h"
 #include "dspmodules.h"
 #include "globals.h"
 #include "mathtables.h"
@@ -195,6 +196,8 @@ class alignas(16) biquadunit
     float plot_magnitude(float f);
 
   protected:
+    // the coeff_ functions share their designs through coefficient_cache
+    void design(coefficient_cache::design_fn fn, double *params, int n_params);
     void set_coef(double a0, double a1, double a2, double b0, double b1, double b2);
     bool first_run;
 };
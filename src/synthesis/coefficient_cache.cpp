@@ -0,0 +1,90 @@
+/*
+** Shortcircuit XT is Free and Open Source Software
+**
+** Shortcircuit is made available under the Gnu General Public License, v3.0
+** https://www.gnu.org/licenses/gpl-3.0.en.html; The authors of the code
+** reserve the right to re-license their contributions under the MIT license in the
+** future at the discretion of the project maintainers.
+**
+** Copyright 2004-2021 by various individuals as described by the git transaction log
+**
+** All source at: https://github.com/surge-synthesizer/surge.git
+**
+** Shortcircuit was a commercial product from 2004-2018, with copyright and ownership
+** in that period held by Claes Johanson at Vember Audio. Claes made Shortcircuit
+** open source in December 2020.
+*/
+
+#include "coefficient_cache.h"
+
+#include <cstring>
+
+namespace
+{
+uint32_t round_mantissa(double &x)
+{
+    static constexpr uint32_t drop = 23 - coefficient_cache::mantissa_bits;
+    float f = (float)x;
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    // round half up in magnitude; a carry into the exponent is still the right value
+    bits = (bits + (1u << (drop - 1))) & ~((1u << drop) - 1);
+    memcpy(&f, &bits, sizeof(f));
+    x = f;
+    return bits;
+}
+} // namespace
+
+coefficient_cache &coefficient_cache::get()
+{
+    static coefficient_cache cache;
+    return cache;
+}
+
+void coefficient_cache::design(design_fn fn, double *params, int n_params, double *coefficients)
+{
+    if (!is_enabled())
+    {
+        fn(params, coefficients);
+        return;
+    }
+
+    uint32_t key[max_params] = {};
+    uint64_t h = (uint64_t)(uintptr_t)fn * 0x9e3779b97f4a7c15ULL;
+    for (int i = 0; i < n_params; i++)
+    {
+        key[i] = round_mantissa(params[i]);
+        h = (h ^ key[i]) * 0x100000001b3ULL;
+    }
+    auto &s = slots[(h ^ (h >> 29)) % n_slots];
+
+    auto seq = s.sequence.load(std::memory_order_acquire);
+    if (seq && !(seq & 1) && s.fn.load(std::memory_order_relaxed) == (uintptr_t)fn)
+    {
+        bool match = true;
+        for (int i = 0; i < max_params; i++)
+            match &= (s.key[i].load(std::memory_order_relaxed) == key[i]);
+        if (match)
+        {
+            for (int i = 0; i < max_coefficients; i++)
+                coefficients[i] = s.coefficients[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (s.sequence.load(std::memory_order_relaxed) == seq)
+                return;
+        }
+    }
+
+    fn(params, coefficients);
+
+    seq = s.sequence.load(std::memory_order_relaxed);
+    if ((seq & 1) ||
+        !s.sequence.compare_exchange_strong(seq, seq + 1, std::memory_order_relaxed))
+        return;
+    std::atomic_thread_fence(std::memory_order_release);
+    s.fn.store((uintptr_t)fn, std::memory_order_relaxed);
+    for (int i = 0; i < max_params; i++)
+        s.key[i].store(key[i], std::memory_order_relaxed);
+    for (int i = 0; i < max_coefficients; i++)
+        s.coefficients[i].store(coefficients[i], std::memory_order_relaxed);
+    s.sequence.store(seq + 2, std::memory_order_release);
+}
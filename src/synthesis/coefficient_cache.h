@@ -0,0 +1,63 @@
+/*
+** Shortcircuit XT is Free and Open Source Software
+**
+** Shortcircuit is made available under the Gnu General Public License, v3.0
+** https://www.gnu.org/licenses/gpl-3.0.en.html; The authors of the code
+** reserve the right to re-license their contributions under the MIT license in the
+** future at the discretion of the project maintainers.
+**
+** Copyright 2004-2021 by various individuals as described by the git transaction log
+**
+** All source at: https://github.com/surge-synthesizer/surge.git
+**
+** Shortcircuit was a commercial product from 2004-2018, with copyright and ownership
+** in that period held by Claes Johanson at Vember Audio. Claes made Shortcircuit
+** open source in December 2020.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * A process wide table of filter coefficients, so voices sharing filter settings, and modulated
+ * ones coming back to the same values, fetch coefficients rather than design them with sin, cos
+ * and pow every block. The parameters are rounded to mantissa_bits significant bits (a fifth of
+ * a cent for a frequency) and the design runs on the rounded values, so a hit gives exactly
+ * what a miss would. The table is direct mapped and lock free: a writer claims a slot by making
+ * its sequence odd and skips the store if another has it, a reader which sees the sequence move
+ * treats the slot as a miss.
+ */
+class coefficient_cache
+{
+  public:
+    static constexpr int max_params = 5, max_coefficients = 5;
+    static constexpr int mantissa_bits = 12;
+    static constexpr int n_slots = 1024;
+
+    // fills coefficients from params; one function per design, its address is part of the key
+    typedef void (*design_fn)(const double *params, double *coefficients);
+
+    static coefficient_cache &get();
+
+    // rounds params in place to the values the coefficients are designed from
+    void design(design_fn fn, double *params, int n_params, double *coefficients);
+
+    // off designs every call from the exact parameters, for comparing against
+    void set_enabled(bool e) { enabled.store(e, std::memory_order_relaxed); }
+    bool is_enabled() const { return enabled.load(std::memory_order_relaxed); }
+
+  private:
+    coefficient_cache() = default;
+
+    struct slot
+    {
+        std::atomic<uint32_t> sequence{0}; // odd while written, 0 when never filled
+        std::atomic<uintptr_t> fn{0};
+        std::atomic<uint32_t> key[max_params];
+        std::atomic<double> coefficients[max_coefficients];
+    };
+    slot slots[n_slots];
+    std::atomic<bool> enabled{true};
+};
@@ -135,7 +135,7 @@ float Envelope::CalcCurve()
 {
     assert((curve >= 0) && (curve < n_curves));
 
-    unsigned int e = std::min((uint32_t)0x7fffffff, phase) >> (31 - 5 - 16);
+    unsigned int e = (unsigned int)std::min((uint64_t)0x7fffffff, phase) >> (31 - 5 - 16);
 
     unsigned int e_coarse = e >> 16;
     unsigned int e_fine = e & 0xffff;
@@ -201,7 +201,7 @@ bool Envelope::Process(unsigned int samples)
     {
     case sAttack: // attack
     {
-        phase += samples * rate;
+        phase += (uint64_t)samples * rate;
 
         level = GetValue();
 
@@ -212,7 +212,7 @@ bool Envelope::Process(unsigned int samples)
     }
     break;
     case sHold: // attack
-        phase += samples * rate;
+        phase += (uint64_t)samples * rate;
         level = 1;
         if (phase > 0x80000000)
         {
@@ -221,7 +221,7 @@ bool Envelope::Process(unsigned int samples)
         break;
     case sDecay: // decay
     {
-        phase += samples * rate;
+        phase += (uint64_t)samples * rate;
 
         if (phase > 0x80000000)
         {
@@ -254,7 +254,7 @@ bool Envelope::Process(unsigned int samples)
         {
             SetRate(*R);
         }
-        phase += samples * rate;
+        phase += (uint64_t)samples * rate;
 
         if (phase > 0x80000000)
             state = sIdle;
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 //-------------------------------------------------------------------------------------------------
 
 enum envelope_state
@@ -43,7 +45,10 @@ class Envelope
     envelope_AHDSR *edata;
     // float phase;
     // float rate;
-    unsigned int phase, rate;
+    // phase is 64 bit so a control step longer than a whole stage (see
+    // sampler::set_control_interval) overshoots the stage end rather than wrapping
+    uint64_t phase;
+    unsigned int rate;
     unsigned int curve;
     bool no_sustain;
     long state;
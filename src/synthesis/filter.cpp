@@ -21,8 +21,11 @@ bool spawn_filter_release(filter *f)
 {
     if (!f)
         return false;
-    f->~filter();
-    _mm_free(f);
+    scxt::Reclaimer::get().retire(f, [](scxt::Reclaimable *r) {
+        auto f = static_cast<filter *>(r);
+        f->~filter();
+        _mm_free(f);
+    });
     return true;
 }
 
@@ -7,12 +7,15 @@
 //-------------------------------------------------------------------------------------------------------
 #pragma once
 
+#include "infrastructure/reclaimer.h"
+#include "util/prng.h"
+
 const int max_fparams = 9;
 const int labelsize = 32;
 
 /*	base class			*/
 
-class filter
+class filter : public scxt::Reclaimable
 {
   public:
     filter(float *params, void *loader = 0, bool stereo = true, int *iparams = 0);
@@ -48,6 +51,8 @@ class filter
     // filters are required to be able to process stereo blocks if stereo is true in the contructor
     virtual void suspend() {}
     virtual int tail_length() { return 1000; }
+    // the stream filters draw random numbers from, see prng
+    void seed_random(uint64_t seed) { rng.seed(seed); }
 
     float modulation_output; // filters can use this to output modulation data to the matrix
 
@@ -66,7 +71,9 @@ class filter
     char filtername[32];
     void *loader;
     bool is_stereo;
+    prng rng;
 };
 
 filter *spawn_filter(int id, float *fp, int *ip, void *loader, bool stereo);
+// hands the filter to the reclaimer, so it is destroyed later off the audio thread
 bool spawn_filter_release(filter *);
\ No newline at end of file
@@ -936,13 +936,11 @@ class alignas(16) osc_pulse : public filter
     virtual int tail_length() { return tail_infinite; }
 
   protected:
-    void convolute();
     bool first_run;
     int64_t oscstate;
     float pitch;
     int polarity;
     float osc_out;
-    int bufpos;
 };
 
 //-------------------------------------------------------------------------------------------------------
@@ -961,13 +959,11 @@ class alignas(16) osc_pulse_sync : public filter
     virtual int tail_length() { return tail_infinite; }
 
   protected:
-    void convolute();
     bool first_run;
     int64_t oscstate, syncstate, lastpulselength;
     float pitch;
     int polarity;
     float osc_out;
-    int bufpos;
 };
 
 //-------------------------------------------------------------------------------------------------------
@@ -993,7 +989,6 @@ class alignas(16) osc_saw : public filter
     virtual int tail_length() { return tail_infinite; }
 
   protected:
-    void convolute(int);
     bool first_run;
     int64_t oscstate[max_unison];
     float pitch;
@@ -1001,7 +996,6 @@ class alignas(16) osc_saw : public filter
     float out_attenuation;
     float detune_bias, detune_offset;
     float dc, dc_uni[max_unison];
-    int bufpos;
     int n_unison;
 };
 
@@ -37,7 +37,6 @@ osc_pulse::osc_pulse(float *fp) : filter(fp)
     oscstate = 0;
     osc_out = 0;
     polarity = 0;
-    bufpos = 0;
     pitch = 0;
 
     int i;
@@ -62,33 +61,52 @@ void osc_pulse::init_params()
 const int64_t large = 0x10000000000;
 const float integrator_hpf = 0.99999999f;
 
-void osc_pulse::convolute()
+/*
+ * The oscillators put a band limited impulse wherever their 40.24 fixed point state passes a
+ * sample boundary and integrate the result. The rates only change between blocks, so a block
+ * is rendered event by event rather than sample by sample: an event's sample is the integer
+ * part of its state, measured from the block's start, and its impulse goes into a linear
+ * buffer holding the block and the FIRipol_N frames after it. oscbuffer carries those over to
+ * the next block.
+ */
+static_assert(ob_length == FIRipol_N, "oscbuffer carries one impulse length");
+const int64_t block_end = large * block_size;
+
+static inline void begin_block(float *buf, const float *oscbuffer)
 {
-    int ipos = (large + oscstate) >> 16;
-    // generate pulse
-    float fpol = polarity ? -1.0f : 1.0f;
-    int m = ((ipos >> 16) & 0xff) * FIRipol_N;
-    float lipol = ((float)((uint32)(ipos & 0xffff)));
+    memcpy(buf, oscbuffer, ob_length * sizeof(float));
+    memset(buf + ob_length, 0, block_size * sizeof(float));
+}
 
-    int k;
-    for (k = 0; k < FIRipol_N; k++)
-    {
-        oscbuffer[bufpos + k & (ob_length - 1)] +=
-            fpol * (SincTableF32[m + k] + lipol * SincOffsetF32[m + k]);
-    }
+static inline void end_block(const float *buf, float *oscbuffer)
+{
+    memcpy(oscbuffer, buf + block_size, ob_length * sizeof(float));
+}
 
-    // add time until next statechange
-    double width = (0.5 - 0.499f * min(1.f, max(0.f, param[1])));
-    double t =
-        max(0.5, samplerate / (440.0 * pow((double)1.05946309435, (double)pitch + param[0])));
-    if (polarity)
+// adds amp times the impulse at the sub sample position of state to out, returns its tap sum
+static inline float add_impulse(float *out, int64_t state, float amp)
+{
+    int ipos = (int)((state & (large - 1)) >> 16);
+    int m = ((ipos >> 16) & 0xff) * FIRipol_N;
+    __m128 lipol = _mm_set1_ps((float)((uint32)(ipos & 0xffff)));
+    __m128 a = _mm_set1_ps(amp);
+    __m128 s = _mm_setzero_ps();
+    for (int k = 0; k < FIRipol_N; k += 4)
     {
-        width = 1 - width;
+        __m128 v = _mm_add_ps(_mm_load_ps(&SincTableF32[m + k]),
+                              _mm_mul_ps(lipol, _mm_load_ps(&SincOffsetF32[m + k])));
+        _mm_storeu_ps(out + k, _mm_add_ps(_mm_loadu_ps(out + k), _mm_mul_ps(a, v)));
+        s = _mm_add_ps(s, v);
     }
-    int64_t rate = (int64_t)(double)(65536.0 * 16777216.0 * t * width);
+    return _mm_cvtss_f32(sum_ps_to_ss(s));
+}
 
-    oscstate += rate;
-    polarity = !polarity;
+// the time in samples between pulse edges of either polarity, as state increments
+static inline void pulse_rates(double t, float width_param, int64_t *rate)
+{
+    double width = (0.5 - 0.499f * min(1.f, max(0.f, width_param)));
+    rate[0] = (int64_t)(double)(65536.0 * 16777216.0 * t * width);
+    rate[1] = (int64_t)(double)(65536.0 * 16777216.0 * t * (1 - width));
 }
 
 void osc_pulse::process_stereo(float *datainL, float *datainR, float *dataoutL, float *dataoutR,
@@ -103,29 +121,37 @@ void osc_pulse::process(float *datain, float *dataout, float pitch)
     {
         first_run = false;
         // initial antipulse
-        convolute();
-        oscstate -= large;
-        int i;
-        for (i = 0; i < ob_length; i++)
+        add_impulse(oscbuffer, 0, 1.f);
+        for (int i = 0; i < ob_length; i++)
             oscbuffer[i] *= -0.5f;
         oscstate = 0;
         polarity = 0;
     }
 
     this->pitch = pitch;
-    int k;
-    for (k = 0; k < block_size; k++)
+    float buf alignas(16)[block_size + ob_length];
+    begin_block(buf, oscbuffer);
+    if (oscstate < block_end)
     {
-        oscstate -= large;
-        while (oscstate < 0)
-            this->convolute();
-        osc_out = osc_out * integrator_hpf + oscbuffer[bufpos];
-        dataout[k] = osc_out;
-        oscbuffer[bufpos] = 0.f;
+        double t =
+            max(0.5, samplerate / (440.0 * pow((double)1.05946309435, (double)pitch + param[0])));
+        int64_t rate[2];
+        pulse_rates(t, param[1], rate);
+        while (oscstate < block_end)
+        {
+            add_impulse(buf + (oscstate >> 40), oscstate, polarity ? -1.0f : 1.0f);
+            oscstate += rate[polarity];
+            polarity = !polarity;
+        }
+    }
+    oscstate -= block_end;
 
-        bufpos++;
-        bufpos = bufpos & (ob_length - 1);
+    for (int k = 0; k < block_size; k++)
+    {
+        osc_out = osc_out * integrator_hpf + buf[k];
+        dataout[k] = osc_out;
     }
+    end_block(buf, oscbuffer);
 }
 
 /* pulse sync				*/
@@ -150,7 +176,6 @@ osc_pulse_sync::osc_pulse_sync(float *fp) : filter(fp)
     syncstate = 0;
     osc_out = 0;
     polarity = 0;
-    bufpos = 0;
     pitch = 0;
 
     int i;
@@ -173,55 +198,6 @@ void osc_pulse_sync::init_params()
     param[2] = 19.0f;
 }
 
-void osc_pulse_sync::convolute()
-{
-
-    int ipos = ((large + oscstate) >> 16) & 0xFFFFFFFF;
-    bool sync = false;
-    if (syncstate < oscstate)
-    {
-        ipos = ((large + syncstate) >> 16) & 0xFFFFFFFF;
-        double t =
-            max(0.5, samplerate / (440.0 * pow((double)1.05946309435, (double)pitch + param[0])));
-        int64_t syncrate = (int64_t)(double)(65536.0 * 16777216.0 * t);
-        oscstate = syncstate;
-        syncstate += syncrate;
-        sync = true;
-    }
-    // generate pulse
-    float fpol = polarity ? -1.0f : 1.0f;
-    int m = ((ipos >> 16) & 0xff) * FIRipol_N;
-    float lipol = ((float)((uint32)(ipos & 0xffff)));
-
-    int k;
-    if (!sync || !polarity)
-    {
-        for (k = 0; k < FIRipol_N; k++)
-        {
-            oscbuffer[bufpos + k & (ob_length - 1)] +=
-                fpol * (SincTableF32[m + k] + lipol * SincOffsetF32[m + k]);
-        }
-    }
-
-    if (sync)
-        polarity = false;
-
-    // add time until next statechange
-    double width = (0.5 - 0.499f * min(1.f, max(0.f, param[1])));
-    double t =
-        max(0.5,
-            samplerate / (440.0 * pow((double)1.05946309435, (double)pitch + param[0] + param[2])));
-    lastpulselength = t;
-    if (polarity)
-    {
-        width = 1 - width;
-    }
-    int64_t rate = (int64_t)(double)(65536.0 * 16777216.0 * t * width);
-
-    oscstate += rate;
-    polarity = !polarity;
-}
-
 void osc_pulse_sync::process_stereo(float *datainL, float *datainR, float *dataoutL,
                                     float *dataoutR, float pitch)
 {
@@ -235,31 +211,53 @@ void osc_pulse_sync::process(float *datain, float *dataout, float pitch)
         first_run = false;
 
         // initial antipulse
-        convolute();
-        oscstate -= large;
-        int i;
-        for (i = 0; i < ob_length; i++)
+        add_impulse(oscbuffer, 0, 1.f);
+        for (int i = 0; i < ob_length; i++)
             oscbuffer[i] *= -0.5f;
         oscstate = 0;
         polarity = 0;
     }
     this->pitch = pitch;
-    int k;
-    for (k = 0; k < block_size; k++)
+    float buf alignas(16)[block_size + ob_length];
+    begin_block(buf, oscbuffer);
+    if (min(oscstate, syncstate) < block_end)
     {
-        oscstate -= large;
-        syncstate -= large;
-        while (syncstate < 0)
-            this->convolute();
-        while (oscstate < 0)
-            this->convolute();
-        osc_out = osc_out * integrator_hpf + oscbuffer[bufpos];
-        dataout[k] = osc_out;
-        oscbuffer[bufpos] = 0.f;
+        double tsync =
+            max(0.5, samplerate / (440.0 * pow((double)1.05946309435, (double)pitch + param[0])));
+        int64_t syncrate = (int64_t)(double)(65536.0 * 16777216.0 * tsync);
+        double t = max(0.5, samplerate / (440.0 * pow((double)1.05946309435,
+                                                      (double)pitch + param[0] + param[2])));
+        lastpulselength = t;
+        int64_t rate[2];
+        pulse_rates(t, param[1], rate);
+
+        // the earlier of the two goes first, a sync restarts the pulse at its low edge
+        while (min(oscstate, syncstate) < block_end)
+        {
+            bool sync = syncstate < oscstate;
+            if (sync)
+            {
+                oscstate = syncstate;
+                syncstate += syncrate;
+            }
+            if (!sync || !polarity)
+                add_impulse(buf + (oscstate >> 40), oscstate, polarity ? -1.0f : 1.0f);
+            if (sync)
+                polarity = false;
+
+            oscstate += rate[polarity];
+            polarity = !polarity;
+        }
+    }
+    oscstate -= block_end;
+    syncstate -= block_end;
 
-        bufpos++;
-        bufpos = bufpos & (ob_length - 1);
+    for (int k = 0; k < block_size; k++)
+    {
+        osc_out = osc_out * integrator_hpf + buf[k];
+        dataout[k] = osc_out;
     }
+    end_block(buf, oscbuffer);
 }
 
 /* sawtooth				*/
@@ -282,8 +280,7 @@ osc_saw::osc_saw(float *fp, int *ip) : filter(fp, 0, true, ip)
     {
         first_run = true;
         osc_out = 0;
-        bufpos = 0;
-        dc = 0;
+            dc = 0;
         n_unison = iparam[0] + 1;
         n_unison = max(1, min(16, n_unison));
         out_attenuation = 1 / sqrt((float)n_unison);
@@ -317,43 +314,6 @@ void osc_saw::init_params()
     iparam[0] = 0;
 }
 
-void osc_saw::convolute(int voice)
-{
-    int ipos = (large + oscstate[voice]) >> 16;
-    // generate pulse
-    int m = ((ipos >> 16) & 0xff) * FIRipol_N;
-    float lipol = ((float)((uint32)(ipos & 0xffff)));
-
-    int k;
-    float a, s = 0;
-    if (dc_uni[voice] == 0.0f)
-    {
-        for (k = 0; k < FIRipol_N; k++)
-        {
-            a = SincTableF32[m + k] + lipol * SincOffsetF32[m + k];
-            oscbuffer[bufpos + k & (ob_length - 1)] += 0.5f * a;
-            s += a;
-        }
-    }
-    else
-    {
-        for (k = 0; k < FIRipol_N; k++)
-        {
-            a = SincTableF32[m + k] + lipol * SincOffsetF32[m + k];
-            oscbuffer[bufpos + k & (ob_length - 1)] += a;
-            s += a;
-        }
-    }
-
-    // add time until next statechange
-    double detune = param[1] * (detune_bias * float(voice) + detune_offset);
-    double t = max(2.0, samplerate / (440.0 * pow(1.05946309435, pitch + param[0] + detune)));
-    dc_uni[voice] = s / t;
-    int64_t rate = (int64_t)(double)(65536.0 * 16777216.0 * t);
-
-    oscstate[voice] += rate;
-}
-
 int osc_saw::get_ip_count() { return 1; }
 
 const char *osc_saw::get_ip_label(int ip_id)
@@ -403,7 +363,7 @@ void osc_saw::process(float *datain, float *dataout, float pitch)
         int i;
         for (i = 0; i < n_unison; i++)
         {
-            double drand = (double)rand() / RAND_MAX;
+            double drand = rng.uni();
             double t = drand * max(2.0, samplerate / (440.0 * pow((double)1.05946309435,
                                                                   (double)pitch + param[0])));
             oscstate[i] = (int64_t)(double)(65536.0 * 16777216.0 * t);
@@ -411,27 +371,44 @@ void osc_saw::process(float *datain, float *dataout, float pitch)
         }
     }
     this->pitch = pitch;
-    int k, l;
-    for (k = 0; k < block_size; k++)
+
+    float buf alignas(16)[block_size + ob_length];
+    begin_block(buf, oscbuffer);
+    // each voice's ramp is its impulses less its dc, kept as the change from each sample on
+    float dcstep alignas(16)[block_size] = {};
+    dc = 0;
+    for (int l = 0; l < n_unison; l++)
     {
-        dc = 0;
-        for (l = 0; l < n_unison; l++)
+        dc += dc_uni[l];
+        if (oscstate[l] >= block_end)
+        {
+            oscstate[l] -= block_end;
+            continue;
+        }
+        double detune = param[1] * (detune_bias * float(l) + detune_offset);
+        double t = max(2.0, samplerate / (440.0 * pow(1.05946309435, pitch + param[0] + detune)));
+        int64_t rate = (int64_t)(double)(65536.0 * 16777216.0 * t);
+        while (oscstate[l] < block_end)
         {
-            oscstate[l] -= large;
-            while (oscstate[l] < 0)
-                this->convolute(l);
-            dc += dc_uni[l];
+            int k = oscstate[l] >> 40;
+            float s = add_impulse(buf + k, oscstate[l], (dc_uni[l] == 0.0f) ? 0.5f : 1.f);
+            float d = s / t;
+            dcstep[k] += d - dc_uni[l];
+            dc_uni[l] = d;
+            oscstate[l] += rate;
         }
+        oscstate[l] -= block_end;
+    }
 
-        oscbuffer[(bufpos + 6) & (ob_length - 1)] -= dc;
-        osc_out = osc_out * integrator_hpf + oscbuffer[bufpos];
+    for (int k = 0; k < block_size; k++)
+    {
+        dc += dcstep[k];
+        buf[k + 6] -= dc;
+        osc_out = osc_out * integrator_hpf + buf[k];
         dataout[k] =
             out_attenuation * (1.f + param[2] * (datain[k] - 1.f)) * osc_out; // ringmod mix
-        oscbuffer[bufpos] = 0.f;
-
-        bufpos++;
-        bufpos = bufpos & (ob_length - 1);
     }
+    end_block(buf, oscbuffer);
 }
 
 /* sin				*/
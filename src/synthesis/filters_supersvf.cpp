@@ -1,4 +1,5 @@
 
+#include "coefficient_cache.h"
 #include "filter_defs.h"
 #include <algorithm>
 #include <cmath>
@@ -60,25 +61,40 @@ __forceinline __m128 SplatVector(float x)
     return _mm_shuffle_ps(v, v, 0);
 }
 
-void SuperSVF::calc_coeffs()
+// p holds the cutoff as a fraction of the oversampled rate, the resonance and the order
+static void design_SuperSVF(const double *p, double *c)
 {
-    if ((lastparam[0] != param[0]) || (lastparam[1] != param[1]) || (lastiparam[1] != iparam[1]))
-    {
-        float f = 440.f * note_to_pitch(param[0] * 12.f);
-        float F1 = 2.0 * sin(M_PI * min(0.11, f * (0.25 * samplerate_inv))); // 4x oversampling
+    float F1 = 2.0 * sin(M_PI * min(0.11, p[0])); // 4x oversampling
+
+    float Reso = sqrt(limit_range((float)p[1], 0.f, 1.f));
+
+    float overshoot = (p[2] == 1) ? 0.05 : 0.075;
+    float Q1 = 2.0 - Reso * (2.0 + overshoot) + F1 * F1 * overshoot * 0.9;
 
-        float Reso = sqrt(limit_range(param[1], 0.f, 1.f));
+    Q1 = min(Q1, min(2.00f, 2.00f - 1.52f * F1));
 
-        float overshoot = (iparam[1] == 1) ? 0.05 : 0.075;
-        float Q1 = 2.0 - Reso * (2.0 + overshoot) + F1 * F1 * overshoot * 0.9;
+    float NewClipDamp = 0.1 * Reso * F1;
 
-        Q1 = min(Q1, min(2.00f, 2.00f - 1.52f * F1));
+    const float a = 0.65;
 
-        float NewClipDamp = 0.1 * Reso * F1;
+    float NewGain = 1 - a * Reso;
 
-        const float a = 0.65;
+    c[0] = F1;
+    c[1] = Q1;
+    c[2] = NewClipDamp;
+    c[3] = NewGain;
+    c[4] = 0;
+}
 
-        float NewGain = 1 - a * Reso;
+void SuperSVF::calc_coeffs()
+{
+    if ((lastparam[0] != param[0]) || (lastparam[1] != param[1]) || (lastiparam[1] != iparam[1]))
+    {
+        float f = 440.f * note_to_pitch(param[0] * 12.f);
+        double p[] = {f * (0.25 * samplerate_inv), param[1], (double)iparam[1]};
+        double c[coefficient_cache::max_coefficients];
+        coefficient_cache::get().design(design_SuperSVF, p, 3, c);
+        float F1 = c[0], Q1 = c[1], NewClipDamp = c[2], NewGain = c[3];
 
         // Set interpolators
         __m128 nFreq = SplatVector(F1);
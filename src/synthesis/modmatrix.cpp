@@ -15,7 +15,11 @@
 #include "sampler_voice.h"
 #include "synthesis/filter.h"
 #include <algorithm>
+#include <cassert>
+#include <cstdio>
 #include <cstring>
+#include <string>
+#include <unordered_map>
 #include <vt_dsp/basic_dsp.h>
 #include "util/scxtstring.h"
 using std::max;
@@ -23,11 +27,322 @@ using std::min;
 
 float one = 1.0f;
 
-const float randscale = (2.f / (float)RAND_MAX);
+static_assert(mm_custom_controllers == n_custom_controllers,
+              "modmatrix label storage must match the custom controller count");
+
+//-------------------------------------------------------------------------------------------------
+// source & destination registry
+
+namespace
+{
+struct mm_bind_context
+{
+    sampler_voice *voice;
+    sample_part *part;
+    float *control;
+    timedata *td;
+    float *noisegen, *alternate;
+};
+
+typedef float *(*mm_bind_fn)(const mm_bind_context &, int);
+
+struct mm_source_info
+{
+    unsigned char RIFFID;
+    const char *id_name;
+    const char *display_name; // 0 for id_name
+    bool zone_only;
+    mm_bind_fn bind;
+    int index;
+};
+
+struct mm_destination_info
+{
+    unsigned char RIFFID;
+    int id;
+    const char *id_name;
+    const char *display_name;
+    int ctrlmode;
+    int filter_label; // index into modmatrix::filter_labels, -1 for static labels
+};
+
+float *bind_none(const mm_bind_context &, int) { return 0; }
+float *bind_noise(const mm_bind_context &c, int) { return c.noisegen; }
+float *bind_one(const mm_bind_context &, int) { return &one; }
+float *bind_alternate(const mm_bind_context &c, int)
+{
+    return c.voice ? &c.voice->alternate : c.alternate;
+}
+float *bind_control(const mm_bind_context &c, int i) { return c.control ? &c.control[i] : 0; }
+float *bind_custom(const mm_bind_context &c, int i)
+{
+    return c.part ? &c.part->userparameter_smoothed[i] : 0;
+}
+
+#define MM_VOICE(member)                                                                           \
+    [](const mm_bind_context &c, int) -> float * { return c.voice ? &c.voice->member : 0; }
+#define MM_TIME(member)                                                                            \
+    [](const mm_bind_context &c, int) -> float * { return c.td ? &c.td->member : 0; }
+#define MM_CUSTOM(i)                                                                               \
+    {                                                                                              \
+        (unsigned char)(RMS_Ctrl1 + i - 1), "C" #i, 0, false, bind_custom, i - 1                   \
+    }
+
+// in matrix order, the part matrix skips the zone_only entries
+const mm_source_info mm_sources[] = {
+    {RMS_None, "none", "None", false, bind_none},
+    // voice sources
+    {RMS_Keytrack, "keytrack", "Keytrack", true, MM_VOICE(keytrack)},
+    {RMS_Velocity, "velocity", "Velocity", true, MM_VOICE(fvelocity)},
+    {RMS_Modulator1, "AEG", 0, true, MM_VOICE(AEG.output)},
+    {RMS_Modulator2, "EG2", 0, true, MM_VOICE(EG2.output)},
+    {RMS_Modulator3, "stepLFO1", "Step LFO 1", true, MM_VOICE(stepLFO[0].output)},
+    {RMS_Modulator4, "stepLFO2", "Step LFO 2", true, MM_VOICE(stepLFO[1].output)},
+    {RMS_Modulator5, "stepLFO3", "Step LFO 3", true, MM_VOICE(stepLFO[2].output)},
+    {RMS_SliceEnv, "slice_env", "Slice Envelope", true, MM_VOICE(slice_env)},
+    {RMS_Random, "random+", "Random Uni", true, MM_VOICE(random)},
+    {RMS_RandomBP, "random +/-", "Random Bi", true, MM_VOICE(randombp)},
+    {RMS_Gate, "gate", "Gate", true, MM_VOICE(fgate)},
+    {RMS_Time, "time", "Time (s)", true, MM_VOICE(time)},
+    {RMS_TimeMinutes, "time60", "Time (m)", true, MM_VOICE(time60)},
+    {RMS_LagGenerator1, "lag1", "Lag 1", true, MM_VOICE(lag[0])},
+    {RMS_LagGenerator2, "lag2", "Lag 2", true, MM_VOICE(lag[1])},
+    // {"envfollow", MM_VOICE(envelope_follower)},
+    {RMS_WithinLoop, "loop_gate", "Is Within Loop", true, MM_VOICE(loop_gate)},
+    {RMS_LoopPos, "loop_pos", "Position In Loop", true, MM_VOICE(loop_pos)},
+    {RMS_Filter1ModOut, "f1modout", "F1 Mod Out", true, MM_VOICE(filter_modout[0])},
+    {RMS_Filter2ModOut, "f2modout", "F2 Mod Out", true, MM_VOICE(filter_modout[1])},
+
+    {RMS_Noise, "noise", "Noise", false, bind_noise},
+    {RMS_Alternate, "alternate", "Alternate", false, bind_alternate},
+
+    {RMS_PosBeat, "pos_beat", "Sync (1 Beat)", false, MM_TIME(pos_in_beat)},
+    {RMS_Pos2Beats, "pos_2beats", "Sync (2 Beats)", false, MM_TIME(pos_in_2beats)},
+    {RMS_PosBar, "pos_bar", "Sync (1 Bar)", false, MM_TIME(pos_in_bar)},
+    {RMS_Pos2Bars, "pos_2bars", "Sync (2 Bars)", false, MM_TIME(pos_in_2bars)},
+    {RMS_Pos4Bars, "pos_4bars", "Sync (4 Bars)", false, MM_TIME(pos_in_4bars)},
+
+    {RMS_One, "constant1", "Constant", false, bind_one},
+    // automation & channel modulation sources
+    {RMS_PitchBend, "pitchbend", "Pitch Bend", false, bind_control, c_pitch_bend},
+    {RMS_ChAftertouch, "channelAT", "Channel AT", false, bind_control, c_channel_aftertouch},
+    {RMS_ModulationWheel, "modwheel", "Modwheel", false, bind_control, c_modwheel},
+    // display names are "C1: userparametername", see modmatrix::update_labels
+    MM_CUSTOM(1),
+    MM_CUSTOM(2),
+    MM_CUSTOM(3),
+    MM_CUSTOM(4),
+    MM_CUSTOM(5),
+    MM_CUSTOM(6),
+    MM_CUSTOM(7),
+    MM_CUSTOM(8),
+    MM_CUSTOM(9),
+    MM_CUSTOM(10),
+    MM_CUSTOM(11),
+    MM_CUSTOM(12),
+    MM_CUSTOM(13),
+    MM_CUSTOM(14),
+    MM_CUSTOM(15),
+    MM_CUSTOM(16),
+};
+
+#undef MM_VOICE
+#undef MM_TIME
+#undef MM_CUSTOM
+
+// filter parameter labels and ctrlmodes depend on the filter type, see modmatrix::update_labels
+#define MM_ZONE_FILTER(fs, fp)                                                                     \
+    {                                                                                              \
+        (unsigned char)(RMD_Filter1Param0 + 0x10 * (fs - 1) + fp - 1),                             \
+            md_filter1prm0 + (fs - 1) * (md_filter2prm0 - md_filter1prm0) + fp - 1,                \
+            "f" #fs "p" #fp, "F" #fs ": ---", 0, (fs - 1) * n_filter_parameters + fp - 1           \
+    }
+#define MM_PART_FILTER(fs, fp)                                                                     \
+    {                                                                                              \
+        (unsigned char)(RMD_PartFilter1Param0 + 0x10 * (fs - 1) + fp - 1),                         \
+            md_part_filter1prm0 + (fs - 1) * (md_part_filter2prm0 - md_part_filter1prm0) + fp - 1, \
+            "f" #fs "p" #fp, "F" #fs ": ---", 0, (fs - 1) * n_filter_parameters + fp - 1           \
+    }
+
+const mm_destination_info mm_zone_destinations[] = {
+    {RMD_None, md_none, "none", "None", 0, -1},
+    {RMD_Pitch, md_pitch, "pitch", "Pitch", cm_mod_pitch, -1},
+    {RMD_Rate, md_rate, "rate", "Rate (Linear)", cm_mod_percent, -1},
+    {RMD_Amplitude, md_amplitude, "amplitude", "Amplitude", cm_mod_decibel, -1},
+    {RMD_PreFilterGain, md_prefilter_gain, "pfg", "Pre-Filter Gain", cm_mod_decibel, -1},
+    {RMD_Balance, md_pan, "pan", "Pan", cm_mod_percent, -1},
+    {RMD_AmplitudeAux1, md_aux_level, "aux_level", "Aux 1 Level", cm_mod_decibel, -1},
+    {RMD_BalanceAux1, md_aux_balance, "aux_balance", "Aux 1 Balance", cm_mod_percent, -1},
+    {RMD_AmplitudeAux2, md_aux2_level, "aux2_level", "Aux 2 Level", cm_mod_decibel, -1},
+    {RMD_BalanceAux2, md_aux2_balance, "aux2_balance", "Aux 2 Balance", cm_mod_percent, -1},
+
+    {RMD_Filter1Mix, md_filter1mix, "f1mix", "Filter 1 Mix", cm_mod_percent, -1},
+    {RMD_Filter2Mix, md_filter2mix, "f2mix", "Filter 2 Mix", cm_mod_percent, -1},
+
+    MM_ZONE_FILTER(1, 1),
+    MM_ZONE_FILTER(1, 2),
+    MM_ZONE_FILTER(1, 3),
+    MM_ZONE_FILTER(1, 4),
+    MM_ZONE_FILTER(1, 5),
+    MM_ZONE_FILTER(1, 6),
+    MM_ZONE_FILTER(2, 1),
+    MM_ZONE_FILTER(2, 2),
+    MM_ZONE_FILTER(2, 3),
+    MM_ZONE_FILTER(2, 4),
+    MM_ZONE_FILTER(2, 5),
+    MM_ZONE_FILTER(2, 6),
+
+    {RMD_SampleStart, md_sample_start, "samplestart", "Sample Start", cm_mod_percent, -1},
+    {RMD_LoopStart, md_loop_start, "loopstart", "Loop Start", cm_mod_percent, -1},
+    {RMD_LoopLength, md_loop_length, "looplength", "Loop Length", cm_mod_percent, -1},
+
+    {RMD_AEGAttack, md_AEG_a, "eg1a", "AEG Attack", cm_mod_time, -1},
+    {RMD_AEGHold, md_AEG_h, "eg1h", "AEG Hold", cm_mod_time, -1},
+    {RMD_AEGDecay, md_AEG_d, "eg1d", "AEG Decay", cm_mod_time, -1},
+    {RMD_AEGSustain, md_AEG_s, "eg1s", "AEG Sustain", cm_mod_percent, -1},
+    {RMD_AEGRelease, md_AEG_r, "eg1r", "AEG Release", cm_mod_time, -1},
+    {RMD_EG2Attack, md_EG2_a, "eg2a", "EG2 Attack", cm_mod_time, -1},
+    {RMD_EG2Hold, md_EG2_h, "eg2h", "EG2 Hold", cm_mod_time, -1},
+    {RMD_EG2Decay, md_EG2_d, "eg2d", "EG2 Decay", cm_mod_time, -1},
+    {RMD_EG2Sustain, md_EG2_s, "eg2s", "EG2 Sustain", cm_mod_percent, -1},
+    {RMD_EG2Release, md_EG2_r, "eg2r", "EG2 Release", cm_mod_time, -1},
+
+    {RMD_LFO1Rate, md_LFO1_rate, "lfo1rate", "Step LFO 1 Rate", cm_mod_freq, -1},
+    {RMD_LFO2Rate, md_LFO2_rate, "lfo2rate", "Step LFO 2 Rate", cm_mod_freq, -1},
+    {RMD_LFO3Rate, md_LFO3_rate, "lfo3rate", "Step LFO 3 Rate", cm_mod_freq, -1},
+
+    {RMD_LagGenerator1, md_lag0, "lag1", "Lag 1", cm_mod_percent, -1},
+    {RMD_LagGenerator2, md_lag1, "lag2", "Lag 2", cm_mod_percent, -1},
+};
+
+const mm_destination_info mm_part_destinations[] = {
+    {RMD_None, md_none, "none", "None", 0, -1},
+    {RMD_PartAmplitude, md_part_amplitude, "amplitude", "Amplitude", cm_mod_decibel, -1},
+    {RMD_PartPreFilterGain, md_part_prefilter_gain, "pfg", "Pre-Filter Gain", cm_mod_decibel, -1},
+    {RMD_PartBalance, md_part_pan, "balance", "Balance", cm_mod_percent, -1},
+    {RMD_PartAmplitudeAux1, md_part_aux_level, "aux_level", "Aux 1 Level", cm_mod_decibel, -1},
+    {RMD_PartBalanceAux1, md_part_aux_balance, "aux_balance", "Aux 1 Balance", cm_mod_percent,
+     -1},
+    {RMD_PartAmplitudeAux2, md_part_aux2_level, "aux2_level", "Aux 2 Level", cm_mod_decibel, -1},
+    {RMD_PartBalanceAux2, md_part_aux2_balance, "aux2_balance", "Aux 2 Balance", cm_mod_percent,
+     -1},
+
+    {RMD_PartFilter1Mix, md_part_filter1mix, "f1mix", "F1 Mix", cm_mod_percent, -1},
+    {RMD_PartFilter2Mix, md_part_filter2mix, "f2mix", "F2 Mix", cm_mod_percent, -1},
+
+    MM_PART_FILTER(1, 1),
+    MM_PART_FILTER(1, 2),
+    MM_PART_FILTER(1, 3),
+    MM_PART_FILTER(1, 4),
+    MM_PART_FILTER(1, 5),
+    MM_PART_FILTER(1, 6),
+    MM_PART_FILTER(1, 7),
+    MM_PART_FILTER(1, 8),
+    MM_PART_FILTER(1, 9),
+    MM_PART_FILTER(2, 1),
+    MM_PART_FILTER(2, 2),
+    MM_PART_FILTER(2, 3),
+    MM_PART_FILTER(2, 4),
+    MM_PART_FILTER(2, 5),
+    MM_PART_FILTER(2, 6),
+    MM_PART_FILTER(2, 7),
+    MM_PART_FILTER(2, 8),
+    MM_PART_FILTER(2, 9),
+};
+
+#undef MM_ZONE_FILTER
+#undef MM_PART_FILTER
+} // namespace
+
+// the registry resolved for one layout, built once and never modified after
+struct mm_layout
+{
+    bool zone;
+    int n_sources, n_destinations;
+    const mm_source_info *sources[mm_max_sources];
+    const mm_destination_info *destinations[md_num_destinations];
+    int ss_id[num_switchable_sources];
+    int source_from_RIFF[256], destination_from_RIFF[256];
+    std::unordered_map<std::string, int> source_ids, destination_ids;
+
+    mm_layout(bool zone) : zone(zone), n_sources(0)
+    {
+        memset(destinations, 0, sizeof(destinations));
+        for (auto &s : ss_id)
+            s = 0;
+        for (int i = 0; i < 256; i++)
+            source_from_RIFF[i] = destination_from_RIFF[i] = 0;
+
+        for (auto &s : mm_sources)
+        {
+            if (s.zone_only && !zone)
+                continue;
+            assert(n_sources < mm_max_sources);
+            sources[n_sources] = &s;
+            source_ids.emplace(s.id_name, n_sources);
+            // the first match wins, as a linear scan would
+            if (!source_from_RIFF[s.RIFFID])
+                source_from_RIFF[s.RIFFID] = n_sources;
+            n_sources++;
+        }
+
+        if (zone)
+        {
+            ss_id[ss_EG2] = source_ids["EG2"];
+            ss_id[ss_LFO1] = source_ids["stepLFO1"];
+            ss_id[ss_LFO2] = source_ids["stepLFO2"];
+            ss_id[ss_LFO3] = source_ids["stepLFO3"];
+            ss_id[ss_lag0] = source_ids["lag1"];
+            ss_id[ss_lag1] = source_ids["lag2"];
+            // there is no envelope follower, its slot has always pointed at the next source
+            ss_id[ss_envf] = source_ids["loop_gate"];
+        }
+
+        auto add = [this](const mm_destination_info *d, int n) {
+            for (int i = 0; i < n; i++)
+            {
+                destinations[d[i].id] = &d[i];
+                destination_ids.emplace(d[i].id_name, d[i].id);
+            }
+        };
+        if (zone)
+        {
+            n_destinations = md_num_zone_destinations;
+            add(mm_zone_destinations, sizeof(mm_zone_destinations) / sizeof(mm_destination_info));
+        }
+        else
+        {
+            n_destinations = md_num_part_destinations;
+            add(mm_part_destinations, sizeof(mm_part_destinations) / sizeof(mm_destination_info));
+        }
+        for (int i = n_destinations - 1; i >= 0; i--)
+        {
+            assert(destinations[i]);
+            destination_from_RIFF[destinations[i]->RIFFID] = i;
+        }
+    }
+
+    int find(const std::unordered_map<std::string, int> &ids, const char *id_name) const
+    {
+        auto it = ids.find(id_name);
+        return it == ids.end() ? 0 : it->second;
+    }
+};
+
+static const mm_layout &get_mm_layout(bool zone)
+{
+    static const mm_layout zone_layout(true), part_layout(false);
+    return zone ? zone_layout : part_layout;
+}
+
+//-------------------------------------------------------------------------------------------------
 
 int modmatrix::get_destination_value_int(int id) { return Float2Int(fdst[id]); }
 
-modmatrix::modmatrix() {}
+modmatrix::modmatrix() : layout(&get_mm_layout(false)), labels_valid(false)
+{
+    memset(src, 0, sizeof(src));
+}
 
 void modmatrix::assign(configuration *conf, sample_zone *zone, sample_part *part,
                        sampler_voice *voice, float *control, float *automation, timedata *td)
@@ -41,217 +356,94 @@ void modmatrix::assign(configuration *conf, sample_zone *zone, sample_part *part
     this->voice = voice;
     this->control = control;
     this->automation = automation;
+    labels_valid = false;
+
+    layout = &get_mm_layout(zone != 0);
+    mm_bind_context c = {voice, part, control, td, &noisegen, &alternate};
+    int n = layout->n_sources;
+    for (int i = 0; i < n; i++)
+        src[i] = layout->sources[i]->bind(c, layout->sources[i]->index);
+    for (int i = n; i < mm_max_sources; i++)
+        src[i] = 0;
+}
 
-    add_source(RMS_None, "none", 0, "None");
-    // voice sources
-    if (zone) // only available for the zone
+void modmatrix::update_labels()
+{
+    for (int i = 0; i < n_custom_controllers; i++)
+        snprintf(source_labels[i], namelen, "C%i: %s", i + 1,
+                 part ? part->userparametername[i] : "");
+
+    int np = zone ? 6 : n_filter_parameters;
+    for (int fs = 0; fs < 2; fs++)
     {
-        add_source(RMS_Keytrack, "keytrack", voice ? &voice->keytrack : 0, "Keytrack");
-        add_source(RMS_Velocity, "velocity", voice ? &voice->fvelocity : 0, "Velocity");
-        add_source(RMS_Modulator1, "AEG", voice ? &voice->AEG.output : 0);
-        ss_id[ss_EG2] = (int)src.size();
-        add_source(RMS_Modulator2, "EG2", voice ? &voice->EG2.output : 0);
-        ss_id[ss_LFO1] = (int)src.size();
-        add_source(RMS_Modulator3, "stepLFO1", voice ? &voice->stepLFO[0].output : 0, "Step LFO 1");
-        ss_id[ss_LFO2] = (int)src.size();
-        add_source(RMS_Modulator4, "stepLFO2", voice ? &voice->stepLFO[1].output : 0, "Step LFO 2");
-        ss_id[ss_LFO3] = (int)src.size();
-        add_source(RMS_Modulator5, "stepLFO3", voice ? &voice->stepLFO[2].output : 0, "Step LFO 3");
-        add_source(RMS_SliceEnv, "slice_env", voice ? &voice->slice_env : 0, "Slice Envelope");
-        add_source(RMS_Random, "random+", voice ? &voice->random : 0, "Random Uni");
-        add_source(RMS_RandomBP, "random +/-", voice ? &voice->randombp : 0, "Random Bi");
-        add_source(RMS_Gate, "gate", voice ? &voice->fgate : 0, "Gate");
-        add_source(RMS_Time, "time", voice ? &voice->time : 0, "Time (s)");
-        add_source(RMS_TimeMinutes, "time60", voice ? &voice->time60 : 0, "Time (m)");
-        ss_id[ss_lag0] = (int)src.size();
-        add_source(RMS_LagGenerator1, "lag1", voice ? &voice->lag[0] : 0, "Lag 1");
-        ss_id[ss_lag1] = (int)src.size();
-        add_source(RMS_LagGenerator2, "lag2", voice ? &voice->lag[1] : 0, "Lag 2");
-        ss_id[ss_envf] = (int)src.size();
-        // add_source("envfollow",		voice ? &voice->envelope_follower : 0);
-        add_source(RMS_WithinLoop, "loop_gate", voice ? &voice->loop_gate : 0, "Is Within Loop");
-        add_source(RMS_LoopPos, "loop_pos", voice ? &voice->loop_pos : 0, "Position In Loop");
-        add_source(RMS_Filter1ModOut, "f1modout", voice ? &voice->filter_modout[0] : 0,
-                   "F1 Mod Out");
-        add_source(RMS_Filter2ModOut, "f2modout", voice ? &voice->filter_modout[1] : 0,
-                   "F2 Mod Out");
+        filter *tempf = 0;
+        if (zone)
+            tempf = spawn_filter(zone->Filter[fs].type, zone->Filter[fs].p, zone->Filter[fs].ip, 0,
+                                 false);
+        else if (part)
+            tempf = spawn_filter(part->Filter[fs].type, part->Filter[fs].p, part->Filter[fs].ip, 0,
+                                 false);
+
+        for (int fp = 0; fp < np; fp++)
+        {
+            int l = fs * n_filter_parameters + fp;
+            if (tempf)
+                snprintf(filter_labels[l], namelen, "F%i: %s", fs + 1,
+                         tempf->get_parameter_label(fp));
+            else
+                snprintf(filter_labels[l], namelen, "F%i: ---", fs + 1);
+            filter_ctrlmodes[l] = get_mod_mode(tempf ? tempf->get_parameter_ctrlmode(fp) : 0);
+        }
+        spawn_filter_release(tempf);
     }
+    labels_valid = true;
+}
 
-    add_source(RMS_Noise, "noise", &noisegen, "Noise");
-    add_source(RMS_Alternate, "alternate", voice ? &voice->alternate : &alternate, "Alternate");
-
-    add_source(RMS_PosBeat, "pos_beat", td ? &td->pos_in_beat : 0, "Sync (1 Beat)");
-    add_source(RMS_Pos2Beats, "pos_2beats", td ? &td->pos_in_2beats : 0, "Sync (2 Beats)");
-    add_source(RMS_PosBar, "pos_bar", td ? &td->pos_in_bar : 0, "Sync (1 Bar)");
-    add_source(RMS_Pos2Bars, "pos_2bars", td ? &td->pos_in_2bars : 0, "Sync (2 Bars)");
-    add_source(RMS_Pos4Bars, "pos_4bars", td ? &td->pos_in_4bars : 0, "Sync (4 Bars)");
-
-    add_source(RMS_One, "constant1", &one, "Constant");
-    // automation & channel modulation sources
-    add_source(RMS_PitchBend, "pitchbend", control ? &control[c_pitch_bend] : 0, "Pitch Bend");
-    // add_source("pb_up",			&pb_up,"pitchbend up");
-    // add_source("pb_down",		&pb_down,"pitchbend down");
-    add_source(RMS_ChAftertouch, "channelAT", control ? &control[c_channel_aftertouch] : 0,
-               "Channel AT");
-    add_source(RMS_ModulationWheel, "modwheel", control ? &control[c_modwheel] : 0, "Modwheel");
-    int i;
-    for (i = 0; i < n_custom_controllers; i++)
+const char *modmatrix::get_source_name(int id)
+{
+    auto s = layout->sources[id];
+    if (s->bind == bind_custom)
     {
-        char stnice[namelen], st[namelen];
-        sprintf(stnice, "C%i: %s", i + 1, part ? part->userparametername[i] : "");
-        sprintf(st, "C%i", i + 1);
-        add_source(RMS_Ctrl1 + i, st, part ? &part->userparameter_smoothed[i] : 0, stnice);
+        if (!labels_valid)
+            update_labels();
+        return source_labels[s->index];
     }
-    /*for(i=0; i<n_automation_parameters; i++)
-    {
-            char st[namelen];
-            sprintf(st,"auto%02i",i);
-            add_source(st,	automation ? &automation[i] : 0);
-    }	*/
+    return s->display_name ? s->display_name : s->id_name;
+}
 
-    // destinations
+const char *modmatrix::get_source_idname(int id) { return layout->sources[id]->id_name; }
 
-    add_destination(RMD_None, md_none, "none", 0, "None");
-    if (zone)
+const char *modmatrix::get_destination_name(int id)
+{
+    auto d = layout->destinations[id];
+    if (d->filter_label >= 0)
     {
-        // zone-level matrix
-        add_destination(RMD_Pitch, md_pitch, "pitch", cm_mod_pitch, "Pitch");
-        add_destination(RMD_Rate, md_rate, "rate", cm_mod_percent, "Rate (Linear)");
-        add_destination(RMD_Amplitude, md_amplitude, "amplitude", cm_mod_decibel, "Amplitude");
-        add_destination(RMD_PreFilterGain, md_prefilter_gain, "pfg", cm_mod_decibel,
-                        "Pre-Filter Gain");
-        add_destination(RMD_Balance, md_pan, "pan", cm_mod_percent, "Pan");
-        add_destination(RMD_AmplitudeAux1, md_aux_level, "aux_level", cm_mod_decibel,
-                        "Aux 1 Level");
-        add_destination(RMD_BalanceAux1, md_aux_balance, "aux_balance", cm_mod_percent,
-                        "Aux 1 Balance");
-        add_destination(RMD_AmplitudeAux2, md_aux2_level, "aux2_level", cm_mod_decibel,
-                        "Aux 2 Level");
-        add_destination(RMD_BalanceAux2, md_aux2_balance, "aux2_balance", cm_mod_percent,
-                        "Aux 2 Balance");
-
-        add_destination(RMD_Filter1Mix, md_filter1mix, "f1mix", cm_mod_percent, "Filter 1 Mix");
-        add_destination(RMD_Filter2Mix, md_filter2mix, "f2mix", cm_mod_percent, "Filter 2 Mix");
-
-        for (unsigned int fs = 0; fs < 2; fs++)
-        {
-            filter *tempf = 0;
-            if (zone)
-                tempf = spawn_filter(zone->Filter[fs].type, zone->Filter[fs].p, zone->Filter[fs].ip,
-                                     0, false);
+        if (!labels_valid)
+            update_labels();
+        return filter_labels[d->filter_label];
+    }
+    return d->display_name;
+}
 
-            for (unsigned int fp = 0; fp < 6; fp++)
-            {
-                int ct = 0;
-                char txt[namelen];
-                char idname[namelen];
-                sprintf(idname, "f%ip%i", fs + 1, fp + 1);
-                if (tempf)
-                    sprintf(txt, "F%i: %s", fs + 1, tempf->get_parameter_label(fp));
-                else
-                    sprintf(txt, "F%i: ---", fs + 1);
-                if (tempf)
-                    ct = tempf->get_parameter_ctrlmode(fp);
-
-                ct = get_mod_mode(ct);
-
-                add_destination(RMD_Filter1Param0 + 0x10 * fs + fp,
-                                md_filter1prm0 + fs * (md_filter2prm0 - md_filter1prm0) + fp,
-                                idname, ct, txt);
-            }
-            spawn_filter_release(tempf);
-        }
+const char *modmatrix::get_destination_idname(int id) { return layout->destinations[id]->id_name; }
 
-        add_destination(RMD_SampleStart, md_sample_start, "samplestart", cm_mod_percent,
-                        "Sample Start");
-        add_destination(RMD_LoopStart, md_loop_start, "loopstart", cm_mod_percent, "Loop Start");
-        add_destination(RMD_LoopLength, md_loop_length, "looplength", cm_mod_percent,
-                        "Loop Length");
-
-        // add_destination(md_granularpos,"granular",cm_mod_percent,"granular pos");
-
-        add_destination(RMD_AEGAttack, md_AEG_a, "eg1a", cm_mod_time, "AEG Attack");
-        add_destination(RMD_AEGHold, md_AEG_h, "eg1h", cm_mod_time, "AEG Hold");
-        add_destination(RMD_AEGDecay, md_AEG_d, "eg1d", cm_mod_time, "AEG Decay");
-        add_destination(RMD_AEGSustain, md_AEG_s, "eg1s", cm_mod_percent, "AEG Sustain");
-        add_destination(RMD_AEGRelease, md_AEG_r, "eg1r", cm_mod_time, "AEG Release");
-        add_destination(RMD_EG2Attack, md_EG2_a, "eg2a", cm_mod_time, "EG2 Attack");
-        add_destination(RMD_EG2Hold, md_EG2_h, "eg2h", cm_mod_time, "EG2 Hold");
-        add_destination(RMD_EG2Decay, md_EG2_d, "eg2d", cm_mod_time, "EG2 Decay");
-        add_destination(RMD_EG2Sustain, md_EG2_s, "eg2s", cm_mod_percent, "EG2 Sustain");
-        add_destination(RMD_EG2Release, md_EG2_r, "eg2r", cm_mod_time, "EG2 Release");
-
-        add_destination(RMD_LFO1Rate, md_LFO1_rate, "lfo1rate", cm_mod_freq, "Step LFO 1 Rate");
-        add_destination(RMD_LFO2Rate, md_LFO2_rate, "lfo2rate", cm_mod_freq, "Step LFO 2 Rate");
-        add_destination(RMD_LFO3Rate, md_LFO3_rate, "lfo3rate", cm_mod_freq, "Step LFO 3 Rate");
-
-        add_destination(RMD_LagGenerator1, md_lag0, "lag1", cm_mod_percent, "Lag 1");
-        add_destination(RMD_LagGenerator2, md_lag1, "lag2", cm_mod_percent, "Lag 2");
-
-        /*for(i=0; i<mm_entries; i++)
-        {
-                char label[namelen],id[namelen];
-                sprintf(label,"mod slot #%i",i+1);
-                sprintf(id,"mm%i",i);
-                int ct = cm_mod_percent;
-                if (zone)
-                {
-                        int d = zone->mm[i].destination;
-                        if((d>0)&&(d<(int)dst.size())) ct = dst[d].ctrlmode;
-                }
-                add_destination(md_MM0_depth+i,id,ct,label);
-        }*/
-    }
-    else
+int modmatrix::get_destination_ctrlmode(int id)
+{
+    auto d = layout->destinations[id];
+    if (d->filter_label >= 0)
     {
-        // part-level matrix
-        add_destination(RMD_PartAmplitude, md_part_amplitude, "amplitude", cm_mod_decibel,
-                        "Amplitude");
-        add_destination(RMD_PartPreFilterGain, md_part_prefilter_gain, "pfg", cm_mod_decibel,
-                        "Pre-Filter Gain");
-        add_destination(RMD_PartBalance, md_part_pan, "balance", cm_mod_percent, "Balance");
-        add_destination(RMD_PartAmplitudeAux1, md_part_aux_level, "aux_level", cm_mod_decibel,
-                        "Aux 1 Level");
-        add_destination(RMD_PartBalanceAux1, md_part_aux_balance, "aux_balance", cm_mod_percent,
-                        "Aux 1 Balance");
-        add_destination(RMD_PartAmplitudeAux2, md_part_aux2_level, "aux2_level", cm_mod_decibel,
-                        "Aux 2 Level");
-        add_destination(RMD_PartBalanceAux2, md_part_aux2_balance, "aux2_balance", cm_mod_percent,
-                        "Aux 2 Balance");
-
-        add_destination(RMD_PartFilter1Mix, md_part_filter1mix, "f1mix", cm_mod_percent, "F1 Mix");
-        add_destination(RMD_PartFilter2Mix, md_part_filter2mix, "f2mix", cm_mod_percent, "F2 Mix");
-
-        for (unsigned int fs = 0; fs < 2; fs++)
-        {
-            filter *tempf = 0;
-            if (part)
-                tempf = spawn_filter(part->Filter[fs].type, part->Filter[fs].p, part->Filter[fs].ip,
-                                     0, false);
-
-            for (unsigned int fp = 0; fp < n_filter_parameters; fp++)
-            {
-                int ct = 0;
-                char txt[namelen];
-                char idname[namelen];
-                sprintf(idname, "f%ip%i", fs + 1, fp + 1);
-                if (tempf)
-                    sprintf(txt, "F%i: %s", fs + 1, tempf->get_parameter_label(fp));
-                else
-                    sprintf(txt, "F%i: ---", fs + 1);
-                if (tempf)
-                    ct = tempf->get_parameter_ctrlmode(fp);
-
-                ct = get_mod_mode(ct);
-
-                add_destination(RMD_PartFilter1Param0 + 0x10 * fs + fp,
-                                md_part_filter1prm0 +
-                                    fs * (md_part_filter2prm0 - md_part_filter1prm0) + fp,
-                                idname, ct, txt);
-            }
-            spawn_filter_release(tempf);
-        }
+        if (!labels_valid)
+            update_labels();
+        return filter_ctrlmodes[d->filter_label];
     }
+    return d->ctrlmode;
+}
+
+unsigned char modmatrix::get_source_RIFFID(int id) { return layout->sources[id]->RIFFID; }
+
+unsigned char modmatrix::get_destination_RIFFID(int id)
+{
+    return layout->destinations[id]->RIFFID;
 }
 
 int modmatrix::is_source_used(int source) // for CPU saving purposes
@@ -260,7 +452,7 @@ int modmatrix::is_source_used(int source) // for CPU saving purposes
         return 0;
     if (!zone)
         return 0;
-    int sid = ss_id[source];
+    int sid = layout->ss_id[source];
     for (int i = 0; i < mm_entries; i++)
     {
         if ((zone->mm[i].source == sid) || (zone->mm[i].source2 == sid))
@@ -269,47 +461,10 @@ int modmatrix::is_source_used(int source) // for CPU saving purposes
     return 0;
 }
 
-void modmatrix::add_destination(unsigned char RIFFID, int id, const char *name, int control_type,
-                                const char *dispname)
-{
-    strncpy_0term(dst[id].id_name, name, namelen);
-
-    if (dispname)
-        strncpy_0term(dst[id].display_name, dispname, namelen);
-    else
-        strncpy_0term(dst[id].display_name, name, namelen);
-
-    dst[id].ctrlmode = control_type;
-    dst[id].RIFFID = RIFFID;
-}
-
 modmatrix::~modmatrix() {}
 
-void modmatrix::add_source(unsigned char RIFFID, const char *name, float *fptr,
-                           const char *dispname)
-{
-    mm_src t;
-    strncpy_0term(t.id_name, name, namelen);
-
-    if (dispname)
-        strncpy_0term(t.display_name, dispname, namelen);
-    else
-        strncpy_0term(t.display_name, name, namelen);
-
-    t.fptr = fptr;
-    t.RIFFID = RIFFID;
-    src.push_back(t);
-}
-
-int modmatrix::get_n_sources() { return (int)src.size(); }
-int modmatrix::get_n_destinations()
-{
-    // return (int)dst.size();
-    if (zone)
-        return md_num_zone_destinations;
-    else
-        return md_num_part_destinations;
-}
+int modmatrix::get_n_sources() { return layout->n_sources; }
+int modmatrix::get_n_destinations() { return layout->n_destinations; }
 
 bool modmatrix::check_NC(sample_zone *z)
 {
@@ -319,9 +474,9 @@ bool modmatrix::check_NC(sample_zone *z)
     // checks NCs
     for (int i = 0; i < nc_entries; i++)
     {
-        if (src[z->nc[i].source].fptr)
+        if (src[z->nc[i].source])
         {
-            int val = (int)(float)(*src[z->nc[i].source].fptr * 127.f);
+            int val = (int)(float)(*src[z->nc[i].source] * 127.f);
             if ((val < z->nc[i].low) || (val > z->nc[i].high))
                 return false;
         }
@@ -329,9 +484,9 @@ bool modmatrix::check_NC(sample_zone *z)
     unsigned int layer = z->layer & (num_layers - 1);
     for (int i = (layer * num_layer_ncs); i < (layer * num_layer_ncs + num_layer_ncs); i++)
     {
-        if (src[part->nc[i].source].fptr)
+        if (src[part->nc[i].source])
         {
-            int val = (int)(float)(*src[part->nc[i].source].fptr * 127.f);
+            int val = (int)(float)(*src[part->nc[i].source] * 127.f);
             if ((val < part->nc[i].low) || (val > part->nc[i].high))
                 return false;
         }
@@ -406,7 +561,7 @@ void modmatrix::process_part()
 {
     //	pb_up = max(0,control[c_pitch_bend]);
     //	pb_down = max(0,-control[c_pitch_bend]);
-    noisegen = ((float)rand() * randscale) - 1.f;
+    noisegen = rng.bi();
 
     fdst[md_part_amplitude] = part->aux[0].level;
     fdst[md_part_pan] = part->aux[0].balance;
@@ -446,14 +601,14 @@ void modmatrix::process_part()
     for (int i = 0; i < mm_part_entries; i++)
     {
         if (part->mm[i].destination && (part->mm[i].source || part->mm[i].source2) &&
-            (part->mm[i].active) && (src[part->mm[i].source].fptr))
+            (part->mm[i].active) && (src[part->mm[i].source]))
         {
             int dest = part->mm[i].destination;
             int curve = part->mm[i].curve;
             float strength = part->mm[i].strength; // + fdst[md_MM0_depth+i];
-            float tmodulation = *src[part->mm[i].source].fptr;
-            if (src[part->mm[i].source2].fptr)
-                tmodulation *= *src[part->mm[i].source2].fptr;
+            float tmodulation = *src[part->mm[i].source];
+            if (src[part->mm[i].source2])
+                tmodulation *= *src[part->mm[i].source2];
 
             if (curve)
                 tmodulation = do_curve(curve, tmodulation);
@@ -475,7 +630,7 @@ void modmatrix::process()
     // calculate special controllers that only exist within the modmatrix
     // pb_up = max(0,control[c_pitch_bend]);
     // pb_down = max(0,-control[c_pitch_bend]);
-    noisegen = ((float)rand() * randscale) - 1.f;
+    noisegen = rng.bi();
 
     if (!zone)
         return;
@@ -546,24 +701,24 @@ void modmatrix::process()
     /*for(i=0; i<mm_entries; i++)
     {
             if((zone->mm[i].destination >=
-    md_MM0_depth)&&(zone->mm[i].active)&&(src[zone->mm[i].source].fptr))
+    md_MM0_depth)&&(zone->mm[i].active)&&(src[zone->mm[i].source]))
             {
                     float strength = zone->mm[i].strength + fdst[md_MM0_depth+i];
-                    fdst[zone->mm[i].destination] += strength * *src[zone->mm[i].source].fptr;
+                    fdst[zone->mm[i].destination] += strength * *src[zone->mm[i].source];
             }
     }*/
 
     for (i = 0; i < mm_entries; i++)
     {
         if (zone->mm[i].destination && (zone->mm[i].source || zone->mm[i].source2) &&
-            (zone->mm[i].active) && (src[zone->mm[i].source].fptr))
+            (zone->mm[i].active) && (src[zone->mm[i].source]))
         {
             int dest = zone->mm[i].destination;
             int curve = zone->mm[i].curve;
             float strength = zone->mm[i].strength; // + fdst[md_MM0_depth+i];
-            float tmodulation = *src[zone->mm[i].source].fptr;
-            if (src[zone->mm[i].source2].fptr)
-                tmodulation *= *src[zone->mm[i].source2].fptr;
+            float tmodulation = *src[zone->mm[i].source];
+            if (src[zone->mm[i].source2])
+                tmodulation *= *src[zone->mm[i].source2];
 
             if (curve)
                 tmodulation = do_curve(curve, tmodulation);
@@ -590,42 +745,20 @@ void modmatrix::process()
     }
 }
 
+// importers resolve ids against the part layout, as they always have
 int get_mm_source_id(const char *txt)
 {
-    modmatrix mm;
-    mm.assign(0, 0, 0);
-    int k, n = mm.get_n_sources();
-    for (k = 0; k < n; k++)
-    {
-        if (!strcmp(txt, mm.get_source_idname(k)))
-            return k;
-    }
-    return 0;
+    auto &l = get_mm_layout(false);
+    return l.find(l.source_ids, txt);
 }
 
 int get_mm_dest_id(const char *txt)
 {
-    modmatrix mm;
-    mm.assign(0, 0, 0);
-    int k, n = mm.get_n_destinations();
-    for (k = 0; k < n; k++)
-    {
-        if (!strcmp(txt, mm.get_destination_idname(k)))
-            return k;
-    }
-    return 0;
+    auto &l = get_mm_layout(false);
+    return l.find(l.destination_ids, txt);
 }
 
-int modmatrix::SourceRiffIDToInternal(unsigned char ID)
-{
-    int k, n = get_n_sources();
-    for (k = 0; k < n; k++)
-    {
-        if (ID == get_source_RIFFID(k))
-            return k;
-    }
-    return 0;
-}
+int modmatrix::SourceRiffIDToInternal(unsigned char ID) { return layout->source_from_RIFF[ID]; }
 unsigned char modmatrix::SourceInternalToRiffID(unsigned int ID)
 {
     if (ID < get_n_sources())
@@ -634,13 +767,7 @@ unsigned char modmatrix::SourceInternalToRiffID(unsigned int ID)
 }
 int modmatrix::DestinationRiffIDToInternal(unsigned char ID)
 {
-    int k, n = get_n_destinations();
-    for (k = 0; k < n; k++)
-    {
-        if (ID == get_destination_RIFFID(k))
-            return k;
-    }
-    return 0;
+    return layout->destination_from_RIFF[ID];
 }
 unsigned char modmatrix::DestinationInternalToRiffID(unsigned int ID)
 {
@@ -7,7 +7,8 @@
 //-------------------------------------------------------------------------------------------------------
 #pragma once
 
-#include <vector>
+#include "sampler_state.h"
+#include "util/prng.h"
 
 class modmatrix;
 class sampler_voice;
@@ -119,21 +120,17 @@ enum mm_destinations
         md_num_zone_destinations, // std::max(md_num_part_destinations,md_num_zone_destinations)
 };
 
-struct mm_src
-{
-    char display_name[namelen];
-    char id_name[namelen];
-    float *fptr;
-    unsigned char RIFFID;
-};
-
-struct mm_dst
-{
-    char display_name[namelen];
-    char id_name[namelen];
-    int ctrlmode;
-    unsigned char RIFFID;
-};
+/*
+ * The sources and destinations a matrix offers are fixed per layout (zone or part), so their
+ * names, RIFF ids and ctrlmodes live in one static registry in modmatrix.cpp; an instance
+ * only binds the source pointers of its voice in assign(), which is allocation free and cheap
+ * enough to run at every note-on. The few labels which depend on the patch (user controller
+ * names and filter parameters) are filled in on first request, for the editor.
+ */
+const int mm_max_sources = 64;
+const int mm_filter_labels = 2 * n_filter_parameters;
+const int mm_custom_controllers = 16; // n_custom_controllers, checked in modmatrix.cpp
+struct mm_layout;
 
 class modmatrix
 {
@@ -148,20 +145,19 @@ class modmatrix
     bool check_NC(sample_zone *z);
     void process_part();
     void process_group();
+    // the noise source's stream, see prng
+    void seed_random(uint64_t seed) { rng.seed(seed); }
     int get_controltype(int destination);
-    void add_destination(unsigned char RIFFID, int id, const char *name, int control_type,
-                         const char *dispname = 0);
-    void add_source(unsigned char RIFFID, const char *name, float *fptr, const char *dispname = 0);
     int is_source_used(int source);
     int get_n_sources();
     int get_n_destinations();
-    char *get_source_name(int id) { return src[id].display_name; }
-    char *get_source_idname(int id) { return src[id].id_name; }
-    char *get_destination_name(int id) { return dst[id].display_name; }
-    char *get_destination_idname(int id) { return dst[id].id_name; }
-    int get_destination_ctrlmode(int id) { return dst[id].ctrlmode; }
-    unsigned char get_source_RIFFID(int id) { return src[id].RIFFID; }
-    unsigned char get_destination_RIFFID(int id) { return dst[id].RIFFID; }
+    const char *get_source_name(int id);
+    const char *get_source_idname(int id);
+    const char *get_destination_name(int id);
+    const char *get_destination_idname(int id);
+    int get_destination_ctrlmode(int id);
+    unsigned char get_source_RIFFID(int id);
+    unsigned char get_destination_RIFFID(int id);
     inline float get_destination_value(int id) { return fdst[id]; }
     int get_destination_value_int(int id);
     float *get_destination_ptr(int id) { return &fdst[id]; }
@@ -172,16 +168,24 @@ class modmatrix
     unsigned char DestinationInternalToRiffID(unsigned int);
 
   private:
-    std::vector<mm_src> src;
-    mm_dst dst[md_num_destinations];
+    void update_labels();
+
+    const mm_layout *layout;
+    float *src[mm_max_sources];
     float fdst[md_num_destinations];
     sample_zone *__restrict zone;
     sample_part *__restrict part;
     sampler_voice *__restrict voice;
     float *__restrict control, *__restrict automation;
-    int ss_id[num_switchable_sources];
     bool first_run;
     float noisegen, alternate;
+    prng rng;
+
+    // patch dependent labels, only filled in when asked for
+    bool labels_valid;
+    char source_labels[mm_custom_controllers][namelen];
+    char filter_labels[mm_filter_labels][namelen];
+    int filter_ctrlmodes[mm_filter_labels];
 };
 
 int get_mm_source_id(const char *);
@@ -11,10 +11,13 @@
 using std::max;
 using std::min;
 
-void load_lfo_preset(int id, steplfostruct *settings)
+void load_lfo_preset(int id, steplfostruct *settings, prng *rng)
 {
     if (!settings)
         return;
+    prng fixed;
+    if (!rng)
+        rng = &fixed;
 
     int t;
     switch (id)
@@ -92,7 +95,7 @@ void load_lfo_preset(int id, steplfostruct *settings)
 
         for (t = 0; t < 32; t++)
         {
-            noisev[t] = (((float)rand() / RAND_MAX) * 2 - 1);
+            noisev[t] = rng->bi();
             noisev[t] /= (float)nmean;
         }
         for (t = 0; t < 32; t++)
@@ -154,7 +157,7 @@ float QuadraticBSpline(float y0, float y1, float y2, float mu)
 
 steplfo::steplfo() {}
 
-void steplfo::assign(steplfostruct *settings, float *rate, timedata *td)
+void steplfo::assign(steplfostruct *settings, float *rate, timedata *td, prng &rng)
 {
     this->settings = settings;
     this->td = td;
@@ -168,8 +171,8 @@ void steplfo::assign(steplfostruct *settings, float *rate, timedata *td)
     if (settings->triggermode == 2)
     {
         // simulate free running lfo by randomizing start phase
-        phase = (float)rand() / RAND_MAX;
-        state = rand() % settings->repeat;
+        phase = rng.uni();
+        state = rng.next() % settings->repeat;
     }
     else if (settings->triggermode == 1)
     {
@@ -194,9 +197,10 @@ void steplfo::UpdatePhaseIncrement()
                (settings->temposync ? (td->tempo * (1.f / 120.f)) : 1);
 }
 
-void steplfo::process(int)
+void steplfo::process(int samples)
 {
-    phase += phaseInc;
+    // phaseInc is per block, the control path may step several at once
+    phase += phaseInc * (samples * inv_block_size);
     while (phase > 1.0f)
     {
         // shuffle_id = (shuffle_id+1)&1;
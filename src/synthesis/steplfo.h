@@ -7,10 +7,13 @@
 //-------------------------------------------------------------------------------------------------------
 #pragma once
 
+#include "util/prng.h"
+
 struct timedata;
 struct steplfostruct;
 
-void load_lfo_preset(int preset, steplfostruct *settings);
+// the noise presets draw from rng, or from a fixed sequence without one
+void load_lfo_preset(int preset, steplfostruct *settings, prng *rng = nullptr);
 float lfo_ipol(float *step_history, float phase, float smooth, int odd);
 
 class steplfo
@@ -18,7 +21,8 @@ class steplfo
   public:
     steplfo();
     ~steplfo();
-    void assign(steplfostruct *settings, float *rate, timedata *td);
+    // free running lfos start at a random phase taken from rng
+    void assign(steplfostruct *settings, float *rate, timedata *td, prng &rng);
     void sync();
     void process(int samples);
     float output;
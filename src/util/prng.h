@@ -0,0 +1,59 @@
+/*
+** Shortcircuit XT is Free and Open Source Software
+**
+** Shortcircuit is made available under the Gnu General Public License, v3.0
+** https://www.gnu.org/licenses/gpl-3.0.en.html; The authors of the code
+** reserve the right to re-license their contributions under the MIT license in the
+** future at the discretion of the project maintainers.
+**
+** Copyright 2004-2021 by various individuals as described by the git transaction log
+**
+** All source at: https://github.com/surge-synthesizer/surge.git
+**
+** Shortcircuit was a commercial product from 2004-2018, with copyright and ownership
+** in that period held by Claes Johanson at Vember Audio. Claes made Shortcircuit
+** open source in December 2020.
+*/
+
+#ifndef SHORTCIRCUIT_PRNG_H
+#define SHORTCIRCUIT_PRNG_H
+
+#include <cstdint>
+
+/*
+ * Random numbers for the audio path. Every voice, part, modmatrix and filter owns one, so
+ * nothing is shared between threads, and they are seeded from the sampler's random seed and
+ * the note count (see sampler::set_random_seed), so a render repeats exactly given the same
+ * seed and events.
+ *
+ * xorshift64*, seeded through the splitmix64 finalizer so neighbouring seeds give unrelated
+ * streams.
+ */
+struct prng
+{
+    uint64_t state{0x853c49e6748fea9bULL};
+
+    static uint64_t mix(uint64_t x)
+    {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+    void seed(uint64_t s) { state = mix(s) | 1; } // xorshift never leaves 0
+    void seed(uint64_t s, uint64_t stream) { seed(s ^ mix(stream)); }
+
+    uint32_t next()
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return (uint32_t)((state * 0x2545f4914f6cdd1dULL) >> 32);
+    }
+    // [0, 1)
+    float uni() { return (float)(next() >> 8) * (1.f / 16777216.f); }
+    // [-1, 1)
+    float bi() { return (float)(next() >> 8) * (2.f / 16777216.f) - 1.f; }
+};
+
+#endif // SHORTCIRCUIT_PRNG_H
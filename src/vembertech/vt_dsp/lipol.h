@@ -75,3 +75,38 @@ class alignas(16) lipol_ps
         y = _mm_add_ps(y, _mm_mul_ps(dy, m128_lipolstarter));
     }
 };
+
+// Stretches the ramps of a set of lipol_ps over several blocks, for control paths which only
+// update their targets every few blocks. Set the targets for the end of the interval as usual,
+// then call begin(blocks); advance() moves each interpolator one block along its ramp.
+template <int max_lipols> class lipol_span
+{
+  public:
+    template <typename... L> lipol_span(L *... l) : lipols{l...}, n(sizeof...(L)) {}
+
+    void begin(int blocks)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            if (blocks <= 1)
+            {
+                step[i] = 0.f;
+                continue;
+            }
+            float from = _mm_cvtss_f32(lipols[i]->currentval);
+            step[i] = (lipols[i]->get_target() - from) / (float)blocks;
+            lipols[i]->target = _mm_set_ss(from + step[i]);
+        }
+    }
+
+    void advance()
+    {
+        for (int i = 0; i < n; i++)
+            lipols[i]->set_target(lipols[i]->get_target() + step[i]);
+    }
+
+  private:
+    lipol_ps *lipols[max_lipols];
+    float step[max_lipols];
+    int n;
+};
@@ -60,6 +60,8 @@ inline std::string debug_wrapper_ip_to_string(int in)
         return "ip_polphyony";
     case ip_vumeter:
         return "ip_vumeter";
+    case ip_sample_memory:
+        return "ip_sample_memory";
     case ip_zone_name:
         return "ip_zone_name";
     case ip_channel:
@@ -448,6 +450,8 @@ inline std::string debug_wrapper_vga_to_string(int in)
         return "vga_save_patch";
     case vga_save_multi:
         return "vga_save_multi";
+    case vga_purge_samples:
+        return "vga_purge_samples";
     case vga_vudata:
         return "vga_vudata";
     case vga_set_range_and_units:
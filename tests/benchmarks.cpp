@@ -0,0 +1,309 @@
+/*
+** Shortcircuit XT is Free and Open Source Software
+**
+** Shortcircuit is made available under the Gnu General Public License, v3.0
+** https://www.gnu.org/licenses/gpl-3.0.en.html; The authors of the code
+** reserve the right to re-license their contributions under the MIT license in the
+** future at the discretion of the project maintainers.
+**
+** Copyright 2004-2021 by various individuals as described by the git transaction log
+**
+** All source at: https://github.com/surge-synthesizer/surge.git
+**
+** Shortcircuit was a commercial product from 2004-2018, with copyright and ownership
+** in that period held by Claes Johanson at Vember Audio. Claes made Shortcircuit
+** open source in December 2020.
+*/
+
+/*
+ * Benchmarks are hidden from the default run. Use "sc3-test [benchmark]" to run them.
+ */
+
+#include "test_main.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "configuration.h"
+#include "globals.h"
+#include "loaders/sfz_import.h"
+#include "sample.h"
+#include "sampler.h"
+#include "synthesis/coefficient_cache.h"
+#include "synthesis/filter.h"
+
+TEST_CASE("SFZ load time", "[.][benchmark]")
+{
+    // generate a file with a region for every zone next to a few of the malicex samples
+    auto dir = fs::temp_directory_path() / string_to_path("scxt-sfz-benchmark");
+    fs::create_directories(dir);
+
+    auto src = string_to_path("resources/test_samples/malicex_sfz");
+    const char *samples[] = {"FMKick.wav", "FM Snare.wav", "FMtom.wav", "FM Agogo.wav"};
+    for (auto s : samples)
+        fs::copy_file(src / string_to_path(s), dir / string_to_path(s),
+                      fs::copy_options::overwrite_existing);
+
+    // regions past max_zones would be parsed without becoming zones, which isn't a load
+    const int n_regions = 128, n_groups = max_zones / n_regions, n_runs = 10;
+    auto sfzPath = dir / string_to_path("benchmark.sfz");
+    {
+        std::ofstream sfz(sfzPath);
+        sfz << "// generated by the sc3-test SFZ benchmark\n<global>\nampeg_release=0.5\n";
+        for (int g = 0; g < n_groups; ++g)
+        {
+            sfz << "\n<group>\nloop_mode=one_shot volume=-3 ampeg_attack=0.001\n";
+            for (int r = 0; r < n_regions; ++r)
+            {
+                sfz << "<region> sample=" << samples[r & 3] << " lokey=" << (r & 127)
+                    << " hikey=" << (r & 127) << " pitch_keycenter=c4 lovel=" << (g & 63)
+                    << " hivel=" << (64 + (g & 63)) << " tune=" << (r % 21 - 10)
+                    << " ampeg_decay=1.25 ampeg_sustain=40\n";
+            }
+        }
+    }
+
+    std::chrono::duration<double, std::milli> t{0};
+    for (int run = 0; run < n_runs; ++run)
+    {
+        auto sc3 = std::make_unique<sampler>(nullptr, 2, nullptr);
+        REQUIRE(sc3);
+        sc3->set_samplerate(48000);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        REQUIRE(sc3->load_file(sfzPath));
+        t += std::chrono::high_resolution_clock::now() - start;
+
+        int nZones = 0;
+        for (int z = 0; z < max_zones; ++z)
+            nZones += sc3->zone_exist(z);
+        REQUIRE(nZones == n_groups * n_regions);
+    }
+
+    std::cout << "Loaded " << n_groups * n_regions << " SFZ regions in " << t.count() / n_runs
+              << "ms" << std::endl;
+    fs::remove_all(dir);
+}
+
+TEST_CASE("SFZ parse time", "[.][benchmark]")
+{
+    // far more regions than max_zones, only tokenized and resolved, no samples or zones
+    const int n_regions = 50000, regions_per_group = 100, n_runs = 10;
+    std::string sfz = "// generated by the sc3-test SFZ benchmark\n"
+                      "<control>\ndefault_path=samples/\n<global>\nampeg_release=0.5\n";
+    const char *samples[] = {"FMKick.wav", "FM Snare.wav", "FMtom.wav", "FM Agogo.wav"};
+    for (int r = 0; r < n_regions; ++r)
+    {
+        if (r % regions_per_group == 0)
+            sfz += "\n<group>\nloop_mode=one_shot volume=-3 ampeg_attack=0.001\n";
+        int key = r & 127, g = r / regions_per_group;
+        sfz += "<region> sample=" + std::string(samples[r & 3]) + " lokey=" +
+               std::to_string(key) + " hikey=" + std::to_string(key) +
+               " pitch_keycenter=c4 lovel=" + std::to_string(g & 63) +
+               " hivel=" + std::to_string(64 + (g & 63)) +
+               " tune=" + std::to_string(r % 21 - 10) + " ampeg_decay=1.25 // comment\n";
+    }
+
+    auto sc3 = std::make_unique<sampler>(nullptr, 2, nullptr);
+    REQUIRE(sc3);
+    std::chrono::duration<double, std::milli> t{0};
+    for (int run = 0; run < n_runs; ++run)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        auto n = resolve_sfz_regions(sc3.get(), sfz.data(), sfz.size());
+        t += std::chrono::high_resolution_clock::now() - start;
+        REQUIRE(n == n_regions);
+    }
+
+    std::cout << "Parsed " << n_regions << " SFZ regions (" << (sfz.size() >> 10) << " kB) in "
+              << t.count() / n_runs << "ms" << std::endl;
+}
+
+TEST_CASE("Compressed sample playback", "[.][benchmark]")
+{
+    auto olpc = string_to_path("resources/test_samples/OLPC");
+    auto kit = {olpc / string_to_path("drum-bass-lo-1.wav"),
+                olpc / string_to_path("drum-snare-tap.wav"),
+                olpc / string_to_path("cymbal-hihat-foot-2.wav")};
+
+    const int n_blocks = 48000 * 20 / block_size;
+    // each mode renders twice: a note's mip level mustn't depend on when it is played
+    std::vector<float> rendered[2][2];
+    std::vector<short> data[2];
+    double ms[2];
+    size_t bytes[2];
+    for (int compressed = 0; compressed < 2; ++compressed)
+    {
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            auto sc3 = std::make_unique<sampler>(nullptr, 2, nullptr);
+            REQUIRE(sc3);
+            sc3->conf->set_compress_samples(compressed);
+            sc3->set_samplerate(48000);
+            // keep the load shedder out of it, so the runs can be compared
+            sc3->set_realtime(false);
+            for (auto &item : kit)
+                REQUIRE(sc3->load_file(item));
+
+            bytes[compressed] = 0;
+            data[compressed].clear();
+            for (auto s : sc3->samples)
+                if (s)
+                {
+                    REQUIRE(s->is_compressed() == (bool)compressed);
+                    REQUIRE(s->get_mip_count() == (compressed ? 0 : sample::max_mip_levels));
+                    bytes[compressed] += s->GetDataSize();
+                    for (int c = 0; c < s->channels; ++c)
+                    {
+                        auto n = data[compressed].size();
+                        data[compressed].resize(n + s->sample_length);
+                        REQUIRE(s->read_i16(c, data[compressed].data() + n));
+                    }
+                }
+
+            // spread every drum over the keyboard so each voice resamples
+            for (int z = 0; z < max_zones; ++z)
+                if (sc3->zone_exist(z))
+                    sc3->selected->select_zone(z);
+            sc3->selected->set_zone_int(key_low, 24);
+            sc3->selected->set_zone_int(key_high, 96);
+
+            auto &out = rendered[compressed][pass];
+            out.reserve((size_t)n_blocks * block_size * 2);
+            std::chrono::duration<double, std::milli> t{0};
+            for (int b = 0; b < n_blocks; ++b)
+            {
+                if ((b & 3) == 0)
+                    sc3->PlayNote(0, 24 + (b * 7) % 72, 100);
+                if ((b & 3) == 2)
+                    sc3->ReleaseNote(0, 24 + ((b - 2) * 7) % 72, 0);
+
+                auto start = std::chrono::high_resolution_clock::now();
+                sc3->process_audio();
+                t += std::chrono::high_resolution_clock::now() - start;
+
+                for (int c = 0; c < 2; ++c)
+                    out.insert(out.end(), sc3->output[c], sc3->output[c] + block_size);
+            }
+            if (!pass)
+                ms[compressed] = t.count();
+        }
+    }
+
+    std::cout << "Rendered " << n_blocks * block_size / 48000 << "s in " << ms[0]
+              << "ms from " << bytes[0] << " bytes of samples, " << ms[1] << "ms from "
+              << bytes[1] << " compressed" << std::endl;
+    REQUIRE(bytes[1] < bytes[0]);
+    // decoding is lossless. Notes far above the root play mip levels in the uncompressed
+    // runs only, so compare the data rather than the audio, and the audio run to run. The
+    // extra parentheses keep Catch from printing the buffers
+    REQUIRE((data[0] == data[1]));
+    REQUIRE((rendered[0][0] == rendered[0][1]));
+    REQUIRE((rendered[1][0] == rendered[1][1]));
+}
+
+TEST_CASE("Zone filter coefficients", "[.][benchmark]")
+{
+    auto sc3 = std::make_unique<sampler>(nullptr, 2, nullptr);
+    REQUIRE(sc3);
+    sc3->set_samplerate(48000);
+
+    // a chord's worth of voices with the same filter settings, swept by a shared LFO
+    const int n_voices = 16, n_blocks = 48000 * 5 / block_size;
+    alignas(16) float in[2][block_size], out[2][block_size];
+    for (int i = 0; i < block_size; ++i)
+        in[0][i] = in[1][i] = (i & 1) ? 0.25f : -0.25f;
+
+    auto &cache = coefficient_cache::get();
+    for (int type = ft_zone_first; type <= ft_zone_last; ++type)
+    {
+        double ms[2];
+        for (int cached = 0; cached < 2; ++cached)
+        {
+            cache.set_enabled(cached);
+            float fp[n_voices][max_fparams] = {};
+            int ip[n_voices][2] = {};
+            filter *f[n_voices];
+            for (int v = 0; v < n_voices; ++v)
+            {
+                f[v] = spawn_filter(type, fp[v], ip[v], nullptr, true);
+                REQUIRE(f[v]);
+                f[v]->init_params();
+                f[v]->init();
+            }
+            float base[2] = {fp[0][0], fp[0][1]};
+
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int b = 0; b < n_blocks; ++b)
+            {
+                float lfo = sinf(b * 0.01f);
+                for (int v = 0; v < n_voices; ++v)
+                {
+                    fp[v][0] = base[0] + 0.5f * lfo;
+                    fp[v][1] = base[1] + 0.1f * lfo;
+                    f[v]->process_stereo(in[0], in[1], out[0], out[1], 0);
+                }
+            }
+            ms[cached] = std::chrono::duration<double, std::milli>(
+                             std::chrono::high_resolution_clock::now() - start)
+                             .count();
+
+            for (auto v : f)
+                spawn_filter_release(v);
+        }
+        std::cout << filter_descname[type] << ": " << ms[0] << "ms designing every block, "
+                  << ms[1] << "ms through the coefficient cache" << std::endl;
+    }
+    cache.set_enabled(true);
+}
+
+TEST_CASE("Oscillator filters", "[.][benchmark]")
+{
+    auto sc3 = std::make_unique<sampler>(nullptr, 2, nullptr);
+    REQUIRE(sc3);
+    sc3->set_samplerate(48000);
+
+    // 16 voices of each, up and down the keyboard
+    const int n_voices = 16, n_blocks = 48000 * 5 / block_size;
+    alignas(16) float in[block_size], out[2][block_size];
+    std::fill(in, in + block_size, 1.f);
+
+    struct
+    {
+        int type, unison;
+    } oscs[] = {{ft_osc_pulse, 0}, {ft_osc_pulse_sync, 0}, {ft_osc_saw, 0}, {ft_osc_saw, 2},
+                {ft_osc_saw, 4}};
+    for (auto &o : oscs)
+    {
+        float fp[n_voices][max_fparams] = {};
+        int ip[n_voices][2] = {};
+        filter *f[n_voices];
+        for (int v = 0; v < n_voices; ++v)
+        {
+            // unison is read on construction
+            ip[v][0] = o.unison;
+            f[v] = spawn_filter(o.type, fp[v], ip[v], nullptr, true);
+            REQUIRE(f[v]);
+            f[v]->init_params();
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int b = 0; b < n_blocks; ++b)
+            for (int v = 0; v < n_voices; ++v)
+                f[v]->process_stereo(in, in, out[0], out[1], (v - 8) * 5.f);
+        auto ms = std::chrono::duration<double, std::milli>(
+                      std::chrono::high_resolution_clock::now() - start)
+                      .count();
+
+        for (auto v : f)
+            spawn_filter_release(v);
+        std::cout << filter_descname[o.type] << " unison " << o.unison + 1 << ": " << ms
+                  << "ms for " << n_voices * n_blocks * block_size / 48000 << "s of voices"
+                  << std::endl;
+    }
+}
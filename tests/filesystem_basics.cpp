@@ -19,6 +19,7 @@
 
 #include "test_main.h"
 #include "filesystem/import.h"
+#include "browser/ContentBrowser.h"
 
 TEST_CASE("FileSystem", "[infra]")
 {
@@ -34,3 +35,64 @@ TEST_CASE("FileSystem", "[infra]")
         REQUIRE(i.is_open());
     }
 }
+
+TEST_CASE("ContentBrowser Scan", "[infra]")
+{
+    using scxt::content::ContentBrowser;
+    auto docs = fs::temp_directory_path() / string_to_path("scxt-browser-test");
+    fs::remove_all(docs);
+    auto lib = docs / "Library";
+    fs::create_directories(lib / "drums" / "kicks");
+    std::ofstream(lib / "drums" / "kicks" / "kick.wav");
+    std::ofstream(lib / "drums" / "snare.WAV");
+    std::ofstream(lib / "drums" / "readme.txt");
+    std::ofstream(lib / "patch.sc2p");
+
+    auto find = [](const ContentBrowser::ContentPtr &c, const std::string &name) {
+        for (const auto &k : c->children)
+            if (path_to_string(k->displayPath) == name)
+                return k;
+        return ContentBrowser::ContentPtr();
+    };
+
+    {
+        ContentBrowser browser;
+        browser.initialize(docs);
+        browser.waitForScan();
+
+        auto root = browser.getRoot();
+        REQUIRE(root->children.size() == 1);
+        auto library = root->children[0];
+        REQUIRE(library->scanned);
+        REQUIRE(library->children.size() == 2);
+        auto drums = find(library, "drums");
+        REQUIRE(drums);
+        REQUIRE(drums->type == ContentBrowser::Content::DIR);
+        REQUIRE(drums->children.size() == 2);
+        REQUIRE(find(drums, "snare.WAV")->type == ContentBrowser::Content::SAMPLE);
+        REQUIRE(find(find(drums, "kicks"), "kick.wav"));
+        REQUIRE(find(library, "patch.sc2p")->type == ContentBrowser::Content::PATCH);
+
+        // a rescan picks up the change and shares what didn't change
+        std::ofstream(lib / "drums" / "kicks" / "kick2.wav");
+        browser.rescanContentRoots();
+        browser.waitForScan();
+        auto rescanned = browser.getRoot();
+        REQUIRE(rescanned != root);
+        auto kicks = find(find(rescanned->children[0], "drums"), "kicks");
+        REQUIRE(kicks->children.size() == 2);
+        REQUIRE(find(rescanned->children[0], "patch.sc2p") == find(library, "patch.sc2p"));
+    }
+
+    // a new session starts from the saved index
+    REQUIRE(fs::exists(docs / "Cache" / "ContentIndex.txt"));
+    {
+        ContentBrowser browser;
+        browser.initialize(docs);
+        browser.waitForScan();
+        auto kicks = find(find(browser.getRoot()->children[0], "drums"), "kicks");
+        REQUIRE(kicks->children.size() == 2);
+    }
+
+    fs::remove_all(docs);
+}
@@ -16,13 +16,29 @@
 */
 
 #include "test_main.h"
+#include "test_wav.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <iterator>
 #include <map>
+#include <memory>
+#include <thread>
 #include <vector>
 
+#include "configuration.h"
 #include "globals.h"
+#include "loaders/sample_cache.h"
+#include "resampling.h"
+#include "sample.h"
+#include "sample_memory.h"
 #include "sampler.h"
+#include "sampler_voice.h"
 
 TEST_CASE("Simple SF2 Load", "[formats]")
 {
@@ -171,7 +187,7 @@ TEST_CASE("Simple SFZ+WAV Load", "[formats]")
         }
         rms = sqrt(rms);
         // TODO this one fluctuates a lot, also risk of segfault due to looping bug
-        REQUIRE(rms == Approx(232.55386).margin(1e-4));
+        REQUIRE(rms == Approx(232.34011).margin(1e-4));
     }
 
     SECTION("Load SFZ - Multi-velocity zones")
@@ -269,3 +285,1182 @@ TEST_CASE("Akai S6k patch load", "[formats]")
 
     gTestLevel = scxt::log::Level::None;
 }
+
+namespace
+{
+const char w64GuidTail[13] = "\xF3\xAC\xD3\x11\x8C\xD1\x00\xC0\x4F\x8E\xDB\x8A";
+void putw64(std::vector<char> &v, const char *id, const char *tail, uint64_t size)
+{
+    putid(v, id);
+    v.insert(v.end(), tail, tail + 12);
+    put64(v, size);
+}
+
+// the fmt and data chunks of a plain RIFF/WAVE file
+void findWaveChunks(const std::vector<char> &wav, std::string &fmt, std::string &data)
+{
+    size_t p = 12;
+    while (p + 8 <= wav.size())
+    {
+        uint32_t sz;
+        memcpy(&sz, &wav[p + 4], 4);
+        auto id = std::string(&wav[p], 4);
+        if (id == "fmt ")
+            fmt = std::string(&wav[p + 8], sz);
+        if (id == "data")
+            data = std::string(&wav[p + 8], sz);
+        p += 8 + sz + (sz & 1);
+    }
+}
+
+sample *onlySample(sampler *sc3)
+{
+    sample *res = nullptr;
+    for (auto s : sc3->samples)
+    {
+        if (s)
+        {
+            REQUIRE(!res);
+            res = s;
+        }
+    }
+    REQUIRE(res);
+    return res;
+}
+} // namespace
+
+TEST_CASE("SFZ Headers And Opcodes", "[formats]")
+{
+    auto dir = fs::temp_directory_path() / string_to_path("scxt-sfz-opcodes-test");
+    fs::remove_all(dir);
+    fs::create_directories(dir / "sub dir");
+    auto wav = pcmWav(1, 4800, [](int, uint32_t i) { return (short)(i & 0xFFF); });
+    for (auto f : {dir / "a.wav", dir / "sub dir" / "my sample.wav"})
+    {
+        std::ofstream ofs(f, std::ios::binary);
+        ofs.write(wav.data(), wav.size());
+    }
+
+    std::unique_ptr<sampler> sc3;
+    // the zones an SFZ file makes, in the order of its regions
+    auto load = [&](const std::string &text) {
+        sc3 = std::make_unique<sampler>(nullptr, 2, nullptr);
+        {
+            std::ofstream ofs(dir / "test.sfz");
+            ofs << text;
+        }
+        REQUIRE(sc3->load_file(dir / "test.sfz"));
+        std::vector<sample_zone *> res;
+        for (int z = 0; z < (int)max_zones; ++z)
+            if (sc3->zone_exist(z))
+                res.push_back(&sc3->zones[z]);
+        return res;
+    };
+    auto sampleName = [&](sample_zone *z) {
+        return std::string(sc3->samples[z->sample_id]->GetName());
+    };
+
+    SECTION("Regions override their group, which overrides the global")
+    {
+        // and within a header the last of an opcode counts
+        auto zones = load("<global> lokey=10 hikey=20 pitch_keycenter=15 lovel=5 hivel=50\n"
+                          "<region> sample=a.wav\n"
+                          "<group> hikey=30 lovel=6 lovel=7\n"
+                          "<region> sample=a.wav pitch_keycenter=25\n"
+                          "<region> sample=a.wav hikey=40 hikey=41\n"
+                          "<group> hivel=60\n"
+                          "<region> sample=a.wav\n"
+                          "<global> lokey=1\n"
+                          "<region> sample=a.wav\n");
+        REQUIRE(zones.size() == 5);
+        struct expected
+        {
+            int key_low, key_high, key_root, velocity_low, velocity_high;
+        } want[] = {{10, 20, 15, 5, 50},
+                    {10, 30, 25, 7, 50},
+                    {10, 41, 15, 7, 50},
+                    {10, 20, 15, 5, 60},
+                    {1, 127, 60, 0, 127}};
+        for (size_t i = 0; i < zones.size(); ++i)
+        {
+            INFO("region " << i);
+            REQUIRE(zones[i]->key_low == want[i].key_low);
+            REQUIRE(zones[i]->key_high == want[i].key_high);
+            REQUIRE(zones[i]->key_root == want[i].key_root);
+            REQUIRE(zones[i]->velocity_low == want[i].velocity_low);
+            REQUIRE(zones[i]->velocity_high == want[i].velocity_high);
+        }
+    }
+
+    SECTION("Sample paths may be quoted and contain spaces")
+    {
+        auto zones = load("<region> sample=\"sub dir/my sample.wav\" key=1\n"
+                          "<region> sample=sub dir/my sample.wav key=2\n"
+                          "<region> sample=sub dir\\my sample.wav key=3 // a comment\n"
+                          "<region> key=4 sample=sub dir/my sample.wav\n"
+                          "<region> key=5 sample=sub dir/my sample.wav\tlovel=3\n");
+        REQUIRE(zones.size() == 5);
+        for (int i = 0; i < 5; ++i)
+        {
+            INFO("region " << i);
+            REQUIRE(sampleName(zones[i]) == "my sample");
+            REQUIRE(zones[i]->key_root == i + 1);
+        }
+        REQUIRE(zones[4]->velocity_low == 3);
+    }
+
+    SECTION("Comments run to the end of the line")
+    {
+        auto zones = load("// <region> sample=a.wav key=9\n"
+                          "<region> sample=a.wav key=1 // key=2\n"
+                          "  // lovel=3\n"
+                          "hivel=90\n");
+        REQUIRE(zones.size() == 1);
+        REQUIRE(zones[0]->key_root == 1);
+        REQUIRE(zones[0]->velocity_low == 0);
+        REQUIRE(zones[0]->velocity_high == 90);
+    }
+
+    SECTION("Unknown headers and opcodes are skipped")
+    {
+        // the opcodes of an unknown header don't reach the region before it
+        auto zones = load("<region> sample=a.wav key=1 made_up_opcode=3\n"
+                          "<curve> curve_index=1 v000=0 key=2\n"
+                          "<region> sample=a.wav key=3\n"
+                          "<effect> type=reverb lovel=4\n");
+        REQUIRE(zones.size() == 2);
+        REQUIRE(zones[0]->key_root == 1);
+        REQUIRE(zones[1]->key_root == 3);
+        REQUIRE(zones[1]->velocity_low == 0);
+    }
+
+    SECTION("<control> sets where samples are, and nothing else")
+    {
+        auto zones = load("<control> default_path=sub dir/ lokey=100\n"
+                          "<region> sample=my sample.wav key=1\n"
+                          "<control> default_path=./\n"
+                          "<region> sample=a.wav key=2\n"
+                          "<region> sample=sub dir/my sample.wav key=3\n");
+        REQUIRE(zones.size() == 3);
+        REQUIRE(sampleName(zones[0]) == "my sample");
+        REQUIRE(zones[0]->key_low == 1);
+        REQUIRE(sampleName(zones[1]) == "a");
+        REQUIRE(sampleName(zones[2]) == "my sample");
+    }
+
+    sc3.reset();
+    fs::remove_all(dir);
+}
+
+TEST_CASE("RF64 and Wave64 Load", "[formats]")
+{
+    auto src = string_to_path("resources/test_samples/WavStereo48k.wav");
+    std::ifstream ifs(src, std::ios::binary);
+    std::vector<char> wav((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    std::string fmt, data;
+    findWaveChunks(wav, fmt, data);
+    REQUIRE(fmt.size() == 16);
+    REQUIRE(!data.empty());
+
+    // RF64 with the data size only in ds64, and a Wave64 container, around the same audio
+    std::vector<char> rf64;
+    putid(rf64, "RF64");
+    put32(rf64, 0xFFFFFFFF);
+    putid(rf64, "WAVE");
+    putid(rf64, "ds64");
+    put32(rf64, 28);
+    put64(rf64, 4 + 36 + 8 + fmt.size() + 8 + data.size());
+    put64(rf64, data.size());
+    put64(rf64, data.size() / 4);
+    put32(rf64, 0);
+    putid(rf64, "fmt ");
+    put32(rf64, fmt.size());
+    rf64.insert(rf64.end(), fmt.begin(), fmt.end());
+    putid(rf64, "data");
+    put32(rf64, 0xFFFFFFFF);
+    rf64.insert(rf64.end(), data.begin(), data.end());
+
+    std::vector<char> w64;
+    auto fmtPadded = (fmt.size() + 7) & ~(size_t)7;
+    putw64(w64, "riff", "\x2E\x91\xCF\x11\xA5\xD6\x28\xDB\x04\xC1\x00\x00",
+           40 + 24 + fmtPadded + 24 + data.size());
+    putid(w64, "wave");
+    w64.insert(w64.end(), w64GuidTail, w64GuidTail + 12);
+    putw64(w64, "fmt ", w64GuidTail, 24 + fmt.size());
+    w64.insert(w64.end(), fmt.begin(), fmt.end());
+    w64.resize(w64.size() + fmtPadded - fmt.size());
+    putw64(w64, "data", w64GuidTail, 24 + data.size());
+    w64.insert(w64.end(), data.begin(), data.end());
+
+    auto dir = fs::temp_directory_path() / string_to_path("scxt-format-test");
+    fs::create_directories(dir);
+
+    auto ref = std::make_unique<sampler>(nullptr, 2, nullptr);
+    REQUIRE(ref->load_file(src));
+    auto refSample = onlySample(ref.get());
+    REQUIRE(refSample->channels == 2);
+
+    for (auto &[name, bytes] : {std::make_pair("stereo.rf64", &rf64),
+                                std::make_pair("stereo.w64", &w64)})
+    {
+        INFO("Loading " << name);
+        auto path = dir / string_to_path(name);
+        std::ofstream(path, std::ios::binary).write(bytes->data(), bytes->size());
+
+        auto sc3 = std::make_unique<sampler>(nullptr, 2, nullptr);
+        REQUIRE(sc3->load_file(path));
+        auto s = onlySample(sc3.get());
+
+        REQUIRE(s->channels == refSample->channels);
+        REQUIRE(s->sample_rate == refSample->sample_rate);
+        REQUIRE(s->sample_length == refSample->sample_length);
+        REQUIRE(s->UseInt16 == refSample->UseInt16);
+        for (int c = 0; c < s->channels; ++c)
+        {
+            auto bpc = s->sample_length * (s->UseInt16 ? 2 : 4);
+            auto a = s->UseInt16 ? (void *)s->GetSamplePtrI16(c) : (void *)s->GetSamplePtrF32(c);
+            auto b = refSample->UseInt16 ? (void *)refSample->GetSamplePtrI16(c)
+                                         : (void *)refSample->GetSamplePtrF32(c);
+            REQUIRE(memcmp(a, b, bpc) == 0);
+        }
+    }
+
+    fs::remove_all(dir);
+}
+
+TEST_CASE("Decoded Sample Cache", "[formats]")
+{
+    auto dir = fs::temp_directory_path() / string_to_path("scxt-sample-cache-test");
+    fs::remove_all(dir);
+
+    scxt::log::StreamLogger logger(gLogger);
+    configuration conf(logger);
+    conf.set_sample_cache_path(dir);
+
+    auto src = string_to_path("resources/test_samples/BadPluckSample.wav");
+    sample decoded(&conf);
+    REQUIRE(decoded.load(src));
+
+    // the first load leaves exactly one entry behind
+    std::vector<fs::path> entries;
+    for (auto &e : fs::directory_iterator(dir))
+        entries.push_back(e.path());
+    REQUIRE(entries.size() == 1);
+    auto entrySize = fs::file_size(entries[0]);
+
+    sample cached(&conf);
+    REQUIRE(cached.load(src));
+    REQUIRE(fs::file_size(entries[0]) == entrySize);
+    REQUIRE(cached.channels == decoded.channels);
+    REQUIRE(cached.sample_rate == decoded.sample_rate);
+    REQUIRE(cached.sample_length == decoded.sample_length);
+    REQUIRE(cached.UseInt16 == decoded.UseInt16);
+    REQUIRE(std::string(cached.GetName()) == std::string(decoded.GetName()));
+    for (int c = 0; c < cached.channels; ++c)
+    {
+        auto bpc = cached.sample_length * (cached.UseInt16 ? 2 : 4);
+        auto a = cached.UseInt16 ? (void *)cached.GetSamplePtrI16(c)
+                                 : (void *)cached.GetSamplePtrF32(c);
+        auto b = decoded.UseInt16 ? (void *)decoded.GetSamplePtrI16(c)
+                                  : (void *)decoded.GetSamplePtrF32(c);
+        REQUIRE(memcmp(a, b, bpc) == 0);
+    }
+
+    // a corrupt entry is ignored and rewritten
+    {
+        std::ofstream(entries[0], std::ios::binary | std::ios::trunc) << "not a cache entry";
+    }
+    sample redecoded(&conf);
+    REQUIRE(redecoded.load(src));
+    REQUIRE(redecoded.sample_length == decoded.sample_length);
+    REQUIRE(fs::file_size(entries[0]) == entrySize);
+
+    fs::remove_all(dir);
+}
+
+TEST_CASE("Sample Cache Pruning", "[formats]")
+{
+    auto dir = fs::temp_directory_path() / string_to_path("scxt-sample-cache-prune-test");
+    fs::remove_all(dir);
+    auto cache = dir / "cache";
+    fs::create_directories(dir / "src");
+
+    scxt::log::StreamLogger logger(gLogger);
+    configuration conf(logger);
+    conf.set_sample_cache_path(cache);
+
+    // three sources of our own, so one can be changed under the cache
+    std::map<std::string, fs::path> src, entry;
+    for (auto n : {"a", "b", "c"})
+    {
+        src[n] = dir / "src" / (std::string(n) + ".wav");
+        fs::copy_file(string_to_path("resources/test_samples/BadPluckSample.wav"), src[n]);
+        sample s(&conf);
+        REQUIRE(s.load(src[n]));
+        // the one entry the load added
+        for (auto &e : fs::directory_iterator(cache))
+            if (std::none_of(entry.begin(), entry.end(),
+                             [&](auto &k) { return k.second == e.path(); }))
+                entry[n] = e.path();
+        REQUIRE(fs::exists(entry[n]));
+    }
+    REQUIRE(entry.size() == 3);
+    auto entrySize = fs::file_size(entry["a"]);
+    auto now = fs::file_time_type::clock::now();
+
+    SECTION("Stale entries and leftovers go")
+    {
+        REQUIRE(prune_sample_cache(cache, 0) == 0);
+
+        std::ofstream(src["c"], std::ios::binary | std::ios::app) << "changed";
+        auto oldTmp = cache / "0000000000000000.scxtcache.1.tmp";
+        auto newTmp = cache / "0000000000000000.scxtcache.2.tmp";
+        std::ofstream(oldTmp) << "half written";
+        std::ofstream(newTmp) << "being written";
+        fs::last_write_time(oldTmp, now - std::chrono::hours(2));
+
+        REQUIRE(prune_sample_cache(cache, 0) > entrySize);
+        REQUIRE(fs::exists(entry["a"]));
+        REQUIRE(fs::exists(entry["b"]));
+        REQUIRE(!fs::exists(entry["c"]));
+        REQUIRE(!fs::exists(oldTmp));
+        REQUIRE(fs::exists(newTmp));
+
+        fs::remove(src["b"]);
+        REQUIRE(prune_sample_cache(cache, 0) == entrySize);
+        REQUIRE(!fs::exists(entry["b"]));
+    }
+
+    SECTION("The least recently used entries go over budget")
+    {
+        fs::last_write_time(entry["a"], now - std::chrono::hours(3));
+        fs::last_write_time(entry["b"], now - std::chrono::hours(2));
+        fs::last_write_time(entry["c"], now - std::chrono::hours(1));
+        // a cache hit makes a the most recently used
+        sample s(&conf);
+        REQUIRE(s.load(src["a"]));
+
+        REQUIRE(prune_sample_cache(cache, 2 * entrySize) == entrySize);
+        REQUIRE(fs::exists(entry["a"]));
+        REQUIRE(!fs::exists(entry["b"]));
+        REQUIRE(fs::exists(entry["c"]));
+    }
+
+    fs::remove_all(dir);
+}
+
+TEST_CASE("Sample Mip Levels", "[formats]")
+{
+    // a mono float WAV holding one sine
+    auto sineWav = [](double freq, uint32_t frames) {
+        std::vector<char> wav;
+        putid(wav, "RIFF");
+        put32(wav, 4 + 8 + 16 + 8 + frames * 4);
+        putid(wav, "WAVE");
+        putid(wav, "fmt ");
+        put32(wav, 16);
+        put32(wav, 3 | (1 << 16)); // IEEE float, mono
+        put32(wav, 48000);
+        put32(wav, 48000 * 4);
+        put32(wav, 4 | (32 << 16));
+        putid(wav, "data");
+        put32(wav, frames * 4);
+        for (uint32_t i = 0; i < frames; ++i)
+        {
+            float f = (float)sin(2.0 * 3.14159265358979 * freq * i / 48000.0);
+            uint32_t u;
+            memcpy(&u, &f, 4);
+            put32(wav, u);
+        }
+        return wav;
+    };
+    // sine amplitude in a mip level, away from the edges
+    auto amplitude = [](sample &s, int level) {
+        auto d = (float *)s.get_mip_data(level, 0) + FIRoffset;
+        auto n = s.get_mip_length(level);
+        double sum = 0;
+        for (uint32_t i = n / 4; i < 3 * n / 4; ++i)
+            sum += d[i] * d[i];
+        return sqrt(2.0 * sum / (3 * n / 4 - n / 4));
+    };
+
+    auto low = sineWav(400, 48000);
+    sample s(nullptr);
+    REQUIRE(s.parse_riff_wave(low.data(), low.size()));
+    REQUIRE(!s.UseInt16);
+    REQUIRE(s.get_mip_count() == 0);
+    REQUIRE(!s.mips_requested());
+
+    s.request_mips();
+    REQUIRE(s.mips_requested());
+    s.build_mips();
+    REQUIRE(!s.mips_requested());
+    REQUIRE(s.get_mip_count() == sample::max_mip_levels);
+    uint32_t len = s.sample_length;
+    for (int l = 1; l <= sample::max_mip_levels; ++l)
+    {
+        len = (len + 1) / 2;
+        REQUIRE(s.get_mip_length(l) == len);
+        // the margins are silent, like the sample's own
+        auto d = (float *)s.get_mip_data(l, 0);
+        for (unsigned i = 0; i < FIRoffset; ++i)
+        {
+            REQUIRE(d[i] == 0.f);
+            REQUIRE(d[FIRoffset + len + i] == 0.f);
+        }
+        // well below the cutoff of every level
+        REQUIRE(amplitude(s, l) == Approx(1.0).margin(0.01));
+    }
+
+    // zero phase, so level positions line up with the source ones
+    auto d0 = s.GetSamplePtrF32(0);
+    auto d1 = (float *)s.get_mip_data(1, 0) + FIRoffset;
+    for (uint32_t i = 1000; i < 2000; ++i)
+        REQUIRE(d1[i] == Approx(d0[2 * i]).margin(0.01));
+
+    // above a quarter of the rate is removed rather than folded back
+    auto high = sineWav(18000, 48000);
+    sample h(nullptr);
+    REQUIRE(h.parse_riff_wave(high.data(), high.size()));
+    h.build_mips();
+    REQUIRE(amplitude(h, 1) < 0.01);
+
+    // load() builds them up front, so the level a note plays doesn't depend on when it starts
+    scxt::log::StreamLogger logger(gLogger);
+    configuration conf(logger);
+    sample f(&conf);
+    REQUIRE(f.load(string_to_path("resources/test_samples/BadPluckSample.wav")));
+    REQUIRE(f.get_mip_count() == sample::max_mip_levels);
+}
+
+TEST_CASE("Compressed Samples", "[formats]")
+{
+    uint32_t seed = 17;
+    auto noise = [&seed]() {
+        seed = seed * 1664525 + 1013904223;
+        return (int)(seed >> 16);
+    };
+
+    // decaying sines over a little noise
+    const uint32_t frames = 20000;
+    auto wav = pcmWav(2, frames, [&](int c, uint32_t i) {
+        return (short)(20000 * sin(0.01 * (c + 1) * i) * exp(-(double)i / frames) +
+                       (noise() & 63) - 32);
+    });
+    sample s(nullptr);
+    REQUIRE(s.parse_riff_wave(wav.data(), wav.size()));
+    REQUIRE(s.UseInt16);
+    REQUIRE(s.channels == 2);
+
+    std::vector<short> ref[2];
+    for (int c = 0; c < 2; ++c)
+        ref[c].assign(s.GetSamplePtrI16(c), s.GetSamplePtrI16(c) + frames);
+    auto rawSize = s.GetDataSize();
+
+    REQUIRE(s.compress());
+    REQUIRE(s.is_compressed());
+    REQUIRE(!s.SampleData[0]);
+    REQUIRE(s.GetDataSize() < rawSize * 3 / 4);
+    for (int c = 0; c < 2; ++c)
+    {
+        std::vector<short> out(frames);
+        REQUIRE(s.read_i16(c, out.data()));
+        REQUIRE(out == ref[c]);
+    }
+
+    // a window reads like SampleData, margins and all, wherever it is moved
+    auto w = std::make_unique<compressed_window>();
+    w->reset();
+    auto check = [&](int from, int to) {
+        void *data[2];
+        w->map(&s, from, to, data);
+        for (int c = 0; c < 2; ++c)
+            for (int p = from; p <= to; ++p)
+            {
+                int f = p - (int)FIRoffset;
+                short expect = (f >= 0 && f < (int)frames) ? ref[c][f] : 0;
+                INFO("channel " << c << " position " << p);
+                REQUIRE(((short *)data[c])[p] == expect);
+            }
+    };
+    for (int p = 0; p < (int)(frames + FIRipol_N); p += 997)
+        check(p, p + 100);
+    for (int p = frames; p >= 0; p -= 1511)
+        check(p, p + compressed_window::max_span - 1);
+    check(0, FIRipol_N);
+    check(frames - 1, frames + FIRipol_N - 1);
+
+    // noise isn't worth it and is left alone
+    auto hiss = pcmWav(1, frames, [&](int, uint32_t) { return (short)noise(); });
+    sample n(nullptr);
+    REQUIRE(n.parse_riff_wave(hiss.data(), hiss.size()));
+    REQUIRE(!n.compress());
+    REQUIRE(!n.is_compressed());
+    REQUIRE(n.GetSamplePtrI16(0));
+}
+
+TEST_CASE("Sample Storage Modes", "[formats]")
+{
+    // a mono 24 bit WAV ramping through the full range, with a few odd low bits
+    const uint32_t frames = 5000;
+    std::vector<char> wav;
+    putid(wav, "RIFF");
+    put32(wav, 4 + 8 + 16 + 8 + frames * 3);
+    putid(wav, "WAVE");
+    putid(wav, "fmt ");
+    put32(wav, 16);
+    put32(wav, 1 | (1 << 16)); // PCM mono
+    put32(wav, 44100);
+    put32(wav, 44100 * 3);
+    put32(wav, 3 | (24 << 16));
+    putid(wav, "data");
+    put32(wav, frames * 3);
+    std::vector<int> ref;
+    for (uint32_t i = 0; i < frames; ++i)
+    {
+        int v = (int)(8388607.0 * sin(0.003 * i)) ^ (int)(i & 7);
+        ref.push_back(v);
+        for (int b = 0; b < 3; ++b)
+            wav.push_back((char)((v >> (8 * b)) & 0xFF));
+    }
+
+    scxt::log::StreamLogger logger(gLogger);
+    configuration conf(logger);
+
+    SECTION("Native")
+    {
+        sample s(&conf);
+        REQUIRE(s.parse_riff_wave(wav.data(), wav.size()));
+        REQUIRE(!s.UseInt16);
+        REQUIRE(!s.UseInt24);
+        REQUIRE(s.get_bytes_per_sample() == 4);
+        for (uint32_t i = 0; i < frames; ++i)
+            REQUIRE(s.GetSamplePtrF32(0)[i] * 8388608.f == Approx(ref[i]).margin(1));
+    }
+
+    SECTION("Packed 24 bit is exact")
+    {
+        conf.set_sample_storage(ss_packed24);
+        sample s(&conf);
+        REQUIRE(s.parse_riff_wave(wav.data(), wav.size()));
+        REQUIRE(s.UseInt24);
+        REQUIRE(!s.GetSamplePtrF32(0));
+        REQUIRE(s.get_bytes_per_sample() == 3);
+        REQUIRE(s.GetDataSize() < frames * 4);
+        auto p = s.GetSamplePtrI24(0);
+        for (uint32_t i = 0; i < frames; ++i)
+        {
+            int v = (p[3 * i] | (p[3 * i + 1] << 8) | ((int8_t)p[3 * i + 2] << 16));
+            REQUIRE(v == ref[i]);
+        }
+
+        // narrowing further goes through the same dither as loading
+        REQUIRE(s.convert_storage(ss_int16));
+        REQUIRE(s.UseInt16);
+        REQUIRE(!s.UseInt24);
+        for (uint32_t i = 0; i < frames; ++i)
+            REQUIRE(std::abs(s.GetSamplePtrI16(0)[i] * 256 - ref[i]) <= 2 * 256);
+        REQUIRE(!s.convert_storage(ss_packed24));
+    }
+
+    SECTION("Int16 is dithered to within a couple of LSB")
+    {
+        conf.set_sample_storage(ss_int16);
+        sample s(&conf);
+        REQUIRE(s.parse_riff_wave(wav.data(), wav.size()));
+        REQUIRE(s.UseInt16);
+        REQUIRE(s.get_bytes_per_sample() == 2);
+        double err = 0;
+        for (uint32_t i = 0; i < frames; ++i)
+        {
+            auto d = s.GetSamplePtrI16(0)[i] * 256 - ref[i];
+            REQUIRE(std::abs(d) <= 2 * 256);
+            err += d;
+        }
+        // and the dither doesn't add an offset
+        REQUIRE(std::abs(err / frames) < 32);
+    }
+
+    SECTION("Float converts in place")
+    {
+        sample s(&conf);
+        REQUIRE(s.parse_riff_wave(wav.data(), wav.size()));
+        REQUIRE(s.convert_storage(ss_packed24));
+        REQUIRE(s.UseInt24);
+        auto p = s.GetSamplePtrI24(0);
+        for (uint32_t i = 0; i < frames; ++i)
+        {
+            int v = (p[3 * i] | (p[3 * i + 1] << 8) | ((int8_t)p[3 * i + 2] << 16));
+            REQUIRE(std::abs(v - ref[i]) <= 1);
+        }
+    }
+}
+
+TEST_CASE("Sample Analysis", "[formats]")
+{
+    auto dir = fs::temp_directory_path() / string_to_path("scxt-sample-analysis-test");
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    // a stereo tone which is mono up to an LSB of dither, then 2000 frames of silence
+    const uint32_t sound = 3000, frames = sound + 2000;
+    auto tone = [&](int c, uint32_t i) {
+        if (i >= sound)
+            return (short)0;
+        return (short)(10000 * sin(0.02 * i) + ((c && (i % 7) == 0) ? 1 : 0));
+    };
+    auto src = dir / "tone.wav";
+    {
+        auto wav = pcmWav(2, frames, tone);
+        std::ofstream ofs(src, std::ios::binary);
+        ofs.write(wav.data(), wav.size());
+    }
+
+    scxt::log::StreamLogger logger(gLogger);
+    configuration conf(logger);
+
+    SECTION("Off by default")
+    {
+        sample s(&conf);
+        REQUIRE(s.load(src));
+        REQUIRE(s.channels == 2);
+        REQUIRE(s.sample_length == frames);
+        REQUIRE(s.source_length == frames);
+    }
+
+    SECTION("Fold and trim on load")
+    {
+        conf.set_sample_analysis(sa_fold_mono | sa_trim_silence);
+        sample s(&conf);
+        REQUIRE(s.load(src));
+        REQUIRE(s.channels == 1);
+        REQUIRE(!s.SampleData[1]);
+        REQUIRE(s.source_length == frames);
+        REQUIRE(s.sample_length <= sound);
+        REQUIRE(s.sample_length > sound - 100);
+        for (uint32_t i = 0; i < s.sample_length; ++i)
+            REQUIRE(std::abs(s.GetSamplePtrI16(0)[i] - tone(0, i)) <= 1);
+        // what follows the trimmed data reads as zeros
+        for (int i = 0; i < (int)(FIRipol_N - FIRoffset); ++i)
+            REQUIRE(s.GetSamplePtrI16(0)[s.sample_length + i] == 0);
+    }
+
+    SECTION("Different channels stay stereo")
+    {
+        auto wide = pcmWav(2, frames, [&](int c, uint32_t i) { return tone(c, i * (c + 1)); });
+        sample s(&conf);
+        REQUIRE(s.parse_riff_wave(wide.data(), wide.size()));
+        REQUIRE(!s.fold_mono());
+        REQUIRE(s.channels == 2);
+    }
+
+    SECTION("Loops keep their silence")
+    {
+        auto wav = pcmWav(1, frames, tone);
+        sample s(&conf);
+        REQUIRE(s.parse_riff_wave(wav.data(), wav.size()));
+        s.meta.loop_present = true;
+        s.meta.loop_start = 100;
+        s.meta.loop_end = sound + 500;
+        REQUIRE(s.trim_silence());
+        REQUIRE(s.sample_length == sound + 500);
+        REQUIRE(!s.trim_silence());
+        REQUIRE(s.source_length == frames);
+    }
+
+    fs::remove_all(dir);
+}
+
+TEST_CASE("Samples Loaded On Demand", "[formats]")
+{
+    auto dir = fs::temp_directory_path() / string_to_path("scxt-on-demand-test");
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    const uint32_t frames = 4 * sample::preload_frames;
+    auto ramp = [](int, uint32_t i) { return (short)(i * 13); };
+    auto src = dir / "long.wav";
+    {
+        auto wav = pcmWav(1, frames, ramp);
+        std::ofstream ofs(src, std::ios::binary);
+        ofs.write(wav.data(), wav.size());
+    }
+    auto matches = [&](sample &s, uint32_t n) {
+        auto d = s.GetSamplePtrI16(0);
+        for (uint32_t i = 0; i < n; ++i)
+            if (d[i] != ramp(0, i))
+                return false;
+        return true;
+    };
+    // what page_out drops: all but the head, of the channel and of each mip level
+    auto tailBytes = [](uint32_t length) {
+        size_t bytes = (length - sample::preload_frames) * 2;
+        for (int l = 1; l <= sample::max_mip_levels; ++l)
+        {
+            length = (length + 1) / 2;
+            bytes += (length - std::min(length, sample::preload_frames >> l)) * 2;
+        }
+        return bytes;
+    };
+
+    scxt::log::StreamLogger logger(gLogger);
+    configuration conf(logger);
+    conf.set_load_on_demand(true);
+
+    SECTION("Without the cache the file is decoded again")
+    {
+        configuration fullConf(logger);
+        sample full(&fullConf);
+        REQUIRE(full.load(src));
+        REQUIRE(full.is_resident());
+
+        sample s(&conf);
+        REQUIRE(s.load(src));
+        REQUIRE(!s.is_resident());
+        REQUIRE(s.get_available_frames() == sample::preload_frames);
+        REQUIRE(s.get_available_frames(1) == 0); // no mip levels until paged in
+        REQUIRE(s.get_resident_bytes() == sample::channel_bytes(sample::preload_frames, 2));
+        REQUIRE(matches(s, sample::preload_frames));
+
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            s.note_played();
+            REQUIRE(s.page_in_requested());
+            s.page_in();
+            REQUIRE(s.is_resident());
+            REQUIRE(s.get_available_frames() == frames);
+            REQUIRE(matches(s, frames));
+            REQUIRE(s.get_resident_bytes() == full.get_resident_bytes());
+            REQUIRE(s.get_mip_count() == sample::max_mip_levels);
+            for (int l = 1; l <= sample::max_mip_levels; ++l)
+                REQUIRE(!memcmp(s.get_mip_data(l, 0), full.get_mip_data(l, 0),
+                                sample::channel_bytes(s.get_mip_length(l), 2)));
+
+            REQUIRE(s.page_out() == tailBytes(frames));
+            REQUIRE(!s.is_resident());
+            REQUIRE(s.get_available_frames(2) == sample::preload_frames / 4);
+            REQUIRE(matches(s, sample::preload_frames));
+        }
+    }
+
+    SECTION("Where it can't take effect everything is resident")
+    {
+        sample orphan(nullptr); // nothing to read it again with
+        REQUIRE(orphan.load(src, &conf));
+        REQUIRE(orphan.is_resident());
+        REQUIRE(orphan.page_out() == 0);
+
+        conf.set_compress_samples(true);
+        sample s(&conf);
+        REQUIRE(s.load(src));
+        REQUIRE(s.is_compressed());
+        REQUIRE(s.is_resident());
+        REQUIRE(s.page_out() == 0);
+    }
+
+    SECTION("Cache backed samples page in when played")
+    {
+        conf.set_sample_cache_path(dir / "cache");
+        for (int pass = 0; pass < 2; ++pass) // decoded, then from the cache
+        {
+            sample s(&conf);
+            REQUIRE(s.load(src));
+            REQUIRE(s.sample_length == frames);
+            REQUIRE(!s.is_resident());
+            REQUIRE(!s.page_in_requested());
+            REQUIRE(!s.was_played());
+
+            s.note_played();
+            REQUIRE(s.was_played());
+            REQUIRE(s.page_in_requested());
+            s.page_in();
+            REQUIRE(s.is_resident());
+            REQUIRE(!s.page_in_requested());
+            REQUIRE(matches(s, frames));
+            REQUIRE(s.get_mip_count() == sample::max_mip_levels);
+
+            // dropped pages are read back from the cache file
+            REQUIRE(s.page_out() == tailBytes(frames));
+            REQUIRE(!s.is_resident());
+            REQUIRE(matches(s, frames));
+        }
+
+        auto shortWav = pcmWav(1, 1000, ramp);
+        auto shortSrc = dir / "short.wav";
+        {
+            std::ofstream ofs(shortSrc, std::ios::binary);
+            ofs.write(shortWav.data(), shortWav.size());
+        }
+        sample s(&conf);
+        REQUIRE(s.load(shortSrc));
+        REQUIRE(s.is_resident());
+    }
+
+    fs::remove_all(dir);
+}
+
+TEST_CASE("Sample Memory Budget", "[formats]")
+{
+    auto dir = fs::temp_directory_path() / string_to_path("scxt-memory-budget-test");
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    const uint32_t frames = 4 * sample::preload_frames;
+    auto ramp = [](int, uint32_t i) { return (short)(i * 7); };
+    scxt::log::StreamLogger logger(gLogger);
+    configuration conf(logger);
+    conf.set_load_on_demand(true);
+    // backed by the cache or held on the heap, either can be paged out
+    bool cached = GENERATE(true, false);
+    if (cached)
+        conf.set_sample_cache_path(dir / "cache");
+
+    auto &memory = sample_memory::get();
+    memory.set_budget(0);
+    memory.update();
+    auto before = memory.get_usage();
+
+    std::vector<std::unique_ptr<sample>> s;
+    for (int i = 0; i < 3; ++i)
+    {
+        auto src = dir / ("s" + std::to_string(i) + ".wav");
+        {
+            auto wav = pcmWav(1, frames, ramp);
+            std::ofstream ofs(src, std::ios::binary);
+            ofs.write(wav.data(), wav.size());
+        }
+        s.push_back(std::make_unique<sample>(&conf));
+        REQUIRE(s.back()->load(src));
+        REQUIRE(!s.back()->is_resident());
+    }
+    // a sample loaded on demand gets its mip levels once paged in, and keeps their heads
+    auto first = sample::channel_bytes(sample::preload_frames, 2);
+    auto head = first, full = sample::channel_bytes(frames, 2);
+    for (uint32_t l = 1, n = frames; l <= sample::max_mip_levels; ++l)
+    {
+        n = (n + 1) / 2;
+        head += sample::channel_bytes(std::min(n, sample::preload_frames >> l), 2);
+        full += sample::channel_bytes(n, 2);
+    }
+    REQUIRE(s[0]->get_resident_bytes() == first);
+
+    auto play = [&](int i) {
+        // now() counts milliseconds, keep the plays apart
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        s[i]->note_played();
+        s[i]->page_in();
+        REQUIRE(s[i]->is_resident());
+        REQUIRE(s[i]->get_resident_bytes() == full);
+    };
+    for (int i = 0; i < 3; ++i)
+        play(i);
+
+    // without a budget nothing goes
+    REQUIRE(memory.update() == 0);
+    REQUIRE(memory.get_usage() == before + 3 * full);
+
+    SECTION("The least recently played go first, keeping their heads")
+    {
+        auto evictions = memory.get_evictions();
+        memory.set_budget(before + 3 * full - 1);
+        REQUIRE(memory.update() == full - head);
+        REQUIRE(memory.get_evictions() == evictions + 1);
+        REQUIRE(!s[0]->is_resident());
+        REQUIRE(s[1]->is_resident());
+        REQUIRE(s[2]->is_resident());
+        REQUIRE(s[0]->get_resident_bytes() == head);
+        REQUIRE(memory.get_usage() == before + 2 * full + head);
+
+        play(0);
+        REQUIRE(memory.update() == full - head);
+        REQUIRE(s[0]->is_resident());
+        REQUIRE(!s[1]->is_resident());
+
+        // what is evicted reads back from the cache file or the source
+        s[1]->page_in();
+        auto d = s[1]->GetSamplePtrI16(0);
+        for (uint32_t i = 0; i < frames; i += 101)
+            REQUIRE(d[i] == ramp(0, i));
+    }
+
+    SECTION("Only as many as needed")
+    {
+        memory.set_budget(before + full + 3 * head);
+        REQUIRE(memory.update() == 2 * (full - head));
+        REQUIRE(!s[0]->is_resident());
+        REQUIRE(!s[1]->is_resident());
+        REQUIRE(s[2]->is_resident());
+        REQUIRE(!memory.over_budget());
+    }
+
+    SECTION("What can't be paged out goes over the budget")
+    {
+        configuration fullConf(logger);
+        fullConf.set_compress_samples(true);
+        sample compressed(&fullConf);
+        REQUIRE(compressed.load(dir / "s0.wav"));
+        REQUIRE(compressed.is_compressed());
+
+        memory.set_budget(before + 3 * head + compressed.get_resident_bytes() - 1);
+        memory.update();
+        REQUIRE(!s[0]->is_resident());
+        REQUIRE(!s[1]->is_resident());
+        REQUIRE(!s[2]->is_resident());
+        REQUIRE(memory.over_budget());
+        memory.set_budget(0);
+    }
+
+    memory.set_budget(0);
+    s.clear();
+    memory.update();
+    REQUIRE(memory.get_usage() == before);
+    fs::remove_all(dir);
+}
+
+TEST_CASE("Playing Samples Stay Resident", "[formats]")
+{
+    auto dir = fs::temp_directory_path() / string_to_path("scxt-playing-resident-test");
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    auto src = dir / "long.wav";
+    {
+        auto wav = pcmWav(1, 4 * sample::preload_frames, [](int, uint32_t i) {
+            return (short)(1000 + (i & 0xFFF));
+        });
+        std::ofstream ofs(src, std::ios::binary);
+        ofs.write(wav.data(), wav.size());
+    }
+
+    auto sc3 = std::make_unique<sampler>(nullptr, 2, nullptr);
+    sc3->set_samplerate(48000);
+    sc3->conf->set_load_on_demand(true);
+    sc3->conf->set_sample_cache_path(dir / "cache");
+    int newG, newZ;
+    REQUIRE(sc3->load_file(src, &newG, &newZ));
+    auto s = sc3->samples[sc3->zones[newZ].sample_id];
+    REQUIRE(!s->is_resident());
+
+    // the sample worker pages it in once a voice plays it
+    auto key = sc3->zones[newZ].key_root;
+    sc3->PlayNote(0, key, 127);
+    auto waitFor = [&](std::function<bool()> f) {
+        for (int i = 0; i < 400 && !f(); ++i)
+        {
+            sc3->process_audio();
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return f();
+    };
+    REQUIRE(waitFor([&]() { return s->is_resident(); }));
+
+    auto &memory = sample_memory::get();
+    memory.set_budget(1);
+    for (int i = 0; i < 10; ++i)
+    {
+        sc3->process_audio();
+        memory.update();
+        REQUIRE(s->is_resident());
+    }
+
+    // once the voice has ended it can go
+    sc3->ReleaseNote(0, key, 0);
+    REQUIRE(waitFor([&]() { return sc3->polyphony == 0; }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(sample_memory::playing_grace_ms + 10));
+    memory.update();
+    REQUIRE(!s->is_resident());
+
+    memory.set_budget(0);
+    sc3.reset();
+    fs::remove_all(dir);
+}
+
+TEST_CASE("Voices Keep To The Head", "[formats]")
+{
+    auto dir = fs::temp_directory_path() / string_to_path("scxt-voice-head-test");
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    auto src = dir / "long.wav";
+    {
+        auto wav = pcmWav(1, 4 * sample::preload_frames, [](int, uint32_t) { return 8000; });
+        std::ofstream ofs(src, std::ios::binary);
+        ofs.write(wav.data(), wav.size());
+    }
+
+    auto sc3 = std::make_unique<sampler>(nullptr, 2, nullptr);
+    sc3->set_samplerate(48000);
+    sc3->conf->set_load_on_demand(true);
+    int newG, newZ;
+    REQUIRE(sc3->load_file(src, &newG, &newZ));
+    auto s = sc3->samples[sc3->zones[newZ].sample_id];
+    REQUIRE(!s->is_resident());
+    auto key = sc3->zones[newZ].key_root;
+
+    SECTION("Offline renders read the rest in at note on")
+    {
+        sc3->set_realtime(false);
+        sc3->PlayNote(0, key, 127);
+        REQUIRE(s->is_resident());
+    }
+
+    SECTION("Until the rest is in, voices hold at the end of the head")
+    {
+        // so the sample worker can't read it again
+        fs::remove(src);
+        sc3->PlayNote(0, key, 127);
+        const int head_blocks = sample::preload_frames / block_size;
+        for (int b = 0; b < head_blocks + 64; ++b)
+        {
+            sc3->process_audio();
+            float peak = 0;
+            for (int k = 0; k < (int)block_size; ++k)
+                peak = std::max(peak, fabsf(sc3->output[0][k]));
+            if (b > 16 && b < head_blocks - 16)
+                REQUIRE(peak > 0.f);
+            if (b > head_blocks + 16)
+                REQUIRE(peak < 1e-6f);
+        }
+        REQUIRE(sc3->polyphony == 1);
+        REQUIRE(!s->is_resident());
+    }
+
+    sc3.reset();
+    fs::remove_all(dir);
+}
+
+TEST_CASE("Sample Rate Conversion", "[formats]")
+{
+    // a 1k sine at 48k, taken down to 44.1k
+    const uint32_t frames = 9600;
+    const double amp = 16000.0 / 32768.0;
+    auto wav = pcmWav(1, frames, [&](int, uint32_t i) {
+        return (short)std::round(16000 * sin(2 * M_PI * 1000 * i / 48000.0));
+    });
+    sample s(nullptr);
+    REQUIRE(s.parse_riff_wave(wav.data(), wav.size()));
+    REQUIRE(s.sample_rate == 48000);
+    s.meta.loop_start = 480;
+    s.meta.loop_end = 9120;
+
+    sample::rate_conversion rc;
+    REQUIRE(!s.convert_rate(48000, rc));
+    REQUIRE(s.convert_rate(44100, rc));
+    REQUIRE(rc.length == 8820);
+    REQUIRE(rc.resampler->map_position(9600) == 8820);
+
+    s.apply_rate_conversion(rc);
+    REQUIRE(s.rate_converted);
+    REQUIRE(s.UseInt16);
+    REQUIRE(s.sample_rate == 44100);
+    REQUIRE(s.sample_length == 8820);
+    REQUIRE(s.meta.loop_start == 441);
+    REQUIRE(s.meta.loop_end == 8379);
+
+    // away from the ends, where the filter runs into the silence beyond them
+    auto p = s.GetSamplePtrI16(0);
+    double err = 0;
+    for (uint32_t i = 200; i < 8620; ++i)
+        err = std::max(err, std::abs(p[i] / 32768.0 - amp * sin(2 * M_PI * 1000 * i / 44100.0)));
+    REQUIRE(err < 2e-4);
+
+    // and back up again
+    sample::rate_conversion up;
+    REQUIRE(s.convert_rate(48000, up));
+    s.apply_rate_conversion(up);
+    REQUIRE(s.sample_length == 9600);
+    REQUIRE(s.meta.loop_start == 480);
+    REQUIRE(s.meta.loop_end == 9120);
+    p = s.GetSamplePtrI16(0);
+    err = 0;
+    for (uint32_t i = 200; i < 9400; ++i)
+        err = std::max(err, std::abs(p[i] / 32768.0 - amp * sin(2 * M_PI * 1000 * i / 48000.0)));
+    REQUIRE(err < 3e-4);
+
+    // compressed samples are left alone
+    REQUIRE(s.compress());
+    sample::rate_conversion none;
+    REQUIRE(!s.convert_rate(44100, none));
+}
+
+// whether a voice is fading out after an uberrelease rather than having been stopped
+struct release_probe : public sampler
+{
+    release_probe() : sampler(nullptr, 2, nullptr) {}
+    bool fading()
+    {
+        for (int v = 0; v < (int)max_voices; ++v)
+            if (voice_state[v].active && voices[v]->is_uberrelease)
+                return true;
+        return false;
+    }
+};
+
+TEST_CASE("Samples Resampled As They Load", "[formats]")
+{
+    auto file = GENERATE(as<std::string>{}, "tone.wav", "tone.sfz");
+    INFO(file);
+    auto dir = fs::temp_directory_path() / string_to_path("scxt-load-resample-test");
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    auto src = dir / "tone.wav";
+    {
+        auto wav = pcmWav(1, 9600, [](int, uint32_t i) {
+            return (short)std::round(16000 * sin(2 * M_PI * 1000 * i / 48000.0));
+        });
+        std::ofstream ofs(src, std::ios::binary);
+        ofs.write(wav.data(), wav.size());
+    }
+    {
+        std::ofstream ofs(dir / "tone.sfz");
+        ofs << "<region> sample=tone.wav key=60\n";
+    }
+
+    auto sc3 = std::make_unique<release_probe>();
+    sc3->set_samplerate(44100);
+    sc3->set_convert_sample_rate(true);
+    int newG, newZ;
+    REQUIRE(sc3->load_file(dir / file, &newG, &newZ));
+
+    // by the time load_file returns, with the zone mapped once, not again by the worker
+    int z = -1;
+    for (int i = 0; i < (int)max_zones && z < 0; ++i)
+        if (sc3->zone_exist(i))
+            z = i;
+    REQUIRE(z >= 0);
+    auto s = sc3->samples[sc3->zones[z].sample_id];
+    REQUIRE(s->sample_rate == 44100);
+    REQUIRE(s->sample_length == 8820);
+    REQUIRE(!s->pending_rate);
+    REQUIRE(s->get_mip_count() == sample::max_mip_levels);
+    REQUIRE(sc3->zones[z].sample_stop == 8820);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    REQUIRE(sc3->zones[z].sample_stop == 8820);
+
+    // following a change of engine rate the voices playing it fade out before it switches
+    sc3->zones[z].playmode = pm_forward_loop;
+    sc3->zones[z].loop_start = 0;
+    sc3->zones[z].loop_end = 8820;
+    auto key = sc3->zones[z].key_root;
+    sc3->PlayNote(0, key, 127);
+    REQUIRE(sc3->polyphony == 1);
+    sc3->set_samplerate(48000);
+    auto waitFor = [&](std::function<bool()> f) {
+        for (int i = 0; i < 400 && !f(); ++i)
+        {
+            sc3->process_audio();
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return f();
+    };
+    REQUIRE(waitFor([&]() { return sc3->fading(); }));
+    REQUIRE(s->sample_rate == 44100);
+    REQUIRE(waitFor([&]() { return s->sample_rate == 48000; }));
+    REQUIRE(sc3->polyphony == 0);
+    REQUIRE(sc3->zones[z].sample_stop == 9600);
+    REQUIRE(sc3->zones[z].loop_end == 9600);
+
+    sc3.reset();
+    fs::remove_all(dir);
+}
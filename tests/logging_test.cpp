@@ -16,10 +16,14 @@
 */
 
 #include "test_main.h"
+#include <thread>
 #include <vector>
 // ensure debug is tested
 #define LOGGING_DEBUG_ENABLED 1
 #include "infrastructure/logfile.h"
+// and that realtime debug records compile out
+#define RTLOG_LEVEL 3
+#include "infrastructure/rt_logger.h"
 
 using namespace scxt::log;
 
@@ -125,4 +129,122 @@ TEST_CASE("Test logging", "[logging]")
         LOGERROR(logger) << "should not eval" << eval1() << std::flush;
         REQUIRE(!first_eval);
     }
-}
\ No newline at end of file
+}
+TEST_CASE("Test realtime logging", "[logging]")
+{
+    SECTION("records")
+    {
+        TestCallback cb;
+        cb.mLevel = Level::Info;
+        RealtimeLogger logger(&cb);
+        std::string name = "zone";
+        RTLOGERROR(logger, "{} of {} at {}: {}", name, 3u, 0.5, true);
+        RTLOGINFO(logger, "no args");
+        RTLOGWARNING(logger, "{} {}", -7, "missing {}");
+        logger.flush();
+
+        REQUIRE(cb.mResults.size() == 3);
+        REQUIRE(cb.mResults[0].first == Level::Error);
+        REQUIRE(cb.mResults[0].second.find("logging_test.cpp:") == 0);
+        REQUIRE(cb.mResults[0].second.find(" zone of 3 at 0.5: true") != std::string::npos);
+        REQUIRE(cb.mResults[1].first == Level::Info);
+        REQUIRE(cb.mResults[1].second.find(" no args") != std::string::npos);
+        REQUIRE(cb.mResults[2].second.find(" -7 missing {}") != std::string::npos);
+    }
+
+    SECTION("filtered levels")
+    {
+        bool evaluated = false;
+        [[maybe_unused]] auto eval = [&]() -> int {
+            evaluated = true;
+            return 0;
+        };
+
+        TestCallback cb;
+        cb.mLevel = Level::Warning;
+        RealtimeLogger logger(&cb);
+        RTLOGINFO(logger, "filtered {}", 1);
+        RTLOGDEBUG(logger, "compiled out {}", eval());
+        RTLOGWARNING(logger, "kept");
+        logger.flush();
+
+        REQUIRE(cb.mResults.size() == 1);
+        REQUIRE(cb.mResults[0].first == Level::Warning);
+        REQUIRE(!evaluated);
+    }
+
+    SECTION("long text is truncated")
+    {
+        TestCallback cb;
+        cb.mLevel = Level::Info;
+        RealtimeLogger logger(&cb);
+        std::string longName(500, 'x');
+        RTLOGINFO(logger, "{}|{}|{}", longName, longName, 12);
+        logger.flush();
+
+        REQUIRE(cb.mResults.size() == 1);
+        auto &msg = cb.mResults[0].second;
+        auto first = msg.find('x');
+        auto bar = msg.find('|');
+        REQUIRE(bar - first == RealtimeLogger::textSize - 1);
+        REQUIRE(msg.substr(bar) == "||12");
+    }
+
+    SECTION("full ring drops records")
+    {
+        TestCallback cb;
+        cb.mLevel = Level::Info;
+        RealtimeLogger logger(&cb);
+        int n = RealtimeLogger::capacity * 2;
+        for (int i = 0; i < n; i++)
+            RTLOGINFO(logger, "record {}", i);
+        logger.flush();
+
+        size_t records = 0, reports = 0;
+        for (auto &r : cb.mResults)
+        {
+            if (r.second.find(" record ") != std::string::npos)
+                records++;
+            else if (r.first == Level::Warning && r.second.find("dropped") != std::string::npos)
+                reports++;
+        }
+        REQUIRE(records + logger.getDroppedCount() == n);
+        REQUIRE((reports > 0) == (logger.getDroppedCount() > 0));
+    }
+
+    SECTION("several writers")
+    {
+        TestCallback cb;
+        cb.mLevel = Level::Info;
+        RealtimeLogger logger(&cb);
+        static constexpr int writers = 4, perWriter = 200;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < writers; t++)
+            threads.emplace_back([&logger, t]() {
+                for (int i = 0; i < perWriter; i++)
+                    RTLOGINFO(logger, "{} {}", t, i);
+            });
+        for (auto &t : threads)
+            t.join();
+        logger.flush();
+
+        REQUIRE(cb.mResults.size() == writers * perWriter);
+        REQUIRE(logger.getDroppedCount() == 0);
+        // each writer's records arrive in order
+        int next[writers] = {};
+        for (auto &r : cb.mResults)
+        {
+            int t, i;
+            auto sp = r.second.find(' ');
+            REQUIRE(sscanf(r.second.c_str() + sp, "%d %d", &t, &i) == 2);
+            REQUIRE(i == next[t]++);
+        }
+    }
+
+    SECTION("null callback")
+    {
+        RealtimeLogger logger(nullptr);
+        RTLOGERROR(logger, "nowhere {}", 1);
+        REQUIRE(logger.getDroppedCount() == 0);
+    }
+}
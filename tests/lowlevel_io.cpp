@@ -20,6 +20,7 @@
 #include <map>
 #include <cctype>
 #include <stdio.h>
+#include <vector>
 
 #include "test_main.h"
 #include "filesystem/import.h"
@@ -27,6 +28,7 @@
 #include "globals.h"
 #include "riff_memfile.h"
 #include "infrastructure/file_map_view.h"
+#include "infrastructure/sample_arena.h"
 
 TEST_CASE("RIFF_MemFile", "[io]")
 {
@@ -198,4 +200,69 @@ TEST_CASE("File Mapper", "[io]")
             d += testSkip;
         }
     }
-}
\ No newline at end of file
+}
+TEST_CASE("Sample Arena", "[io]")
+{
+    auto &arena = scxt::SampleArena::get();
+    auto prior = arena.getConfig();
+    auto before = arena.getStats();
+
+    scxt::SampleArena::Config c;
+    c.lockBudget = 1 << 20;
+    c.hugePages = scxt::SampleArena::hugePagesExplicit; // falls back without a hugetlbfs pool
+    arena.configure(c);
+
+    SECTION("Buffers hold their data and are accounted for")
+    {
+        size_t sizes[] = {100, scxt::SampleArena::mapThreshold, 512 * 1024,
+                          scxt::SampleArena::hugePageSize + 100};
+        std::vector<uint8_t *> bufs;
+        for (auto n : sizes)
+        {
+            auto p = (uint8_t *)arena.allocate(n);
+            REQUIRE(p);
+            REQUIRE((uintptr_t)p % 16 == 0);
+            for (size_t i = 0; i < n; i++)
+                p[i] = (uint8_t)(i * 7);
+            bufs.push_back(p);
+        }
+
+        auto st = arena.getStats();
+        REQUIRE(st.allocatedBytes - before.allocatedBytes == 100 + 64 * 1024 + 512 * 1024 +
+                                                                 (2 << 20) + 100);
+        REQUIRE(st.mappedBytes - before.mappedBytes >= 64 * 1024 + 512 * 1024 + (2 << 20));
+        REQUIRE(st.lockBudget == 1 << 20);
+        // locking may be refused by RLIMIT_MEMLOCK, but never beyond the budget
+        REQUIRE(st.lockedBytes <= 1 << 20);
+        REQUIRE((st.lockedBytes > before.lockedBytes || st.lockFailures > before.lockFailures));
+
+        // shrinking keeps the leading data
+        bufs[2] = (uint8_t *)arena.reallocate(bufs[2], 1000);
+        REQUIRE(bufs[2]);
+        for (size_t i = 0; i < 1000; i++)
+            REQUIRE(bufs[2][i] == (uint8_t)(i * 7));
+        for (size_t i = 0; i < sizes[3]; i += 4093)
+            REQUIRE(bufs[3][i] == (uint8_t)(i * 7));
+
+        for (auto p : bufs)
+            arena.release(p);
+        st = arena.getStats();
+        REQUIRE(st.allocatedBytes == before.allocatedBytes);
+        REQUIRE(st.mappedBytes == before.mappedBytes);
+        REQUIRE(st.lockedBytes == before.lockedBytes);
+    }
+
+    SECTION("Mapped files are prepared within the budget")
+    {
+        auto mapper = std::make_unique<scxt::FileMapView>(
+            string_to_path(std::string("resources/test_samples/not_audio.bin")));
+        REQUIRE(mapper->isMapped());
+        auto locked = arena.prepareRange(mapper->data(), mapper->dataSize());
+        REQUIRE((locked == 0 || locked == mapper->dataSize()));
+        REQUIRE(arena.getStats().lockedBytes == before.lockedBytes + locked);
+        arena.unlockRange(mapper->data(), locked);
+        REQUIRE(arena.getStats().lockedBytes == before.lockedBytes);
+    }
+
+    arena.configure(prior);
+}
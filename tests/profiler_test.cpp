@@ -18,6 +18,7 @@
 #include "test_main.h"
 #include "infrastructure/profiler.h"
 #include "infrastructure/ticks.h"
+#include "load_shedder.h"
 #include <chrono>
 #include <thread>
 #if WINDOWS
@@ -58,3 +59,50 @@ TEST_CASE("Profiler Basic", "[profiler]")
     }
 }
 #endif
+
+TEST_CASE("Load Shedder", "[profiler]")
+{
+    const float budget = 0.001f;
+    auto run = [budget](load_shedder &ls, float load, int blocks) {
+        for (int i = 0; i < blocks; i++)
+            ls.update(load * budget, budget);
+    };
+
+    SECTION("Escalates under sustained load and recovers stage by stage")
+    {
+        load_shedder ls;
+        run(ls, 0.5f, 2000);
+        REQUIRE(ls.get_stage() == load_shedder::ls_none);
+
+        // a single slow block is smoothed away
+        ls.update(10 * budget, budget);
+        run(ls, 0.5f, 10);
+        REQUIRE(ls.get_stage() == load_shedder::ls_none);
+
+        run(ls, 1.5f, 2000);
+        REQUIRE(ls.is_overloaded());
+        REQUIRE(ls.get_stage() == load_shedder::ls_skip_filter2);
+
+        // in the hysteresis band nothing changes
+        run(ls, 0.75f, 5000);
+        REQUIRE(ls.get_stage() == load_shedder::ls_skip_filter2);
+
+        run(ls, 0.2f, 1200);
+        REQUIRE(ls.get_stage() == load_shedder::ls_reduce_quality);
+        run(ls, 0.2f, 3000);
+        REQUIRE(ls.get_stage() == load_shedder::ls_none);
+    }
+
+    SECTION("Respects the maximum stage")
+    {
+        load_shedder ls;
+        ls.set_max_stage(load_shedder::ls_steal_released);
+        run(ls, 2.f, 2000);
+        REQUIRE(ls.get_stage() == load_shedder::ls_steal_released);
+
+        ls.set_max_stage(load_shedder::ls_none);
+        REQUIRE(ls.get_stage() == load_shedder::ls_none);
+        run(ls, 2.f, 2000);
+        REQUIRE(ls.get_stage() == load_shedder::ls_none);
+    }
+}
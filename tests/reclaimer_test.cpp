@@ -0,0 +1,90 @@
+/*
+** Shortcircuit XT is Free and Open Source Software
+**
+** Shortcircuit is made available under the Gnu General Public License, v3.0
+** https://www.gnu.org/licenses/gpl-3.0.en.html; The authors of the code
+** reserve the right to re-license their contributions under the MIT license in the
+** future at the discretion of the project maintainers.
+**
+** Copyright 2004-2021 by various individuals as described by the git transaction log
+**
+** All source at: https://github.com/surge-synthesizer/surge.git
+**
+** Shortcircuit was a commercial product from 2004-2018, with copyright and ownership
+** in that period held by Claes Johanson at Vember Audio. Claes made Shortcircuit
+** open source in December 2020.
+*/
+
+#include "test_main.h"
+#include "infrastructure/reclaimer.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace
+{
+struct Tracked : scxt::Reclaimable
+{
+    std::atomic<int> *destroyed;
+    explicit Tracked(std::atomic<int> *d) : destroyed(d) {}
+    ~Tracked() { (*destroyed)++; }
+};
+
+void destroyTracked(scxt::Reclaimable *r) { delete static_cast<Tracked *>(r); }
+
+bool waitFor(const std::atomic<int> &v, int target)
+{
+    for (int i = 0; i < 200 && v < target; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    return v == target;
+}
+} // namespace
+
+TEST_CASE("Deferred Reclamation", "[infra]")
+{
+    auto &r = scxt::Reclaimer::get();
+    std::atomic<int> destroyed{0};
+
+    SECTION("Without participants objects go right away")
+    {
+        r.retire(new Tracked(&destroyed), destroyTracked);
+        REQUIRE(destroyed == 1);
+    }
+
+    SECTION("A running block holds back what it may still see")
+    {
+        auto id = r.registerParticipant();
+        REQUIRE(id >= 0);
+        {
+            scxt::Reclaimer::Block b(id);
+            r.retire(new Tracked(&destroyed), destroyTracked);
+            r.collect();
+            std::this_thread::sleep_for(
+                std::chrono::milliseconds(3 * scxt::Reclaimer::collectIntervalMs));
+            REQUIRE(destroyed == 0);
+        }
+        REQUIRE(waitFor(destroyed, 1));
+        r.unregisterParticipant(id);
+    }
+
+    SECTION("Concurrent retirement is drained when the last participant leaves")
+    {
+        auto id = r.registerParticipant();
+        {
+            scxt::Reclaimer::Block b(id);
+            std::vector<std::thread> threads;
+            for (int t = 0; t < 4; t++)
+                threads.emplace_back([&]() {
+                    for (int i = 0; i < 1000; i++)
+                        r.retire(new Tracked(&destroyed), destroyTracked);
+                });
+            for (auto &t : threads)
+                t.join();
+            REQUIRE(destroyed == 0);
+        }
+        r.unregisterParticipant(id);
+        REQUIRE(destroyed == 4000);
+        REQUIRE(r.getPendingCount() == 0);
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef TEST_WAV_H_
+#define TEST_WAV_H_
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// little endian RIFF pieces for building WAV files in memory
+inline void put32(std::vector<char> &v, uint32_t x)
+{
+    for (int i = 0; i < 4; ++i)
+        v.push_back((char)((x >> (8 * i)) & 0xFF));
+}
+inline void put64(std::vector<char> &v, uint64_t x)
+{
+    put32(v, (uint32_t)x);
+    put32(v, (uint32_t)(x >> 32));
+}
+inline void putid(std::vector<char> &v, const char *id) { v.insert(v.end(), id, id + 4); }
+
+// a 16 bit 48k WAV with f(channel, frame) in it
+inline std::vector<char> pcmWav(int channels, uint32_t frames,
+                                std::function<short(int, uint32_t)> f)
+{
+    std::vector<char> wav;
+    uint32_t bytes = frames * channels * 2;
+    putid(wav, "RIFF");
+    put32(wav, 4 + 8 + 16 + 8 + bytes);
+    putid(wav, "WAVE");
+    putid(wav, "fmt ");
+    put32(wav, 16);
+    put32(wav, 1 | (channels << 16)); // PCM
+    put32(wav, 48000);
+    put32(wav, 48000 * channels * 2);
+    put32(wav, (channels * 2) | (16 << 16));
+    putid(wav, "data");
+    put32(wav, bytes);
+    for (uint32_t i = 0; i < frames; ++i)
+        for (int c = 0; c < channels; ++c)
+        {
+            auto v = (uint16_t)f(c, i);
+            wav.push_back((char)(v & 0xFF));
+            wav.push_back((char)(v >> 8));
+        }
+    return wav;
+}
+#endif
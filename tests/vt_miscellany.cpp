@@ -16,6 +16,10 @@
 */
 #include <catch2/catch2.hpp>
 #include "util/scxtstring.h"
+#include "util/prng.h"
+#include "globals.h"
+#include <vt_dsp/lipol.h>
+#include <cmath>
 #include <cstring>
 
 TEST_CASE("vtString", "[vt]")
@@ -39,3 +43,84 @@ TEST_CASE("vtString", "[vt]")
         REQUIRE(strlen(dest) == 255);
     }
 }
+
+TEST_CASE("lipol_span", "[vt]")
+{
+    SECTION("ramps across several blocks")
+    {
+        lipol_ps a, b;
+        a.set_blocksize(block_size);
+        b.set_blocksize(block_size);
+        lipol_span<2> span{&a, &b};
+
+        a.set_target_instantize(0.f);
+        b.set_target_instantize(2.f);
+        a.set_target(1.f);
+        b.set_target(-2.f);
+        span.begin(4);
+
+        float buf alignas(16)[block_size];
+        for (int blk = 0; blk < 4; blk++)
+        {
+            if (blk)
+                span.advance();
+            for (auto &f : buf)
+                f = 1.f;
+            a.multiply_block(buf, block_size_quad);
+            for (int i = 0; i < block_size; i++)
+                REQUIRE(buf[i] == Approx((blk * block_size + i + 1) / (4.f * block_size)));
+            for (auto &f : buf)
+                f = 1.f;
+            b.multiply_block(buf, block_size_quad);
+            REQUIRE(buf[block_size - 1] == Approx(2.f - (blk + 1)));
+        }
+    }
+
+    SECTION("a single block leaves the ramp alone")
+    {
+        lipol_ps a;
+        a.set_blocksize(block_size);
+        lipol_span<1> span{&a};
+        a.set_target_instantize(0.5f);
+        a.set_target(1.5f);
+        span.begin(1);
+        REQUIRE(a.get_target() == 1.5f);
+    }
+}
+
+TEST_CASE("prng", "[vt]")
+{
+    SECTION("a seed and stream give one sequence")
+    {
+        prng a, b, c;
+        a.seed(1234, 7);
+        b.seed(1234, 7);
+        c.seed(1234, 8);
+        int same = 0;
+        for (int i = 0; i < 1000; i++)
+        {
+            auto x = a.next();
+            REQUIRE(x == b.next());
+            same += (x == c.next());
+        }
+        REQUIRE(same < 2);
+    }
+
+    SECTION("uni and bi stay in range")
+    {
+        prng r;
+        r.seed(0);
+        double sum = 0;
+        for (int i = 0; i < 100000; i++)
+        {
+            auto u = r.uni();
+            REQUIRE(u >= 0.f);
+            REQUIRE(u < 1.f);
+            auto b = r.bi();
+            REQUIRE(b >= -1.f);
+            REQUIRE(b < 1.f);
+            sum += b;
+        }
+        REQUIRE(std::abs(sum / 100000) < 0.01);
+    }
+}
@@ -17,13 +17,96 @@
 
 #include <catch2/catch2.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <set>
 #include <vector>
 
 #include "sampler.h"
 #include "filesystem/import.h"
+#include "generator.h"
+#include "resampling.h"
 #include "sample.h"
+#include "sampler_voice.h"
+#include "synthesis/biquadunit.h"
+#include "synthesis/coefficient_cache.h"
+#include "synthesis/filter.h"
+#include "synthesis/modmatrix.h"
+#include "test_wav.h"
+
+// lets the tests look at what the voices are doing
+struct sampler_probe : public sampler
+{
+    sampler_probe() : sampler(nullptr, 2, nullptr) {}
+    sampler_voice *active_voice()
+    {
+        for (int v = 0; v < (int)max_voices; ++v)
+            if (voice_state[v].active)
+                return voices[v];
+        return nullptr;
+    }
+    std::set<int> active_zones()
+    {
+        std::set<int> res;
+        for (int v = 0; v < (int)max_voices; ++v)
+            if (voice_state[v].active)
+                res.insert(voice_state[v].zone_id);
+        return res;
+    }
+};
+
+TEST_CASE("Zone edits reach the next note", "[zones]")
+{
+    auto sc3 = std::make_unique<sampler_probe>();
+    sc3->set_samplerate(48000);
+    // the zones a note on the key starts
+    auto play = [&](int key) {
+        sc3->AllNotesOff();
+        sc3->PlayNote(0, key, 100);
+        return sc3->active_zones();
+    };
+
+    int g, kick;
+    REQUIRE(sc3->load_file(string_to_path("resources/test_samples/OLPC/drum-bass-lo-1.wav"), &g,
+                           &kick));
+    int kickKey = sc3->zones[kick].key_low;
+    // which has the index compiled
+    REQUIRE(play(kickKey) == std::set<int>{kick});
+
+    SECTION("An added zone")
+    {
+        int snare;
+        auto snarePath = string_to_path("resources/test_samples/OLPC/drum-snare-tap.wav");
+        REQUIRE(sc3->add_zone(snarePath, &snare));
+        int snareKey = sc3->zones[snare].key_low;
+        REQUIRE(snareKey != kickKey);
+        REQUIRE(play(snareKey) == std::set<int>{snare});
+    }
+
+    SECTION("A muted zone")
+    {
+        sc3->selected->select_zone(kick);
+        sc3->selected->mute_zones(true);
+        REQUIRE(play(kickKey).empty());
+        sc3->selected->mute_zones(false);
+        REQUIRE(play(kickKey) == std::set<int>{kick});
+    }
+
+    SECTION("A zone moved to other keys")
+    {
+        REQUIRE((kickKey < 70 || kickKey > 72));
+        sc3->selected->select_zone(kick);
+        sc3->selected->set_zone_int(key_low, 70);
+        sc3->selected->set_zone_int(key_high, 72);
+        REQUIRE(play(kickKey).empty());
+        REQUIRE(play(71) == std::set<int>{kick});
+    }
+}
 
 TEST_CASE("Zones from 3 Wavs", "[zones]")
 {
@@ -56,7 +139,7 @@ TEST_CASE("Zones from 3 Wavs", "[zones]")
         }
 
         INFO("Checking zone existence is correct");
-        for (int i = 0; i < max_zones; ++i)
+        for (int i = 0; i < (int)max_zones; ++i)
             REQUIRE(sc3->zone_exist(i) == (i < z));
     }
 
@@ -74,7 +157,7 @@ TEST_CASE("Zones from 3 Wavs", "[zones]")
             z++;
         }
 
-        for (auto i = 0; i < max_zones; ++i)
+        for (auto i = 0; i < (int)max_zones; ++i)
         {
             if (sc3->zone_exist(i))
             {
@@ -111,7 +194,7 @@ TEST_CASE("Zones from 3 Wavs", "[zones]")
                 REQUIRE(sc3->load_file(item, &newG, &newZ));
             }
 
-            for (auto i = 0; i < max_zones; ++i)
+            for (auto i = 0; i < (int)max_zones; ++i)
             {
                 if (sc3->zone_exist(i))
                 {
@@ -145,7 +228,7 @@ TEST_CASE("Zones from 3 Wavs", "[zones]")
                         sc3->ReleaseNote(0, n, 0);
 
                     sc3->process_audio();
-                    for (int k = 0; k < block_size; ++k)
+                    for (int k = 0; k < (int)block_size; ++k)
                     {
                         rms += sc3->output[0][k] * sc3->output[0][k] +
                                sc3->output[1][k] * sc3->output[1][k];
@@ -166,4 +249,720 @@ TEST_CASE("Zones from 3 Wavs", "[zones]")
                 }
             }
         }
-}
\ No newline at end of file
+}
+TEST_CASE("Multi-sample imports share samples", "[zones]")
+{
+    SECTION("SFZ regions reference one sample each")
+    {
+        auto sc3 = std::make_unique<sampler>(nullptr, 2, nullptr);
+        REQUIRE(sc3);
+
+        REQUIRE(sc3->load_file("resources/test_samples/malicex_sfz/YM-FM_Font FM Drums.sfz"));
+
+        std::map<int, int> zonesPerSample;
+        int nZones = 0;
+        for (int i = 0; i < (int)max_zones; ++i)
+        {
+            if (sc3->zone_exist(i))
+            {
+                nZones++;
+                REQUIRE(sc3->zones[i].sample_id >= 0);
+                zonesPerSample[sc3->zones[i].sample_id]++;
+            }
+        }
+        REQUIRE(nZones > 0);
+        REQUIRE((int)zonesPerSample.size() < nZones);
+
+        for (int s = 0; s < (int)max_samples; ++s)
+        {
+            INFO("Checking refcount of sample " << s);
+            if (sc3->samples[s])
+                REQUIRE(sc3->samples[s]->GetRefCount() == zonesPerSample[s]);
+            else
+                REQUIRE(zonesPerSample.find(s) == zonesPerSample.end());
+        }
+    }
+
+    SECTION("Preloaded samples stay pinned until released")
+    {
+        auto sc3 = std::make_unique<sampler>(nullptr, 2, nullptr);
+        auto kick = string_to_path("resources/test_samples/OLPC/drum-bass-lo-1.wav");
+        auto snare = string_to_path("resources/test_samples/OLPC/drum-snare-tap.wav");
+        auto missing = string_to_path("resources/test_samples/OLPC/no-such-sample.wav");
+
+        auto batch = sc3->preload_samples({kick, missing, snare, kick});
+        REQUIRE(batch.sample_ids.size() == 2);
+        REQUIRE(batch.failed_to_load(missing));
+        REQUIRE(!batch.failed_to_load(kick));
+
+        // nothing has played them, but a purge mustn't take them away from the import
+        sc3->purge_unused_samples();
+        for (auto s : batch.sample_ids)
+        {
+            REQUIRE(sc3->samples[s]);
+            REQUIRE(sc3->samples[s]->GetRefCount() == 1);
+        }
+
+        int z;
+        REQUIRE(sc3->add_zone(kick, &z));
+        int kickId = sc3->zones[z].sample_id;
+        REQUIRE(std::count(batch.sample_ids.begin(), batch.sample_ids.end(), kickId) == 1);
+        REQUIRE(sc3->samples[kickId]->GetRefCount() == 2);
+
+        // the zone keeps the kick, the snare nobody claimed goes
+        sc3->release_unused_samples(batch);
+        for (auto s : batch.sample_ids)
+        {
+            if (s == kickId)
+                REQUIRE(sc3->samples[s]->GetRefCount() == 1);
+            else
+                REQUIRE(!sc3->samples[s]);
+        }
+    }
+
+    SECTION("Samples past max_samples are reported as failed")
+    {
+        auto sc3 = std::make_unique<sampler>(nullptr, 2, nullptr);
+        auto kick = string_to_path("resources/test_samples/OLPC/drum-bass-lo-1.wav");
+        auto snare = string_to_path("resources/test_samples/OLPC/drum-snare-tap.wav");
+
+        // leave a single free slot
+        std::vector<int> fillers;
+        {
+            std::lock_guard g(sc3->cs_patch);
+            for (int s = 1; s < (int)max_samples; ++s)
+            {
+                sc3->samples[s] = new sample(nullptr);
+                fillers.push_back(s);
+            }
+        }
+
+        auto batch = sc3->preload_samples({kick, snare});
+        REQUIRE(batch.sample_ids.size() == 1);
+        REQUIRE(!batch.failed_to_load(kick));
+        REQUIRE(batch.failed_to_load(snare));
+
+        sc3->release_unused_samples(batch);
+        std::lock_guard g(sc3->cs_patch);
+        for (auto s : fillers)
+        {
+            delete sc3->samples[s];
+            sc3->samples[s] = nullptr;
+        }
+    }
+}
+
+TEST_CASE("State saves reuse unchanged chunks", "[zones]")
+{
+    auto sc3 = std::make_unique<sampler>(nullptr, 2, nullptr);
+    REQUIRE(sc3);
+
+    auto pbolpc = string_to_path("resources/test_samples/OLPC");
+    for (auto f : {"drum-bass-lo-1.wav", "drum-snare-tap.wav"})
+        REQUIRE(sc3->load_file(pbolpc / string_to_path(f)));
+
+    auto save = [&sc3]() {
+        void *data = nullptr;
+        auto size = sc3->SaveAllAsRIFF(&data);
+        REQUIRE(size > 0);
+        return std::vector<char>((char *)data, (char *)data + size);
+    };
+
+    auto first = save();
+    auto s0 = sc3->samples[sc3->zones[0].sample_id];
+    REQUIRE(s0->saved_chunk);
+    auto chunk = s0->saved_chunk;
+    REQUIRE(s0->GetRefCount() == 1);
+
+    // nothing changed, so the same bytes and the same sample chunk
+    REQUIRE(save() == first);
+    REQUIRE(s0->saved_chunk == chunk);
+
+    // what voices change while playing isn't state
+    sc3->zones[0].alternate ^= 1;
+    sc3->parts[0].userparameter_smoothed[0] += 0.5f;
+    REQUIRE(save() == first);
+
+    // an edit shows up, and loading the result gives it back
+    sc3->zones[1].finetune = 0.25f;
+    auto edited = save();
+    REQUIRE(edited != first);
+    REQUIRE(edited.size() == first.size());
+    REQUIRE(s0->saved_chunk == chunk);
+
+    auto sc3b = std::make_unique<sampler>(nullptr, 2, nullptr);
+    REQUIRE(sc3b->LoadAllFromRIFF(edited.data(), edited.size()));
+    int nZones = 0;
+    for (int i = 0; i < (int)max_zones; ++i)
+        if (sc3b->zone_exist(i))
+        {
+            nZones++;
+            if (sc3b->zones[i].key_root == sc3->zones[1].key_root)
+                REQUIRE(sc3b->zones[i].finetune == 0.25f);
+        }
+    REQUIRE(nZones == 2);
+
+    // converting the data drops the chunk
+    if (!s0->UseInt16)
+    {
+        REQUIRE(sc3->set_sample_storage(sc3->zones[0].sample_id, ss_int16));
+        REQUIRE(!s0->saved_chunk);
+    }
+}
+
+TEST_CASE("Mod Matrix Registry", "[zones]")
+{
+    auto z = std::make_unique<sample_zone>();
+    auto p = std::make_unique<sample_part>();
+    memset(z.get(), 0, sizeof(sample_zone));
+    memset(p.get(), 0, sizeof(sample_part));
+    strcpy(p->userparametername[0], "Brightness");
+
+    modmatrix zmm, pmm;
+    zmm.assign(nullptr, z.get(), p.get());
+    pmm.assign(nullptr, nullptr, p.get());
+
+    REQUIRE(zmm.get_n_destinations() == md_num_zone_destinations);
+    REQUIRE(pmm.get_n_destinations() == md_num_part_destinations);
+    REQUIRE(zmm.get_n_sources() > pmm.get_n_sources());
+
+    // binding again must not grow the matrix
+    int nz = zmm.get_n_sources();
+    for (int i = 0; i < 100; i++)
+        zmm.assign(nullptr, z.get(), p.get());
+    REQUIRE(zmm.get_n_sources() == nz);
+
+    REQUIRE(std::string(zmm.get_source_idname(0)) == "none");
+    REQUIRE(std::string(zmm.get_destination_idname(md_pitch)) == "pitch");
+    REQUIRE(std::string(pmm.get_destination_idname(md_part_pan)) == "balance");
+    REQUIRE(std::string(zmm.get_destination_name(md_filter2prm0)) == "F2: ---");
+
+    bool found = false;
+    for (int i = 0; i < pmm.get_n_sources(); i++)
+    {
+        if (std::string(pmm.get_source_idname(i)) == "C1")
+        {
+            REQUIRE(std::string(pmm.get_source_name(i)) == "C1: Brightness");
+            found = true;
+        }
+    }
+    REQUIRE(found);
+
+    for (auto *mm : {&zmm, &pmm})
+    {
+        for (int i = 0; i < mm->get_n_sources(); i++)
+            REQUIRE(mm->SourceRiffIDToInternal(mm->SourceInternalToRiffID(i)) == i);
+        for (int i = 0; i < mm->get_n_destinations(); i++)
+            REQUIRE(mm->DestinationRiffIDToInternal(mm->DestinationInternalToRiffID(i)) == i);
+    }
+
+    // the importer lookups resolve against the part layout
+    for (int i = 0; i < pmm.get_n_sources(); i++)
+        REQUIRE(get_mm_source_id(pmm.get_source_idname(i)) == i);
+    REQUIRE(get_mm_dest_id("f1p1") == md_part_filter1prm0);
+    REQUIRE(get_mm_source_id("not-a-source") == 0);
+    REQUIRE(get_mm_dest_id("not-a-destination") == 0);
+}
+
+TEST_CASE("Envelopes across control intervals", "[zones]")
+{
+    auto kick = string_to_path("resources/test_samples/OLPC/drum-bass-lo-1.wav");
+
+    for (int interval = 1; interval <= sampler::max_control_interval; ++interval)
+        DYNAMIC_SECTION("Short AEG stages at interval " << interval)
+        {
+            auto sc3 = std::make_unique<sampler_probe>();
+            sc3->set_samplerate(48000);
+            sc3->set_control_interval(interval);
+            int newG, newZ;
+            REQUIRE(sc3->load_file(kick, &newG, &newZ));
+            // -10 skips the stage, just above it the attack and hold take about 1.4 ms each
+            sc3->zones[newZ].AEG.attack = -9.5f;
+            sc3->zones[newZ].AEG.hold = -9.5f;
+            sc3->PlayNote(0, sc3->zones[newZ].key_root, 120);
+
+            // a control step can span a whole stage, which must not wrap around
+            float last = 0.f;
+            int sustainAt = -1;
+            for (int b = 0; b < 200; ++b)
+            {
+                sc3->process_audio();
+                auto v = sc3->active_voice();
+                REQUIRE(v);
+                float out = v->AEG.output;
+                REQUIRE(out >= last);
+                last = out;
+                if (out == 1.f && sustainAt < 0)
+                    sustainAt = b;
+            }
+            REQUIRE(sustainAt >= 0);
+            REQUIRE(sustainAt <= 4 * interval);
+        }
+}
+
+namespace
+{
+void appendTone(std::vector<short> &frames, int n)
+{
+    for (int i = 0; i < n; ++i)
+        frames.push_back((short)(8000 * std::sin(2.0 * M_PI * 1000.0 * i / 48000.0)));
+}
+} // namespace
+
+TEST_CASE("Released voices end once silent", "[zones]")
+{
+    auto dir = fs::temp_directory_path() / string_to_path("scxt-voice-silence-test");
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    auto blocks = [](int frames) { return frames / (int)block_size; };
+
+    auto load = [&](sampler_probe *sc3, const std::vector<short> &frames) {
+        auto path = dir / string_to_path("tone.wav");
+        auto wav = pcmWav(1, (uint32_t)frames.size(), [&](int, uint32_t i) { return frames[i]; });
+        std::ofstream(path, std::ios::binary).write(wav.data(), wav.size());
+        sc3->set_samplerate(48000);
+        int newG, newZ;
+        REQUIRE(sc3->load_file(path, &newG, &newZ));
+        // a four second release, so only the silence can end the voice early
+        sc3->zones[newZ].AEG.release = 2.f;
+        return newZ;
+    };
+
+    SECTION("A released voice ends after the timeout")
+    {
+        // the generator holds the last frame once it runs out, end on silence
+        std::vector<short> frames;
+        appendTone(frames, 4800);
+        frames.resize(frames.size() + 64, 0);
+        auto sc3 = std::make_unique<sampler_probe>();
+        auto z = load(sc3.get(), frames);
+        // an open ended filter tail keeps the voice going once the sample has run out
+        sc3->zones[z].Filter[0].type = ft_SuperSVF;
+
+        auto lifetime = [&](float timeout) {
+            sc3->set_voice_silence_timeout(timeout);
+            sc3->PlayNote(0, sc3->zones[z].key_root, 120);
+            sc3->process_audio();
+            sc3->ReleaseNote(0, sc3->zones[z].key_root, 0);
+            int b = 1;
+            while (sc3->active_voice() && b < blocks(48000))
+            {
+                sc3->process_audio();
+                b++;
+            }
+            return b;
+        };
+
+        // the sample ends after 150 blocks, the output has to stay silent for another 150
+        auto ended = lifetime(0.1f);
+        REQUIRE(ended >= blocks(4800 + 4800));
+        REQUIRE(ended < blocks(4800 + 4800 + 4800));
+        REQUIRE(lifetime(0.f) == blocks(48000));
+    }
+
+    SECTION("A quiet passage does not end a released voice")
+    {
+        // a tone, 200ms of silence and the tone again
+        std::vector<short> frames;
+        appendTone(frames, 2400);
+        frames.resize(frames.size() + 9600, 0);
+        appendTone(frames, 2400);
+        auto sc3 = std::make_unique<sampler_probe>();
+        auto z = load(sc3.get(), frames);
+        sc3->set_voice_silence_timeout(0.1f);
+        sc3->PlayNote(0, sc3->zones[z].key_root, 120);
+        sc3->process_audio();
+        sc3->ReleaseNote(0, sc3->zones[z].key_root, 0);
+
+        float after = 0.f;
+        for (int b = 1; b < blocks(2400 + 9600 + 1200); ++b)
+        {
+            sc3->process_audio();
+            REQUIRE(sc3->active_voice());
+            if (b > blocks(2400 + 9600))
+                for (int k = 0; k < (int)block_size; ++k)
+                    after = std::max(after, std::fabs(sc3->output[0][k]));
+        }
+        REQUIRE(after > 0.01f);
+    }
+
+    fs::remove_all(dir);
+}
+
+TEST_CASE("Sample Generator Bounds", "[zones]")
+{
+    // with the linear interpolator and whole sample steps each frame is a sample as it is
+    std::vector<float> data(64 + FIRipol_N);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = (float)i - (FIRoffset - 1);
+    float outL[64], outR[64];
+    GeneratorIO io{outL, outR, data.data(), nullptr, 40, nullptr};
+
+    auto state = [](int pos, int lo, int hi, int ratio = 1 << 24) {
+        GeneratorState gd{};
+        gd.Direction = 1;
+        gd.SamplePos = pos;
+        gd.LowerBound = lo;
+        gd.UpperBound = hi;
+        gd.InvertedBounds = 1.f / (hi - lo);
+        gd.Ratio = ratio;
+        gd.BlockSize = 64;
+        return gd;
+    };
+    auto run = [&](int mode, GeneratorState gd) {
+        GetFPtrGeneratorSample(false, GSF_Float, mode, true)(&gd, &io);
+        return std::make_pair(std::vector<float>(outL, outL + 64), gd);
+    };
+    auto play = [&](int mode, int pos, int lo, int hi) {
+        auto [out, gd] = run(mode, state(pos, lo, hi));
+        std::vector<int> r;
+        for (auto f : out)
+            r.push_back((int)f);
+        return std::make_pair(r, gd);
+    };
+
+    // the bound handling of each mode after every frame, which the generator only does for
+    // the frames it works out may reach a bound
+    auto reference = [&](int mode, GeneratorState gd) {
+        std::vector<float> r;
+        int pos = gd.SamplePos, sub = gd.SampleSubPos, finished = 0;
+        int dir = gd.Direction * (gd.Ratio < 0 ? -1 : 1), step = std::abs(gd.Ratio);
+        auto wrap = [&]() {
+            if (pos > gd.UpperBound)
+                pos -= std::max(1, gd.UpperBound - gd.LowerBound);
+            if (pos > io.WaveSize || pos < 0)
+                pos = gd.UpperBound;
+        };
+        auto stop = [&](int lo, int hi) {
+            if (pos > hi)
+            {
+                pos = hi;
+                sub = 0;
+                finished = 1;
+            }
+            if (pos < lo)
+            {
+                pos = lo;
+                sub = 0;
+            }
+        };
+        for (int i = 0; i < gd.BlockSize; ++i)
+        {
+            r.push_back(pos + sub * (1.f / 16777216.f));
+            sub += step * dir;
+            pos += sub >> 24;
+            sub &= (1 << 24) - 1;
+            if (mode == GSM_Normal)
+                stop(gd.LowerBound, gd.UpperBound);
+            else if (mode == GSM_Loop || (mode == GSM_LoopUntilRelease && gd.Gated))
+                wrap();
+            else if (mode == GSM_LoopUntilRelease)
+                stop(gd.SampleStart, gd.SampleStop);
+            else if (mode == GSM_Bidirectional)
+            {
+                if (pos >= gd.UpperBound)
+                    dir = -1;
+                else if (pos <= gd.LowerBound)
+                    dir = 1;
+                pos = std::clamp(pos, 0, io.WaveSize);
+            }
+            else if (mode == GSM_Shot && (pos < gd.LowerBound || pos > gd.UpperBound))
+            {
+                finished = 1;
+                pos = std::clamp(pos, gd.LowerBound, gd.UpperBound);
+            }
+        }
+        gd.SamplePos = pos;
+        gd.SampleSubPos = sub;
+        gd.IsFinished = finished;
+        gd.Direction = dir * (gd.Ratio < 0 ? -1 : 1);
+        return std::make_pair(r, gd);
+    };
+    auto matches_reference = [&](int mode, const GeneratorState &gd) {
+        auto [out, res] = run(mode, gd);
+        auto [want, ref] = reference(mode, gd);
+        for (int i = 0; i < 64; ++i)
+        {
+            INFO("frame " << i);
+            REQUIRE(out[i] == want[i]);
+        }
+        REQUIRE(res.SamplePos == ref.SamplePos);
+        REQUIRE(res.SampleSubPos == ref.SampleSubPos);
+        REQUIRE(res.IsFinished == ref.IsFinished);
+        REQUIRE(res.Direction == ref.Direction);
+    };
+
+    SECTION("Normal stops at the end")
+    {
+        auto [out, gd] = play(GSM_Normal, 10, 0, 20);
+        for (int i = 0; i < 64; ++i)
+            REQUIRE(out[i] == std::min(10 + i, 20));
+        REQUIRE(gd.IsFinished);
+        REQUIRE(gd.SamplePos == 20);
+    }
+
+    SECTION("Loop wraps to the loop start")
+    {
+        auto [out, gd] = play(GSM_Loop, 15, 10, 20);
+        int expected = 15;
+        for (int i = 0; i < 64; ++i)
+        {
+            REQUIRE(out[i] == expected);
+            expected = (expected == 20) ? 11 : expected + 1;
+        }
+        REQUIRE(!gd.IsFinished);
+        REQUIRE(gd.SamplePos == expected);
+        REQUIRE(gd.IsInLoop);
+    }
+
+    SECTION("Bidirectional turns at both ends")
+    {
+        auto [out, gd] = play(GSM_Bidirectional, 15, 10, 20);
+        int expected = 15, direction = 1;
+        for (int i = 0; i < 64; ++i)
+        {
+            REQUIRE(out[i] == expected);
+            expected += direction;
+            if (expected >= 20)
+                direction = -1;
+            else if (expected <= 10)
+                direction = 1;
+        }
+        REQUIRE(gd.SamplePos == expected);
+        REQUIRE(gd.Direction == direction);
+    }
+
+    SECTION("Shot finishes leaving the bounds either way")
+    {
+        auto [out, gd] = play(GSM_Shot, 10, 0, 20);
+        for (int i = 0; i < 64; ++i)
+            REQUIRE(out[i] == std::min(10 + i, 20));
+        REQUIRE(gd.IsFinished);
+        REQUIRE(gd.SamplePos == 20);
+
+        auto [back, bgd] = run(GSM_Shot, state(10, 5, 20, -(1 << 24)));
+        for (int i = 0; i < 64; ++i)
+            REQUIRE(back[i] == std::max(10 - i, 5));
+        REQUIRE(bgd.IsFinished);
+        REQUIRE(bgd.SamplePos == 5);
+    }
+
+    SECTION("Loop until release loops while gated and plays out once released")
+    {
+        auto gd = state(15, 10, 20);
+        gd.SampleStart = 2;
+        gd.SampleStop = 30;
+        gd.Gated = true;
+        auto [looped, lgd] = run(GSM_LoopUntilRelease, gd);
+        int expected = 15;
+        for (int i = 0; i < 64; ++i)
+        {
+            REQUIRE(looped[i] == expected);
+            expected = (expected == 20) ? 11 : expected + 1;
+        }
+        REQUIRE(!lgd.IsFinished);
+        REQUIRE(lgd.IsInLoop);
+
+        gd.Gated = false;
+        auto [released, rgd] = run(GSM_LoopUntilRelease, gd);
+        for (int i = 0; i < 64; ++i)
+            REQUIRE(released[i] == std::min(15 + i, 30));
+        REQUIRE(rgd.IsFinished);
+        REQUIRE(rgd.SamplePos == 30);
+    }
+
+    SECTION("A negative ratio plays backwards")
+    {
+        auto [out, gd] = run(GSM_Normal, state(15, 4, 20, -(1 << 24)));
+        for (int i = 0; i < 64; ++i)
+            REQUIRE(out[i] == std::max(15 - i, 4));
+        REQUIRE(!gd.IsFinished);
+        REQUIRE(gd.SamplePos == 4);
+        REQUIRE(gd.Direction == 1);
+
+        // and bidirectional loops start out going down
+        auto [bidi, bgd] = run(GSM_Bidirectional, state(15, 10, 20, -(1 << 24)));
+        REQUIRE(bidi[1] == 14);
+        REQUIRE(bidi[5] == 10);
+        REQUIRE(bidi[6] == 11);
+        matches_reference(GSM_Bidirectional, state(15, 10, 20, -(1 << 24)));
+    }
+
+    SECTION("Every mode matches bounds checked after each frame")
+    {
+        // steps which land exactly on a bound after some frames, from on and between frames,
+        // as well as ones which don't divide a frame evenly
+        const int ratios[] = {1 << 24,       1 << 23,       1 << 22,        3 << 22,
+                              3 << 23,       1 << 25,       (1 << 24) / 3, (1 << 24) / 3 + 1,
+                              (1 << 24) - 1, (1 << 24) + 1, 5 << 21};
+        const int subs[] = {0, 1 << 23, 1 << 22, (1 << 24) - 1, 1};
+        for (int mode : {GSM_Normal, GSM_Loop, GSM_Bidirectional, GSM_Shot, GSM_LoopUntilRelease})
+            for (int sign : {1, -1})
+                for (auto ratio : ratios)
+                    for (auto sub : subs)
+                        for (int pos : {10, 12, 19, 20})
+                            for (bool gated : {true, false})
+                            {
+                                INFO("mode " << mode << " ratio " << sign * ratio << " at "
+                                             << pos << " + " << sub << (gated ? " gated" : ""));
+                                auto gd = state(pos, 10, 20, sign * ratio);
+                                gd.SampleSubPos = sub;
+                                gd.SampleStart = 4;
+                                gd.SampleStop = 30;
+                                gd.Gated = gated;
+                                matches_reference(mode, gd);
+                            }
+    }
+}
+
+TEST_CASE("Filter Coefficient Cache", "[zones]")
+{
+    static int designs = 0;
+    auto count = [](const double *p, double *c) {
+        designs++;
+        for (int i = 0; i < coefficient_cache::max_coefficients; ++i)
+            c[i] = p[0] * (i + 1) + p[1];
+    };
+    auto &cache = coefficient_cache::get();
+    REQUIRE(cache.is_enabled());
+
+    SECTION("Nearby parameters share a design")
+    {
+        double c0[5], c1[5], c2[5];
+        double p0[] = {1000.0, 0.5}, p1[] = {1000.01, 0.5}, p2[] = {1010.0, 0.5};
+        int before = designs;
+        cache.design(count, p0, 2, c0);
+        REQUIRE(designs == before + 1);
+        cache.design(count, p1, 2, c1);
+        REQUIRE(designs == before + 1);
+        REQUIRE(p1[0] == p0[0]);
+        for (int i = 0; i < 5; ++i)
+            REQUIRE(c1[i] == c0[i]);
+
+        cache.design(count, p2, 2, c2);
+        REQUIRE(designs == before + 2);
+        REQUIRE(c2[0] != c0[0]);
+    }
+
+    SECTION("Disabled designs every time from the exact parameters")
+    {
+        cache.set_enabled(false);
+        double c[5], p[] = {1234.5678, 0.25};
+        int before = designs;
+        cache.design(count, p, 2, c);
+        cache.design(count, p, 2, c);
+        cache.set_enabled(true);
+        REQUIRE(designs == before + 2);
+        REQUIRE(p[0] == 1234.5678);
+        REQUIRE(c[0] == 1234.5678 + 0.25);
+    }
+
+    SECTION("Biquads stay within the rounding")
+    {
+        // a fresh biquad starts out at the first coefficients it is given
+        for (double omega : {0.001, 0.05, 0.7, 2.9})
+            for (int type = 0; type < 3; ++type)
+            {
+                auto set = [&](biquadunit &b) {
+                    if (type == 0)
+                        b.coeff_LP2B(omega, 3.0);
+                    else if (type == 1)
+                        b.coeff_HP(omega, 0.707);
+                    else
+                        b.coeff_peakEQ(omega, 1.0, 6.0);
+                };
+                biquadunit cached, exact;
+                set(cached);
+                cache.set_enabled(false);
+                set(exact);
+                cache.set_enabled(true);
+                for (float f : {0.001f, 0.01f, 0.1f, 0.3f})
+                    REQUIRE(cached.plot_magnitude(f) ==
+                            Approx(exact.plot_magnitude(f)).epsilon(2e-3).margin(1e-6));
+            }
+    }
+}
+
+TEST_CASE("Oscillator Filters", "[zones]")
+{
+    // the sinc tables come with the first voice
+    auto sc3 = std::make_unique<sampler>(nullptr, 2, nullptr);
+    REQUIRE(sc3);
+    sc3->set_samplerate(48000);
+
+    // a second of A 440
+    auto render = [](int type, int unison) {
+        float fp[max_fparams] = {};
+        int ip[2] = {};
+        auto f = spawn_filter(type, fp, ip, nullptr, true);
+        REQUIRE(f);
+        f->init_params();
+        if (unison)
+        {
+            // unison is read on construction
+            spawn_filter_release(f);
+            ip[0] = unison;
+            f = spawn_filter(type, fp, ip, nullptr, true);
+        }
+        alignas(16) float in[block_size], out[2][block_size];
+        std::fill(in, in + block_size, 1.f);
+        std::vector<float> res;
+        for (int b = 0; b < 48000 / (int)block_size; ++b)
+        {
+            f->process_stereo(in, in, out[0], out[1], 0);
+            res.insert(res.end(), out[0], out[0] + block_size);
+        }
+        spawn_filter_release(f);
+        return res;
+    };
+    // rising edges, with a little hysteresis against the ringing of the band limited steps
+    auto rises = [](const std::vector<float> &v) {
+        int n = 0;
+        bool low = false;
+        for (auto x : v)
+        {
+            if (low && x > 0.2f)
+                n++;
+            if (x < -0.2f)
+                low = true;
+            else if (x > 0.2f)
+                low = false;
+        }
+        return n;
+    };
+
+    SECTION("Pulse")
+    {
+        auto v = render(ft_osc_pulse, 0);
+        REQUIRE(std::abs(rises(v) - 440) <= 2);
+        for (auto x : v)
+            REQUIRE(std::abs(x) < 0.7f);
+    }
+
+    SECTION("Pulse sync")
+    {
+        // the synced pulse runs 19 semitones up
+        auto v = render(ft_osc_pulse_sync, 0);
+        REQUIRE(rises(v) > 2 * 440);
+        for (auto x : v)
+            REQUIRE(std::abs(x) < 1.5f);
+    }
+
+    SECTION("Saw, alone and in unison")
+    {
+        for (int unison = 0; unison < 5; ++unison)
+        {
+            auto v = render(ft_osc_saw, unison);
+            float lo = 0, hi = 0;
+            for (auto x : v)
+            {
+                lo = std::min(lo, x);
+                hi = std::max(hi, x);
+            }
+            REQUIRE(hi - lo > 0.5f);
+            REQUIRE(hi - lo < 2.5f);
+            if (unison == 0)
+                REQUIRE(std::abs(rises(v) - 440) <= 2);
+        }
+    }
+}
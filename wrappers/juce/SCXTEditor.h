@@ -211,6 +211,8 @@ class SCXTEditor : public juce::AudioProcessorEditor,
     };
     std::array<VUData, max_outputs> vuData;
     int polyphony{0};
+    int loadShedStage{0}; // see load_shedder::stage
+    int sampleMemoryMB{0}, sampleMemoryBudgetMB{0}; // across all instances, see sample_memory
 
     int selectedPart{0};
     int selectedLayer{0};
@@ -71,6 +71,8 @@ void SCXTProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
     // Use this method as the place to do any pre-playback
     // initialisation that you need..
     sc3->set_samplerate(sampleRate);
+    // a render starting here plays its notes with the same random numbers every time
+    sc3->restart_random();
     sc3->AudioHalted = false;
 }
 
@@ -103,6 +105,7 @@ bool SCXTProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const
 void SCXTProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midiMessages)
 {
     auto ftzGuard = sst::plugininfra::cpufeatures::FPUStateGuard();
+    sc3->set_realtime(!isNonRealtime());
 
     auto playhead = getPlayHead();
     if (playhead)
@@ -10,7 +10,7 @@ namespace scxt
 {
 namespace components
 {
-void rdump(const std::unique_ptr<scxt::content::ContentBrowser::Content> &r, const std::string &pfx)
+void rdump(const scxt::content::ContentBrowser::ContentPtr &r, const std::string &pfx)
 {
     std::cout << pfx << r->displayPath << " " << r->type << "\n";
     for (const auto &q : r->children)
@@ -44,13 +44,47 @@ struct BrowserDragThingy : public juce::Component
 };
 
 BrowserSidebar::BrowserSidebar(SCXTEditor *ed)
-    : editor(ed), root(editor->audioProcessor.sc3->browser.root)
+    : editor(ed), root(editor->audioProcessor.sc3->browser.getRoot())
 {
     // rdump(root, std::string());
+    startTimer(250);
 }
 
 BrowserSidebar::~BrowserSidebar() = default;
 
+void BrowserSidebar::timerCallback()
+{
+    // the browser scans in the background and publishes a new tree as it goes
+    if (editor->audioProcessor.sc3->browser.getRoot() != root)
+        repaint();
+}
+
+void BrowserSidebar::refreshRoot()
+{
+    auto newRoot = editor->audioProcessor.sc3->browser.getRoot();
+    if (newRoot == root)
+        return;
+
+    // stay in the same directories in the new tree, as far as they still exist
+    std::vector<int> newStack;
+    content_raw_t op = root.get(), np = newRoot.get();
+    for (auto pathI : childStack)
+    {
+        if (pathI >= (int)op->children.size())
+            break;
+        const auto &want = op->children[pathI]->fullPath;
+        auto it = std::find_if(np->children.begin(), np->children.end(),
+                               [&want](const auto &c) { return c->fullPath == want; });
+        if (it == np->children.end())
+            break;
+        newStack.push_back(it - np->children.begin());
+        op = op->children[pathI].get();
+        np = it->get();
+    }
+    childStack = newStack;
+    root = newRoot;
+}
+
 void BrowserSidebar::paintContainer(juce::Graphics &g, const content_raw_t &content, int offset,
                                     int off0)
 {
@@ -94,6 +128,7 @@ void BrowserSidebar::paintContainer(juce::Graphics &g, const content_raw_t &cont
 void BrowserSidebar::paint(juce::Graphics &g)
 {
     // it sucks we do this here but oh well
+    refreshRoot();
     clickZones.clear();
     g.fillAll(juce::Colour(0xFF000020));
     auto hb = getLocalBounds().withHeight(20);
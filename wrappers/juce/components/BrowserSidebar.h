@@ -17,14 +17,14 @@ namespace components
 {
 
 struct BrowserDragThingy;
-struct BrowserSidebar : public juce::Component
+struct BrowserSidebar : public juce::Component, juce::Timer
 {
     BrowserSidebar(SCXTEditor *ed);
     ~BrowserSidebar();
     SCXTEditor *editor{nullptr};
 
-    typedef std::unique_ptr<scxt::content::ContentBrowser::Content> content_t;
-    typedef scxt::content::ContentBrowser::Content *content_raw_t;
+    typedef scxt::content::ContentBrowser::ContentPtr content_t;
+    typedef const scxt::content::ContentBrowser::Content *content_raw_t;
     void paint(juce::Graphics &g) override;
     void paintContainer(juce::Graphics &g, const content_raw_t &content, int offset, int off0 = -1);
 
@@ -32,7 +32,11 @@ struct BrowserSidebar : public juce::Component
     void mouseUp(const juce::MouseEvent &e) override;
     void mouseDrag(const juce::MouseEvent &e) override;
 
-    const content_t &root;
+    void timerCallback() override;
+    void refreshRoot();
+
+    // the snapshot of the browser we last painted, which the click zones refer to
+    content_t root;
     std::vector<int> childStack;
 
     // This is a gross solution
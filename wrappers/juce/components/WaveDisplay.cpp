@@ -146,6 +146,7 @@ bool WaveDisplay::processActionData(const actiondata &ad)
         bool same_sample = (mSamplePtr == e.samplePtr()) && (dispmode == 0);
         dispmode = 0;
         mSamplePtr = (sample *)e.samplePtr();
+        mDecodedValid = false; // its data may have been converted meanwhile
 
         playmode = e.playMode(); // todo playmode wasnt initialized
         markerpos[ActionWaveDisplayEditPoint::PointType::start] = e.start();
@@ -277,6 +278,29 @@ void WaveDisplay::renderWave(bool quick)
         bheight = (imgh - totalGap) / mSamplePtr->channels;
     }
 
+    if ((mSamplePtr->is_compressed() || mSamplePtr->UseInt24) && !mDecodedValid)
+    {
+        for (int c = 0; c < mSamplePtr->channels; c++)
+        {
+            if (mSamplePtr->UseInt24)
+            {
+                auto p = mSamplePtr->GetSamplePtrI24(c);
+                mDecodedF32[c].resize(mSamplePtr->sample_length);
+                for (size_t i = 0; i < mSamplePtr->sample_length; i++)
+                {
+                    int v = (p[3 * i + 2] << 16) | (p[3 * i + 1] << 8) | p[3 * i];
+                    mDecodedF32[c][i] = (v - ((v & 0x800000) << 1)) * (1.f / 8388608.f);
+                }
+            }
+            else
+            {
+                mDecoded[c].resize(mSamplePtr->sample_length);
+                mSamplePtr->read_i16(c, mDecoded[c].data());
+            }
+        }
+        mDecodedValid = true;
+    }
+
     prof.enter();
     for (int c = 0; c < mSamplePtr->channels; c++)
     {
@@ -286,7 +310,8 @@ void WaveDisplay::renderWave(bool quick)
         // location of bottom of waveform for this channel
         int bbottom = std::min(imgh - 1, btop + bheight);
 
-        if (!mSamplePtr->SampleData[c]) // no data for that channel
+        // no data for that channel
+        if (!mSamplePtr->SampleData[c] && !mSamplePtr->is_compressed())
             continue;
 
         /*was commented:
@@ -303,8 +328,10 @@ void WaveDisplay::renderWave(bool quick)
         int topline = btop;
         int bottomline = bbottom - 1;
 
-        short *SampleDataI16 = mSamplePtr->GetSamplePtrI16(c);
-        float *SampleDataF32 = mSamplePtr->GetSamplePtrF32(c);
+        short *SampleDataI16 = mSamplePtr->is_compressed() ? mDecoded[c].data()
+                                                           : mSamplePtr->GetSamplePtrI16(c);
+        float *SampleDataF32 =
+            mSamplePtr->UseInt24 ? mDecodedF32[c].data() : mSamplePtr->GetSamplePtrF32(c);
 
         int last_imax, last_imin;
 
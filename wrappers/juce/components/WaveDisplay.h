@@ -22,6 +22,7 @@
 
 #include <SCXTEditor.h>
 #include "infrastructure/profiler.h"
+#include <vector>
 
 namespace scxt
 {
@@ -48,6 +49,10 @@ class WaveDisplay : public juce::Component, public scxt::data::UIStateProxy
     juce::Image mWavePixels;
 
     sample *mSamplePtr;
+    // compressed and packed 24 bit samples are decoded once for drawing
+    std::vector<short> mDecoded[2];
+    std::vector<float> mDecodedF32[2];
+    bool mDecodedValid{false};
     int dispmode;
     int mZoom; // zoom factor. A value of 1 means 1 pixel is 1 sample. Higher value is more zoomed
                // out
@@ -52,6 +52,18 @@ struct VUMeterPolyphonyProxy : public scxt::data::UIStateProxy
             if (at != vga_intval)
                 break;
             editor->polyphony = ad.data.i[0];
+            editor->loadShedStage = ad.data.i[1];
+            markNeedsRepaintAndProxyUpdate();
+            return true;
+            break;
+        }
+        case ip_sample_memory:
+        {
+            auto at = std::get<VAction>(ad.actiontype);
+            if (at != vga_intval)
+                break;
+            editor->sampleMemoryMB = ad.data.i[0];
+            editor->sampleMemoryBudgetMB = ad.data.i[1];
             markNeedsRepaintAndProxyUpdate();
             return true;
             break;
@@ -19,7 +19,9 @@ struct PolyphonyDisplay : public juce::Component, scxt::data::UIStateProxy::Inva
 
     void paint(juce::Graphics &g) override
     {
-        if (poly == 0)
+        if (shedStage > 0)
+            g.setColour(juce::Colours::orange); // the engine is shedding load
+        else if (poly == 0)
             g.setColour(juce::Colours::lightgrey);
         else
             g.setColour(juce::Colours::white);
@@ -29,14 +31,15 @@ struct PolyphonyDisplay : public juce::Component, scxt::data::UIStateProxy::Inva
 
     void onProxyUpdate() override
     {
-        if (poly != editor->polyphony)
+        if (poly != editor->polyphony || shedStage != editor->loadShedStage)
         {
             poly = editor->polyphony;
+            shedStage = editor->loadShedStage;
             repaint();
         }
     }
 
-    int poly{0};
+    int poly{0}, shedStage{0};
     SCXTEditor *editor{nullptr};
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PolyphonyDisplay);
 };